@@ -0,0 +1,80 @@
+; hostio.s
+;
+; Copyright (c) 2023 Micah John Cowan.
+; This code is licensed under the MIT license.
+; See the accompanying LICENSE file for details.
+;
+; Helper routines for bobbin's "host I/O" card (see --hostio-dir in
+; the README), for use from assembly programs. Assemble with ca65;
+; the card is assumed to be in slot 1, as bobbin places it.
+;
+; Each routine takes the address of a parameter block in A (low)
+; and Y (high):
+;
+;   +0,+1   address of the file name (ASCII, ended by $00 or $0D)
+;   +2,+3   buffer address
+;   +4,+5   length (for hio_load, 0 means "the whole file")
+;
+; On return, carry is clear on success; otherwise it's set, and A
+; holds the card's status code. Either way, X (low) and Y (high) hold
+; the number of bytes transferred.
+;
+; Example: save $2000-$3FFF (hi-res page 1) to the host file PIC:
+;
+;           lda #<params
+;           ldy #>params
+;           jsr hio_save
+;           ...
+;   params: .word name, $2000, $2000
+;   name:   .byte "PIC", 0
+
+        .export hio_load, hio_save, hio_append
+
+HIO_REGS    = $C090
+HIO_OFFSET  = HIO_REGS + 6
+HIO_OP      = HIO_REGS + 9
+HIO_COUNT   = HIO_REGS + $A
+
+OP_READ     = 1
+OP_WRITE    = 2
+OP_APPEND   = 3
+
+        .segment "CODE"
+
+; Read a file (from its beginning) into memory.
+hio_load:
+        ldx #OP_READ
+        bne hio_do
+
+; Write memory to a file, replacing any existing one.
+hio_save:
+        ldx #OP_WRITE
+        bne hio_do
+
+; Add memory to the end of a file (creating it if need be).
+hio_append:
+        ldx #OP_APPEND
+
+hio_do:
+        stx opcode
+        sta @src+1
+        sty @src+2
+        ldy #5
+@copy:
+@src:   lda $FFFF,y         ; (operand filled in above)
+        sta HIO_REGS,y
+        dey
+        bpl @copy
+        lda #0
+        sta HIO_OFFSET
+        sta HIO_OFFSET+1
+        sta HIO_OFFSET+2
+        lda opcode
+        sta HIO_OP          ; the whole transfer happens here
+        ldx HIO_COUNT
+        ldy HIO_COUNT+1
+        lda HIO_OP          ; status
+        cmp #1              ; carry set if nonzero
+        rts
+
+opcode: .byte 0
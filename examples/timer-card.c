@@ -0,0 +1,88 @@
+//  timer-card.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// An example peripheral card plugin for bobbin (see src/bobbin-plugin.h):
+// a countdown timer. Build it with something like
+//
+//      cc -shared -fPIC -I path/to/bobbin/src -o timer-card.so timer-card.c
+//
+// and load it with  bobbin --card 5=./timer-card.so
+//
+// Registers (for slot s):
+//   $C0s0  write N: start counting down N thousand cycles.
+//          read: $80 if the count has run out, else $00.
+//   $C0s1  read: how many times the count has run out (mod 256).
+//
+// Its slot ROM ($Cs00) starts with the text TIMER, and its $C800 ROM
+// with TIMER CARD (both in high-bit ASCII).
+
+#include "bobbin-plugin.h"
+
+#include <string.h>
+
+static const BobbinHost *host;
+
+static uint8_t slot_rom[256];
+static uint8_t exp_rom[2048];
+
+static int running;     // which countdown is current
+static uint8_t expired;
+static uint8_t count;
+
+static void put_text(uint8_t *rom, const char *s)
+{
+    for (; *s; ++s) *rom++ = *s | 0x80;
+}
+
+static void timeout(void *ctx)
+{
+    // Ignore countdowns that were since restarted.
+    if ((int)(intptr_t)ctx != running) return;
+    expired = 0x80;
+    ++count;
+}
+
+static uint8_t io_read(void *ctx, unsigned int reg)
+{
+    return reg == 0? expired : count;
+}
+
+static void io_write(void *ctx, unsigned int reg, uint8_t val)
+{
+    if (reg != 0) return;
+    expired = 0;
+    ++running;
+    if (host->schedule(val * 1000ull, timeout,
+                       (void *)(intptr_t)running) != 0) {
+        host->message(host, "too many timers");
+    }
+}
+
+static void reset(void *ctx)
+{
+    ++running;
+    expired = 0;
+}
+
+int bobbin_card_init(const BobbinHost *h, BobbinCard *card)
+{
+    if (h->abi_version != BOBBIN_PLUGIN_ABI) return -1;
+    host = h;
+
+    memset(slot_rom, 0, sizeof slot_rom);
+    put_text(slot_rom, "TIMER");
+    memset(exp_rom, 0, sizeof exp_rom);
+    put_text(exp_rom, "TIMER CARD");
+
+    card->name = "timer card";
+    card->io_mask = 0x0003; // $C0s0 and $C0s1
+    card->io_read = io_read;
+    card->io_write = io_write;
+    card->slot_rom = slot_rom;
+    card->exp_rom = exp_rom;
+    card->reset = reset;
+    return 0;
+}
@@ -22,6 +22,7 @@
 #include <string.h>
 
 #include <strings.h>
+#include <sys/types.h>
 
 #include "apple2.h"
 
@@ -101,6 +102,13 @@ struct Config {
     const char *    machine;
     const char *    disk;
     const char *    disk2;
+    const char *    hdd;
+    const char *    hdd2;
+    const char *    hostio_dir;
+    const char *    serial;
+    const char *    ramdisk;
+    const char *    ramdisk_file;
+    bool            share_nibbles;
     bool            machine_set;
     size_t          amt_ram;
     bool            load_rom;
@@ -118,6 +126,10 @@ struct Config {
     bool            delay_set;
     bool            bell;
 
+    // "tty" interface config:
+    const char *    tty_gfx;
+    const char *    tty_colors;
+
     // "simple" interface config:
     bool            remain_after_pipe;
     bool            remain_tty;
@@ -126,6 +138,7 @@ struct Config {
     // trace stuff
     bool            die_on_brk;
     const char *    trace_file;
+    bool            trace_binary;
     uintmax_t       trace_start;
     uintmax_t       trace_end;
     bool            trap_success_on;
@@ -134,9 +147,37 @@ struct Config {
     word            trap_failure;
     bool            trap_print_on;
     word            trap_print;
+    bool            rewind;
+    const char *    record_file;
+    const char *    replay_file;
+    bool            fuzz_at_set;
+    word            fuzz_at;
+    const char *    fuzz_input;
+    bool            fuzz_mem_set;
+    word            fuzz_mem;
+    unsigned long   fuzz_cycles;
+    const char *    shm;
+    bool            detect_loops;
+    uintmax_t       cycle_limit;
+    double          time_limit;
+    const char *    stall_dump;
+    const char *    checkpoint_file;
+    double          checkpoint_every;
+    const char *    resume_file;
+    bool            cosim;
+    const char *    cosim_engine;
+    const char *    bus_log;
+    const char *    bus_log_only;
+
+    // video output
+    const char *    screenshot_file;
+    const char *    video_color;
+    const char *    record_video;
+    unsigned long   record_video_every;
 
     // special options
     bool            watch;
+    const char *    watch_mode;     // NULL (= "reboot"), or "patch"
     bool            tokenize;
     bool            detokenize;
 };
@@ -208,6 +249,8 @@ extern bool machine_has_mousetext(void);
 
 /********** MEMORY **********/
 
+#define MEM_SIZE    (128 * 1024)    // main and aux RAM
+
 typedef byte SoftSwitches[3];
 
 extern SoftSwitches ss;
@@ -256,6 +299,8 @@ extern void mem_init(void);
 extern void mem_reset(void);
 extern void mem_reboot(void);
 extern const byte *getram(void);
+// Moves RAM into buf (MEM_SIZE bytes), e.g. a --shm mapping.
+extern void mem_use_buffer(byte *buf);
 extern byte peek(word loc);
 extern void poke(word loc, byte val);
 // These versions don't trigger debugger break-on-memory,
@@ -263,8 +308,20 @@ extern void poke(word loc, byte val);
 extern byte peek_sneaky(word loc);
 extern void poke_sneaky(word loc, byte val);
 extern bool mem_match(word loc, unsigned int nargs, ...);
+// Block copies for peripherals that move data straight to/from
+//  memory (as the CPU would see it, but without events).
+//  mem_dma_write() fires a DISPLAY_TOUCH if screen memory was hit.
+extern void mem_dma_write(word loc, const byte *src, size_t n);
+extern void mem_dma_read(word loc, byte *dst, size_t n);
+// Raw copy into the RAM buffer, for restoring --rewind checkpoints.
+extern void mem_put(size_t bufloc, const byte *src, size_t n);
 extern byte *load_rom(const char *fname, size_t expected, bool exact);
 extern void load_ram_finish(void);
+// Re-reads the --load file, and pokes just the bytes that differ
+//  from what was loaded before into RAM (--watch=patch).
+//  Returns 1 if RAM was patched, 0 if the file hasn't been loaded
+//  yet (--delay-until), or -1 if it couldn't be done.
+extern int load_ram_patch(void);
 
 // NOTE: Does not account for bank-switched ROM in slots area,
 //       nor <64k configured RAM
@@ -409,7 +466,8 @@ enum EventType {
         /* Start of every cycle. */
     EV_FRAME,
         /* Called when ~ a 60th of a second (emulated time) has passed.
-           Interfaces are automatically registered for this. */
+           Interfaces are automatically registered for this; other
+           handlers must be registered with the EVH_FRAME flag. */
 
     /* The following event types are ONLY sent to interfaces. */
     EV_UNHOOK,
@@ -422,7 +480,8 @@ enum EventType {
         /* Used to indicate that screen memory may have been changed,
            in a way that did not trigger POKE events. Interface
            should re-scan memory to be certain the screen's contents
-           are correct. */
+           are correct. (Exception: this one is also sent to regular
+           handlers, so that the video renderer hears about it.) */
     EV_DISK_ACTIVE,
         /* A change in disk activity. Intended for interfaces
            to indicate via a "disk light" or some such. `val` holds
@@ -455,8 +514,12 @@ struct Event {
 
 typedef void (*event_handler)(Event *e);
 
+// Handler flags, for event_reghandler_flags()
+#define EVH_FRAME   (1 << 0)    // also receive EV_FRAME
+
 extern void events_init(void);
 extern void event_reghandler(event_handler h);
+extern void event_reghandler_flags(event_handler h, unsigned int flags);
 extern void event_unreghandler(event_handler h);
 extern void event_fire_disk_active(int val);
 extern int event_fire_peek(word loc);
@@ -498,6 +561,16 @@ typedef struct PeriphDesc PeriphDesc;
 struct PeriphDesc {
     void (*init)(void);
     periph_handler  handler;
+    // Optional, for --rewind: a card that can copy its state out (to
+    // state_size bytes) and back has it kept in checkpoints, and is
+    // run again when history is re-executed (its reads then answered
+    // from the log). Cards without these are left alone.
+    size_t          state_size;
+    void (*save_state)(void *buf);
+    void (*restore_state)(const void *buf);
+    // Optional: 2k of ROM for $C800-$CFFE, switched in by any access to
+    // the card's $CnXX space, and out by an access to $CFFF.
+    const byte      *c8rom;
 };
 
 extern void periph_init(void);
@@ -506,12 +579,61 @@ extern byte periph_sw_peek(word loc);
 extern void periph_sw_poke(word loc, byte val);
 extern byte periph_rom_peek(word loc);
 extern void periph_rom_poke(word loc, byte val);
+// Card state for --rewind checkpoints.
+extern size_t periph_state_size(void);
+extern void periph_save_state(byte *buf);
+extern void periph_restore_state(const byte *buf);
+// Replays a soft-switch access on a card that keeps its state.
+extern void periph_sw_replay(word loc, int val);
+// Tracks which card's ROM is switched in at $C800 (loc in $C100-$CFFF,
+// accessed by the CPU).
+extern void periph_expansion_access(word loc);
+// Pointer into the switched-in card's $C800 ROM, or NULL.
+extern const byte *periph_expansion_rom(word loc);
+
+// Cards loaded from shared objects (--card)
+extern PeriphDesc *plugin_card(unsigned int slot);
+// Cycle count at which the next plugin callback is due
+//  (see plugin_timer_due(), below).
+extern uintmax_t plugin_next_due;
+extern void plugin_run_timers(void);
 
 // Disk ][ controller
 extern bool drive_spinning(void);
 extern int active_disk(void);
 extern int eject_disk(int drive);
 extern int insert_disk(int drive, const char *path);
+// The image file for drive was rewritten; reload it once it's idle.
+extern void disk_image_changed(int drive);
+
+// ProDOS block devices (periph/blockdev.c), shared by the hard disk
+// and RAM disk cards.
+#define BLOCK_SIZE      512
+
+typedef struct BlockDev BlockDev;
+struct BlockDev {
+    byte *data;             // NULL if no volume is present
+    unsigned long nblocks;
+    bool writeprot;
+    void (*wrote)(BlockDev *, unsigned long block); // may be NULL
+};
+
+typedef struct BlockCard BlockCard;
+struct BlockCard {
+    BlockDev *unit[2];
+    byte err, blocks_lo, blocks_hi;
+};
+
+// Fills in a 256-byte slot ROM whose ProDOS driver uses the
+// soft switches at $C0n0 + swbase. A card that isn't bootable
+// doesn't present the autostart signature.
+extern void blockdev_build_rom(byte *rombuf, unsigned int slot,
+                               unsigned int swbase, bool bootable,
+                               int nvolumes);
+// Handles an access to soft switch swbase + reg.
+extern byte blockdev_sw(BlockCard *card, unsigned int reg, int val);
+// Lays down an empty ProDOS volume.
+extern void blockdev_format(BlockDev *d, const char *volname);
 
 /********** FORMATS  **********/
 
@@ -523,13 +645,31 @@ struct DiskFormatDesc {
     void *privdat;
     bool writeprot;
     unsigned int halftrack;
+    int bytenum;    // read/write position within the track
     void (*spin)(DiskFormatDesc *, bool);
     byte (*read_byte)(DiskFormatDesc *);
     void (*write_byte)(DiskFormatDesc *, byte);
     void (*eject)(DiskFormatDesc *);
+    // Picks up changes made to the image file by someone else. Only
+    // called while the disk isn't spinning. May be NULL.
+    void (*refresh)(DiskFormatDesc *);
 };
 
 extern DiskFormatDesc disk_format_load(const char *path);
+// If path has been replaced by a different file (as when a tool
+// writes a new image and renames it into place) since the mapping at
+// *buf was made, maps the new file in its stead. The first call
+// just records the identity of the file.
+extern void disk_image_follow(const char *path, byte **buf, size_t sz,
+                              dev_t *dev, ino_t *ino);
+// Writes changes to the image mapped at buf back to its file
+// (compressing it again, for a gzipped image). Returns 0, or an
+// errno value.
+extern int disk_image_sync(byte *buf, size_t sz);
+// Syncs (if need be) and unmaps the image at buf.
+extern void disk_image_unmap(byte *buf, size_t sz);
+// Whether path ends in .EXT (ignoring case), or .EXT.gz.
+extern bool disk_image_has_ext(const char *path, const char *ext);
 
 /********** TRACE **********/
 
@@ -554,6 +694,117 @@ extern void debugger(void);
 extern bool debugging(void);
 extern void breakpoint_set(word loc);
 
+/********** RECORD/REPLAY **********/
+
+extern void record_init(void);
+extern bool record_replaying(void);
+// Instruction count at which the next --replay entry is due
+//  (see replay_due(), below).
+extern uintmax_t replay_next_at;
+// Applies the --replay entries that are due.
+extern void replay_catch_up(void);
+// Returns the seed to use for a RAM fill (live, unless replaying).
+extern unsigned long record_seed(unsigned long live);
+// Returns the keyboard value for the CPU: from live(), unless replaying.
+extern int record_key(int (*live)(void));
+// Logs a breakout command that changes the machine (--record).
+extern void record_cmd(const char *line);
+
+/********** FUZZ **********/
+
+extern void fuzz_init(void);
+// Takes the snapshot at --fuzz-at, or ends the current run if it's
+//  over (restoring the snapshot for the next one).
+extern void fuzz_check(void);
+// Runs one instruction, counting coverage (used in place of cpu_step()).
+extern void fuzz_cpu_step(void);
+// Hooks for mem.c and cpu.c.
+extern void fuzz_note_write(size_t bufloc);
+extern void fuzz_brk(void);
+
+/********** STALL **********/
+
+// Set up --detect-loops, --cycle-limit and --time-limit.
+extern void stall_init(void);
+// Loop detection samples the machine once, when the PC next reaches
+//  stall_anchor (see stall_sample_due(), below).
+extern bool stall_sampling;
+extern word stall_anchor;
+extern void stall_sample(void);
+// Hook for mem.c.
+extern void stall_note_write(size_t bufloc);
+
+/********** CHECKPOINT **********/
+
+// Opens the --checkpoint file (needs the cards to be set up).
+extern void checkpoint_init(void);
+// Restores the machine from the --resume file, if there is one.
+extern void checkpoint_resume(void);
+// Hook for mem.c.
+extern void checkpoint_note_write(size_t bufloc);
+
+/********** COSIM **********/
+
+// Another CPU engine, to be checked against cpu_step() by --cosim.
+typedef struct {
+    byte    (*read)(word loc);
+    void    (*write)(word loc, byte val);
+} CpuBus;
+
+typedef struct {
+    const char *name;
+    // Runs one instruction on regs, with memory reached only through
+    //  bus. Returns the cycles it took.
+    unsigned    (*step)(Registers *regs, const CpuBus *bus);
+} CpuEngine;
+
+extern const CpuEngine tableEngine;
+
+extern void cosim_init(void);
+// Runs one instruction on both engines (used in place of cpu_step()).
+extern void cosim_cpu_step(void);
+// Hooks for mem.c, while cosim_logging.
+extern bool cosim_logging;
+extern void cosim_note_read(word loc, byte val);
+extern void cosim_note_write(word loc, byte val);
+
+/********** BUS LOG **********/
+
+extern void buslog_init(void);
+// Hook for mem.c, while buslog_on.
+extern bool buslog_on;
+extern void buslog_note(word loc, byte val, bool wr);
+
+/********** SHM **********/
+
+// Moves RAM into the --shm object, if there is one.
+extern void shm_init(void);
+
+/********** REWIND **********/
+
+// True while --rewind is re-executing history.
+extern bool rewind_replaying;
+// Runs one instruction, keeping history (used in place of cpu_step()).
+extern void rewind_cpu_step(void);
+// Discards all history (RAM was changed behind our back).
+extern void rewind_barrier(void);
+// Hooks for mem.c.
+extern void rewind_note_write(size_t bufloc, byte val);
+extern void rewind_dma(bool on);
+extern void rewind_log_io(word loc, byte val);
+extern byte rewind_replay_io(word loc);
+extern void rewind_replay_poke(word loc);
+// How many instructions back the history goes.
+extern uintmax_t rewind_available(void);
+// Moves back n instructions. False if history doesn't go back that far.
+extern bool rewind_back(uintmax_t n);
+// Moves back to the most recent instruction boundary at which match()
+//  is true. begin() is called each time re-execution restarts from a
+//  checkpoint. False (having gone nowhere) if there isn't one.
+extern bool rewind_search(void (*begin)(void), bool (*match)(void));
+// Moves back to just before the last instruction that wrote loc.
+extern bool rewind_last_write(word loc);
+
 /********** UTIL **********/
 
 extern void *xalloc(size_t sz);
@@ -568,6 +819,35 @@ extern int util_fromascii(int c);
 extern int util_isprint(int c);
 extern void util_reopen_stdin_tty(int flags);
 
+/********** VIDEO **********/
+
+#define VIDEO_WIDTH     280
+#define VIDEO_HEIGHT    192
+
+extern void video_init(void);
+extern void video_enable(void);
+// Returns a VIDEO_WIDTH x VIDEO_HEIGHT buffer of RGB triples.
+extern const byte *video_render(void);
+// As video_render(), but also sets a bit in `changed` (one bit per
+// scanline, lsb-first) for every scanline that was re-rendered since
+// this caller last looked. `seen` is the caller's own record of that:
+// an array of VIDEO_HEIGHT counters, initially zero.
+extern const byte *video_render_changed(uint32_t *seen, byte *changed);
+// Start recording frames to the video stream in cfg.record_video.
+extern void vidrec_init(void);
+
+// Terminal graphics (Unicode half-block/braille cells), for interfaces.
+// termgfx_init() returns false if graphics are off or unsupported.
+extern bool termgfx_init(void);
+extern bool termgfx_active(void);
+// Forget what's on screen: the next draw repaints every cell.
+extern void termgfx_invalidate(void);
+// Draw the top `lines` scanlines of the display into the top-left
+// cols x rows cells of the terminal on fd, emitting changed cells only.
+extern void termgfx_draw(int fd, int cols, int rows, int lines);
+// Writes a PPM if path ends in .ppm; raw RGB otherwise. Returns errno.
+extern int video_write_frame(const char *path);
+
 /********** WATCH **********/
 
 extern void setup_watches(void);
@@ -575,13 +855,30 @@ extern bool check_watches(void);
 
 /* TBD */
 extern word print_disasm(FILE *f, word pos, const Registers *regs);
+// --disassemble: static listings of whole files, then exit.
+extern bool disasm_requested(void);
+extern void disasm_run(void);
 
 #define NS_PER_FRAME        16651559
 #define CYCLES_PER_FRAME    17030
 
 extern uintmax_t cycle_count;
 extern uintmax_t instr_count;
+static inline bool replay_due(void) { return instr_count >= replay_next_at; }
 extern uintmax_t frame_count;
+// CPU cycles since the machine started (or --watch last rebooted it).
+static inline uintmax_t cycles_elapsed(void)
+{
+    return frame_count * CYCLES_PER_FRAME + cycle_count;
+}
+static inline bool stall_sample_due(void)
+{
+    return stall_sampling && PC == stall_anchor;
+}
+static inline bool plugin_timer_due(void)
+{
+    return cycles_elapsed() >= plugin_next_due;
+}
 extern bool text_flash;
 static inline void cycle(void) { ++cycle_count; }
 extern volatile sig_atomic_t sigint_received;
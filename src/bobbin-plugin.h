@@ -0,0 +1,84 @@
+//  bobbin-plugin.h
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// The interface for peripheral cards built as shared objects, loaded
+// into a slot with --card SLOT=PATH. This header has no dependencies
+// on the rest of bobbin's source.
+//
+// A plugin exports one function, named by BOBBIN_CARD_INIT_SYM:
+//
+//      int bobbin_card_init(const BobbinHost *host, BobbinCard *card);
+//
+// The host's abi_version is BOBBIN_PLUGIN_ABI; a plugin built against
+// another version should return nonzero. Otherwise, the plugin fills
+// in *card (which arrives zeroed, apart from abi_version and size),
+// and returns 0. The host pointer stays valid for the life of the
+// process.
+//
+// The card says up front which addresses it answers:
+//
+//   - io_mask: bit N set means the card handles $C0s0+N (s = slot);
+//     io_read/io_write are called for those, and only those.
+//   - slot_rom: 256 bytes, read directly for $Cs00-$CsFF.
+//   - exp_rom: 2048 bytes, read directly for $C800-$CFFE while the
+//     card owns that space: from any access to its $CsXX space until
+//     an access to $CFFF, as on the real machine.
+//
+// Anything left NULL/0 is simply not decoded, and costs nothing. The
+// ROM buffers belong to the plugin, which may change their contents
+// at any time (to bank-switch, say).
+//
+// Rather than polling, a card that needs to act later asks for a
+// callback with host->schedule(). Callbacks run between instructions,
+// at the first instruction boundary after the requested cycle.
+
+#ifndef BOBBIN_PLUGIN_H
+#define BOBBIN_PLUGIN_H
+
+#include <stdint.h>
+
+#define BOBBIN_PLUGIN_ABI       1
+#define BOBBIN_CARD_INIT_SYM    "bobbin_card_init"
+
+typedef struct BobbinHost BobbinHost;
+struct BobbinHost {
+    uint32_t    abi_version;
+    unsigned int slot;
+    // Memory as the CPU currently sees it, without side effects
+    // (soft switches aren't triggered).
+    uint8_t     (*peek)(uint16_t loc);
+    void        (*poke)(uint16_t loc, uint8_t val);
+    // CPU cycles since the machine started.
+    uint64_t    (*cycles)(void);
+    // Calls fn(ctx) once, delay cycles from now. Returns nonzero if
+    // it couldn't be scheduled.
+    int         (*schedule)(uint64_t delay, void (*fn)(void *ctx),
+                            void *ctx);
+    // Prints a message, prefixed with the card's name and slot.
+    void        (*message)(const BobbinHost *host, const char *msg);
+};
+
+typedef struct BobbinCard BobbinCard;
+struct BobbinCard {
+    uint32_t    abi_version;    // set by the host
+    uint32_t    size;           // sizeof (BobbinCard), set by the host
+    const char  *name;
+    void        *ctx;           // passed to the functions below
+
+    uint16_t    io_mask;
+    uint8_t     (*io_read)(void *ctx, unsigned int reg);
+    void        (*io_write)(void *ctx, unsigned int reg, uint8_t val);
+
+    const uint8_t *slot_rom;
+    const uint8_t *exp_rom;
+
+    // Optional: called at power-on and whenever RESET is pressed.
+    void        (*reset)(void *ctx);
+};
+
+typedef int (*BobbinCardInit)(const BobbinHost *host, BobbinCard *card);
+
+#endif // BOBBIN_PLUGIN_H
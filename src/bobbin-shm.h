@@ -0,0 +1,52 @@
+//  bobbin-shm.h
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// Layout of the shared-memory object that bobbin creates with --shm,
+// for external tools that want to watch the emulated machine. This
+// header has no dependencies on the rest of bobbin's source.
+//
+// The object holds a BobbinShmHeader, then (at header_size bytes
+// from the start) the emulated RAM: ram_size bytes, main RAM first,
+// then aux. Within each 64k, $C000-$CFFF holds bank 1 of the
+// language card's $D000-$DFFF, and $D000-$FFFF the rest of it.
+//
+// RAM is the emulator's own memory, so it's always current. The rest
+// of the header is updated once a frame (1/60 sec of emulated time),
+// under a sequence lock: to read a consistent copy,
+//
+//      do {
+//          s = load_acquire(&h->seq);
+//          copy = *h;
+//      } while ((s & 1) || load_acquire(&h->seq) != s);
+
+#ifndef BOBBIN_SHM_H
+#define BOBBIN_SHM_H
+
+#include <stdint.h>
+
+#define BOBBIN_SHM_MAGIC    "BOBBIN\0\0"
+#define BOBBIN_SHM_VERSION  1
+
+typedef struct BobbinShmHeader BobbinShmHeader;
+struct BobbinShmHeader {
+    char        magic[8];       // BOBBIN_SHM_MAGIC
+    uint32_t    version;        // BOBBIN_SHM_VERSION
+    uint32_t    header_size;    // offset of RAM from the start
+    uint32_t    ram_size;
+    uint32_t    pid;            // of the bobbin process
+
+    uint32_t    seq;            // odd while the fields below change
+    uint32_t    reserved;
+    uint64_t    frames;         // frames emulated so far
+    uint64_t    cycles;         // CPU cycles emulated so far
+    uint64_t    instructions;   // instructions executed so far
+
+    uint16_t    pc;
+    uint8_t     a, x, y, sp, p;
+    uint8_t     switches[3];    // soft switches (see bobbin-internal.h)
+};
+
+#endif // BOBBIN_SHM_H
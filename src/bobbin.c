@@ -32,12 +32,24 @@ void bobbin_run(void)
 {
     setlocale(LC_ALL, "");
 
+    if (disasm_requested()) {
+        disasm_run(); // doesn't return
+    }
+
     signals_init();
     machine_init();
     handle_io_opts();
+    record_init();
+    fuzz_init();
+    shm_init();
+    stall_init();
+    cosim_init();
+    buslog_init();
     events_init();
+    video_init();
     interfaces_init();
     periph_init();
+    checkpoint_init();
     mem_init(); // Loads ROM files. Nothing past this point
                 // should be validating options or arguments.
     setup_watches();
@@ -45,19 +57,28 @@ void bobbin_run(void)
 
     event_fire(EV_RESET);
 
-    if (cfg.start_loc_set && !cfg.delay_set) {
+    if (cfg.resume_file) {
+        checkpoint_resume();
+    } else if (cfg.start_loc_set && !cfg.delay_set) {
         PC = cfg.start_loc;
     }
 
     for (;;) /* ever */ {
         if (check_watches()) frame_count = 0;
         struct timespec preframe;
-        if (!cfg.turbo) {
+        // A --replay runs at full speed until it's caught up;
+        // fuzzing always does.
+        bool pace = !cfg.turbo && !record_replaying() && !cfg.fuzz_at_set;
+        if (pace) {
             clock_gettime(CLOCK_MONOTONIC, &preframe);
         }
         cycle_count = 0;
         do {
             // Provide hooks the opportunity to alter the PC, here
+            if (replay_due()) replay_catch_up();
+            if (cfg.fuzz_at_set) fuzz_check();
+            if (plugin_timer_due()) plugin_run_timers();
+            if (stall_sample_due()) stall_sample();
             do {
                 current_pc_val = PC;
                 event_fire(EV_PRESTEP);
@@ -67,12 +88,20 @@ void bobbin_run(void)
                                             // doesn't get count-limited.
 
             event_fire(EV_STEP);
-            cpu_step();
+            if (cfg.rewind) {
+                rewind_cpu_step();
+            } else if (cfg.fuzz_at_set) {
+                fuzz_cpu_step();
+            } else if (cfg.cosim) {
+                cosim_cpu_step();
+            } else {
+                cpu_step();
+            }
         } while (cycle_count < CYCLES_PER_FRAME);
         frame_count += cycle_count / CYCLES_PER_FRAME;
         text_flash = frame_count % 60 >= 30;
         event_fire(EV_FRAME);
-        if (!cfg.turbo) {
+        if (pace) {
             struct timespec postframe;
             clock_gettime(CLOCK_MONOTONIC, &postframe);
             long elapsed;
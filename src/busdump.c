@@ -0,0 +1,147 @@
+//  busdump.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "buslogfmt.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Decodes a bobbin --bus-log file into text, one access per line.
+
+static const char *progname;
+static const char *inname;
+
+static void exit_with_usage(int status)
+{
+    FILE *fp = status == 0? stdout : stderr;
+
+    fprintf(fp, "USAGE: %s [-c CLASS,...] LOG\n"
+          "\n"
+          "Decodes a bobbin --bus-log LOG, one access per line: the cycle\n"
+          "it happened at, the PC, the address, whether it was a read or a\n"
+          "write and of what value, its address class, and the memory\n"
+          "configuration it left. With -c, shows only accesses of the given\n"
+          "classes (%s", progname, buslog_class_names[1]);
+    for (int c = 2; c != BC_NUM; ++c) {
+        fprintf(fp, "%s%s", c == BC_NUM - 1? ", or " : ", ",
+                buslog_class_names[c]);
+    }
+    fputs(").\n", fp);
+    exit(status);
+}
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "%s: %s: %s\n", progname, inname, msg);
+    exit(1);
+}
+
+static unsigned parse_classes(const char *arg)
+{
+    unsigned classes = 0;
+    while (*arg) {
+        size_t len = strcspn(arg, ",");
+        int c;
+        for (c = BC_NONE + 1; c != BC_NUM; ++c) {
+            const char *name = buslog_class_names[c];
+            if (strlen(name) == len && !strncmp(arg, name, len)) break;
+        }
+        if (c == BC_NUM) {
+            fprintf(stderr, "%s: unknown address class \"%.*s\"\n",
+                    progname, (int)len, arg);
+            exit(2);
+        }
+        classes |= 1u << c;
+        arg += len;
+        if (*arg == ',') ++arg;
+    }
+    return classes;
+}
+
+static unsigned long get_le(const unsigned char *p, int nbytes)
+{
+    unsigned long v = 0;
+    for (int i = nbytes - 1; i != -1; --i) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+// "ROM/RAM bank 2 RAMRD PAGE2": where $D000-$FFFF reads and writes go,
+// then the other switches that are on.
+static void print_bank(unsigned bank)
+{
+    bool rd_ram = (bank & (1 << 3)) != 0;
+    bool wr_ram = (bank & (1 << 1)) == 0;
+    printf("%s/%s bank %d", rd_ram? "RAM" : "ROM", wr_ram? "RAM" : "ROM",
+           (bank & (1 << 2))? 1 : 2);
+    for (int i = 4; i != 16; ++i) {
+        if (bank & (1u << i)) printf(" %s", buslog_bank_names[i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    progname = argv[0];
+    unsigned classes = ~0u;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; ++i) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            exit_with_usage(0);
+        } else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            classes = parse_classes(argv[++i]);
+        } else {
+            exit_with_usage(2);
+        }
+    }
+    if (i != argc - 1) exit_with_usage(2);
+    inname = argv[i];
+
+    FILE *in = fopen(inname, "rb");
+    if (in == NULL) {
+        fprintf(stderr, "%s: couldn't open %s: %s\n", progname, inname,
+                strerror(errno));
+        exit(1);
+    }
+
+    unsigned char hdr[BUSLOG_HDR_LEN];
+    if (fread(hdr, 1, sizeof hdr, in) != sizeof hdr
+        || memcmp(hdr, BUSLOG_MAGIC, BUSLOG_MAGIC_LEN) != 0) {
+        die("not a bobbin bus log");
+    }
+
+    static unsigned char buf[4096 * BUSLOG_REC_LEN];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof buf, in)) != 0) {
+        if (n % BUSLOG_REC_LEN != 0) {
+            fprintf(stderr, "%s: %s: warning: log was truncated\n",
+                    progname, inname);
+        }
+        for (const unsigned char *r = buf; r + BUSLOG_REC_LEN <= buf + n;
+             r += BUSLOG_REC_LEN) {
+            int c = r[BL_FLAGS] >> BL_CLASS_SHIFT;
+            if (c >= BC_NUM) die("bad record");
+            if (!(classes & (1u << c))) continue;
+
+            uintmax_t cycles = 0;
+            for (int j = 7; j != -1; --j) {
+                cycles = (cycles << 8) | r[BL_CYCLES + j];
+            }
+            printf("%12ju  %04lX  %04lX %s %02X  %-7s  ", cycles,
+                   get_le(r + BL_PC, 2), get_le(r + BL_ADDR, 2),
+                   (r[BL_FLAGS] & BL_WRITE)? "wr" : "rd", r[BL_VAL],
+                   buslog_class_names[c]);
+            print_bank(get_le(r + BL_BANK, 2));
+            putchar('\n');
+        }
+    }
+    return 0;
+}
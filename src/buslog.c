@@ -0,0 +1,261 @@
+//  buslog.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+#include "buslogfmt.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// --bus-log: a record of I/O and bank-switched memory accesses.
+//
+// Each access that passes the --bus-log-only filter is copied, as a
+// fixed-width record (see buslogfmt.h), into a ring of blocks shared
+// with a writer process. When a block fills, its number is sent down
+// a pipe; the writer writes the block out and answers with a byte when
+// it's free again. So the emulator only waits on the disk if it gets a
+// whole ring ahead of it. bobbin-busdump decodes the log.
+
+#define BLOCK_RECS      4096
+#define BLOCK_BYTES      (BLOCK_RECS * BUSLOG_REC_LEN)
+#define NBLOCKS         64
+
+#define DEFAULT_CLASSES "switch,lc,lcram"
+
+typedef struct {
+    unsigned    block;
+    unsigned    len;
+} BlockMsg;
+
+bool buslog_on;
+
+static unsigned classes;        // mask of BC_ bits to log
+static byte *ring;
+static unsigned cur_block, cur_n, free_blocks = NBLOCKS;
+static int to_writer = -1, from_writer = -1;
+static pid_t writer;
+static uintmax_t logged;
+
+static bool write_all(int fd, const void *buf, size_t len)
+{
+    const byte *p = buf;
+    while (len != 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void *buf, size_t len)
+{
+    byte *p = buf;
+    while (len != 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static void writer_main(int in, int out, int fd)
+{
+    // A Ctrl-C is for the emulator; we still have its log to finish.
+    signal(SIGINT, SIG_IGN);
+    BlockMsg m;
+    while (read_all(in, &m, sizeof m)) {
+        if (!write_all(fd, ring + (size_t)m.block * BLOCK_BYTES, m.len)) {
+            _exit(1);
+        }
+        byte ack = 0;
+        (void) write_all(out, &ack, 1);
+    }
+    _exit(close(fd) == 0? 0 : 1);
+}
+
+static bool send_block(void)
+{
+    BlockMsg m = { cur_block, cur_n * BUSLOG_REC_LEN };
+    if (!write_all(to_writer, &m, sizeof m)) return false;
+    cur_block = (cur_block + 1) % NBLOCKS;
+    cur_n = 0;
+
+    // The next block is the oldest one sent; if it isn't free yet,
+    // wait until it is.
+    if (--free_blocks == 0) {
+        byte ack;
+        if (!read_all(from_writer, &ack, 1)) return false;
+        ++free_blocks;
+    }
+    return true;
+}
+
+static void buslog_finish(void)
+{
+    buslog_on = false;
+    if (cur_n != 0) (void) send_block();
+    close(to_writer);
+
+    int status;
+    while (waitpid(writer, &status, 0) < 0 && errno == EINTR)
+        ;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        WARN("--bus-log: error writing \"%s\".\n", cfg.bus_log);
+    } else {
+        INFO("--bus-log: %ju accesses logged to \"%s\".\n", logged,
+             cfg.bus_log);
+    }
+}
+
+static void parse_classes(const char *arg)
+{
+    classes = 0;
+    while (*arg) {
+        size_t len = strcspn(arg, ",");
+        bool found = false;
+        if (len == 3 && !strncmp(arg, "all", 3)) {
+            classes = ~(1u << BC_NONE);
+            found = true;
+        }
+        for (int c = BC_NONE + 1; !found && c != BC_NUM; ++c) {
+            const char *name = buslog_class_names[c];
+            if (strlen(name) == len && !strncmp(arg, name, len)) {
+                classes |= 1u << c;
+                found = true;
+            }
+        }
+        if (!found) {
+            DIE(2, "--bus-log-only: unknown address class \"%.*s\".\n",
+                (int)len, arg);
+        }
+        arg += len;
+        if (*arg == ',') ++arg;
+    }
+}
+
+void buslog_init(void)
+{
+    if (cfg.bus_log_only && !cfg.bus_log) {
+        DIE(2, "--bus-log-only requires --bus-log.\n");
+    }
+    if (!cfg.bus_log) return;
+    if (cfg.fuzz_at_set) {
+        // Every forked run would share the one writer.
+        DIE(2, "--bus-log can't be used with --fuzz-at.\n");
+    }
+    parse_classes(cfg.bus_log_only? cfg.bus_log_only : DEFAULT_CLASSES);
+
+    int fd = open(cfg.bus_log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        DIE(1, "--bus-log: couldn't open \"%s\": %s\n", cfg.bus_log,
+            strerror(errno));
+    }
+    byte hdr[BUSLOG_HDR_LEN] = {0};
+    memcpy(hdr, BUSLOG_MAGIC, BUSLOG_MAGIC_LEN);
+    if (!write_all(fd, hdr, sizeof hdr)) {
+        DIE(1, "--bus-log: couldn't write \"%s\": %s\n", cfg.bus_log,
+            strerror(errno));
+    }
+
+    ring = mmap(NULL, (size_t)NBLOCKS * BLOCK_BYTES, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        DIE(1, "--bus-log: couldn't map the log buffer: %s\n",
+            strerror(errno));
+    }
+
+    int down[2], up[2];
+    if (pipe(down) < 0 || pipe(up) < 0) {
+        DIE(1, "--bus-log: couldn't make pipes: %s\n", strerror(errno));
+    }
+    writer = fork();
+    if (writer < 0) {
+        DIE(1, "--bus-log: fork failed: %s\n", strerror(errno));
+    } else if (writer == 0) {
+        close(down[1]);
+        close(up[0]);
+        writer_main(down[0], up[1], fd);
+    }
+    close(down[0]);
+    close(up[1]);
+    close(fd);
+    to_writer = down[1];
+    from_writer = up[0];
+
+    buslog_on = true;
+    atexit(buslog_finish);
+}
+
+static int classify(word loc, bool wr)
+{
+    if (loc >= SS_START && loc < LOC_SLOTS_START) {
+        if (loc == 0xC030) return BC_SPEAKER;
+        if (loc < SS_LANG_CARD) return BC_SWITCH;
+        if (loc < SS_LANG_CARD + 0x10) return BC_LC;
+        return BC_SLOT;
+    }
+    if (loc >= LOC_SLOTS_START && loc < LOC_SLOTS_END) return BC_CXROM;
+
+    // Everything past here is ordinary memory, reached on nearly every
+    // access, so only work out where it went if that class is wanted.
+    if (loc >= LOC_ROM_START) {
+        if (!(classes & (1u << BC_LCRAM))) return BC_NONE;
+        // mem_get_true_access()'s ROM test, inline: every fetch from
+        // ROM comes through here.
+        if (cfg.load_rom && (!cfg.lang_card
+                             || (wr? (ss[0] >> ss_lc_no_write) & 1
+                                   : !((ss[0] >> ss_lc_read_bsr) & 1)))) {
+            return BC_NONE;
+        }
+        return BC_LCRAM;
+    }
+    if (!(classes & (1u << BC_AUX))) return BC_NONE;
+    size_t bufloc;
+    bool aux;
+    MemAccessType acc;
+    mem_get_true_access(loc, wr, &bufloc, &aux, &acc);
+    return aux? BC_AUX : BC_NONE;
+}
+
+void buslog_note(word loc, byte val, bool wr)
+{
+    int c = classify(loc, wr);
+    if (!(classes & (1u << c))) return;
+
+    byte *r = ring + (size_t)cur_block * BLOCK_BYTES
+        + (size_t)cur_n * BUSLOG_REC_LEN;
+    uintmax_t cycles = cycles_elapsed();
+    for (int i = 0; i != 8; ++i) {
+        r[BL_CYCLES + i] = cycles & 0xFF;
+        cycles >>= 8;
+    }
+    word pc = current_pc();
+    r[BL_PC]        = LO(pc);
+    r[BL_PC + 1]    = HI(pc);
+    r[BL_ADDR]      = LO(loc);
+    r[BL_ADDR + 1]  = HI(loc);
+    r[BL_VAL]       = val;
+    r[BL_FLAGS]     = (c << BL_CLASS_SHIFT) | (wr? BL_WRITE : 0);
+    r[BL_BANK]      = (ss[0] & 0x0F) | (ss[1] << 4);
+    r[BL_BANK + 1]  = (ss[1] >> 4) | (ss[2] << 4);
+    ++logged;
+
+    if (++cur_n == BLOCK_RECS && !send_block()) {
+        buslog_on = false;
+        DIE(1, "--bus-log: lost the writer process.\n");
+    }
+}
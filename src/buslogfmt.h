@@ -0,0 +1,67 @@
+//  buslogfmt.h
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#ifndef BOBBIN_BUSLOGFMT_H
+#define BOBBIN_BUSLOGFMT_H
+
+// Layout of a --bus-log file. All multi-byte values are little-endian.
+//
+// Header (16 bytes):
+//   BUSLOG_MAGIC (8 bytes), reserved (8).
+//
+// Then one fixed-width record per logged access:
+//   cycles since the machine started (8 bytes), PC of the instruction
+//   making the access (2), address (2), value read or written (1),
+//   flags (1), and the memory configuration just after the access (2).
+//
+// The flags byte holds BL_WRITE, and the access's class (one of the
+// BC_ values) in the bits above it. The memory configuration packs the
+// soft switches: the language card's four flags in the low bits, then
+// RAMRD through VERTBLANK, then TEXT, MIXED, PAGE2 and HIRES (in the
+// order of the BLS_ names below).
+
+#define BUSLOG_MAGIC        "BOBBUS\0\1"
+#define BUSLOG_MAGIC_LEN    8
+#define BUSLOG_HDR_LEN      16
+#define BUSLOG_REC_LEN      16
+
+// Offsets of the fields within a record.
+#define BL_CYCLES   0
+#define BL_PC       8
+#define BL_ADDR     10
+#define BL_VAL      12
+#define BL_FLAGS    13
+#define BL_BANK     14
+
+#define BL_WRITE        0x01
+#define BL_CLASS_SHIFT  1
+
+// Address classes.
+enum {
+    BC_NONE = 0,
+    BC_SWITCH,      // $C000-$C07F soft switches (but not the speaker)
+    BC_SPEAKER,     // $C030
+    BC_LC,          // $C080-$C08F language card switches
+    BC_SLOT,        // $C090-$C0FF peripheral card I/O
+    BC_CXROM,       // $C100-$CFFF slot and internal ROM
+    BC_LCRAM,       // $D000-$FFFF, when it reaches language card RAM
+    BC_AUX,         // anywhere else, when it reaches auxiliary RAM
+    BC_NUM
+};
+
+static const char * const buslog_class_names[BC_NUM] = {
+    "none", "switch", "speaker", "lc", "slot", "cxrom", "lcram", "aux",
+};
+
+// Names of the memory configuration bits.
+static const char * const buslog_bank_names[16] = {
+    "LC_PREWRITE", "LC_NO_WRITE", "LC_BANK_ONE", "LC_READ_BSR",
+    "RAMRD", "RAMWRT", "INTCXROM", "ALTZP",
+    "INTC8ROM", "SLOTC3ROM", "EIGHTYSTORE", "VERTBLANK",
+    "TEXT", "MIXED", "PAGE2", "HIRES",
+};
+
+#endif /* BOBBIN_BUSLOGFMT_H */
@@ -0,0 +1,329 @@
+//  checkpoint.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// --checkpoint and --resume: picking a long run back up where it
+// was, after the host goes down.
+//
+// Every --checkpoint-every seconds, at the end of a frame, we append
+// a checkpoint to the file: the instruction and frame counts, CPU
+// registers, soft switches, the state of cards that can give it to
+// us (the Disk II controller and drive mechanics), and just the RAM
+// pages written since the previous checkpoint. The first checkpoint
+// in a file has every page. --resume reads the file from the start,
+// applying each checkpoint's pages in turn, and carries on from the
+// last complete one; a checkpoint cut short by a crash is ignored,
+// and cut off the file if we're appending to it.
+//
+// Disk contents aren't in the checkpoints: disk images are written
+// back to their files whenever the drive motor stops, so we don't
+// take a checkpoint while it's running. Other cards' state, and
+// whatever the interface was in the middle of, are not saved either.
+//
+// File format (integers little-endian):
+//   "BOBBINCK" u8 version, u8 len, machine ROM name (len bytes)
+// then any number of:
+//   "CKPT" u64 instr_count, u64 frame_count,
+//   u16 pc, u8 sp, p, a, x, y, 3 bytes soft switches,
+//   u32 card state size, card state,
+//   u32 npages, npages * (u16 page number, 256 bytes),
+//   "DONE"
+
+#define NPAGES          (MEM_SIZE / 256)
+#define FILE_MAGIC      "BOBBINCK"
+#define FILE_VERSION    1
+
+static FILE *ckfile;
+static bool appending;
+static bool page_dirty[NPAGES];
+static size_t dirty[NPAGES];
+static size_t ndirty;
+static struct timespec last_taken;
+
+static size_t periph_sz;
+static byte *periph_buf;
+
+static void put_bytes(const void *p, size_t n)
+{
+    if (fwrite(p, 1, n, ckfile) != n) {
+        DIE(1, "Couldn't write --checkpoint file \"%s\": %s\n",
+            cfg.checkpoint_file, strerror(errno));
+    }
+}
+
+static void put_uint(uintmax_t v, int nbytes)
+{
+    byte b[8];
+    for (int i = 0; i != nbytes; ++i) {
+        b[i] = v & 0xFF;
+        v >>= 8;
+    }
+    put_bytes(b, nbytes);
+}
+
+static void mark_all(void)
+{
+    for (size_t page = 0; page != NPAGES; ++page) {
+        checkpoint_note_write(page << 8);
+    }
+}
+
+static void take(void)
+{
+    periph_save_state(periph_buf);
+    const Registers *r = &theCpu.regs;
+    const byte *ram = getram();
+
+    put_bytes("CKPT", 4);
+    put_uint(instr_count, 8);
+    put_uint(frame_count, 8);
+    put_uint(r->pc, 2);
+    byte regs[] = { r->sp, r->p, r->a, r->x, r->y };
+    put_bytes(regs, sizeof regs);
+    put_bytes(ss, sizeof ss);
+    put_uint(periph_sz, 4);
+    put_bytes(periph_buf, periph_sz);
+    put_uint(ndirty, 4);
+    for (size_t i = 0; i != ndirty; ++i) {
+        size_t page = dirty[i];
+        put_uint(page, 2);
+        put_bytes(&ram[page << 8], 256);
+        page_dirty[page] = false;
+    }
+    ndirty = 0;
+    put_bytes("DONE", 4);
+
+    if (fflush(ckfile) != 0 || fsync(fileno(ckfile)) != 0) {
+        DIE(1, "Couldn't write --checkpoint file \"%s\": %s\n",
+            cfg.checkpoint_file, strerror(errno));
+    }
+}
+
+void checkpoint_note_write(size_t bufloc)
+{
+    size_t page = bufloc >> 8;
+    if (!page_dirty[page]) {
+        page_dirty[page] = true;
+        dirty[ndirty++] = page;
+    }
+}
+
+static void checkpoint_event(Event *e)
+{
+    if (e->type == EV_REBOOT) {
+        // RAM was refilled behind our back; the next checkpoint
+        // needs all of it.
+        mark_all();
+        return;
+    }
+    if (e->type != EV_FRAME) return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double since = (now.tv_sec - last_taken.tv_sec)
+        + (now.tv_nsec - last_taken.tv_nsec) / 1e9;
+    if (since < cfg.checkpoint_every || drive_spinning()) return;
+
+    take();
+    last_taken = now;
+}
+
+/********** resuming **********/
+
+typedef struct Reader Reader;
+struct Reader {
+    FILE        *f;
+    const char  *path;
+};
+
+static bool get_bytes(Reader *rd, void *p, size_t n)
+{
+    if (fread(p, 1, n, rd->f) == n) return true;
+    if (ferror(rd->f)) {
+        DIE(1, "Error reading --resume file \"%s\": %s\n",
+            rd->path, strerror(errno));
+    }
+    return false;
+}
+
+static bool get_uint(Reader *rd, uintmax_t *v, int nbytes)
+{
+    byte b[8];
+    if (!get_bytes(rd, b, nbytes)) return false;
+    *v = 0;
+    for (int i = nbytes; i != 0; --i) {
+        *v = (*v << 8) | b[i-1];
+    }
+    return true;
+}
+
+typedef struct Saved Saved;
+struct Saved {
+    uintmax_t       instr;
+    uintmax_t       frames;
+    Registers       regs;
+    SoftSwitches    ss;
+    byte            *periph;
+};
+
+// Reads one checkpoint into *sv and ram; false if there wasn't a
+// complete one.
+static bool read_one(Reader *rd, Saved *sv, byte *ram)
+{
+    char tag[4];
+    uintmax_t pc, sz, npages;
+    byte regs[5];
+    if (!get_bytes(rd, tag, 4) || memcmp(tag, "CKPT", 4) != 0
+        || !get_uint(rd, &sv->instr, 8) || !get_uint(rd, &sv->frames, 8)
+        || !get_uint(rd, &pc, 2) || !get_bytes(rd, regs, sizeof regs)
+        || !get_bytes(rd, sv->ss, sizeof sv->ss)
+        || !get_uint(rd, &sz, 4)) {
+        return false;
+    }
+    if (sz != periph_sz) {
+        DIE(1, "--resume file \"%s\" was made with different cards.\n",
+            rd->path);
+    }
+    if (!get_bytes(rd, sv->periph, sz) || !get_uint(rd, &npages, 4)
+        || npages > NPAGES) {
+        return false;
+    }
+    for (uintmax_t i = 0; i != npages; ++i) {
+        uintmax_t page;
+        if (!get_uint(rd, &page, 2) || page >= NPAGES
+            || !get_bytes(rd, &ram[page << 8], 256)) {
+            return false;
+        }
+    }
+    if (!get_bytes(rd, tag, 4) || memcmp(tag, "DONE", 4) != 0) {
+        return false;
+    }
+    sv->regs = (Registers){ .pc = pc, .sp = regs[0], .p = regs[1],
+                            .a = regs[2], .x = regs[3], .y = regs[4] };
+    return true;
+}
+
+static bool same_file(const char *a, const char *b)
+{
+    struct stat sa, sb;
+    return stat(a, &sa) == 0 && stat(b, &sb) == 0
+        && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+void checkpoint_resume(void)
+{
+    if (cfg.resume_file == NULL) return;
+
+    Reader rd = { fopen(cfg.resume_file, "rb"), cfg.resume_file };
+    if (rd.f == NULL) {
+        DIE(1, "Couldn't open --resume file \"%s\": %s\n",
+            cfg.resume_file, strerror(errno));
+    }
+    char magic[8];
+    uintmax_t version, len;
+    char machine[256];
+    if (!get_bytes(&rd, magic, sizeof magic)
+        || memcmp(magic, FILE_MAGIC, sizeof magic) != 0
+        || !get_uint(&rd, &version, 1) || version != FILE_VERSION
+        || !get_uint(&rd, &len, 1) || !get_bytes(&rd, machine, len)) {
+        DIE(1, "\"%s\" isn't a bobbin checkpoint file.\n", cfg.resume_file);
+    }
+    machine[len] = '\0';
+    if (!STREQ(machine, default_romfname)) {
+        DIE(1, "--resume file \"%s\" was made with a different machine"
+            " type.\n", cfg.resume_file);
+    }
+
+    // Pages are applied to a scratch copy, so that a checkpoint cut
+    // short doesn't leave half its pages behind.
+    byte *ram = xalloc(MEM_SIZE);
+    byte *scratch = xalloc(MEM_SIZE);
+    Saved sv = { .periph = xalloc(periph_sz? periph_sz : 1) };
+    Saved next = { .periph = xalloc(periph_sz? periph_sz : 1) };
+    unsigned long n = 0;
+    long good_end = ftell(rd.f);
+    for (;;) {
+        memcpy(scratch, ram, MEM_SIZE);
+        if (!read_one(&rd, &next, scratch)) break;
+        byte *t = ram; ram = scratch; scratch = t;
+        Saved st = sv; sv = next; next = st;
+        good_end = ftell(rd.f);
+        ++n;
+    }
+    fclose(rd.f);
+    if (n == 0) {
+        DIE(1, "--resume file \"%s\" has no complete checkpoints.\n",
+            cfg.resume_file);
+    }
+
+    mem_put(0, ram, MEM_SIZE);
+    theCpu.regs = sv.regs;
+    memcpy(ss, sv.ss, sizeof ss);
+    periph_restore_state(sv.periph);
+    instr_count = sv.instr;
+    frame_count = sv.frames;
+    if (cfg.rewind) rewind_barrier();
+    // Screen memory and the video switches changed under anyone
+    // following the display, with no POKE events to say so.
+    event_fire(EV_DISPLAY_TOUCH);
+    INFO("Resumed from checkpoint %lu of \"%s\", at instruction %ju.\n",
+         n, cfg.resume_file, instr_count);
+
+    free(ram);
+    free(scratch);
+    free(sv.periph);
+    free(next.periph);
+
+    if (appending) {
+        // Carrying on with the same file: drop any partial
+        // checkpoint, and only the changes need adding.
+        if (ftruncate(fileno(ckfile), good_end) != 0) {
+            DIE(1, "Couldn't truncate --checkpoint file \"%s\": %s\n",
+                cfg.checkpoint_file, strerror(errno));
+        }
+        for (size_t i = 0; i != ndirty; ++i) page_dirty[dirty[i]] = false;
+        ndirty = 0;
+    }
+}
+
+void checkpoint_init(void)
+{
+    if (cfg.checkpoint_file == NULL && cfg.resume_file == NULL) return;
+    if (cfg.fuzz_at_set) {
+        DIE(2, "--checkpoint and --resume can't be used with --fuzz-at.\n");
+    }
+    periph_sz = periph_state_size();
+    periph_buf = xalloc(periph_sz? periph_sz : 1);
+    if (cfg.checkpoint_file == NULL) return;
+
+    appending = cfg.resume_file != NULL
+        && same_file(cfg.resume_file, cfg.checkpoint_file);
+    ckfile = fopen(cfg.checkpoint_file, appending? "ab" : "wb");
+    if (ckfile == NULL) {
+        DIE(1, "Couldn't open --checkpoint file \"%s\": %s\n",
+            cfg.checkpoint_file, strerror(errno));
+    }
+    if (!appending) {
+        size_t len = strlen(default_romfname);
+        put_bytes(FILE_MAGIC, 8);
+        put_uint(FILE_VERSION, 1);
+        put_uint(len, 1);
+        put_bytes(default_romfname, len);
+    }
+    mark_all();
+    clock_gettime(CLOCK_MONOTONIC, &last_taken);
+    event_reghandler_flags(checkpoint_event, EVH_FRAME);
+}
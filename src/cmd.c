@@ -23,20 +23,26 @@ m\n\
     invoke the Apple ][ monitor.\n\
 disk NUM { eject | load PATH }.\n\
     Eject or load a disk image.\n\
+screenshot PATH\n\
+    save the graphics display (PPM if PATH ends in .ppm).\n\
 ";
 
 static const char SAVE_RAM_STR[] = "save-ram ";
+static const char SCREENSHOT_STR[] = "screenshot ";
 static const char DISK_STR[] = "disk ";
 static const char LOAD_STR[] = "load ";
 
 bool command_do(const char *line, printer pr)
 {
+    const char *orig_line = line;
     bool handled = true;
+    bool changes_machine = false; // for --record
 #define HAVE(s) (STREQ(line,(s)))
     if (HAVE("m")) {
         // Swap ourselves out for the built-in Apple II system
         // monitor!
         pr("Switching to monitor.\n");
+        changes_machine = true;
         // Behave as if it were a BRK.
         // Push stuff to stack...
         stack_push_sneaky(HI(PC));
@@ -50,6 +56,7 @@ bool command_do(const char *line, printer pr)
     } else if (HAVE("r") || HAVE("w")) {
         pr("Sending reset.\n");
         event_fire(EV_RESET);
+        changes_machine = true;
     } else if (HAVE("rr")) {
         pr("Sending COLD reset.\n");
         event_fire(EV_RESET);
@@ -60,6 +67,7 @@ bool command_do(const char *line, printer pr)
         // correctly XOR-ed version.
         byte b = peek_sneaky(LOC_SOFTEV+1);
         poke_sneaky(LOC_PWREDUP, b);
+        changes_machine = true;
     } else if (HAVE("^C")) {
         // XXX in future this will be replaced by a "send" command
         // that can do other things besides just ^C. ^? or ^D for
@@ -67,6 +75,7 @@ bool command_do(const char *line, printer pr)
         // Send an interrupt back through to the emulation, and
         // continue.
         sigint_received = 1;
+        changes_machine = true;
     } else if (HAVE("q") || HAVE("quit")) {
         event_fire(EV_UNHOOK);
         printf("Exiting.\n"); // Don't use pr
@@ -95,6 +104,16 @@ bool command_do(const char *line, printer pr)
         pr("Success: saved RAM to file \"%s\".\n", line);
 ramsave_bail:
         if (ramfile != NULL) fclose(ramfile);
+    } else if (!memcmp(line, SCREENSHOT_STR, sizeof(SCREENSHOT_STR)-1)) {
+        line += sizeof(SCREENSHOT_STR)-1;
+        while (*line == ' ') ++line;
+        int err = video_write_frame(line);
+        if (err) {
+            pr("ERR: Could not write screenshot to \"%s\": %s\n",
+               line, strerror(err));
+        } else {
+            pr("Success: saved screenshot to file \"%s\".\n", line);
+        }
     } else if (!memcmp(line, DISK_STR, sizeof(DISK_STR)-1)) {
         line += sizeof(DISK_STR)-1; // skip past command
         while (*line == ' ') ++line; // skip WS
@@ -134,6 +153,7 @@ ramsave_bail:
         // Find subcommand
         if (HAVE("eject")) {
             (void) eject_disk(drive);
+            changes_machine = true;
         } else if (!memcmp(line, LOAD_STR, sizeof(LOAD_STR)-1)) {
             // Disable if I ever have a "safe" mode
             line += sizeof(LOAD_STR)-1;
@@ -142,6 +162,7 @@ ramsave_bail:
             if (err) {
                 pr("ERR: disk: unknown problem inserting disk %s\n", line);
             }
+            changes_machine = true;
         } else {
             pr("ERR: disk: unknown subcommand %s\n", line);
         }
@@ -151,5 +172,6 @@ disk_bail:
         handled = false;
     }
 #undef HAVE
+    if (changes_machine) record_cmd(orig_line);
     return handled;
 }
@@ -24,12 +24,19 @@ Config cfg = {
     .bell = true,
     .turbo = true,
     .simple_input_mode = "apple",
+    .tty_gfx = "auto",
+    .tty_colors = "auto",
     .trace_file = "trace.log",
+    .video_color = "color",
+    .record_video_every = 1,
+    .fuzz_cycles = 1000000,
+    .checkpoint_every = 60,
 };
 
 typedef enum {
     T_BOOL = 0,
     T_STRING_ARG,
+    T_OPT_STRING_ARG,   // argument only given with "=", as --opt=arg
     T_WORD_ARG,
     T_ULONG_ARG,
     T_FN_ARG,
@@ -80,12 +87,28 @@ void do_ram(const char *s);
 struct fnarg ramfn = {do_ram};
 void do_trace_to(const char *s);
 struct fnarg trace_to_fn = {do_trace_to};
+void do_trace_format(const char *s);
+struct fnarg trace_format = {do_trace_format};
 void do_load_basic(const char *s);
 struct fnarg load_basic = {do_load_basic};
 void do_delay_until(const char *s);
 struct fnarg delay_until = {do_delay_until};
 void do_breakpoint(const char *s);
 struct fnarg breakpoint = {do_breakpoint};
+void do_record_video_every(const char *arg);
+struct fnarg record_video_every = {do_record_video_every};
+void do_fuzz_cycles(const char *arg);
+struct fnarg fuzz_cycles = {do_fuzz_cycles};
+void do_cycle_limit(const char *arg);
+struct fnarg cycle_limit = {do_cycle_limit};
+void do_time_limit(const char *arg);
+struct fnarg time_limit = {do_time_limit};
+void do_checkpoint_every(const char *arg);
+struct fnarg checkpoint_every = {do_checkpoint_every};
+void do_card(const char *arg);
+struct fnarg card = {do_card};
+void do_disassemble(const char *arg);
+struct fnarg disassemble = {do_disassemble};
 
 const OptInfo options[] = {
     { VERSION_OPT_NAMES, T_FUNCTION, &version },
@@ -98,6 +121,14 @@ const OptInfo options[] = {
     { MACHINE_OPT_NAMES, T_STRING_ARG, &cfg.machine, &cfg.machine_set },
     { DISK_OPT_NAMES, T_STRING_ARG, &cfg.disk },
     { DISK2_OPT_NAMES, T_STRING_ARG, &cfg.disk2 },
+    { SHARE_NIBBLES_OPT_NAMES, T_BOOL, &cfg.share_nibbles },
+    { HDD_OPT_NAMES, T_STRING_ARG, &cfg.hdd },
+    { HDD2_OPT_NAMES, T_STRING_ARG, &cfg.hdd2 },
+    { HOSTIO_DIR_OPT_NAMES, T_STRING_ARG, &cfg.hostio_dir },
+    { SERIAL_OPT_NAMES, T_STRING_ARG, &cfg.serial },
+    { CARD_OPT_NAMES, T_FN_ARG, &card },
+    { RAMDISK_OPT_NAMES, T_STRING_ARG, &cfg.ramdisk },
+    { RAMDISK_FILE_OPT_NAMES, T_STRING_ARG, &cfg.ramdisk_file },
     { LANG_CARD_OPT_NAMES, T_BOOL, &cfg.lang_card, &cfg.lang_card_set },
     { BELL_OPT_NAMES, T_BOOL, &cfg.bell },
     { TURBO_OPT_NAMES, T_BOOL, &cfg.turbo, &cfg.turbo_was_set },
@@ -112,10 +143,31 @@ const OptInfo options[] = {
     { REMAIN_OPT_NAMES, T_BOOL, &cfg.remain_after_pipe },
     { REMAIN_TTY_OPT_NAMES, T_BOOL, &cfg.remain_tty },
     { SIMPLE_INPUT_OPT_NAMES, T_STRING_ARG, &cfg.simple_input_mode },
+    { TTY_GFX_OPT_NAMES, T_STRING_ARG, &cfg.tty_gfx },
+    { TTY_COLORS_OPT_NAMES, T_STRING_ARG, &cfg.tty_colors },
     { DIE_ON_BRK_OPT_NAMES, T_BOOL, &cfg.die_on_brk },
     { BREAKPOINT_OPT_NAMES, T_FN_ARG, &breakpoint },
+    { REWIND_OPT_NAMES, T_BOOL, &cfg.rewind },
+    { RECORD_OPT_NAMES, T_STRING_ARG, &cfg.record_file },
+    { REPLAY_OPT_NAMES, T_STRING_ARG, &cfg.replay_file },
+    { FUZZ_AT_OPT_NAMES, T_WORD_ARG, &cfg.fuzz_at, &cfg.fuzz_at_set },
+    { FUZZ_INPUT_OPT_NAMES, T_STRING_ARG, &cfg.fuzz_input },
+    { FUZZ_MEM_OPT_NAMES, T_WORD_ARG, &cfg.fuzz_mem, &cfg.fuzz_mem_set },
+    { FUZZ_CYCLES_OPT_NAMES, T_FN_ARG, &fuzz_cycles },
+    { SHM_OPT_NAMES, T_STRING_ARG, &cfg.shm },
+    { DETECT_LOOPS_OPT_NAMES, T_BOOL, &cfg.detect_loops },
+    { CYCLE_LIMIT_OPT_NAMES, T_FN_ARG, &cycle_limit },
+    { TIME_LIMIT_OPT_NAMES, T_FN_ARG, &time_limit },
+    { STALL_DUMP_OPT_NAMES, T_STRING_ARG, &cfg.stall_dump },
+    { CHECKPOINT_OPT_NAMES, T_STRING_ARG, &cfg.checkpoint_file },
+    { CHECKPOINT_EVERY_OPT_NAMES, T_FN_ARG, &checkpoint_every },
+    { RESUME_OPT_NAMES, T_STRING_ARG, &cfg.resume_file },
+    { COSIM_OPT_NAMES, T_OPT_STRING_ARG, &cfg.cosim_engine, &cfg.cosim },
+    { BUS_LOG_OPT_NAMES, T_STRING_ARG, &cfg.bus_log },
+    { BUS_LOG_ONLY_OPT_NAMES, T_STRING_ARG, &cfg.bus_log_only },
     { TRACE_FILE_OPT_NAMES, T_STRING_ARG, &cfg.trace_file },
     { TRACE_TO_OPT_NAMES, T_FN_ARG, &trace_to_fn },
+    { TRACE_FORMAT_OPT_NAMES, T_FN_ARG, &trace_format },
     { TRAP_FAILURE_OPT_NAMES, T_WORD_ARG, &cfg.trap_failure,
         &cfg.trap_failure_on },
     { TRAP_SUCCESS_OPT_NAMES, T_WORD_ARG, &cfg.trap_success,
@@ -124,9 +176,14 @@ const OptInfo options[] = {
         &cfg.trap_print_on },
     { START_AT_OPT_NAMES, T_WORD_ARG, &cfg.start_loc, &cfg.start_loc_set },
     { DELAY_UNTIL_PC_OPT_NAMES, T_FN_ARG, &delay_until, &cfg.delay_set },
-    { WATCH_OPT_NAMES, T_BOOL, &cfg.watch },
+    { SCREENSHOT_OPT_NAMES, T_STRING_ARG, &cfg.screenshot_file },
+    { VIDEO_COLOR_OPT_NAMES, T_STRING_ARG, &cfg.video_color },
+    { RECORD_VIDEO_OPT_NAMES, T_STRING_ARG, &cfg.record_video },
+    { RECORD_VIDEO_EVERY_OPT_NAMES, T_FN_ARG, &record_video_every },
+    { WATCH_OPT_NAMES, T_OPT_STRING_ARG, &cfg.watch_mode, &cfg.watch },
     { TOKENIZE_OPT_NAMES, T_BOOL, &cfg.tokenize },
     { DETOKENIZE_OPT_NAMES, T_BOOL, &cfg.detokenize },
+    { DISASSEMBLE_OPT_NAMES, T_FN_ARG, &disassemble },
 };
 
 static const OptInfo *find_option(const char *opt)
@@ -199,18 +256,21 @@ recheck:// Past this point, can't assume opt points at a real argv[] item
         }
 
         const OptInfo *info = find_option(opt);
+        bool negated = false;
         if (!info && opt[0] == 'n' && opt[1] == 'o') {
             const char *yesopt = opt + 2;
             while (*yesopt == '-') ++yesopt;
             info = find_option(yesopt);
-            if (info->type != T_BOOL)
+            if (info && info->type != T_BOOL
+                && info->type != T_OPT_STRING_ARG)
                 info = NULL;
+            negated = (info != NULL);
         }
         if (!info) DIE(2, "Unknown option \"--%s\".\n", opt);
 
         // Mark the option as set.
         if (info->was_set != NULL)
-            (*info->was_set) = true;
+            (*info->was_set) = !(negated && info->type == T_OPT_STRING_ARG);
 
         switch (info->type) {
             case T_STRING_ARG:
@@ -274,6 +334,15 @@ recheck:// Past this point, can't assume opt points at a real argv[] item
                 (*(const char **)info->arg) = arg;
             }
                 break;
+            case T_OPT_STRING_ARG:
+            {
+                if (negated && arg) {
+                    DIE(2, "Option \"--%s\" doesn't take an argument.\n",
+                        opt);
+                }
+                (*(const char **)info->arg) = arg;
+            }
+                break;
             default:
                 DIE(3, "INTERNAL ERROR: unhandled optiont type for --%s.\n",
                     opt);
@@ -316,7 +385,9 @@ PACKAGE_URL "\n"
 
 void do_help(void)
 {
-    fputs(help_text, stdout);
+    for (const char * const *s = help_text; *s != NULL; ++s) {
+        fputs(*s, stdout);
+    }
     exit(0);
 }
 
@@ -400,6 +471,17 @@ void do_trace_to(const char *arg)
     trace_reg();
 }
 
+void do_trace_format(const char *arg)
+{
+    if (STREQ(arg, "text")) {
+        cfg.trace_binary = false;
+    } else if (STREQ(arg, "binary")) {
+        cfg.trace_binary = true;
+    } else {
+        DIE(2, "--trace-format must be \"text\" or \"binary\".\n");
+    }
+}
+
 void do_load_basic(const char *arg)
 {
     // For right now, fake out as if user had specified some other options.
@@ -430,3 +512,70 @@ void do_breakpoint(const char *arg)
     }
     breakpoint_set(bploc);
 }
+
+void do_record_video_every(const char *arg)
+{
+    char *end;
+    errno = 0;
+    cfg.record_video_every = strtoul(arg, &end, 10);
+    if (errno == ERANGE || errno == EINVAL || end == arg) {
+        DIE(2, "Couldn't parse numeric arg to --record-video-every.\n");
+    }
+    if (*end != '\0') {
+        DIE(2, "Garbage at end of arg to --record-video-every.\n");
+    }
+}
+
+void do_fuzz_cycles(const char *arg)
+{
+    char *end;
+    errno = 0;
+    cfg.fuzz_cycles = strtoul(arg, &end, 10);
+    if (errno == ERANGE || errno == EINVAL || end == arg
+        || cfg.fuzz_cycles == 0) {
+        DIE(2, "Couldn't parse numeric arg to --fuzz-cycles.\n");
+    }
+    if (*end != '\0') {
+        DIE(2, "Garbage at end of arg to --fuzz-cycles.\n");
+    }
+}
+
+void do_cycle_limit(const char *arg)
+{
+    char *end;
+    errno = 0;
+    cfg.cycle_limit = strtoumax(arg, &end, 10);
+    if (errno == ERANGE || errno == EINVAL || end == arg
+        || cfg.cycle_limit == 0) {
+        DIE(2, "Couldn't parse numeric arg to --cycle-limit.\n");
+    }
+    if (*end != '\0') {
+        DIE(2, "Garbage at end of arg to --cycle-limit.\n");
+    }
+}
+
+void do_time_limit(const char *arg)
+{
+    char *end;
+    errno = 0;
+    cfg.time_limit = strtod(arg, &end);
+    if (errno == ERANGE || end == arg || !(cfg.time_limit > 0)) {
+        DIE(2, "Couldn't parse numeric arg to --time-limit.\n");
+    }
+    if (*end != '\0') {
+        DIE(2, "Garbage at end of arg to --time-limit.\n");
+    }
+}
+
+void do_checkpoint_every(const char *arg)
+{
+    char *end;
+    errno = 0;
+    cfg.checkpoint_every = strtod(arg, &end);
+    if (errno == ERANGE || end == arg || !(cfg.checkpoint_every >= 0)) {
+        DIE(2, "Couldn't parse numeric arg to --checkpoint-every.\n");
+    }
+    if (*end != '\0') {
+        DIE(2, "Garbage at end of arg to --checkpoint-every.\n");
+    }
+}
@@ -0,0 +1,189 @@
+//  cosim.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// --cosim: run another CPU engine in lockstep with cpu_step().
+//
+// cpu_step() runs each instruction for real, as usual, while we note
+// every read and write it makes. Then the other engine runs the same
+// instruction, from a copy of the registers as they were before it.
+// Its reads are answered from cpu_step()'s (so that soft switches,
+// cards and the keyboard are each touched only once), and its writes
+// are just collected. If the two don't end up with the same
+// registers, cycle count, and writes (in order), we stop and say how.
+
+// No 6502 instruction makes more than seven accesses, so running out
+// of room means something's gone wrong; that's reported as a
+// divergence too, rather than comparing short lists.
+#define MAX_ACCESSES    16
+
+typedef struct {
+    word    loc;
+    byte    val;
+    bool    used;
+} Access;
+
+static const struct {
+    const char      *name;
+    const CpuEngine *engine;
+} engines[] = {
+    {"table", &tableEngine},
+};
+
+bool cosim_logging;
+
+static const CpuEngine *engine;
+static uintmax_t checked;
+
+static Access ref_reads[MAX_ACCESSES];
+static Access ref_writes[MAX_ACCESSES];
+static Access alt_writes[MAX_ACCESSES];
+static int n_ref_reads, n_ref_writes, n_alt_writes;
+static bool stray;          // engine read somewhere cpu_step() didn't
+static word stray_loc;
+static const char *overflow; // whose accesses ran past MAX_ACCESSES
+
+void cosim_note_read(word loc, byte val)
+{
+    if (n_ref_reads == MAX_ACCESSES) {
+        overflow = "cpu_step()";
+        return;
+    }
+    ref_reads[n_ref_reads++] = (Access){ loc, val, false };
+}
+
+void cosim_note_write(word loc, byte val)
+{
+    if (n_ref_writes == MAX_ACCESSES) {
+        overflow = "cpu_step()";
+        return;
+    }
+    ref_writes[n_ref_writes++] = (Access){ loc, val, false };
+}
+
+static byte bus_read(word loc)
+{
+    for (int i = 0; i != n_ref_reads; ++i) {
+        if (!ref_reads[i].used && ref_reads[i].loc == loc) {
+            ref_reads[i].used = true;
+            return ref_reads[i].val;
+        }
+    }
+    if (!stray) {
+        stray = true;
+        stray_loc = loc;
+    }
+    return peek_sneaky(loc);
+}
+
+static void bus_write(word loc, byte val)
+{
+    if (n_alt_writes == MAX_ACCESSES) {
+        overflow = engine->name;
+        return;
+    }
+    alt_writes[n_alt_writes++] = (Access){ loc, val, false };
+}
+
+static const CpuBus bus = { bus_read, bus_write };
+
+static void cosim_atexit(void)
+{
+    INFO("cosim: %ju instructions matched between cpu_step() and "
+         "\"%s\".\n", checked, engine->name);
+}
+
+void cosim_init(void)
+{
+    if (!cfg.cosim) return;
+
+    const char *name = cfg.cosim_engine? cfg.cosim_engine : "table";
+    for (size_t i = 0; i != sizeof engines / sizeof engines[0]; ++i) {
+        if (STREQ(engines[i].name, name)) engine = engines[i].engine;
+    }
+    if (engine == NULL) {
+        DIE(2, "Unknown --cosim engine \"%s\".\n", name);
+    }
+    if (cfg.rewind || cfg.fuzz_at_set) {
+        DIE(2, "--cosim can't be used with --%s.\n",
+            cfg.rewind? "rewind" : "fuzz-at");
+    }
+    atexit(cosim_atexit);
+}
+
+// (cycles < 0: don't print them.)
+static void print_regs(const char *who, const Registers *r, int cycles)
+{
+    fprintf(stderr, "%-9s PC: %04X  ACC: %02X  X: %02X  Y: %02X  SP: %02X"
+            "  P: %02X", who, r->pc, r->a, r->x, r->y, r->sp, r->p);
+    if (cycles >= 0) fprintf(stderr, "  cycles: %d", cycles);
+    fputc('\n', stderr);
+}
+
+static void print_writes(const char *who, const Access *w, int n)
+{
+    fprintf(stderr, "%-9s writes:", who);
+    if (n == 0) fputs(" (none)", stderr);
+    for (int i = 0; i != n; ++i) {
+        fprintf(stderr, " %04X=%02X", w[i].loc, w[i].val);
+    }
+    fputc('\n', stderr);
+}
+
+static void diverged(const Registers *before, const Registers *alt,
+                     unsigned ref_cycles, unsigned alt_cycles)
+{
+    fputs("*** COSIM DIVERGENCE ***\n", stderr);
+    fprintf(stderr, "Instr #: %ju\n", instr_count);
+    print_disasm(stderr, before->pc, before);
+    print_regs("before:", before, -1);
+    print_regs("cpu_step:", &theCpu.regs, ref_cycles);
+    print_regs(engine->name, alt, alt_cycles);
+    print_writes("cpu_step:", ref_writes, n_ref_writes);
+    print_writes(engine->name, alt_writes, n_alt_writes);
+    if (stray) {
+        fprintf(stderr, "%s read $%04X, which cpu_step() didn't.\n",
+                engine->name, stray_loc);
+    }
+    if (overflow) {
+        fprintf(stderr, "%s made more than %d reads or writes.\n",
+                overflow, MAX_ACCESSES);
+    }
+    exit(5);
+}
+
+void cosim_cpu_step(void)
+{
+    Registers before = theCpu.regs;
+    uintmax_t start = cycle_count;
+
+    n_ref_reads = n_ref_writes = 0;
+    overflow = NULL;
+    cosim_logging = true;
+    cpu_step();
+    cosim_logging = false;
+    unsigned ref_cycles = cycle_count - start;
+
+    Registers alt = before;
+    n_alt_writes = 0;
+    stray = false;
+    unsigned alt_cycles = engine->step(&alt, &bus);
+
+    bool same = !stray && !overflow && ref_cycles == alt_cycles
+        && alt.pc == PC && alt.sp == SP && alt.p == PFLAGS
+        && alt.a == ACC && alt.x == XREG && alt.y == YREG
+        && n_alt_writes == n_ref_writes;
+    for (int i = 0; same && i != n_ref_writes; ++i) {
+        same = alt_writes[i].loc == ref_writes[i].loc
+            && alt_writes[i].val == ref_writes[i].val;
+    }
+    if (!same) diverged(&before, &alt, ref_cycles, alt_cycles);
+    ++checked;
+}
@@ -998,6 +998,7 @@ void cpu_step(void)
         case 0x00: // BRK
         default:   // UNRECOGNIZED OPCODE (treat as BRK)
             {
+                if (cfg.fuzz_at_set) fuzz_brk();
                 if (cfg.die_on_brk) {
                     DIE(0, "%s (--die-on-brk)\n",
                         op == 0? "BRK" : "ILLEGAL OP");
@@ -0,0 +1,573 @@
+//  cputab.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+// A second 6502 core, for --cosim to check against cpu_step().
+//
+// Where cpu_step() is one big switch that works on theCpu, calling
+// peek() and poke() and cycle() as it goes, this one looks each
+// opcode up in a table saying what kind of instruction it is, how it
+// addresses memory, and what it costs; works on a Registers of its
+// own; and reaches memory only through a CpuBus. It does only the
+// reads and writes that matter, not cpu_step()'s dummy ones.
+//
+// It must agree with cpu_step() in everything, cycle counts included,
+// even where cpu_step() differs from a real 6502: indexed zero-page
+// and indexed absolute reads are a cycle short, branches a cycle
+// long, and (zp),y reads don't wrap the pointer's high byte within
+// the zero page.
+
+typedef struct {
+    Registers       r;
+    const CpuBus   *bus;
+    unsigned        cycles;
+} Core;
+
+// What kind of instruction: how its operand gets used.
+enum {
+    K_BRK,      // also any opcode cpu_step() doesn't know
+    K_READ,     // reads memory (or an immediate)
+    K_WRITE,    // stores a register
+    K_RMW,      // read-modify-write (memory, or the accumulator)
+    K_IMPL,     // registers/flags only
+    K_BRANCH,
+    K_SPECIAL,  // stack, jumps and returns
+};
+
+// Addressing modes.
+enum {
+    M_NONE,
+    M_IMM,
+    M_ZP,
+    M_ZPX,
+    M_ZPY,
+    M_ABS,
+    M_ABSX,
+    M_ABSY,
+    M_INDX,
+    M_INDY,
+    M_ACC,
+};
+
+typedef struct {
+    byte    kind;
+    byte    mode;
+    byte    cycles;     // before any page-crossing
+    void    (*read)(Core *c, byte val);
+    byte    (*store)(Core *c);
+    byte    (*rmw)(Core *c, byte val);
+    void    (*impl)(Core *c);
+} Op;
+
+static inline byte rd(Core *c, word loc)
+{
+    return c->bus->read(loc);
+}
+
+static inline void wr(Core *c, word loc, byte val)
+{
+    c->bus->write(loc, val);
+}
+
+static inline void push(Core *c, byte val)
+{
+    wr(c, WORD(c->r.sp--, 0x01), val);
+}
+
+static inline byte pull(Core *c)
+{
+    return rd(c, WORD(++c->r.sp, 0x01));
+}
+
+static inline void setf(Core *c, int flag, bool val)
+{
+    RPPUT(c->r.p, flag, val);
+}
+
+static inline byte nz(Core *c, byte val)
+{
+    setf(c, PZERO, val == 0);
+    setf(c, PNEG, val & 0x80);
+    return val;
+}
+
+/********** operations **********/
+
+static void op_lda(Core *c, byte v) { c->r.a = nz(c, v); }
+static void op_ldx(Core *c, byte v) { c->r.x = nz(c, v); }
+static void op_ldy(Core *c, byte v) { c->r.y = nz(c, v); }
+static void op_ora(Core *c, byte v) { c->r.a = nz(c, c->r.a | v); }
+static void op_and(Core *c, byte v) { c->r.a = nz(c, c->r.a & v); }
+static void op_eor(Core *c, byte v) { c->r.a = nz(c, c->r.a ^ v); }
+static void op_nop_r(Core *c, byte v) { }
+
+static void compare(Core *c, byte reg, byte v)
+{
+    byte diff = reg - v;
+    setf(c, PNEG, diff & 0x80);
+    setf(c, PZERO, diff == 0);
+    setf(c, PCARRY, reg >= v);
+}
+
+static void op_cmp(Core *c, byte v) { compare(c, c->r.a, v); }
+static void op_cpx(Core *c, byte v) { compare(c, c->r.x, v); }
+static void op_cpy(Core *c, byte v) { compare(c, c->r.y, v); }
+
+static void op_bit(Core *c, byte v)
+{
+    setf(c, PNEG, v & 0x80);
+    setf(c, POVERFL, v & 0x40);
+    setf(c, PZERO, (c->r.a & v) == 0);
+}
+
+static void op_adc(Core *c, byte v)
+{
+    byte a = c->r.a;
+    bool carry = RPGET(c->r.p, PCARRY);
+    if (RPTEST(c->r.p, PDEC)) {
+        byte lo = (a & 0xF) + (v & 0xF) + carry;
+        byte hi = (a >> 4) + (v >> 4) + (lo > 9);
+        if (lo > 9) lo += 6;
+        setf(c, PZERO, LO(a + v + carry) == 0);
+        setf(c, PNEG, hi & 0x8);
+        setf(c, POVERFL, (((hi << 4) ^ a) & 0x80) && !((a ^ v) & 0x80));
+        if (hi > 9) hi += 6;
+        setf(c, PCARRY, hi > 9);
+        c->r.a = LO((hi << 4) | (lo & 0xF));
+    } else {
+        word sum = a + v + carry;
+        setf(c, PNEG, sum & 0x80);
+        setf(c, POVERFL, ~(a ^ v) & (a ^ sum) & 0x80);
+        setf(c, PZERO, LO(sum) == 0);
+        setf(c, PCARRY, sum & 0x100);
+        c->r.a = LO(sum);
+    }
+}
+
+static void op_sbc(Core *c, byte v)
+{
+    byte a = c->r.a;
+    bool borrow = !RPGET(c->r.p, PCARRY);
+    word diff = a - v - borrow;
+    // Flags are always as for binary.
+    setf(c, PNEG, diff & 0x80);
+    setf(c, POVERFL, (a ^ v) & (a ^ diff) & 0x80);
+    setf(c, PZERO, LO(diff) == 0);
+    setf(c, PCARRY, !(a < v || (a == v && borrow)));
+    if (RPTEST(c->r.p, PDEC)) {
+        byte lo = (a & 0xF) - (v & 0xF) - borrow;
+        if (lo & 0x10) lo -= 6;
+        byte hi = (a >> 4) - (v >> 4) - ((lo & 0x80) != 0);
+        if (hi & 0x10) hi -= 6;
+        c->r.a = LO((hi << 4) | (lo & 0xF));
+    } else {
+        c->r.a = LO(diff);
+    }
+}
+
+static byte op_sta(Core *c) { return c->r.a; }
+static byte op_stx(Core *c) { return c->r.x; }
+static byte op_sty(Core *c) { return c->r.y; }
+
+static byte op_asl(Core *c, byte v)
+{
+    setf(c, PCARRY, v & 0x80);
+    return nz(c, LO(v << 1));
+}
+
+static byte op_rol(Core *c, byte v)
+{
+    byte in = RPGET(c->r.p, PCARRY);
+    setf(c, PCARRY, v & 0x80);
+    return nz(c, LO(v << 1 | in));
+}
+
+static byte op_lsr(Core *c, byte v)
+{
+    setf(c, PCARRY, v & 0x01);
+    return nz(c, v >> 1);
+}
+
+static byte op_ror(Core *c, byte v)
+{
+    byte in = RPGET(c->r.p, PCARRY);
+    setf(c, PCARRY, v & 0x01);
+    return nz(c, LO(v >> 1 | in << 7));
+}
+
+static byte op_inc(Core *c, byte v) { return nz(c, LO(v + 1)); }
+static byte op_dec(Core *c, byte v) { return nz(c, LO(v - 1)); }
+
+static void op_clc(Core *c) { setf(c, PCARRY, 0); }
+static void op_sec(Core *c) { setf(c, PCARRY, 1); }
+static void op_cli(Core *c) { setf(c, PINT, 0); }
+static void op_sei(Core *c) { setf(c, PINT, 1); }
+static void op_clv(Core *c) { setf(c, POVERFL, 0); }
+static void op_cld(Core *c) { setf(c, PDEC, 0); }
+static void op_sed(Core *c) { setf(c, PDEC, 1); }
+static void op_tax(Core *c) { c->r.x = nz(c, c->r.a); }
+static void op_tay(Core *c) { c->r.y = nz(c, c->r.a); }
+static void op_txa(Core *c) { c->r.a = nz(c, c->r.x); }
+static void op_tya(Core *c) { c->r.a = nz(c, c->r.y); }
+static void op_tsx(Core *c) { c->r.x = nz(c, c->r.sp); }
+static void op_txs(Core *c) { c->r.sp = c->r.x; }
+static void op_inx(Core *c) { c->r.x = nz(c, LO(c->r.x + 1)); }
+static void op_iny(Core *c) { c->r.y = nz(c, LO(c->r.y + 1)); }
+static void op_dex(Core *c) { c->r.x = nz(c, LO(c->r.x - 1)); }
+static void op_dey(Core *c) { c->r.y = nz(c, LO(c->r.y - 1)); }
+static void op_nop(Core *c) { }
+
+// Stack, jumps and returns, each whole; pc is past the opcode.
+static void op_php(Core *c)
+{
+    push(c, c->r.p | PMASK(PUNUSED) | PMASK(PBRK));
+}
+
+static void op_plp(Core *c)
+{
+    c->r.p = (pull(c) & 0xCF) | PMASK(PUNUSED);
+}
+
+static void op_pha(Core *c) { push(c, c->r.a); }
+static void op_pla(Core *c) { c->r.a = nz(c, pull(c)); }
+
+static void op_jsr(Core *c)
+{
+    byte lo = rd(c, c->r.pc++);
+    push(c, HI(c->r.pc));
+    push(c, LO(c->r.pc));
+    c->r.pc = WORD(lo, rd(c, c->r.pc));
+}
+
+static void op_rts(Core *c)
+{
+    byte lo = pull(c);
+    byte hi = pull(c);
+    c->r.pc = WORD(lo, hi) + 1;
+}
+
+static void op_rti(Core *c)
+{
+    op_plp(c);
+    byte lo = pull(c);
+    byte hi = pull(c);
+    c->r.pc = WORD(lo, hi);
+}
+
+static void op_jmp(Core *c)
+{
+    byte lo = rd(c, c->r.pc);
+    c->r.pc = WORD(lo, rd(c, c->r.pc + 1));
+}
+
+static void op_jmp_ind(Core *c)
+{
+    word ptr = WORD(rd(c, c->r.pc), rd(c, c->r.pc + 1));
+    byte lo = rd(c, ptr);
+    // The pointer's high byte comes from the same page.
+    c->r.pc = WORD(lo, rd(c, WORD(LO(ptr + 1), HI(ptr))));
+}
+
+/********** the table **********/
+
+// Cycle counts (as cpu_step() has them), by kind and mode.
+#define CYC_R_M_IMM     2
+#define CYC_R_M_ZP      3
+#define CYC_R_M_ZPX     3
+#define CYC_R_M_ZPY     3
+#define CYC_R_M_ABS     4
+#define CYC_R_M_ABSX    3
+#define CYC_R_M_ABSY    3
+#define CYC_R_M_INDX    6
+#define CYC_R_M_INDY    5
+#define CYC_W_M_ZP      3
+#define CYC_W_M_ZPX     4
+#define CYC_W_M_ZPY     4
+#define CYC_W_M_ABS     4
+#define CYC_W_M_ABSX    5
+#define CYC_W_M_ABSY    5
+#define CYC_W_M_INDX    6
+#define CYC_W_M_INDY    6
+#define CYC_M_M_ACC     2
+#define CYC_M_M_ZP      5
+#define CYC_M_M_ZPX     6
+#define CYC_M_M_ABS     6
+#define CYC_M_M_ABSX    7
+
+#define R(m, fn)    { K_READ, m, CYC_R_##m, .read = fn }
+#define W(m, fn)    { K_WRITE, m, CYC_W_##m, .store = fn }
+#define M(m, fn)    { K_RMW, m, CYC_M_##m, .rmw = fn }
+#define I(fn)       { K_IMPL, M_NONE, 2, .impl = fn }
+#define B(flag, set) { K_BRANCH, flag, set }
+#define S(n, fn)    { K_SPECIAL, M_NONE, n, .impl = fn }
+
+static const Op optab[256] = {
+    [0x01] = R(M_INDX, op_ora),
+    [0x05] = R(M_ZP, op_ora),
+    [0x06] = M(M_ZP, op_asl),
+    [0x08] = S(3, op_php),
+    [0x09] = R(M_IMM, op_ora),
+    [0x0A] = M(M_ACC, op_asl),
+    [0x0D] = R(M_ABS, op_ora),
+    [0x0E] = M(M_ABS, op_asl),
+    [0x10] = B(PNEG, 0),
+    [0x11] = R(M_INDY, op_ora),
+    [0x15] = R(M_ZPX, op_ora),
+    [0x16] = M(M_ZPX, op_asl),
+    [0x18] = I(op_clc),
+    [0x19] = R(M_ABSY, op_ora),
+    [0x1A] = I(op_nop),
+    [0x1D] = R(M_ABSX, op_ora),
+    [0x1E] = M(M_ABSX, op_asl),
+
+    [0x20] = S(6, op_jsr),
+    [0x21] = R(M_INDX, op_and),
+    [0x24] = R(M_ZP, op_bit),
+    [0x25] = R(M_ZP, op_and),
+    [0x26] = M(M_ZP, op_rol),
+    [0x28] = S(4, op_plp),
+    [0x29] = R(M_IMM, op_and),
+    [0x2A] = M(M_ACC, op_rol),
+    [0x2C] = R(M_ABS, op_bit),
+    [0x2D] = R(M_ABS, op_and),
+    [0x2E] = M(M_ABS, op_rol),
+    [0x30] = B(PNEG, 1),
+    [0x31] = R(M_INDY, op_and),
+    [0x35] = R(M_ZPX, op_and),
+    [0x36] = M(M_ZPX, op_rol),
+    [0x38] = I(op_sec),
+    [0x39] = R(M_ABSY, op_and),
+    [0x3D] = R(M_ABSX, op_and),
+    [0x3E] = M(M_ABSX, op_rol),
+
+    [0x40] = S(6, op_rti),
+    [0x41] = R(M_INDX, op_eor),
+    [0x45] = R(M_ZP, op_eor),
+    [0x46] = M(M_ZP, op_lsr),
+    [0x48] = S(3, op_pha),
+    [0x49] = R(M_IMM, op_eor),
+    [0x4A] = M(M_ACC, op_lsr),
+    [0x4C] = S(3, op_jmp),
+    [0x4D] = R(M_ABS, op_eor),
+    [0x4E] = M(M_ABS, op_lsr),
+    [0x50] = B(POVERFL, 0),
+    [0x51] = R(M_INDY, op_eor),
+    [0x55] = R(M_ZPX, op_eor),
+    [0x56] = M(M_ZPX, op_lsr),
+    [0x58] = I(op_cli),
+    [0x59] = R(M_ABSY, op_eor),
+    [0x5D] = R(M_ABSX, op_eor),
+    [0x5E] = M(M_ABSX, op_lsr),
+
+    [0x60] = S(6, op_rts),
+    [0x61] = R(M_INDX, op_adc),
+    [0x65] = R(M_ZP, op_adc),
+    [0x66] = M(M_ZP, op_ror),
+    [0x68] = S(4, op_pla),
+    [0x69] = R(M_IMM, op_adc),
+    [0x6A] = M(M_ACC, op_ror),
+    [0x6C] = S(5, op_jmp_ind),
+    [0x6D] = R(M_ABS, op_adc),
+    [0x6E] = M(M_ABS, op_ror),
+    [0x70] = B(POVERFL, 1),
+    [0x71] = R(M_INDY, op_adc),
+    [0x75] = R(M_ZPX, op_adc),
+    [0x76] = M(M_ZPX, op_ror),
+    [0x78] = I(op_sei),
+    [0x79] = R(M_ABSY, op_adc),
+    [0x7D] = R(M_ABSX, op_adc),
+    [0x7E] = M(M_ABSX, op_ror),
+
+    [0x81] = W(M_INDX, op_sta),
+    [0x84] = W(M_ZP, op_sty),
+    [0x85] = W(M_ZP, op_sta),
+    [0x86] = W(M_ZP, op_stx),
+    [0x88] = I(op_dey),
+    [0x8A] = I(op_txa),
+    [0x8C] = W(M_ABS, op_sty),
+    [0x8D] = W(M_ABS, op_sta),
+    [0x8E] = W(M_ABS, op_stx),
+    [0x90] = B(PCARRY, 0),
+    [0x91] = W(M_INDY, op_sta),
+    [0x94] = W(M_ZPX, op_sty),
+    [0x95] = W(M_ZPX, op_sta),
+    [0x96] = W(M_ZPY, op_stx),
+    [0x98] = I(op_tya),
+    [0x99] = W(M_ABSY, op_sta),
+    [0x9A] = I(op_txs),
+    [0x9D] = W(M_ABSX, op_sta),
+
+    [0xA0] = R(M_IMM, op_ldy),
+    [0xA1] = R(M_INDX, op_lda),
+    [0xA2] = R(M_IMM, op_ldx),
+    [0xA4] = R(M_ZP, op_ldy),
+    [0xA5] = R(M_ZP, op_lda),
+    [0xA6] = R(M_ZP, op_ldx),
+    [0xA8] = I(op_tay),
+    [0xA9] = R(M_IMM, op_lda),
+    [0xAA] = I(op_tax),
+    [0xAC] = R(M_ABS, op_ldy),
+    [0xAD] = R(M_ABS, op_lda),
+    [0xAE] = R(M_ABS, op_ldx),
+    [0xB0] = B(PCARRY, 1),
+    [0xB1] = R(M_INDY, op_lda),
+    [0xB4] = R(M_ZPX, op_ldy),
+    [0xB5] = R(M_ZPX, op_lda),
+    [0xB6] = R(M_ZPY, op_ldx),
+    [0xB8] = I(op_clv),
+    [0xB9] = R(M_ABSY, op_lda),
+    [0xBA] = I(op_tsx),
+    [0xBC] = R(M_ABSX, op_ldy),
+    [0xBD] = R(M_ABSX, op_lda),
+    [0xBE] = R(M_ABSY, op_ldx),
+
+    [0xC0] = R(M_IMM, op_cpy),
+    [0xC1] = R(M_INDX, op_cmp),
+    [0xC2] = R(M_IMM, op_nop_r),
+    [0xC4] = R(M_ZP, op_cpy),
+    [0xC5] = R(M_ZP, op_cmp),
+    [0xC6] = M(M_ZP, op_dec),
+    [0xC8] = I(op_iny),
+    [0xC9] = R(M_IMM, op_cmp),
+    [0xCA] = I(op_dex),
+    [0xCC] = R(M_ABS, op_cpy),
+    [0xCD] = R(M_ABS, op_cmp),
+    [0xCE] = M(M_ABS, op_dec),
+    [0xD0] = B(PZERO, 0),
+    [0xD1] = R(M_INDY, op_cmp),
+    [0xD5] = R(M_ZPX, op_cmp),
+    [0xD6] = M(M_ZPX, op_dec),
+    [0xD8] = I(op_cld),
+    [0xD9] = R(M_ABSY, op_cmp),
+    [0xDD] = R(M_ABSX, op_cmp),
+    [0xDE] = M(M_ABSX, op_dec),
+
+    [0xE0] = R(M_IMM, op_cpx),
+    [0xE1] = R(M_INDX, op_sbc),
+    [0xE4] = R(M_ZP, op_cpx),
+    [0xE5] = R(M_ZP, op_sbc),
+    [0xE6] = M(M_ZP, op_inc),
+    [0xE8] = I(op_inx),
+    [0xE9] = R(M_IMM, op_sbc),
+    [0xEA] = I(op_nop),
+    [0xEC] = R(M_ABS, op_cpx),
+    [0xED] = R(M_ABS, op_sbc),
+    [0xEE] = M(M_ABS, op_inc),
+    [0xF0] = B(PZERO, 1),
+    [0xF1] = R(M_INDY, op_sbc),
+    [0xF5] = R(M_ZPX, op_sbc),
+    [0xF6] = M(M_ZPX, op_inc),
+    [0xF8] = I(op_sed),
+    [0xF9] = R(M_ABSY, op_sbc),
+    [0xFD] = R(M_ABSX, op_sbc),
+    [0xFE] = M(M_ABSX, op_inc),
+    // Everything else is K_BRK (0), like 0x00 itself.
+};
+
+// Works out the effective address for mode, taking the operand bytes
+// from pc onward (and leaving pc past them). Adds a cycle for
+// crossing a page, if asked to.
+static word address(Core *c, int mode, bool cross_costs)
+{
+    byte b = rd(c, c->r.pc++);
+    word base, ea;
+    switch (mode) {
+        case M_ZP:
+            return b;
+        case M_ZPX:
+            return LO(b + c->r.x);
+        case M_ZPY:
+            return LO(b + c->r.y);
+        case M_ABS:
+            return WORD(b, rd(c, c->r.pc++));
+        case M_ABSX:
+        case M_ABSY:
+            base = WORD(b, rd(c, c->r.pc++));
+            ea = base + (mode == M_ABSX? c->r.x : c->r.y);
+            if (cross_costs && HI(ea) != HI(base)) ++c->cycles;
+            return ea;
+        case M_INDX:
+            b += c->r.x;
+            return WORD(rd(c, b), rd(c, LO(b + 1)));
+        case M_INDY:
+            // Reads take the high byte from b+1 unwrapped, as
+            //  cpu_step() does; writes wrap it.
+            base = WORD(rd(c, b), rd(c, cross_costs? b + 1 : LO(b + 1)));
+            ea = base + c->r.y;
+            if (cross_costs && HI(ea) != HI(base)) ++c->cycles;
+            return ea;
+        default:
+            return 0;
+    }
+}
+
+static unsigned tab_step(Registers *regs, const CpuBus *bus)
+{
+    Core core = { *regs, bus, 0 };
+    Core *c = &core;
+    byte opcode = rd(c, c->r.pc++);
+    const Op *op = &optab[opcode];
+    c->cycles = op->cycles;
+
+    switch (op->kind) {
+        case K_READ:
+            if (op->mode == M_IMM) {
+                op->read(c, rd(c, c->r.pc++));
+            } else {
+                op->read(c, rd(c, address(c, op->mode, true)));
+            }
+            break;
+        case K_WRITE:
+            {
+                word ea = address(c, op->mode, false);
+                wr(c, ea, op->store(c));
+            }
+            break;
+        case K_RMW:
+            if (op->mode == M_ACC) {
+                c->r.a = op->rmw(c, c->r.a);
+            } else {
+                word ea = address(c, op->mode, false);
+                byte val = rd(c, ea);
+                wr(c, ea, val); // the 6502 writes it back unchanged, first
+                wr(c, ea, op->rmw(c, val));
+            }
+            break;
+        case K_IMPL:
+        case K_SPECIAL:
+            op->impl(c);
+            break;
+        case K_BRANCH:
+            {
+                // (mode holds the flag, and cycles what it must be.)
+                byte off = rd(c, c->r.pc++);
+                c->cycles = 3;
+                if (RPGET(c->r.p, op->mode) == op->cycles) {
+                    word dest = c->r.pc + (word)(int8_t)off;
+                    c->cycles += HI(dest) == HI(c->r.pc)? 1 : 2;
+                    c->r.pc = dest;
+                }
+            }
+            break;
+        default: // K_BRK
+            ++c->r.pc;
+            push(c, HI(c->r.pc));
+            push(c, LO(c->r.pc));
+            push(c, c->r.p | PMASK(PUNUSED) | PMASK(PBRK));
+            c->r.pc = WORD(rd(c, VEC_BRK), rd(c, VEC_BRK + 1));
+            setf(c, PINT, 1);
+            c->cycles = 7;
+    }
+
+    *regs = c->r;
+    return c->cycles;
+}
+
+const CpuEngine tableEngine = {
+    .name = "table",
+    .step = tab_step,
+};
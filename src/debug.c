@@ -16,6 +16,7 @@ struct Breakpoint {
     word loc;
     bool is_watchpoint;
     byte val;
+    byte rc_val; // for "rc"
     bool enabled;
     Breakpoint *next;
 };
@@ -149,6 +150,120 @@ static inline void bp_enable(int num)
     printf("ERR: no such breakpoint #%d.\n", num);
 }
 
+static void sync_watchpoints(void)
+{
+    for (Breakpoint *bp = bp_head; bp != NULL; bp = bp->next) {
+        if (bp->is_watchpoint) {
+            bp->val = peek_sneaky(bp->loc);
+        }
+    }
+}
+
+// Called after moving back in time.
+static void rewound(bool *loop)
+{
+    // Watchpoints fire when the value changes from what it is now.
+    sync_watchpoints();
+    // If the PC moved, leave so the main loop can catch up with it
+    // (we'll be right back, since we're still debugging).
+    if (PC != current_pc()) *loop = false;
+}
+
+static int rc_hit;
+static byte rc_old, rc_new;
+
+static void rc_begin(void)
+{
+    for (Breakpoint *bp = bp_head; bp != NULL; bp = bp->next) {
+        if (bp->is_watchpoint) {
+            bp->rc_val = peek_sneaky(bp->loc);
+        }
+    }
+}
+
+static bool rc_match(void)
+{
+    bool hit = false;
+    Breakpoint *bp;
+    int i;
+    for (bp = bp_head, i = 1; bp != NULL; ++i, bp = bp->next) {
+        if (!bp->enabled) continue;
+        if (bp->is_watchpoint) {
+            byte val = peek_sneaky(bp->loc);
+            if (val != bp->rc_val) {
+                rc_hit = i;
+                rc_old = bp->rc_val;
+                rc_new = val;
+                bp->rc_val = val;
+                hit = true;
+            }
+        } else if (PC == bp->loc) {
+            rc_hit = i;
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+static void reverse_continue(bool *loop)
+{
+    if (!rewind_search(rc_begin, rc_match)) {
+        fputs("No breakpoint or watchpoint was reached, as far back as"
+              " history goes.\n", stdout);
+        return;
+    }
+    Breakpoint *bp;
+    int i;
+    for (bp = bp_head, i = 1; i != rc_hit; ++i, bp = bp->next) {}
+    if (bp->is_watchpoint) {
+        printf("Watchpoint %d fired:\n", i);
+        printf("Value changed at $%04X ($%02X -> $%02X).\n",
+               (unsigned int)(bp->loc), (unsigned int)rc_old,
+               (unsigned int)rc_new);
+    } else {
+        printf("Breakpoint %d at $%04X.\n", i, (unsigned int)PC);
+    }
+    rewound(loop);
+}
+
+static void step_back(const char *arg, bool *loop)
+{
+    unsigned long n = 1;
+    if (*arg != '\0') {
+        char *end;
+        n = strtoul(arg, &end, 10);
+        if (end == arg || *end != '\0' || n == 0) {
+            fputs("ERR: Garbage at end of 'bs' command.\n", stdout);
+            return;
+        }
+    }
+    if (!rewind_back(n)) {
+        printf("ERR: history only goes back %ju instructions.\n",
+               rewind_available());
+        return;
+    }
+    rewound(loop);
+}
+
+static void last_write(const char *arg, bool *loop)
+{
+    char *end;
+    unsigned long loc = strtoul(arg, &end, 16);
+    if (end == arg || *end != '\0' || loc > 0xFFFF) {
+        fputs("ERR: Garbage at end of 'lw' command.\n", stdout);
+        return;
+    }
+    uintmax_t before = instr_count;
+    if (!rewind_last_write(loc)) {
+        printf("$%04X wasn't written, as far back as history goes.\n",
+               (unsigned int)loc);
+        return;
+    }
+    printf("$%04X was last written %ju instructions ago, at $%04X.\n",
+           (unsigned int)loc, before - instr_count, (unsigned int)PC);
+    rewound(loop);
+}
+
 static inline void preface_read(word loc)
 {
     printf("\n%04X:", loc);
@@ -346,6 +461,17 @@ void debugger(void)
                 }
                 bp_enable(dest);
             }
+        } else if ((HAVE("bs") || !memcmp(linebuf, "bs ", 3)
+                    || HAVE("rc") || !memcmp(linebuf, "lw ", 3))
+                   && !cfg.rewind) {
+            fputs("ERR: that needs bobbin to be started with --rewind.\n",
+                  stdout);
+        } else if (HAVE("bs") || !memcmp(linebuf, "bs ", 3)) {
+            step_back(linebuf[2]? &linebuf[3] : &linebuf[2], &loop);
+        } else if (HAVE("rc")) {
+            reverse_continue(&loop);
+        } else if (!memcmp(linebuf, "lw ", 3)) {
+            last_write(&linebuf[3], &loop);
         } else if (HAVE("rts")) {
             // Run until stack is two higher than current
             fputs("Continuing until RTS...\n", stdout);
@@ -6,7 +6,14 @@
 
 #include "bobbin-internal.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
 static const char *get_op_mnem(byte op)
 {
@@ -496,6 +503,52 @@ static void print_access(FILE *f, word pc, const Registers *regs,
     }
 }
 
+/********** table-driven opcode info **********/
+
+// How an instruction passes control on.
+#define F_NEXT          0   // to the following instruction
+#define F_STOP          1   // nowhere we can tell (RTS, RTI, BRK, JMP ())
+#define F_JUMP          2   // to its operand (JMP)
+#define F_CALL          3   // to its operand, and (later) the next (JSR)
+#define F_BRANCH        4   // to its operand, or the next
+
+typedef struct {
+    const char *mnem;
+    byte        type;   // T_*, above
+    byte        len;    // including the opcode
+    byte        flow;   // F_*
+    bool        valid;
+} OpInfo;
+
+static OpInfo optab[256];
+
+// Builds optab from the switches above, so that they stay the one
+// place the instruction set is spelled out.
+static void optab_init(void)
+{
+    if (optab[0].mnem != NULL) return;
+    for (int op = 0; op != 256; ++op) {
+        OpInfo *o = &optab[op];
+        o->mnem = get_op_mnem(op);
+        o->type = get_op_type(op);
+        o->len = 1 + n_oprnd[o->type];
+        o->valid = !STREQ(o->mnem, "???");
+        switch (op) {
+            case 0x00: case 0x40: case 0x60: case 0x6C:
+                o->flow = F_STOP;
+                break;
+            case 0x4C:
+                o->flow = F_JUMP;
+                break;
+            case 0x20:
+                o->flow = F_CALL;
+                break;
+            default:
+                o->flow = o->type == T_RELATIVE? F_BRANCH : F_NEXT;
+        }
+    }
+}
+
 word print_disasm(FILE *f, word pc, const Registers *regs)
 {
     byte m[3];
@@ -503,8 +556,9 @@ word print_disasm(FILE *f, word pc, const Registers *regs)
         m[i] = peek_sneaky(pc+i);
     }
 
-    const char *mnem = get_op_mnem(m[0]);
-    int t = get_op_type(m[0]);
+    optab_init();
+    const char *mnem = optab[m[0]].mnem;
+    int t = optab[m[0]].type;
     int n = n_oprnd[t];
 
     fprintf(f, "%04X:  ", pc);
@@ -536,3 +590,429 @@ word print_disasm(FILE *f, word pc, const Registers *regs)
 
     return pc + 1 + n;
 }
+
+/********** --disassemble **********/
+
+// Byte marks, for a file being disassembled.
+#define M_OP            0x01    // starts an instruction
+#define M_ARG           0x02    // operand of an instruction
+#define M_LABEL         0x04    // something jumps to, or reads, here
+
+#define DATA_PER_LINE   8
+// Upper bound on output per byte of input (a one-byte data line,
+//  with its label, is the worst case).
+#define MAX_OUT_PER_BYTE    64
+
+typedef struct {
+    const char *path;
+    word        org;
+    word       *entries;
+    size_t      nentries;
+} DisFile;
+
+static DisFile *disfiles;
+static size_t ndisfiles;
+
+static bool parse_addr(const char *s, const char *end, word *w)
+{
+    if (s != end && *s == '$') ++s;
+    if (s == end) return false;
+    unsigned long v = 0;
+    for (; s != end; ++s) {
+        int d;
+        if (*s >= '0' && *s <= '9') d = *s - '0';
+        else if (*s >= 'a' && *s <= 'f') d = *s - 'a' + 10;
+        else if (*s >= 'A' && *s <= 'F') d = *s - 'A' + 10;
+        else return false;
+        v = v * 16 + d;
+        if (v > 0xFFFF) return false;
+    }
+    *w = v;
+    return true;
+}
+
+void do_disassemble(const char *arg)
+{
+    const char *at = strrchr(arg, '@');
+    if (at == NULL || at == arg) {
+        DIE(2, "--disassemble argument must be FILE@ADDR[,ENTRY...].\n");
+    }
+    DisFile df = {0};
+    char *path = xalloc(at - arg + 1);
+    memcpy(path, arg, at - arg);
+    path[at - arg] = '\0';
+    df.path = path;
+
+    const char *s = at + 1;
+    const char *comma = strchr(s, ',');
+    if (!parse_addr(s, comma? comma : strchr(s, '\0'), &df.org)) {
+        DIE(2, "Bad load address in --disassemble %s.\n", arg);
+    }
+    while (comma) {
+        s = comma + 1;
+        comma = strchr(s, ',');
+        word w;
+        if (!parse_addr(s, comma? comma : strchr(s, '\0'), &w)) {
+            DIE(2, "Bad entry point in --disassemble %s.\n", arg);
+        }
+        df.entries = realloc(df.entries, (df.nentries + 1) * sizeof w);
+        if (df.entries == NULL) DIE(1, "realloc: %s\n", strerror(errno));
+        df.entries[df.nentries++] = w;
+    }
+
+    disfiles = realloc(disfiles, (ndisfiles + 1) * sizeof df);
+    if (disfiles == NULL) DIE(1, "realloc: %s\n", strerror(errno));
+    disfiles[ndisfiles++] = df;
+}
+
+bool disasm_requested(void)
+{
+    return ndisfiles != 0;
+}
+
+typedef struct {
+    const byte *buf;
+    size_t      size;
+    word        org;
+    byte       *mark;
+    word       *todo;
+    size_t      ntodo;
+} Dis;
+
+static inline bool dis_has(const Dis *d, word addr)
+{
+    return addr >= d->org && (size_t)(addr - d->org) < d->size;
+}
+
+static void dis_push(Dis *d, word addr)
+{
+    if (!dis_has(d, addr)) return;
+    d->mark[addr - d->org] |= M_LABEL;
+    d->todo[d->ntodo++] = addr;
+}
+
+static word operand_target(const OpInfo *o, word pc, const byte *a)
+{
+    if (o->type == T_RELATIVE) {
+        word offset = a[0];
+        if (offset & 0x80) offset |= 0xFF00;
+        return pc + 2 + offset;
+    }
+    return WORD(a[0], a[1]);
+}
+
+static bool refers_abs(const OpInfo *o)
+{
+    return o->type == T_ABSOLUTE || o->type == T_ABS_X
+        || o->type == T_ABS_Y || o->type == T_JMP_IND
+        || o->type == T_RELATIVE;
+}
+
+// Follows code from addr, until it stops or runs into something
+// that isn't (or can't be) a fresh instruction.
+static void dis_trace(Dis *d, word addr)
+{
+    while (dis_has(d, addr)) {
+        size_t i = addr - d->org;
+        if (d->mark[i] & (M_OP | M_ARG)) return;
+        const OpInfo *o = &optab[d->buf[i]];
+        if (!o->valid || i + o->len > d->size) return;
+        for (int j = 1; j != o->len; ++j) {
+            if (d->mark[i + j] & (M_OP | M_ARG)) return;
+        }
+        d->mark[i] |= M_OP;
+        for (int j = 1; j != o->len; ++j) d->mark[i + j] |= M_ARG;
+
+        if (refers_abs(o)) {
+            word t = operand_target(o, addr, &d->buf[i + 1]);
+            if (o->flow == F_NEXT || o->type == T_JMP_IND) {
+                // Data it reads (or the vector it jumps through).
+                if (dis_has(d, t)) d->mark[t - d->org] |= M_LABEL;
+            } else {
+                dis_push(d, t);
+            }
+        }
+        if (o->flow == F_STOP || o->flow == F_JUMP) return;
+        addr += o->len;
+    }
+}
+
+static const char hexdig[] = "0123456789ABCDEF";
+
+static inline char *put_hex2(char *p, byte b)
+{
+    *p++ = hexdig[b >> 4];
+    *p++ = hexdig[b & 0xF];
+    return p;
+}
+
+static inline char *put_hex4(char *p, word w)
+{
+    return put_hex2(put_hex2(p, HI(w)), LO(w));
+}
+
+static inline char *put_str(char *p, const char *s)
+{
+    while (*s) *p++ = *s++;
+    return p;
+}
+
+static inline char *put_label(char *p, word w)
+{
+    *p++ = 'L';
+    return put_hex4(p, w);
+}
+
+// A label can only go at the start of a line: not inside an instruction.
+static inline bool dis_labelled(const Dis *d, word addr)
+{
+    if (!dis_has(d, addr)) return false;
+    byte m = d->mark[addr - d->org];
+    return (m & M_LABEL) && !(m & M_ARG);
+}
+
+static char *put_operand(char *p, const Dis *d, const OpInfo *o, word pc,
+                         const byte *a)
+{
+    word t = refers_abs(o)? operand_target(o, pc, a) : 0;
+    bool lab = refers_abs(o) && dis_labelled(d, t);
+    switch (o->type) {
+        case T_INDX:
+            p = put_str(p, "($");
+            p = put_hex2(p, a[0]);
+            return put_str(p, ",x)");
+        case T_ZP:
+            *p++ = '$';
+            return put_hex2(p, a[0]);
+        case T_IMMEDIATE:
+            p = put_str(p, "#$");
+            return put_hex2(p, a[0]);
+        case T_INDY:
+            p = put_str(p, "($");
+            p = put_hex2(p, a[0]);
+            return put_str(p, "),y");
+        case T_ZP_X:
+        case T_ZP_Y:
+            *p++ = '$';
+            p = put_hex2(p, a[0]);
+            return put_str(p, o->type == T_ZP_X? ",x" : ",y");
+        case T_JMP_IND:
+            *p++ = '(';
+            p = lab? put_label(p, t) : put_hex4(put_str(p, "$"), t);
+            *p++ = ')';
+            return p;
+        case T_ABSOLUTE:
+        case T_ABS_X:
+        case T_ABS_Y:
+        case T_RELATIVE:
+            p = lab? put_label(p, t) : put_hex4(put_str(p, "$"), t);
+            if (o->type == T_ABS_X) p = put_str(p, ",x");
+            if (o->type == T_ABS_Y) p = put_str(p, ",y");
+            return p;
+        default:
+            return p;
+    }
+}
+
+// Start of a line: address, then label (if any) or blanks.
+//  "0300:  A9 C1     L0300  LDA #$C1"
+static char *put_line_start(char *p, const Dis *d, word addr,
+                            const byte *bytes, int n)
+{
+    p = put_hex4(p, addr);
+    p = put_str(p, ":  ");
+    for (int i = 0; i != 3; ++i) {
+        if (i < n) {
+            p = put_hex2(p, bytes[i]);
+            *p++ = ' ';
+        } else {
+            p = put_str(p, "   ");
+        }
+    }
+    if (dis_labelled(d, addr)) {
+        p = put_label(put_str(p, " "), addr);
+        p = put_str(p, "  ");
+    } else {
+        p = put_str(p, "        ");
+    }
+    return p;
+}
+
+// Writes the listing of d into out (which must have room for
+// MAX_OUT_PER_BYTE per byte), returning the end of it.
+static char *dis_format(const Dis *d, char *p)
+{
+    size_t i = 0;
+    while (i != d->size) {
+        word addr = d->org + i;
+        const byte *b = &d->buf[i];
+        if (d->mark[i] & M_OP) {
+            const OpInfo *o = &optab[b[0]];
+            p = put_line_start(p, d, addr, b, o->len);
+            p = put_str(p, o->mnem);
+            if (o->len > 1 || o->type != T_IMPLIED) *p++ = ' ';
+            p = put_operand(p, d, o, addr, &b[1]);
+            i += o->len;
+        } else {
+            // Data, up to the next instruction or label.
+            size_t n = 1;
+            while (n != DATA_PER_LINE && i + n != d->size
+                   && !(d->mark[i + n] & M_OP) && !dis_labelled(d, addr + n))
+                ++n;
+            p = put_line_start(p, d, addr, NULL, 0);
+            p = put_str(p, ".BYTE ");
+            for (size_t j = 0; j != n; ++j) {
+                if (j != 0) *p++ = ',';
+                *p++ = '$';
+                p = put_hex2(p, b[j]);
+            }
+            i += n;
+        }
+        *p++ = '\n';
+    }
+    return p;
+}
+
+// Disassembles one file into a freshly-allocated buffer.
+static char *disasm_one(const DisFile *df, size_t *outlen)
+{
+    byte *buf;
+    size_t size = 0;
+    int err = mmapfile(df->path, &buf, &size, O_RDONLY);
+    if (err != 0) {
+        DIE(1, "Couldn't read \"%s\": %s\n", df->path, strerror(err));
+    }
+    if (size > 0x10000 - df->org) {
+        DIE(1, "\"%s\" (%zu bytes) doesn't fit in memory at $%04X.\n",
+            df->path, size, (unsigned)df->org);
+    }
+
+    Dis d = { .buf = buf, .size = size, .org = df->org };
+    d.mark = xalloc(size);
+    memset(d.mark, 0, size);
+    // Each instruction queues at most one address.
+    d.todo = xalloc((size + df->nentries + 4) * sizeof *d.todo);
+
+    // Where to start: the given entry points, or the load address;
+    // and for an image of the top of memory (a ROM), its vectors.
+    for (size_t i = 0; i != df->nentries; ++i) dis_push(&d, df->entries[i]);
+    bool rom = (size_t)df->org + size == 0x10000 && size >= 6;
+    if (df->nentries == 0 && !rom) dis_push(&d, df->org);
+    if (rom) {
+        for (word v = 0xFFFA; v != 0; v += 2) {
+            const byte *vec = &buf[v - df->org];
+            dis_push(&d, WORD(vec[0], vec[1]));
+        }
+    }
+    while (d.ntodo != 0) {
+        dis_trace(&d, d.todo[--d.ntodo]);
+    }
+
+    size_t room = size * MAX_OUT_PER_BYTE + strlen(df->path) + 32;
+    char *out = xalloc(room);
+    char *p = out;
+    if (ndisfiles > 1) {
+        p = put_str(p, "; ");
+        p = put_str(p, df->path);
+        p = put_str(p, " @ $");
+        p = put_hex4(p, df->org);
+        *p++ = '\n';
+    }
+    p = dis_format(&d, p);
+    *outlen = p - out;
+
+    free(d.todo);
+    free(d.mark);
+    munmap(buf, size);
+    return out;
+}
+
+static bool write_all(int fd, const char *p, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += w;
+        n -= w;
+    }
+    return true;
+}
+
+typedef struct {
+    pid_t   pid;
+    int     fd;
+} Worker;
+
+// Copies a worker's listing to stdout, in order, and reaps it.
+static bool finish_worker(Worker *w)
+{
+    char buf[65536];
+    bool ok = true;
+    ssize_t n;
+    while ((n = read(w->fd, buf, sizeof buf)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        if (!write_all(STDOUT_FILENO, buf, n)) ok = false;
+    }
+    close(w->fd);
+    int status;
+    while (waitpid(w->pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Disassembles every --disassemble file, and exits. With more than
+// one, each is done in its own process (as many at a time as there
+// are CPUs); the listings still come out in the order given.
+void disasm_run(void)
+{
+    optab_init();
+    fflush(stdout);
+
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ndisfiles == 1 || ncpu <= 1) {
+        for (size_t i = 0; i != ndisfiles; ++i) {
+            size_t len;
+            char *out = disasm_one(&disfiles[i], &len);
+            if (!write_all(STDOUT_FILENO, out, len)) {
+                DIE(1, "write: %s\n", strerror(errno));
+            }
+            free(out);
+        }
+        exit(0);
+    }
+
+    Worker *workers = xalloc(ndisfiles * sizeof *workers);
+    size_t next = 0, running = 0;
+    bool ok = true;
+    for (size_t i = 0; i != ndisfiles; ++i) {
+        if (running == (size_t)ncpu) {
+            ok = finish_worker(&workers[next++]) && ok;
+            --running;
+        }
+        int fds[2];
+        if (pipe(fds) < 0) DIE(1, "pipe: %s\n", strerror(errno));
+        pid_t pid = fork();
+        if (pid < 0) {
+            DIE(1, "fork: %s\n", strerror(errno));
+        } else if (pid == 0) {
+            close(fds[0]);
+            size_t len;
+            char *out = disasm_one(&disfiles[i], &len);
+            _exit(write_all(fds[1], out, len)? 0 : 1);
+        }
+        close(fds[1]);
+        workers[i] = (Worker){ pid, fds[0] };
+        ++running;
+    }
+    while (next != ndisfiles) {
+        ok = finish_worker(&workers[next++]) && ok;
+    }
+    exit(ok? 0 : 1);
+}
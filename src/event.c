@@ -86,6 +86,7 @@ void frame_timer_countdown(void)
 
 struct handler {
     event_handler fn;
+    unsigned int flags;
     struct handler *next;
 };
 
@@ -102,14 +103,20 @@ void events_init(void)
     hooks_init();
 }
 
-void event_reghandler(event_handler fn)
+void event_reghandler_flags(event_handler fn, unsigned int flags)
 {
     struct handler *h = xalloc(sizeof *h);
     h->fn = fn;
+    h->flags = flags;
     h->next = head;
     head = h;
 }
 
+void event_reghandler(event_handler fn)
+{
+    event_reghandler_flags(fn, 0);
+}
+
 void event_unreghandler(event_handler h)
 {
     // XXX Currently unimplemented
@@ -131,6 +138,10 @@ void dispatch(Event *e)
                 h->fn(e);
             }
         } while (pc != PC);
+    } else if (e->type == EV_FRAME) {
+        for (h = head; h != NULL; h = h->next) {
+            if (h->flags & EVH_FRAME) h->fn(e);
+        }
     } else {
         for (h = head; h != NULL; h = h->next) {
             h->fn(e);
@@ -140,13 +151,13 @@ void dispatch(Event *e)
 
 static bool for_iface_only(EventType t)
 {
-    return (t == EV_UNHOOK || t == EV_REHOOK || t == EV_DISPLAY_TOUCH);
+    return (t == EV_UNHOOK || t == EV_REHOOK);
 }
 
 void event_fire(EventType type)
 {
-    Event *e = xalloc(sizeof *e);
-    *e = evinit;
+    Event ev = evinit;
+    Event *e = &ev;
     e->type = type;
 
     // special handling
@@ -170,7 +181,7 @@ void event_fire(EventType type)
 
     iface_fire(e);
 
-    if (!(e->type == EV_FRAME || e->type == EV_CYCLE // dispatched specially
+    if (!(e->type == EV_CYCLE // not currently sent
           || for_iface_only(e->type))) {
         dispatch(e);
     }
@@ -183,13 +194,12 @@ void event_fire(EventType type)
         assert(PC == current_pc());
     }
 
-    free(e);
 }
 
 int event_fire_peek(word loc)
 {
-    Event *e = xalloc(sizeof *e);
-    *e = evinit;
+    Event ev = evinit;
+    Event *e = &ev;
     e->type = EV_PEEK;
     e->loc = loc;
     size_t bufloc; // throw-away
@@ -201,14 +211,13 @@ int event_fire_peek(word loc)
     dispatch(e);
     assert(pc == PC);
     int val = e->val;
-    free(e);
     return val;
 }
 
 bool event_fire_poke(word loc, byte val)
 {
-    Event *e = xalloc(sizeof *e);
-    *e = evinit;
+    Event ev = evinit;
+    Event *e = &ev;
     e->type = EV_POKE;
     e->loc = loc;
     size_t bufloc; // throw-away
@@ -221,29 +230,26 @@ bool event_fire_poke(word loc, byte val)
     dispatch(e);
     assert(pc == PC);
     bool suppress = e->suppress;
-    free(e);
     return suppress;
 }
 
 void event_fire_disk_active(int val)
 {
-    Event *e = xalloc(sizeof *e);
-    *e = evinit;
+    Event ev = evinit;
+    Event *e = &ev;
     e->type = EV_DISK_ACTIVE;
     e->val = val;
 
     iface_fire(e);
-    free(e);
 }
 
 void event_fire_switch(SoftSwitchFlagPos f)
 {
-    Event *e = xalloc(sizeof *e);
-    *e = evinit;
+    Event ev = evinit;
+    Event *e = &ev;
     e->type = EV_SWITCH;
     e->val = f;
 
     iface_fire(e);
     dispatch(e);
-    free(e);
 }
@@ -6,16 +6,219 @@
 
 #include "bobbin-internal.h"
 
+#include <errno.h>
 #include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 static const size_t nib_disksz = 232960;
 static const size_t dsk_disksz = 143360;
 
 extern DiskFormatDesc nib_insert(const char*, byte *, size_t);
 extern DiskFormatDesc dsk_insert(const char *, byte *, size_t);
+extern bool woz_detect(const byte *, size_t);
+extern DiskFormatDesc woz_insert(const char *, byte *, size_t);
 extern DiskFormatDesc empty_disk_desc;
 
+#ifdef HAVE_ZLIB
+// Images read from gzip files live in anonymous mappings; syncing
+// one compresses it back into a fresh copy of its file. Floppy images
+// inflate in a millisecond or so, so there's nothing to gain by
+// inflating only the tracks actually used.
+struct gzimage {
+    struct gzimage *next;
+    char *path;
+    byte *buf;
+    size_t sz;
+    uLong crc;      // of the contents as last read or written
+};
+static struct gzimage *gzimages;
+
+static struct gzimage **find_gz(const byte *buf)
+{
+    struct gzimage **gp = &gzimages;
+    while (*gp != NULL && (*gp)->buf != buf) gp = &(*gp)->next;
+    return gp;
+}
+
+static int gz_sync(struct gzimage *g)
+{
+    uLong crc = crc32(0, g->buf, g->sz);
+    if (crc == g->crc) return 0;
+
+    // Compress into a new file beside the old one and rename it over,
+    // so a failed or interrupted write can't lose the image.
+    struct stat st;
+    errno = 0;
+    if (stat(g->path, &st) < 0) return errno;
+    if (access(g->path, W_OK) < 0) return errno;
+    char *tmp = xalloc(strlen(g->path) + sizeof ".XXXXXX");
+    sprintf(tmp, "%s.XXXXXX", g->path);
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        int err = errno;
+        free(tmp);
+        return err;
+    }
+    (void) fchmod(fd, st.st_mode & 07777);
+    gzFile f = gzdopen(fd, "wb");
+    if (f == NULL) {
+        close(fd);
+        unlink(tmp);
+        free(tmp);
+        return ENOMEM;
+    }
+    int err = 0;
+    if (gzwrite(f, g->buf, g->sz) != (int)g->sz) {
+        (void) gzerror(f, &err);
+        err = err == Z_ERRNO? errno : EIO;
+    }
+    errno = 0;
+    if (gzclose(f) != Z_OK && err == 0) {
+        err = errno? errno : EIO;
+    }
+    if (err == 0 && rename(tmp, g->path) < 0) err = errno;
+    if (err != 0) {
+        unlink(tmp);
+    } else {
+        g->crc = crc;
+    }
+    free(tmp);
+    return err;
+}
+
+static void gz_sync_all(void)
+{
+    // Anything written since the motor last stopped.
+    for (struct gzimage *g = gzimages; g != NULL; g = g->next) {
+        int err = gz_sync(g);
+        if (err != 0) {
+            WARN("Couldn't sync to disk file %s: %s\n",
+                 g->path, strerror(err));
+        }
+    }
+}
+
+static const char *gz_inflate(const char *path, const byte *zbuf,
+                              size_t zsz, byte **buf, size_t *sz)
+{
+    // The gzip trailer gives the size of the contents, so they can
+    // be inflated straight into a mapping of the right size.
+    if (zsz < 18) return "truncated gzip file";
+    const byte *t = zbuf + zsz - 4;
+    size_t isz = t[0] | (t[1] << 8) | ((size_t)t[2] << 16)
+        | ((size_t)t[3] << 24);
+    if (isz == 0) return "empty gzip file";
+
+    errno = 0;
+    byte *out = mmap(NULL, isz, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (out == MAP_FAILED) return strerror(errno);
+
+    z_stream zs = { 0 };
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) {
+        (void) munmap(out, isz);
+        return "couldn't start decompressing";
+    }
+    zs.next_in = (Bytef *)zbuf;
+    zs.avail_in = zsz;
+    zs.next_out = out;
+    zs.avail_out = isz;
+    int zerr = inflate(&zs, Z_FINISH);
+    bool ok = zerr == Z_STREAM_END && zs.total_out == isz;
+    (void) inflateEnd(&zs);
+    if (!ok) {
+        (void) munmap(out, isz);
+        return "bad (or multi-part) gzip data";
+    }
+
+    struct gzimage *g = xalloc(sizeof *g);
+    size_t len = strlen(path) + 1;
+    g->path = xalloc(len);
+    memcpy(g->path, path, len);
+    g->buf = out;
+    g->sz = isz;
+    g->crc = crc32(0, out, isz);
+    if (gzimages == NULL) atexit(gz_sync_all);
+    g->next = gzimages;
+    gzimages = g;
+
+    *buf = out;
+    *sz = isz;
+    return NULL;
+}
+#endif // HAVE_ZLIB
+
+// Maps the image at path, inflating it first if it's gzipped. Returns
+// NULL, or else what went wrong.
+static const char *map_image(const char *path, byte **buf, size_t *sz)
+{
+    int err = mmapfile(path, buf, sz, O_RDWR);
+    if (*buf == NULL) return strerror(err);
+    if (*sz < 2 || (*buf)[0] != 0x1F || (*buf)[1] != 0x8B) return NULL;
+
+    byte *zbuf = *buf;
+    size_t zsz = *sz;
+    *buf = NULL;
+#ifdef HAVE_ZLIB
+    const char *msg = gz_inflate(path, zbuf, zsz, buf, sz);
+#else
+    const char *msg = "gzipped, but bobbin was built without zlib";
+#endif
+    (void) munmap(zbuf, zsz);
+    return msg;
+}
+
+static void release_image(byte *buf, size_t sz)
+{
+#ifdef HAVE_ZLIB
+    struct gzimage **gp = find_gz(buf);
+    if (*gp != NULL) {
+        struct gzimage *g = *gp;
+        *gp = g->next;
+        free(g->path);
+        free(g);
+    }
+#endif
+    (void) munmap(buf, sz);
+}
+
+int disk_image_sync(byte *buf, size_t sz)
+{
+#ifdef HAVE_ZLIB
+    struct gzimage *g = *find_gz(buf);
+    if (g != NULL) return gz_sync(g);
+#endif
+    errno = 0;
+    return msync(buf, sz, MS_SYNC) < 0? errno : 0;
+}
+
+void disk_image_unmap(byte *buf, size_t sz)
+{
+    int err = disk_image_sync(buf, sz);
+    if (err != 0) {
+        WARN("Couldn't sync disk image: %s\n", strerror(err));
+    }
+    release_image(buf, sz);
+}
+
+bool disk_image_has_ext(const char *path, const char *ext)
+{
+    size_t plen = strlen(path);
+    if (plen > 3 && STREQCASE(path + plen - 3, ".gz")) plen -= 3;
+    size_t elen = strlen(ext);
+    return plen > elen && path[plen - elen - 1] == '.'
+        && strncasecmp(path + plen - elen, ext, elen) == 0;
+}
+
 DiskFormatDesc disk_format_load(const char *path)
 {
     if (path == NULL) {
@@ -23,12 +226,13 @@ DiskFormatDesc disk_format_load(const char *path)
     }
     byte *buf;
     size_t sz;
-    int err = mmapfile(path, &buf, &sz, O_RDWR);
-    if (buf == NULL) {
-        DIE(1,"Couldn't load/mmap disk %s: %s\n",
-            path, strerror(err));
+    const char *msg = map_image(path, &buf, &sz);
+    if (msg != NULL) {
+        DIE(1,"Couldn't load/mmap disk %s: %s\n", path, msg);
     }
-    if (sz == nib_disksz) {
+    if (woz_detect(buf, sz)) {
+        return woz_insert(path, buf, sz);
+    } else if (sz == nib_disksz) {
         return nib_insert(path, buf, sz);
     } else if (sz == dsk_disksz) {
         return dsk_insert(path, buf, sz);
@@ -36,3 +240,35 @@ DiskFormatDesc disk_format_load(const char *path)
         DIE(2,"Unrecognized disk format for %s.\n", path);
     }
 }
+
+void disk_image_follow(const char *path, byte **buf, size_t sz,
+                       dev_t *dev, ino_t *ino)
+{
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        WARN("Couldn't stat disk %s: %s\n", path, strerror(errno));
+        return;
+    }
+    if (*ino == 0) {
+        // First call, from insertion: just note which file we have.
+    } else if (st.st_dev != *dev || st.st_ino != *ino) {
+        byte *nbuf;
+        size_t nsz;
+        const char *msg = map_image(path, &nbuf, &nsz);
+        if (msg != NULL) {
+            WARN("Couldn't reload/mmap disk %s: %s\n", path, msg);
+            return;
+        }
+        if (nsz != sz) {
+            WARN("New version of disk %s is the wrong size; ignoring it.\n",
+                 path);
+            release_image(nbuf, nsz);
+            return;
+        }
+        // (Not synced: the file it came from is gone.)
+        release_image(*buf, sz);
+        *buf = nbuf;
+    }
+    *dev = st.st_dev;
+    *ino = st.st_ino;
+}
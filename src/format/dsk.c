@@ -5,13 +5,19 @@
 //  See the accompanying LICENSE file for details.
 
 #include "bobbin-internal.h"
+#include "secmap.h"
+#include "sha-256.h"
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <sys/mman.h>
+#include <sys/stat.h>
 
 #define NIBBLE_SECTOR_SIZE  416
 #define NIBBLE_TRACK_SIZE   6656
@@ -19,34 +25,27 @@
 #define MAX_SECTORS         16
 #define VOLUME_NUMBER       254
 #define DSK_TRACK_SIZE      (DSK_SECTOR_SIZE * MAX_SECTORS)
+#define SHARED_PREFIX       "/bobbin-nib-"
+// Bump this when the nibblized layout changes, so that old shared
+// copies aren't picked up.
+#define SHARED_VERSION      1
 
 struct dskprivdat {
     const char *path;
     byte *realbuf;
     byte *buf;
+    bool buf_shared;    // a private mapping of a --share-nibbles object
+    byte *cache;    // the image contents that buf was nibblized from
     const byte *secmap;
-    int bytenum;
     uint64_t dirty_tracks;
+    dev_t dev;
+    ino_t ino;
 };
 static const struct dskprivdat datinit = { 0 };
 
 static const size_t nib_disksz = 232960;
 static const size_t dsk_disksz = 143360;
 
-//  DOS 3.3 Physical sector order (index is physical sector,
-//  value is DOS sector)
-const byte DO[] = {
-    0x0, 0x7, 0xE, 0x6, 0xD, 0x5, 0xC, 0x4,
-    0xB, 0x3, 0xA, 0x2, 0x9, 0x1, 0x8, 0xF
-};
-
-// ProDOS Physical sector order (index is physical sector,
-// value is ProDOS sector).
-const byte PO[] = {
-    0x0, 0x8, 0x1, 0x9, 0x2, 0xa, 0x3, 0xb,
-    0x4, 0xc, 0x5, 0xd, 0x6, 0xe, 0x7, 0xf
-};
-
 const byte TRANS62[] = {
     0x96, 0x97, 0x9a, 0x9b, 0x9d, 0x9e, 0x9f, 0xa6,
     0xa7, 0xab, 0xac, 0xad, 0xae, 0xaf, 0xb2, 0xb3,
@@ -291,12 +290,12 @@ static void spin(DiskFormatDesc *desc, bool b)
     struct dskprivdat *dat = desc->privdat;
     if (!b && dat->dirty_tracks != 0) {
         implodeDo(desc);
+        memcpy(dat->cache, dat->realbuf, dsk_disksz);
         // For now, sync the entire disk
-        errno = 0;
-        int err = msync(dat->realbuf, dsk_disksz, MS_SYNC);
-        if (err < 0) {
+        int err = disk_image_sync(dat->realbuf, dsk_disksz);
+        if (err != 0) {
             DIE(1,"Couldn't sync to disk file %s: %s\n",
-                cfg.disk, strerror(errno));
+                cfg.disk, strerror(err));
         }
         dat->dirty_tracks = 0;
     }
@@ -306,9 +305,9 @@ static byte read_byte(DiskFormatDesc *desc)
 {
     struct dskprivdat *dat = desc->privdat;
     size_t pos = (desc->halftrack/2) * NIBBLE_TRACK_SIZE;
-    pos += (dat->bytenum % NIBBLE_TRACK_SIZE);
+    pos += (desc->bytenum % NIBBLE_TRACK_SIZE);
     byte val = dat->buf[pos];
-    dat->bytenum = (dat->bytenum + 1) % NIBBLE_TRACK_SIZE;
+    desc->bytenum = (desc->bytenum + 1) % NIBBLE_TRACK_SIZE;
     return val;
 }
 
@@ -321,19 +320,25 @@ static void write_byte(DiskFormatDesc *desc, byte val)
     }
     dat->dirty_tracks |= 1 << (desc->halftrack/2);
     size_t pos = (desc->halftrack/2) * NIBBLE_TRACK_SIZE;
-    pos += (dat->bytenum % NIBBLE_TRACK_SIZE);
+    pos += (desc->bytenum % NIBBLE_TRACK_SIZE);
 
     //D2DBG("write byte $%02X at pos $%04zX", (unsigned int)val, pos);
 
     dat->buf[pos] = val;
-    dat->bytenum = (dat->bytenum + 1) % NIBBLE_TRACK_SIZE;
+    desc->bytenum = (desc->bytenum + 1) % NIBBLE_TRACK_SIZE;
 }
 
 static void eject(DiskFormatDesc *desc)
 {
     // free dat->path and dat, and unmap disk image
     struct dskprivdat *dat = desc->privdat;
-    (void) munmap(dat->buf, dsk_disksz);
+    disk_image_unmap(dat->realbuf, dsk_disksz);
+    if (dat->buf_shared) {
+        (void) munmap(dat->buf, nib_disksz);
+    } else {
+        free(dat->buf);
+    }
+    free(dat->cache);
     free((void*)dat->path);
     free(dat);
 }
@@ -417,23 +422,117 @@ static void explodeSector(byte vol, byte track, byte sector,
     *nibSec = wr;
 }
 
-static void explodeDsk(byte *nibbleBuf, byte *dskBuf, const byte *secmap)
+static void explodeTrack(byte *nibbleBuf, const byte *dskBuf, int t,
+                         const byte *secmap)
+{
+    nibbleBuf += t * NIBBLE_TRACK_SIZE;
+    byte *writePtr = nibbleBuf;
+    for (int phys_sector = 0; phys_sector < MAX_SECTORS; ++phys_sector) {
+        const byte dos_sector = secmap[phys_sector];
+        const size_t off = ((MAX_SECTORS * t + dos_sector)
+                            * DSK_SECTOR_SIZE);
+        explodeSector(VOLUME_NUMBER, t, phys_sector,
+                      &writePtr, &dskBuf[off]);
+    }
+    assert(writePtr - nibbleBuf <= NIBBLE_TRACK_SIZE);
+    for (; writePtr != (nibbleBuf + NIBBLE_TRACK_SIZE); ++writePtr) {
+        *writePtr = 0xFF;
+    }
+}
+
+static void explodeDsk(byte *nibbleBuf, const byte *dskBuf,
+                       const byte *secmap)
 {
     for (int t = 0; t < NUM_TRACKS; ++t) {
-        byte *writePtr = nibbleBuf;
-        for (int phys_sector = 0; phys_sector < MAX_SECTORS; ++phys_sector) {
-            const byte dos_sector = secmap[phys_sector];
-            const size_t off = ((MAX_SECTORS * t + dos_sector)
-                                * DSK_SECTOR_SIZE);
-            explodeSector(VOLUME_NUMBER, t, phys_sector,
-                          &writePtr, &dskBuf[off]);
+        explodeTrack(nibbleBuf, dskBuf, t, secmap);
+    }
+}
+
+// --share-nibbles: finds (or makes) a shared-memory copy of the
+// nibblized image, named for a hash of its contents, and maps it
+// copy-on-write. Returns NULL if that can't be done, and the caller
+// should nibblize its own copy.
+static byte *map_shared(const byte *dskBuf, const byte *secmap)
+{
+    uint8_t hash[SIZE_OF_SHA_256_HASH];
+    const byte version = SHARED_VERSION;
+    struct Sha_256 sha;
+    sha_256_init(&sha, hash);
+    sha_256_write(&sha, dskBuf, dsk_disksz);
+    sha_256_write(&sha, secmap, MAX_SECTORS);
+    sha_256_write(&sha, &version, 1);
+    (void) sha_256_close(&sha);
+
+    char name[sizeof SHARED_PREFIX + 2 * SIZE_OF_SHA_256_HASH];
+    strcpy(name, SHARED_PREFIX);
+    for (int i = 0; i != SIZE_OF_SHA_256_HASH; ++i) {
+        sprintf(name + sizeof SHARED_PREFIX - 1 + 2 * i, "%02x", hash[i]);
+    }
+
+    // Whoever creates the object nibblizes into it, and then makes it
+    // readable to say it's ready. Anyone who finds it not yet ready
+    // (or left half-done by a process that died) goes their own way.
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0200);
+    if (fd >= 0) {
+        byte *buf = MAP_FAILED;
+        if (ftruncate(fd, nib_disksz) == 0) {
+            buf = mmap(NULL, nib_disksz, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+        }
+        bool ok = buf != MAP_FAILED;
+        if (ok) {
+            explodeDsk(buf, dskBuf, secmap);
+            (void) munmap(buf, nib_disksz);
+            ok = fchmod(fd, 0444) == 0;
         }
-        assert(writePtr - nibbleBuf <= NIBBLE_TRACK_SIZE);
-        for (; writePtr != (nibbleBuf + NIBBLE_TRACK_SIZE); ++writePtr) {
-            *writePtr = 0xFF;
+        if (!ok) {
+            WARN("Couldn't share nibblized disk as %s: %s\n",
+                 name, strerror(errno));
+            (void) shm_unlink(name);
+            close(fd);
+            return NULL;
         }
-        nibbleBuf += NIBBLE_TRACK_SIZE;
+        INFO("Shared nibblized disk as %s.\n", name);
+    } else if (errno == EEXIST) {
+        fd = shm_open(name, O_RDONLY, 0);
+        struct stat st;
+        if (fd < 0) return NULL;
+        if (fstat(fd, &st) < 0 || (st.st_mode & 0444) != 0444
+            || (size_t)st.st_size != nib_disksz) {
+            close(fd);
+            return NULL;
+        }
+        INFO("Using shared nibblized disk %s.\n", name);
+    } else {
+        return NULL;
     }
+
+    byte *buf = mmap(NULL, nib_disksz, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE, fd, 0);
+    close(fd);
+    return buf == MAP_FAILED? NULL : buf;
+}
+
+static void refresh(DiskFormatDesc *desc)
+{
+    // Compare the image against what we last nibblized, and
+    // re-nibblize just the tracks that differ.
+    struct dskprivdat *dat = desc->privdat;
+    disk_image_follow(dat->path, &dat->realbuf, dsk_disksz,
+                      &dat->dev, &dat->ino);
+    int changed = 0;
+    for (int t = 0; t < NUM_TRACKS; ++t) {
+        const size_t off = t * DSK_TRACK_SIZE;
+        if (memcmp(dat->cache + off, dat->realbuf + off,
+                   DSK_TRACK_SIZE) == 0) {
+            continue;
+        }
+        memcpy(dat->cache + off, dat->realbuf + off, DSK_TRACK_SIZE);
+        explodeTrack(dat->buf, dat->realbuf, t, dat->secmap);
+        ++changed;
+    }
+    INFO("Reloaded %s (%d track%s changed).\n",
+         dat->path, changed, changed == 1? "" : "s");
 }
 
 DiskFormatDesc dsk_insert(const char *path, byte *buf, size_t sz)
@@ -451,17 +550,25 @@ DiskFormatDesc dsk_insert(const char *path, byte *buf, size_t sz)
     *dat = datinit;
     dat->realbuf = buf;
     dat->path = pathcp;
-    dat->buf = xalloc(nib_disksz);
 
-    const char *ext = get_file_ext(path);
-    if (STREQCASE(ext, "PO"))  {
+    if (disk_image_has_ext(path, "PO"))  {
         INFO("Opening %s as PO.\n", cfg.disk);
         dat->secmap = PO;
     } else {
         INFO("Opening %s as DO.\n", cfg.disk);
         dat->secmap = DO;
     }
-    explodeDsk(dat->buf, dat->realbuf, dat->secmap);
+    if (cfg.share_nibbles) {
+        dat->buf = map_shared(dat->realbuf, dat->secmap);
+        dat->buf_shared = dat->buf != NULL;
+    }
+    if (dat->buf == NULL) {
+        dat->buf = xalloc(nib_disksz);
+        explodeDsk(dat->buf, dat->realbuf, dat->secmap);
+    }
+    dat->cache = xalloc(dsk_disksz);
+    memcpy(dat->cache, dat->realbuf, dsk_disksz);
+    disk_image_follow(path, &dat->realbuf, dsk_disksz, &dat->dev, &dat->ino);
 
     return (DiskFormatDesc){
         .privdat = dat,
@@ -469,5 +576,6 @@ DiskFormatDesc dsk_insert(const char *path, byte *buf, size_t sz)
         .read_byte = read_byte,
         .write_byte = write_byte,
         .eject = eject,
+        .refresh = refresh,
     };
 }
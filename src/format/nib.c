@@ -19,8 +19,9 @@
 struct nibprivdat {
     const char *path;
     byte *buf;
-    int bytenum;
     uint64_t dirty_tracks;
+    dev_t dev;
+    ino_t ino;
 };
 static const struct nibprivdat datinit = { 0 };
 
@@ -31,11 +32,10 @@ static void spin(DiskFormatDesc *desc, bool b)
     struct nibprivdat *dat = desc->privdat;
     if (!b && dat->dirty_tracks != 0) {
         // For now, sync the entire disk
-        errno = 0;
-        int err = msync(dat->buf, nib_disksz, MS_SYNC);
-        if (err < 0) {
+        int err = disk_image_sync(dat->buf, nib_disksz);
+        if (err != 0) {
             DIE(1,"Couldn't sync to disk file %s: %s\n",
-                cfg.disk, strerror(errno));
+                cfg.disk, strerror(err));
         }
         dat->dirty_tracks = 0;
     }
@@ -45,9 +45,9 @@ static byte read_byte(DiskFormatDesc *desc)
 {
     struct nibprivdat *dat = desc->privdat;
     size_t pos = (desc->halftrack/2) * NIBBLE_TRACK_SIZE;
-    pos += (dat->bytenum % NIBBLE_TRACK_SIZE);
+    pos += (desc->bytenum % NIBBLE_TRACK_SIZE);
     byte val = dat->buf[pos];
-    dat->bytenum = (dat->bytenum + 1) % NIBBLE_TRACK_SIZE;
+    desc->bytenum = (desc->bytenum + 1) % NIBBLE_TRACK_SIZE;
     return val;
 }
 
@@ -60,19 +60,29 @@ static void write_byte(DiskFormatDesc *desc, byte val)
     }
     dat->dirty_tracks |= 1 << (desc->halftrack/2);
     size_t pos = (desc->halftrack/2) * NIBBLE_TRACK_SIZE;
-    pos += (dat->bytenum % NIBBLE_TRACK_SIZE);
+    pos += (desc->bytenum % NIBBLE_TRACK_SIZE);
 
     //D2DBG("write byte $%02X at pos $%04zX", (unsigned int)val, pos);
 
     dat->buf[pos] = val;
-    dat->bytenum = (dat->bytenum + 1) % NIBBLE_TRACK_SIZE;
+    desc->bytenum = (desc->bytenum + 1) % NIBBLE_TRACK_SIZE;
+}
+
+static void refresh(DiskFormatDesc *desc)
+{
+    // The nibbles are used straight from the (shared) mapping, so an
+    // image that was rewritten in place needs nothing more; one that
+    // was replaced needs mapping anew.
+    struct nibprivdat *dat = desc->privdat;
+    disk_image_follow(dat->path, &dat->buf, nib_disksz, &dat->dev, &dat->ino);
+    INFO("Reloaded %s.\n", dat->path);
 }
 
 static void eject(DiskFormatDesc *desc)
 {
     // free dat->path and dat, and unmap disk image
     struct nibprivdat *dat = desc->privdat;
-    (void) munmap(dat->buf, nib_disksz);
+    disk_image_unmap(dat->buf, nib_disksz);
     free((void*)dat->path);
     free(dat);
 }
@@ -92,6 +102,7 @@ DiskFormatDesc nib_insert(const char *path, byte *buf, size_t sz)
     *dat = datinit;
     dat->buf = buf;
     dat->path = pathcp;
+    disk_image_follow(path, &dat->buf, nib_disksz, &dat->dev, &dat->ino);
 
     return (DiskFormatDesc){
         .privdat = dat,
@@ -99,5 +110,6 @@ DiskFormatDesc nib_insert(const char *path, byte *buf, size_t sz)
         .read_byte = read_byte,
         .write_byte = write_byte,
         .eject = eject,
+        .refresh = refresh,
     };
 }
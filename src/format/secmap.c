@@ -0,0 +1,21 @@
+//  format/secmap.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "secmap.h"
+
+//  DOS 3.3 Physical sector order (index is physical sector,
+//  value is DOS sector)
+const uint8_t DO[16] = {
+    0x0, 0x7, 0xE, 0x6, 0xD, 0x5, 0xC, 0x4,
+    0xB, 0x3, 0xA, 0x2, 0x9, 0x1, 0x8, 0xF
+};
+
+// ProDOS Physical sector order (index is physical sector,
+// value is ProDOS sector).
+const uint8_t PO[16] = {
+    0x0, 0x8, 0x1, 0x9, 0x2, 0xa, 0x3, 0xb,
+    0x4, 0xc, 0x5, 0xd, 0x6, 0xe, 0x7, 0xf
+};
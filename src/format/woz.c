@@ -0,0 +1,463 @@
+//  format/woz.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+// WOZ (versions 1 and 2) disk images: each track is a raw bitstream,
+// so 10-bit sync bytes, odd track lengths and the like (as used by
+// copy protection) come through as they were on the original disk.
+//
+// The disk turns with emulated time: each access first moves the
+// read/write position along by however many bit cells have passed
+// since the last one. Rather than run the controller's shift register
+// bit by bit, a track is decoded once, the first time it's read, into
+// the nibbles the controller would see and the bit positions at which
+// each would be complete; a read then just looks up the most recent
+// one. Decoding pulls a whole nibble at a time out of the bitstream,
+// using a table to skip the zero bits between them.
+//
+// Only whole and half tracks are reached (the drive's stepping is
+// emulated in half-track units). Empty tracks read as all zeros,
+// without the random bits a real drive would pick up.
+
+#define WOZ_HDR_SIZE        12
+#define WOZ_NTMAP           160
+#define WOZ_EMPTY           0xFF
+#define WOZ1_TRK_SIZE       6656
+#define WOZ1_BITS_SIZE      6646
+#define WOZ2_TRK_SIZE       8
+#define WOZ_BLOCK_SIZE      512
+#define DEFAULT_BIT_TIMING  32      // in 125ns units: 4 microseconds
+
+// Emulated cycles are taken as 1 microsecond each.
+#define EIGHTHS_PER_CYCLE   8
+
+// Cycles between nibbles written (see write_byte()).
+#define SYNC_WAIT           38
+#define MAX_WRITE_WAIT      64
+
+struct woztrack {
+    byte *bits;             // within the mapped image
+    unsigned long nbits;
+    // Decoded (NULL until needed): nibble i is complete once the
+    // position reaches ends[i]. ends[] is in increasing order.
+    byte *nibs;
+    uint32_t *ends;
+    unsigned long nnibs;
+};
+
+struct wozprivdat {
+    const char *path;
+    byte *buf;
+    size_t sz;
+    int version;
+    byte tmap[WOZ_NTMAP];
+    struct woztrack tracks[WOZ_NTMAP];
+    unsigned timing;        // bit cell length, in 125ns units
+    uintmax_t last_cycle;
+    unsigned long eighths;  // cycles not yet a whole bit cell, * 8
+    int cur_track;          // TRKS index, -1 for none yet
+    long last_read;         // nibble last read as valid, or -1
+    long write_end;         // position after the last nibble written
+    uintmax_t write_cycle;  // ...and when it was written
+    bool spinning;
+    bool dirty;
+    dev_t dev;
+    ino_t ino;
+};
+static const struct wozprivdat datinit = { 0 };
+
+// Number of zero bits before the first 1, reading from the high bit.
+static byte lead_zeros[256];
+
+static void init_tables(void)
+{
+    if (lead_zeros[0] != 0) return;
+    for (int v = 0; v != 256; ++v) {
+        int n = 0;
+        while (n != 8 && !(v & (0x80 >> n))) ++n;
+        lead_zeros[v] = n;
+    }
+}
+
+static inline unsigned long le16(const byte *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline unsigned long le32(const byte *p)
+{
+    return le16(p) | (le16(p + 2) << 16);
+}
+
+// The eight bits starting at bit pos (bits run from the high bit of
+// each byte), wrapping around the end of the track.
+static inline unsigned window8(const struct woztrack *t, unsigned long pos)
+{
+    unsigned long i = pos >> 3;
+    if (pos + 16 <= t->nbits) {
+        unsigned w = (t->bits[i] << 8) | t->bits[i+1];
+        return (w >> (8 - (pos & 7))) & 0xFF;
+    }
+    unsigned w = 0;
+    for (int n = 0; n != 8; ++n) {
+        unsigned long p = (pos + n) % t->nbits;
+        w = (w << 1) | ((t->bits[p >> 3] >> (7 - (p & 7))) & 1);
+    }
+    return w;
+}
+
+static void put_bit(struct woztrack *t, unsigned long pos, int bit)
+{
+    pos %= t->nbits;
+    byte mask = 0x80 >> (pos & 7);
+    if (bit) t->bits[pos >> 3] |= mask; else t->bits[pos >> 3] &= ~mask;
+}
+
+static void forget(struct woztrack *t)
+{
+    free(t->nibs);
+    free(t->ends);
+    t->nibs = NULL;
+    t->ends = NULL;
+    t->nnibs = 0;
+}
+
+// Goes round the track twice, as the controller would: a nibble is
+// the eight bits from the first 1 after the previous nibble. The
+// first time round is only to get in step; nibbles completed in the
+// second are kept.
+static void decode(struct woztrack *t)
+{
+    unsigned long cap = t->nbits / 8 + 1;
+    t->nibs = xalloc(cap);
+    t->ends = xalloc(cap * sizeof t->ends[0]);
+    t->nnibs = 0;
+
+    unsigned long pos = 0, stop = 2 * t->nbits;
+    while (pos < stop) {
+        unsigned w = window8(t, pos % t->nbits);
+        if (w == 0) {
+            pos += 8;
+            continue;
+        }
+        pos += lead_zeros[w];
+        unsigned long done = pos + 8;
+        if (done >= t->nbits && done < stop && t->nnibs != cap) {
+            t->nibs[t->nnibs] = window8(t, pos % t->nbits);
+            t->ends[t->nnibs] = done - t->nbits;
+            ++t->nnibs;
+        }
+        pos = done;
+    }
+}
+
+static inline bool covers(const struct woztrack *t, unsigned long i,
+                          unsigned long pos)
+{
+    if (i == t->nnibs - 1) {
+        return pos >= t->ends[i] || pos < t->ends[0];
+    }
+    return t->ends[i] <= pos && pos < t->ends[i+1];
+}
+
+// The most recent nibble completed at or before pos. hint is a good
+// guess: usually the last one found, or the one after it.
+static unsigned long find_nib(const struct woztrack *t, unsigned long pos,
+                              unsigned long hint)
+{
+    unsigned long n = t->nnibs;
+    if (covers(t, hint % n, pos)) return hint % n;
+    if (covers(t, (hint + 1) % n, pos)) return (hint + 1) % n;
+    if (pos < t->ends[0]) return n - 1; // from the last time round
+
+    unsigned long lo = 0, hi = n; // ends[lo] <= pos < ends[hi]
+    while (hi - lo > 1) {
+        unsigned long mid = lo + (hi - lo) / 2;
+        if (t->ends[mid] <= pos) lo = mid; else hi = mid;
+    }
+    return lo;
+}
+
+static struct woztrack *cur_track(DiskFormatDesc *desc)
+{
+    struct wozprivdat *dat = desc->privdat;
+    unsigned q = desc->halftrack * 2;
+    int idx = q < WOZ_NTMAP? dat->tmap[q] : WOZ_EMPTY;
+    if (idx == WOZ_EMPTY || dat->tracks[idx].nbits == 0) {
+        return NULL;
+    }
+    struct woztrack *t = &dat->tracks[idx];
+    if (idx != dat->cur_track) {
+        // Tracks needn't be the same length: keep the same place
+        // in the revolution.
+        if (dat->cur_track >= 0) {
+            unsigned long was = dat->tracks[dat->cur_track].nbits;
+            desc->bytenum = (unsigned long)desc->bytenum * t->nbits / was;
+        }
+        desc->bytenum %= t->nbits;
+        dat->cur_track = idx;
+        dat->last_read = -1;
+        dat->write_end = -1;
+    }
+    return t;
+}
+
+// Turns the disk by the time since the last access. Returns the
+// number of bit cells that went by.
+static unsigned long advance(DiskFormatDesc *desc, struct woztrack *t)
+{
+    struct wozprivdat *dat = desc->privdat;
+    uintmax_t now = cycles_elapsed();
+    // (The count starts again when --watch reboots.)
+    uintmax_t elapsed = now > dat->last_cycle? now - dat->last_cycle : 0;
+    dat->last_cycle = now;
+    if (t == NULL) return 0;
+
+    uintmax_t eighths = elapsed * EIGHTHS_PER_CYCLE + dat->eighths;
+    uintmax_t bits = eighths / dat->timing;
+    dat->eighths = eighths % dat->timing;
+    desc->bytenum = (desc->bytenum + bits % t->nbits) % t->nbits;
+    return bits > ULONG_MAX? ULONG_MAX : bits;
+}
+
+static void spin(DiskFormatDesc *desc, bool b)
+{
+    struct wozprivdat *dat = desc->privdat;
+    if (b) {
+        // The disk stood still while the motor was off.
+        if (!dat->spinning) {
+            dat->last_cycle = cycles_elapsed();
+            dat->eighths = 0;
+        }
+        dat->spinning = true;
+        return;
+    }
+    dat->spinning = false;
+    if (dat->dirty) {
+        int err = disk_image_sync(dat->buf, dat->sz);
+        if (err != 0) {
+            DIE(1,"Couldn't sync to disk file %s: %s\n",
+                dat->path, strerror(err));
+        }
+        dat->dirty = false;
+    }
+}
+
+static byte read_byte(DiskFormatDesc *desc)
+{
+    struct wozprivdat *dat = desc->privdat;
+    struct woztrack *t = cur_track(desc);
+    unsigned long bits = advance(desc, t);
+    dat->write_end = -1;
+    if (t == NULL) return 0x00;
+    if (t->nibs == NULL) decode(t);
+    if (t->nnibs == 0) return 0x00;
+
+    unsigned long hint = dat->last_read < 0? 0 : dat->last_read;
+    long i = find_nib(t, desc->bytenum, hint);
+    // A nibble is read as valid once; after that the latch is taken
+    // to be shifting in the next one.
+    bool fresh = i != dat->last_read || bits >= t->nbits;
+    dat->last_read = i;
+    return fresh? t->nibs[i] : t->nibs[i] & 0x7F;
+}
+
+static void write_byte(DiskFormatDesc *desc, byte val)
+{
+    struct wozprivdat *dat = desc->privdat;
+    struct woztrack *t = cur_track(desc);
+    advance(desc, t);
+    if (t == NULL || desc->writeprot) return;
+    if ((val & 0x80) == 0) return; // must have high bit (as for .nib)
+
+    uintmax_t now = cycles_elapsed();
+    unsigned long pos = desc->bytenum;
+    if (dat->write_end >= 0 && now >= dat->write_cycle
+        && now - dat->write_cycle <= MAX_WRITE_WAIT) {
+        // The controller loads a nibble every 32 cycles, but the
+        // emulated CPU's counts for the same loop only come out
+        // roughly right (29 to 36), so nibbles written in quick
+        // succession simply go end to end. A wait well past that
+        // leaves zeros after the last one: that's how the 40-cycle,
+        // 10-bit sync bytes are made.
+        unsigned long wait = now - dat->write_cycle;
+        unsigned long gap = 0;
+        if (wait >= SYNC_WAIT) {
+            gap = (wait * EIGHTHS_PER_CYCLE + dat->timing / 2)
+                / dat->timing - 8;
+        }
+        for (unsigned long n = 0; n != gap; ++n) {
+            put_bit(t, dat->write_end + n, 0);
+        }
+        pos = (dat->write_end + gap) % t->nbits;
+        desc->bytenum = pos;
+    }
+    dat->write_cycle = now;
+    for (int n = 0; n != 8; ++n) {
+        put_bit(t, pos + n, (val >> (7 - n)) & 1);
+    }
+    dat->write_end = (pos + 8) % t->nbits;
+    dat->last_read = -1;
+    forget(t);
+
+    if (!dat->dirty) {
+        // The header CRC no longer holds; zero means "not given".
+        memset(dat->buf + 8, 0, 4);
+        dat->dirty = true;
+    }
+}
+
+static const byte *find_chunk(const byte *buf, size_t sz, const char *id,
+                              unsigned long *len)
+{
+    size_t off = WOZ_HDR_SIZE;
+    while (off + 8 <= sz) {
+        unsigned long clen = le32(buf + off + 4);
+        if (memcmp(buf + off, id, 4) == 0) {
+            if (clen > sz - off - 8) return NULL;
+            *len = clen;
+            return buf + off + 8;
+        }
+        if (clen > sz - off - 8) break;
+        off += 8 + clen;
+    }
+    return NULL;
+}
+
+// Sets up the track table from the mapped image. Returns an error
+// message, or NULL.
+static const char *parse(struct wozprivdat *dat, bool *writeprot)
+{
+    const byte *buf = dat->buf;
+    size_t sz = dat->sz;
+    unsigned long len;
+
+    const byte *info = find_chunk(buf, sz, "INFO", &len);
+    if (info == NULL || len < 37) return "no INFO chunk";
+    if (info[1] != 1) return "not a 5.25\" disk";
+    *writeprot = info[2] != 0;
+    dat->timing = DEFAULT_BIT_TIMING;
+    if (dat->version >= 2 && len >= 40 && info[39] != 0) {
+        dat->timing = info[39];
+    }
+
+    const byte *tmap = find_chunk(buf, sz, "TMAP", &len);
+    if (tmap == NULL || len < WOZ_NTMAP) return "no TMAP chunk";
+    memcpy(dat->tmap, tmap, WOZ_NTMAP);
+
+    const byte *trks = find_chunk(buf, sz, "TRKS", &len);
+    if (trks == NULL) return "no TRKS chunk";
+
+    for (int i = 0; i != WOZ_NTMAP; ++i) {
+        struct woztrack *t = &dat->tracks[i];
+        forget(t);
+        t->bits = NULL;
+        t->nbits = 0;
+        if (dat->version == 1) {
+            if ((i + 1) * (unsigned long)WOZ1_TRK_SIZE > len) continue;
+            const byte *trk = trks + i * WOZ1_TRK_SIZE;
+            t->bits = (byte *)trk;
+            t->nbits = le16(trk + WOZ1_BITS_SIZE + 2);
+            if (t->nbits > WOZ1_BITS_SIZE * 8) return "bad track length";
+        } else {
+            if ((i + 1) * WOZ2_TRK_SIZE > len) break;
+            const byte *trk = trks + i * WOZ2_TRK_SIZE;
+            unsigned long start = le16(trk) * (unsigned long)WOZ_BLOCK_SIZE;
+            unsigned long nblocks = le16(trk + 2);
+            t->nbits = le32(trk + 4);
+            if (nblocks == 0 || t->nbits == 0) {
+                t->nbits = 0;
+                continue;
+            }
+            if (start > sz || nblocks * WOZ_BLOCK_SIZE > sz - start
+                || (t->nbits + 7) / 8 > nblocks * WOZ_BLOCK_SIZE) {
+                return "track data lies outside the file";
+            }
+            t->bits = dat->buf + start;
+        }
+    }
+    for (int q = 0; q != WOZ_NTMAP; ++q) {
+        if (dat->tmap[q] != WOZ_EMPTY && dat->tmap[q] >= WOZ_NTMAP) {
+            return "bad TMAP entry";
+        }
+    }
+    return NULL;
+}
+
+static void refresh(DiskFormatDesc *desc)
+{
+    struct wozprivdat *dat = desc->privdat;
+    disk_image_follow(dat->path, &dat->buf, dat->sz, &dat->dev, &dat->ino);
+    bool writeprot = desc->writeprot;
+    const char *err = parse(dat, &writeprot);
+    if (err != NULL) {
+        // Keep going with what we have: empty tracks, at worst.
+        WARN("Reloaded %s is a bad WOZ image: %s.\n", dat->path, err);
+        memset(dat->tmap, WOZ_EMPTY, sizeof dat->tmap);
+    }
+    desc->writeprot = writeprot;
+    dat->cur_track = -1;
+    dat->last_read = -1;
+    INFO("Reloaded %s.\n", dat->path);
+}
+
+static void eject(DiskFormatDesc *desc)
+{
+    struct wozprivdat *dat = desc->privdat;
+    for (int i = 0; i != WOZ_NTMAP; ++i) forget(&dat->tracks[i]);
+    disk_image_unmap(dat->buf, dat->sz);
+    free((void*)dat->path);
+    free(dat);
+}
+
+bool woz_detect(const byte *buf, size_t sz)
+{
+    return sz >= WOZ_HDR_SIZE
+        && (memcmp(buf, "WOZ1", 4) == 0 || memcmp(buf, "WOZ2", 4) == 0)
+        && memcmp(buf + 4, "\xFF\n\r\n", 4) == 0;
+}
+
+DiskFormatDesc woz_insert(const char *path, byte *buf, size_t sz)
+{
+    init_tables();
+
+    size_t len = strlen(path)+1;
+    char *pathcp = xalloc(len);
+    memcpy(pathcp, path, len);
+
+    struct wozprivdat *dat = xalloc(sizeof *dat);
+    *dat = datinit;
+    dat->buf = buf;
+    dat->sz = sz;
+    dat->path = pathcp;
+    dat->version = buf[3] - '0';
+    dat->cur_track = -1;
+    dat->last_read = -1;
+    dat->write_end = -1;
+
+    bool writeprot;
+    const char *err = parse(dat, &writeprot);
+    if (err != NULL) {
+        DIE(2,"%s: bad WOZ image: %s.\n", path, err);
+    }
+    INFO("Opening %s as WOZ%d.\n", path, dat->version);
+    disk_image_follow(path, &dat->buf, sz, &dat->dev, &dat->ino);
+
+    return (DiskFormatDesc){
+        .privdat = dat,
+        .writeprot = writeprot,
+        .spin = spin,
+        .read_byte = read_byte,
+        .write_byte = write_byte,
+        .eject = eject,
+        .refresh = refresh,
+    };
+}
@@ -0,0 +1,97 @@
+//  fs.h
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#ifndef BOBBIN_FS_H
+#define BOBBIN_FS_H
+
+#include "ac-config.h"
+#ifdef _XOPEN_SOURCE
+#undef _XOPEN_SOURCE
+#endif
+#define _XOPEN_SOURCE   700
+
+// Shared declarations for bobbin-fs, which works on the files inside
+// DOS 3.3 and ProDOS disk images directly, without emulating anything.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FS_SECTOR_SIZE  256
+#define FS_BLOCK_SIZE   512
+#define FS_TRACKS       35
+#define FS_SECTORS      16
+#define FS_FLOPPY_SIZE  (FS_TRACKS * FS_SECTORS * FS_SECTOR_SIZE)
+
+#define ASOFT_BASE      0x801   // where AppleSoft programs load
+
+typedef struct Image Image;
+struct Image {
+    const char  *path;
+    uint8_t     *file;      // the whole file
+    size_t      file_size;
+    uint8_t     *buf;       // the disk data within it (after any header)
+    size_t      size;
+    // Where each logical sector (DOS 3.3 or ProDOS numbering) of a
+    // track sits within the image.
+    uint8_t     dos_pos[FS_SECTORS];
+    uint8_t     pro_pos[FS_SECTORS];
+    bool        floppy;     // a 140k image (else a block image)
+    bool        dirty;
+};
+
+typedef enum {
+    KIND_BINARY,
+    KIND_TEXT,
+    KIND_BASIC,     // tokenized AppleSoft
+    KIND_OTHER,
+} FileKind;
+
+// A file's contents, without any filesystem-specific header (a DOS 3.3
+// binary's address and length, say).
+typedef struct FileData FileData;
+struct FileData {
+    FileKind    kind;
+    const char  *type;  // for insert: the type as the user gave it
+    unsigned    aux;    // load address, for binaries
+    uint8_t     *data;
+    size_t      len;
+};
+
+typedef struct FsOps FsOps;
+struct FsOps {
+    const char  *name;
+    bool        (*probe)(Image *im);
+    void        (*catalog)(Image *im);
+    void        (*extract)(Image *im, const char *name, FileData *fd);
+    // Replaces an existing (unlocked) file of the same name.
+    void        (*insert)(Image *im, const char *name, const FileData *fd);
+    void        (*delete)(Image *im, const char *name);
+    void        (*rename)(Image *im, const char *from, const char *to);
+};
+
+extern const FsOps dos33_ops;
+extern const FsOps prodos_ops;
+
+// main.c
+// Reports an error with the current image, and exits.
+void fail(const char *fmt, ...);
+void *xalloc(size_t sz);
+void *xrealloc(void *p, size_t sz);
+
+// image.c
+void image_load(Image *im, const char *path);
+void image_save(Image *im);
+uint8_t *image_sector(Image *im, unsigned track, unsigned sector);
+void image_read_block(Image *im, unsigned blk, uint8_t *buf);
+void image_write_block(Image *im, unsigned blk, const uint8_t *buf);
+unsigned image_blocks(const Image *im);
+
+// asoft.c
+uint8_t *asoft_tokenize(const char *text, size_t textlen, size_t *len);
+char *asoft_detokenize(const uint8_t *prog, size_t len, size_t *textlen);
+
+#endif // BOBBIN_FS_H
@@ -0,0 +1,247 @@
+//  fs/asoft.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "fs.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// AppleSoft programs, tokenized and detokenized natively.
+//
+// Tokenizing follows the ROM's own parser (PARSE.INPUT.LINE, $D56C),
+// quirks included, so that a program comes out just as if it had been
+// typed in at the ] prompt: spaces vanish outside of quotes, REM and
+// DATA; keywords are found even with spaces inside them; "?" is
+// PRINT; and "AT" followed directly by N or O is left for ATN and
+// TO. Detokenizing gives LIST's output, without its line breaks.
+
+#define MAX_LINE_NUM    63999
+
+enum {
+    TOK_FIRST   = 0x80,
+    TOK_DATA    = 0x83,
+    TOK_REM     = 0xB2,
+    TOK_PRINT   = 0xBA,
+    TOK_AT      = 0xC5,
+};
+
+static const char *const tokens[] = {
+    "END", "FOR", "NEXT", "DATA", "INPUT", "DEL", "DIM", "READ",
+    "GR", "TEXT", "PR#", "IN#", "CALL", "PLOT", "HLIN", "VLIN",
+    "HGR2", "HGR", "HCOLOR=", "HPLOT", "DRAW", "XDRAW", "HTAB", "HOME",
+    "ROT=", "SCALE=", "SHLOAD", "TRACE", "NOTRACE", "NORMAL", "INVERSE",
+    "FLASH", "COLOR=", "POP", "VTAB", "HIMEM:", "LOMEM:", "ONERR",
+    "RESUME", "RECALL", "STORE", "SPEED=", "LET", "GOTO", "RUN", "IF",
+    "RESTORE", "&", "GOSUB", "RETURN", "REM", "STOP", "ON", "WAIT",
+    "LOAD", "SAVE", "DEF", "POKE", "PRINT", "CONT", "LIST", "CLEAR",
+    "GET", "NEW", "TAB(", "TO", "FN", "SPC(", "THEN", "AT", "NOT",
+    "STEP", "+", "-", "*", "/", "^", "AND", "OR", ">", "=", "<", "SGN",
+    "INT", "ABS", "USR", "FRE", "SCRN(", "PDL", "POS", "SQR", "RND",
+    "LOG", "EXP", "COS", "SIN", "TAN", "ATN", "PEEK", "LEN", "STR$",
+    "VAL", "ASC", "CHR$", "LEFT$", "RIGHT$", "MID$",
+};
+#define NTOKENS ((int)(sizeof tokens / sizeof tokens[0]))
+
+typedef struct Line Line;
+struct Line {
+    unsigned    num;
+    uint8_t     *body;
+    size_t      len;
+};
+
+// Tries each keyword in turn against in[i...], skipping any spaces in
+// the input. Returns the token, and sets *end past the match; or
+// returns -1.
+static int match(const char *in, size_t len, size_t i, size_t *end)
+{
+    for (int t = 0; t != NTOKENS; ++t) {
+        const char *k = tokens[t];
+        size_t j = i;
+        while (*k != '\0') {
+            if (j != i) {
+                while (j != len && in[j] == ' ') ++j;
+            }
+            if (j == len || toupper((unsigned char)in[j]) != *k) break;
+            ++j;
+            ++k;
+        }
+        if (*k != '\0') continue;
+        if (t + TOK_FIRST == TOK_AT && j != len) {
+            int c = toupper((unsigned char)in[j]);
+            if (c == 'N' || c == 'O') continue;
+        }
+        *end = j;
+        return t + TOK_FIRST;
+    }
+    return -1;
+}
+
+// Crunches one input line; the result is never longer than the input.
+static size_t parse(const char *in, size_t len, uint8_t *out)
+{
+    size_t i = 0, o = 0;
+    bool data = false;
+    while (i != len) {
+        int c = (unsigned char)in[i];
+        if (c == ' ' && !data) {
+            ++i;
+        } else if (c == '"') {
+            do out[o++] = in[i++]; while (i != len && in[i] != '"');
+            if (i != len) out[o++] = in[i++];
+        } else if (data) {
+            if (c == ':') data = false;
+            out[o++] = c;
+            ++i;
+        } else if (c == '?') {
+            out[o++] = TOK_PRINT;
+            ++i;
+        } else if (c >= '0' && c <= ';') {
+            out[o++] = c;
+            ++i;
+        } else {
+            size_t end;
+            int tok = match(in, len, i, &end);
+            if (tok < 0) {
+                out[o++] = toupper(c);
+                ++i;
+                continue;
+            }
+            out[o++] = tok;
+            i = end;
+            if (tok == TOK_DATA) {
+                data = true;
+            } else if (tok == TOK_REM) {
+                while (i != len) out[o++] = in[i++];
+            }
+        }
+    }
+    return o;
+}
+
+static void add_line(Line **lines, size_t *nlines, unsigned num,
+                     const uint8_t *body, size_t len)
+{
+    size_t i = 0;
+    while (i != *nlines && (*lines)[i].num < num) ++i;
+    if (i != *nlines && (*lines)[i].num == num) {
+        // Replaced, or (with an empty body) deleted.
+        free((*lines)[i].body);
+        --*nlines;
+        memmove(&(*lines)[i], &(*lines)[i + 1],
+                (*nlines - i) * sizeof **lines);
+    }
+    if (len == 0) return;
+
+    *lines = xrealloc(*lines, (*nlines + 1) * sizeof **lines);
+    memmove(&(*lines)[i + 1], &(*lines)[i], (*nlines - i) * sizeof **lines);
+    Line *ln = &(*lines)[i];
+    ln->num = num;
+    ln->body = xalloc(len);
+    memcpy(ln->body, body, len);
+    ln->len = len;
+    ++*nlines;
+}
+
+uint8_t *asoft_tokenize(const char *text, size_t textlen, size_t *len)
+{
+    Line *lines = NULL;
+    size_t nlines = 0;
+    unsigned lineno = 0;
+
+    const char *p = text, *end = text + textlen;
+    while (p != end) {
+        const char *eol = p;
+        while (eol != end && *eol != '\n' && *eol != '\r') ++eol;
+        ++lineno;
+
+        uint8_t *out = xalloc(eol - p + 1);
+        size_t n = parse(p, eol - p, out);
+        if (n != 0) {
+            if (!isdigit(out[0])) {
+                fail("line %u: no line number.", lineno);
+            }
+            unsigned long num = 0;
+            size_t i = 0;
+            while (i != n && isdigit(out[i])) {
+                num = num * 10 + (out[i++] - '0');
+                if (num > MAX_LINE_NUM) {
+                    fail("line %u: line number too large.", lineno);
+                }
+            }
+            add_line(&lines, &nlines, num, out + i, n - i);
+        }
+        free(out);
+
+        if (eol != end && *eol == '\r' && eol + 1 != end && eol[1] == '\n') {
+            ++eol;
+        }
+        p = eol == end? end : eol + 1;
+    }
+
+    size_t total = 2;
+    for (size_t i = 0; i != nlines; ++i) total += 5 + lines[i].len;
+    if (ASOFT_BASE + total > 0xFFFF) fail("program too large.");
+
+    uint8_t *prog = xalloc(total), *q = prog;
+    unsigned addr = ASOFT_BASE;
+    for (size_t i = 0; i != nlines; ++i) {
+        addr += 5 + lines[i].len;
+        *q++ = addr & 0xFF;
+        *q++ = addr >> 8;
+        *q++ = lines[i].num & 0xFF;
+        *q++ = lines[i].num >> 8;
+        memcpy(q, lines[i].body, lines[i].len);
+        q += lines[i].len;
+        *q++ = 0;
+        free(lines[i].body);
+    }
+    *q++ = 0;
+    *q++ = 0;
+    free(lines);
+
+    *len = total;
+    return prog;
+}
+
+char *asoft_detokenize(const uint8_t *prog, size_t len, size_t *textlen)
+{
+    size_t cap = 256, n = 0;
+    char *text = xalloc(cap);
+
+    size_t pos = 0;
+    while (pos + 4 <= len && (prog[pos] | prog[pos + 1]) != 0) {
+        unsigned num = prog[pos + 2] | (prog[pos + 3] << 8);
+        pos += 4;
+
+        char buf[16];
+        int w = sprintf(buf, "%u ", num);
+        for (;;) {
+            // Longest keyword, plus spaces, plus a newline.
+            if (n + w + 10 > cap) text = xrealloc(text, cap *= 2);
+            memcpy(text + n, buf, w);
+            n += w;
+            if (pos == len || prog[pos] == 0) break;
+
+            uint8_t b = prog[pos++];
+            if (b < TOK_FIRST) {
+                buf[0] = b;
+                w = 1;
+            } else if (b - TOK_FIRST < NTOKENS) {
+                w = sprintf(buf, " %s ", tokens[b - TOK_FIRST]);
+            } else {
+                buf[0] = '?';
+                w = 1;
+            }
+        }
+        text[n++] = '\n';
+        ++pos;
+    }
+
+    *textlen = n;
+    return text;
+}
@@ -0,0 +1,458 @@
+//  fs/dos33.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "fs.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// DOS 3.3 volumes.
+//
+// The VTOC (T17 S0) holds the free-sector bitmap and points to the
+// first sector of the catalog, a chain of sectors of 7 file entries
+// each. A file entry points to the first of its file's chain of
+// track/sector lists, which hold the locations of its data sectors.
+
+#define VTOC_TRACK      17
+#define TSL_PAIRS       122
+#define ENTRY_SIZE      35
+#define ENTRIES_PER_SEC 7
+#define NAME_LEN        30
+#define DELETED         0xFF
+
+// VTOC fields
+#define V_CAT_TRACK     0x01
+#define V_CAT_SECTOR    0x02
+#define V_VOLUME        0x06
+#define V_TSL_PAIRS     0x27
+#define V_TRACKS        0x34
+#define V_SECTORS       0x35
+#define V_BITMAP        0x38
+
+// File entry fields
+#define E_TRACK         0x00
+#define E_SECTOR        0x01
+#define E_TYPE          0x02
+#define E_NAME          0x03
+#define E_DELTRACK      0x20    // where the track goes, once deleted
+#define E_LENGTH        0x21
+
+#define LOCKED          0x80
+
+enum {
+    T_TEXT      = 0x00,
+    T_INTEGER   = 0x01,
+    T_APPLESOFT = 0x02,
+    T_BINARY    = 0x04,
+    T_S         = 0x08,
+    T_RELOC     = 0x10,
+};
+
+static inline unsigned get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline void put16(uint8_t *p, unsigned v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static uint8_t *vtoc(Image *im)
+{
+    return image_sector(im, VTOC_TRACK, 0);
+}
+
+static bool probe(Image *im)
+{
+    if (!im->floppy) return false;
+    const uint8_t *v = vtoc(im);
+    return v[V_CAT_TRACK] != 0 && v[V_CAT_TRACK] < FS_TRACKS
+        && v[V_CAT_SECTOR] < FS_SECTORS
+        && v[V_TSL_PAIRS] == TSL_PAIRS
+        && v[V_TRACKS] == FS_TRACKS && v[V_SECTORS] == FS_SECTORS;
+}
+
+// Free-sector bitmap: four bytes a track, of which the first two
+// are used. A set bit means the sector is free.
+static uint8_t *bitmap_byte(Image *im, unsigned t, unsigned s, int *bit)
+{
+    *bit = s & 7;
+    return &vtoc(im)[V_BITMAP + 4 * t + (s < 8)];
+}
+
+static bool sector_free(Image *im, unsigned t, unsigned s)
+{
+    int bit;
+    return (*bitmap_byte(im, t, s, &bit) >> bit) & 1;
+}
+
+static void set_free(Image *im, unsigned t, unsigned s, bool fr)
+{
+    int bit;
+    uint8_t *b = bitmap_byte(im, t, s, &bit);
+    if (fr) *b |= 1 << bit; else *b &= ~(1 << bit);
+    im->dirty = true;
+}
+
+// Like DOS, work outward from the catalog track. Track 0 is never
+// used: it would read as the end of a track/sector list.
+static int alloc_order(int i)
+{
+    return i < FS_TRACKS - VTOC_TRACK - 1
+        ? VTOC_TRACK + 1 + i
+        : VTOC_TRACK - 1 - (i - (FS_TRACKS - VTOC_TRACK - 1));
+}
+
+static unsigned count_free(Image *im)
+{
+    unsigned n = 0;
+    for (int t = 1; t != FS_TRACKS; ++t) {
+        if (t == VTOC_TRACK) continue;
+        for (int s = 0; s != FS_SECTORS; ++s) n += sector_free(im, t, s);
+    }
+    return n;
+}
+
+static void alloc_sector(Image *im, uint8_t *t, uint8_t *s)
+{
+    for (int i = 0; i != FS_TRACKS - 2; ++i) {
+        int tr = alloc_order(i);
+        for (int sec = FS_SECTORS - 1; sec >= 0; --sec) {
+            if (sector_free(im, tr, sec)) {
+                set_free(im, tr, sec, false);
+                *t = tr;
+                *s = sec;
+                return;
+            }
+        }
+    }
+    fail("disk full.");
+}
+
+typedef struct CatPos CatPos;
+struct CatPos {
+    uint8_t     *sec;
+    int         idx;
+    unsigned    visited;
+};
+
+// Steps through every catalog entry, used or not. Start with a
+// zeroed CatPos; returns NULL at the end.
+static uint8_t *cat_next(Image *im, CatPos *p)
+{
+    if (p->sec == NULL) {
+        const uint8_t *v = vtoc(im);
+        p->sec = image_sector(im, v[V_CAT_TRACK], v[V_CAT_SECTOR]);
+        p->idx = 0;
+    } else if (++p->idx == ENTRIES_PER_SEC) {
+        if (p->sec[1] == 0) return NULL;
+        if (++p->visited == FS_TRACKS * FS_SECTORS) {
+            fail("catalog chain loops.");
+        }
+        p->sec = image_sector(im, p->sec[1], p->sec[2]);
+        p->idx = 0;
+    }
+    return p->sec + 0x0B + p->idx * ENTRY_SIZE;
+}
+
+static bool in_use(const uint8_t *e)
+{
+    return e[E_TRACK] != 0 && e[E_TRACK] != DELETED;
+}
+
+static void encode_name(const char *name, uint8_t *out)
+{
+    size_t len = strlen(name);
+    if (len == 0 || len > NAME_LEN) {
+        fail("\"%s\": DOS 3.3 names are 1 to %d characters.", name,
+             NAME_LEN);
+    }
+    if (!isalpha((unsigned char)name[0]) || strchr(name, ',')) {
+        fail("\"%s\": DOS 3.3 names start with a letter, and have no "
+             "commas.", name);
+    }
+    for (size_t i = 0; i != NAME_LEN; ++i) {
+        out[i] = (i < len? toupper((unsigned char)name[i]) : ' ') | 0x80;
+    }
+}
+
+static uint8_t *find(Image *im, const char *name)
+{
+    uint8_t enc[NAME_LEN];
+    encode_name(name, enc);
+
+    CatPos pos = {0};
+    uint8_t *e;
+    while ((e = cat_next(im, &pos)) != NULL) {
+        if (in_use(e) && memcmp(e + E_NAME, enc, NAME_LEN) == 0) return e;
+    }
+    return NULL;
+}
+
+static uint8_t *must_find(Image *im, const char *name)
+{
+    uint8_t *e = find(im, name);
+    if (e == NULL) fail("%s: file not found.", name);
+    return e;
+}
+
+static char type_letter(unsigned type)
+{
+    static const char letters[] = "IABSRAB";
+    type &= ~LOCKED;
+    for (int i = 6; i >= 0; --i) {
+        if (type & (1 << i)) return letters[i];
+    }
+    return 'T';
+}
+
+static void catalog(Image *im)
+{
+    printf("DISK VOLUME %u\n\n", vtoc(im)[V_VOLUME]);
+
+    CatPos pos = {0};
+    uint8_t *e;
+    while ((e = cat_next(im, &pos)) != NULL) {
+        if (!in_use(e)) continue;
+        char name[NAME_LEN + 1];
+        int len = 0;
+        for (int i = 0; i != NAME_LEN; ++i) {
+            name[i] = e[E_NAME + i] & 0x7F;
+            if (name[i] != ' ') len = i + 1;
+        }
+        name[len] = '\0';
+        printf("%c%c %03u %s\n", e[E_TYPE] & LOCKED? '*' : ' ',
+               type_letter(e[E_TYPE]), get16(e + E_LENGTH) % 1000, name);
+    }
+}
+
+// Walks a file's track/sector lists, calling fn (with data NULL) for
+// each list sector, then for each data sector it lists, where n is
+// the data sector's position within the file.
+typedef void (*SectorFn)(Image *im, uint8_t *tsl, uint8_t *data,
+                         unsigned n, void *ctx);
+
+static void walk(Image *im, const uint8_t *e, SectorFn fn, void *ctx)
+{
+    unsigned t = e[E_TRACK], s = e[E_SECTOR];
+    unsigned visited = 0;
+    while (t != 0) {
+        if (++visited == FS_TRACKS * FS_SECTORS) {
+            fail("track/sector list chain loops.");
+        }
+        uint8_t *tsl = image_sector(im, t, s);
+        fn(im, tsl, NULL, 0, ctx);
+        unsigned base = get16(tsl + 5);
+        for (int i = 0; i != TSL_PAIRS; ++i) {
+            const uint8_t *p = tsl + 0x0C + 2 * i;
+            if (p[0] != 0) {
+                fn(im, tsl, image_sector(im, p[0], p[1]), base + i, ctx);
+            }
+        }
+        t = tsl[1];
+        s = tsl[2];
+    }
+}
+
+typedef struct Gather Gather;
+struct Gather {
+    uint8_t     *buf;
+    size_t      len;
+};
+
+static void gather(Image *im, uint8_t *tsl, uint8_t *data, unsigned n,
+                   void *ctx)
+{
+    Gather *g = ctx;
+    if (data == NULL) return;
+    size_t end = (n + 1) * (size_t)FS_SECTOR_SIZE;
+    if (end > g->len) {
+        g->buf = xrealloc(g->buf, end);
+        memset(g->buf + g->len, 0, end - g->len);
+        g->len = end;
+    }
+    memcpy(g->buf + n * FS_SECTOR_SIZE, data, FS_SECTOR_SIZE);
+}
+
+static void extract(Image *im, const char *name, FileData *fd)
+{
+    const uint8_t *e = must_find(im, name);
+    Gather g = { xalloc(1), 0 };
+    walk(im, e, gather, &g);
+
+    size_t skip = 0, len = g.len;
+    fd->aux = 0;
+    switch (e[E_TYPE] & ~LOCKED) {
+    case T_TEXT:
+        fd->kind = KIND_TEXT;
+        len = 0;
+        while (len != g.len && g.buf[len] != 0) ++len;
+        break;
+    case T_INTEGER:
+    case T_APPLESOFT:
+        fd->kind = (e[E_TYPE] & T_APPLESOFT)? KIND_BASIC : KIND_OTHER;
+        skip = 2;
+        len = g.len >= 2? get16(g.buf) : 0;
+        break;
+    case T_BINARY:
+        fd->kind = KIND_BINARY;
+        skip = 4;
+        fd->aux = g.len >= 2? get16(g.buf) : 0;
+        len = g.len >= 4? get16(g.buf + 2) : 0;
+        break;
+    default:
+        fd->kind = KIND_OTHER;
+        break;
+    }
+    if (skip > g.len) skip = g.len;
+    if (len > g.len - skip) len = g.len - skip;
+    fd->data = g.buf;
+    memmove(fd->data, fd->data + skip, len);
+    fd->len = len;
+}
+
+static void free_sector(Image *im, uint8_t *tsl, uint8_t *data, unsigned n,
+                        void *ctx)
+{
+    uint8_t *s = data? data : tsl;
+    size_t off = s - im->buf;
+    unsigned t = off / (FS_SECTORS * FS_SECTOR_SIZE);
+    unsigned pos = off / FS_SECTOR_SIZE % FS_SECTORS;
+    for (int sec = 0; sec != FS_SECTORS; ++sec) {
+        if (im->dos_pos[sec] == pos) set_free(im, t, sec, true);
+    }
+}
+
+static void remove_entry(Image *im, uint8_t *e)
+{
+    walk(im, e, free_sector, NULL);
+    e[E_DELTRACK] = e[E_TRACK];
+    e[E_TRACK] = DELETED;
+    im->dirty = true;
+}
+
+static void delete(Image *im, const char *name)
+{
+    uint8_t *e = must_find(im, name);
+    if (e[E_TYPE] & LOCKED) fail("%s: file is locked.", name);
+    remove_entry(im, e);
+}
+
+static unsigned native_type(const FileData *fd)
+{
+    switch (fd->kind) {
+    case KIND_TEXT:     return T_TEXT;
+    case KIND_BINARY:   return T_BINARY;
+    case KIND_BASIC:    return T_APPLESOFT;
+    default:
+        break;
+    }
+    if (strcasecmp(fd->type, "I") == 0) return T_INTEGER;
+    if (strcasecmp(fd->type, "S") == 0) return T_S;
+    if (strcasecmp(fd->type, "R") == 0) return T_RELOC;
+    fail("unknown DOS 3.3 file type \"%s\".", fd->type);
+    return 0;
+}
+
+static void insert(Image *im, const char *name, const FileData *fd)
+{
+    uint8_t enc[NAME_LEN];
+    encode_name(name, enc);
+    unsigned type = native_type(fd);
+
+    // Lay the file out as DOS keeps it.
+    size_t hdr = type == T_BINARY? 4
+        : (type == T_INTEGER || type == T_APPLESOFT)? 2 : 0;
+    if (hdr != 0 && fd->len > 0xFFFF) {
+        fail("%s: too large for a DOS 3.3 %c file.", name,
+             type_letter(type));
+    }
+    size_t len = hdr + fd->len;
+    uint8_t *buf = xalloc(len + 1);
+    if (type == T_BINARY) {
+        put16(buf, fd->aux);
+        put16(buf + 2, fd->len);
+    } else if (hdr) {
+        put16(buf, fd->len);
+    }
+    memcpy(buf + hdr, fd->data, fd->len);
+    if (type == T_TEXT) {
+        for (size_t i = 0; i != len; ++i) buf[i] |= 0x80;
+    }
+
+    uint8_t *e = find(im, name);
+    if (e != NULL) {
+        if (e[E_TYPE] & LOCKED) fail("%s: file is locked.", name);
+        remove_entry(im, e);
+    } else {
+        CatPos pos = {0};
+        while ((e = cat_next(im, &pos)) != NULL && in_use(e))
+            ;
+        if (e == NULL) fail("catalog is full.");
+    }
+
+    unsigned nsec = (len + FS_SECTOR_SIZE - 1) / FS_SECTOR_SIZE;
+    unsigned ntsl = nsec? (nsec + TSL_PAIRS - 1) / TSL_PAIRS : 1;
+    if (count_free(im) < nsec + ntsl) fail("disk full.");
+
+    uint8_t t, s;
+    alloc_sector(im, &t, &s);
+    memset(e, 0, ENTRY_SIZE);
+    e[E_TRACK] = t;
+    e[E_SECTOR] = s;
+    e[E_TYPE] = type;
+    memcpy(e + E_NAME, enc, NAME_LEN);
+    put16(e + E_LENGTH, nsec + ntsl);
+
+    uint8_t *tsl = image_sector(im, t, s);
+    memset(tsl, 0, FS_SECTOR_SIZE);
+    for (unsigned n = 0; n != nsec; ++n) {
+        if (n != 0 && n % TSL_PAIRS == 0) {
+            alloc_sector(im, &t, &s);
+            tsl[1] = t;
+            tsl[2] = s;
+            tsl = image_sector(im, t, s);
+            memset(tsl, 0, FS_SECTOR_SIZE);
+            put16(tsl + 5, n);
+        }
+        alloc_sector(im, &t, &s);
+        tsl[0x0C + 2 * (n % TSL_PAIRS)] = t;
+        tsl[0x0D + 2 * (n % TSL_PAIRS)] = s;
+
+        uint8_t *data = image_sector(im, t, s);
+        size_t off = n * (size_t)FS_SECTOR_SIZE;
+        size_t chunk = len - off < FS_SECTOR_SIZE? len - off : FS_SECTOR_SIZE;
+        memset(data, 0, FS_SECTOR_SIZE);
+        memcpy(data, buf + off, chunk);
+    }
+    free(buf);
+    im->dirty = true;
+}
+
+static void rename_file(Image *im, const char *from, const char *to)
+{
+    uint8_t *e = must_find(im, from);
+    uint8_t *other = find(im, to);
+    if (other != NULL && other != e) fail("%s: file exists.", to);
+    if (e[E_TYPE] & LOCKED) fail("%s: file is locked.", from);
+    encode_name(to, e + E_NAME);
+    im->dirty = true;
+}
+
+const FsOps dos33_ops = {
+    .name = "DOS 3.3",
+    .probe = probe,
+    .catalog = catalog,
+    .extract = extract,
+    .insert = insert,
+    .delete = delete,
+    .rename = rename_file,
+};
@@ -0,0 +1,167 @@
+//  fs/image.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "fs.h"
+#include "secmap.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Disk images are read whole into memory, and written back (if
+// changed) by replacing the file, so that a running bobbin that's
+// following the image sees one complete change.
+
+#define TWOMG_HDR_SIZE  64
+
+static const size_t nib_disksz = 232960;
+
+static unsigned long le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | ((unsigned long)p[2] << 16)
+        | ((unsigned long)p[3] << 24);
+}
+
+static const char *file_ext(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(slash? slash : path, '.');
+    return dot? dot + 1 : "";
+}
+
+void image_load(Image *im, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) fail("%s", strerror(errno));
+
+    size_t cap = FS_FLOPPY_SIZE, n = 0;
+    im->file = xalloc(cap);
+    for (;;) {
+        n += fread(im->file + n, 1, cap - n, f);
+        if (n < cap) break;
+        cap *= 2;
+        im->file = xrealloc(im->file, cap);
+    }
+    if (ferror(f)) fail("%s", strerror(errno));
+    fclose(f);
+
+    im->path = path;
+    im->file_size = n;
+    im->buf = im->file;
+    im->size = n;
+    im->dirty = false;
+
+    const char *ext = file_ext(path);
+    if (strcasecmp(ext, "2mg") == 0 || strcasecmp(ext, "2img") == 0) {
+        // As for --hdd: ProDOS-ordered only.
+        if (n < TWOMG_HDR_SIZE || memcmp(im->file, "2IMG", 4) != 0) {
+            fail("not a 2IMG file.");
+        }
+        unsigned long off = le32(im->file + 0x18);
+        unsigned long len = le32(im->file + 0x1C);
+        if (le32(im->file + 0x0C) != 1) {
+            fail("only ProDOS-ordered 2IMG files are supported.");
+        }
+        if (off > n || len > n - off) {
+            fail("2IMG data lies outside the file.");
+        }
+        im->buf = im->file + off;
+        im->size = n = len;
+    }
+
+    if (n == nib_disksz) {
+        fail("nibble images aren't supported.");
+    } else if (n != FS_FLOPPY_SIZE && (n == 0 || n % FS_BLOCK_SIZE != 0)) {
+        fail("not a disk image (unexpected size %zu).", n);
+    }
+    im->floppy = (n == FS_FLOPPY_SIZE);
+
+    // Block images are always in ProDOS order; floppies go by
+    // extension, as in the emulator.
+    bool po = !im->floppy || strcasecmp(ext, "po") == 0
+        || im->buf != im->file;
+    for (int phys = 0; phys != FS_SECTORS; ++phys) {
+        im->dos_pos[DO[phys]] = po? PO[phys] : DO[phys];
+        im->pro_pos[PO[phys]] = po? PO[phys] : DO[phys];
+    }
+}
+
+void image_save(Image *im)
+{
+    if (!im->dirty) return;
+
+    struct stat st;
+    if (stat(im->path, &st) < 0) fail("%s", strerror(errno));
+
+    char *tmp = xalloc(strlen(im->path) + sizeof ".XXXXXX");
+    sprintf(tmp, "%s.XXXXXX", im->path);
+    int fd = mkstemp(tmp);
+    if (fd < 0) fail("couldn't create temporary file: %s", strerror(errno));
+
+    size_t done = 0;
+    while (done != im->file_size) {
+        ssize_t w = write(fd, im->file + done, im->file_size - done);
+        if (w < 0) {
+            int e = errno;
+            close(fd);
+            unlink(tmp);
+            fail("couldn't write: %s", strerror(e));
+        }
+        done += w;
+    }
+    fchmod(fd, st.st_mode & 07777);
+    if (close(fd) < 0 || rename(tmp, im->path) < 0) {
+        int e = errno;
+        unlink(tmp);
+        fail("couldn't replace image: %s", strerror(e));
+    }
+    free(tmp);
+    im->dirty = false;
+}
+
+uint8_t *image_sector(Image *im, unsigned track, unsigned sector)
+{
+    if (!im->floppy || track >= FS_TRACKS || sector >= FS_SECTORS) {
+        fail("bad track/sector %u/%u.", track, sector);
+    }
+    return im->buf + (track * FS_SECTORS + im->dos_pos[sector])
+        * FS_SECTOR_SIZE;
+}
+
+// ProDOS block blk is two 256-byte halves, which in a DOS-ordered
+// image aren't next to each other.
+static uint8_t *block_half(Image *im, unsigned blk, unsigned half)
+{
+    if (blk >= image_blocks(im)) fail("bad block number %u.", blk);
+    if (!im->floppy) {
+        return im->buf + blk * FS_BLOCK_SIZE + half * FS_SECTOR_SIZE;
+    }
+    unsigned track = blk / 8, psec = (blk % 8) * 2 + half;
+    return im->buf + (track * FS_SECTORS + im->pro_pos[psec])
+        * FS_SECTOR_SIZE;
+}
+
+void image_read_block(Image *im, unsigned blk, uint8_t *buf)
+{
+    memcpy(buf, block_half(im, blk, 0), FS_SECTOR_SIZE);
+    memcpy(buf + FS_SECTOR_SIZE, block_half(im, blk, 1), FS_SECTOR_SIZE);
+}
+
+void image_write_block(Image *im, unsigned blk, const uint8_t *buf)
+{
+    memcpy(block_half(im, blk, 0), buf, FS_SECTOR_SIZE);
+    memcpy(block_half(im, blk, 1), buf + FS_SECTOR_SIZE, FS_SECTOR_SIZE);
+    im->dirty = true;
+}
+
+unsigned image_blocks(const Image *im)
+{
+    return im->size / FS_BLOCK_SIZE;
+}
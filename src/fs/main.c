@@ -0,0 +1,362 @@
+//  fs/main.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "fs.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// bobbin-fs: catalogs, extracts, inserts, deletes and renames files on
+// DOS 3.3 and ProDOS disk images, working on the image files directly.
+// Given several images, it works on them in parallel, one process
+// apiece.
+
+typedef enum {
+    CMD_CATALOG,
+    CMD_EXTRACT,
+    CMD_INSERT,
+    CMD_DELETE,
+    CMD_RENAME,
+} Command;
+
+static const struct {
+    const char  *name;
+    const char  *alias;
+    Command     cmd;
+    int         nargs;
+} commands[] = {
+    { "catalog", "ls",  CMD_CATALOG, 0 },
+    { "extract", "get", CMD_EXTRACT, 1 },
+    { "insert",  "put", CMD_INSERT,  2 },
+    { "delete",  "rm",  CMD_DELETE,  1 },
+    { "rename",  "mv",  CMD_RENAME,  2 },
+};
+
+static const FsOps *const filesystems[] = { &dos33_ops, &prodos_ops };
+
+static const char *progname;
+static const char *cur_file;
+
+static struct {
+    long        jobs;
+    const char  *out;
+    bool        raw;
+    const char  *type;
+    unsigned    addr;
+} opt = { 0, NULL, false, "BIN", 0x2000 };
+
+static Command cmd;
+static char **args;
+static FileData input;
+
+static void exit_with_usage(int status)
+{
+    FILE *fp = status == 0? stdout : stderr;
+
+    fprintf(fp, "USAGE: %s [OPTIONS] COMMAND [ARGS] IMAGE...\n"
+          "\n"
+          "Works with the files on DOS 3.3 and ProDOS disk images\n"
+          "(.dsk, .do, .po, .hdv, .2mg; ProDOS volumes may be any\n"
+          "size).\n"
+          "\n"
+          "Commands:\n"
+          "  catalog (ls)             List the files.\n"
+          "  extract (get) NAME       Write file NAME's contents out.\n"
+          "  insert (put) FILE NAME   Copy host FILE (- for stdin) in\n"
+          "                           as NAME, replacing any old NAME.\n"
+          "  delete (rm) NAME         Delete file NAME.\n"
+          "  rename (mv) OLD NEW      Rename file OLD to NEW.\n"
+          "\n"
+          "Options:\n"
+          "  -j JOBS     Work on up to JOBS images at once (default:\n"
+          "              the number of CPUs).\n"
+          "  -o FILE     extract: write to FILE, not standard output.\n"
+          "  -t TYPE     insert: the file's type. T/TXT (text), B/BIN\n"
+          "              (binary; the default), A/BAS (AppleSoft), or\n"
+          "              another DOS 3.3 letter or ProDOS type.\n"
+          "  -a ADDR     insert: a binary's load address, in hex\n"
+          "              (default 2000).\n"
+          "  -r          Raw: don't convert text files' line endings,\n"
+          "              or list AppleSoft programs as text.\n"
+          "\n"
+          "ProDOS names may be paths (DIR/FILE), from the volume\n"
+          "directory.\n", progname);
+    exit(status);
+}
+
+void fail(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "%s: ", progname);
+    if (cur_file) fprintf(stderr, "%s: ", cur_file);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    exit(1);
+}
+
+void *xalloc(size_t sz)
+{
+    void *p = malloc(sz);
+    if (p == NULL) fail("out of memory.");
+    return p;
+}
+
+void *xrealloc(void *p, size_t sz)
+{
+    p = realloc(p, sz);
+    if (p == NULL) fail("out of memory.");
+    return p;
+}
+
+static FileKind kind_of(const char *type)
+{
+    if (!strcasecmp(type, "T") || !strcasecmp(type, "TXT")) return KIND_TEXT;
+    if (!strcasecmp(type, "B") || !strcasecmp(type, "BIN")) return KIND_BINARY;
+    if (!strcasecmp(type, "A") || !strcasecmp(type, "BAS")) return KIND_BASIC;
+    return KIND_OTHER;
+}
+
+// Reads and converts the file to insert, once for all images.
+static void read_input(const char *path)
+{
+    cur_file = path;
+    FILE *f = strcmp(path, "-") == 0? stdin : fopen(path, "rb");
+    if (f == NULL) fail("%s", strerror(errno));
+
+    size_t cap = 4096, n = 0;
+    uint8_t *buf = xalloc(cap);
+    for (;;) {
+        n += fread(buf + n, 1, cap - n, f);
+        if (n < cap) break;
+        buf = xrealloc(buf, cap *= 2);
+    }
+    if (ferror(f)) fail("%s", strerror(errno));
+    if (f != stdin) fclose(f);
+
+    input.type = opt.type;
+    input.kind = kind_of(opt.type);
+    input.aux = opt.addr;
+    input.data = buf;
+    input.len = n;
+
+    if (opt.raw) {
+        // as is
+    } else if (input.kind == KIND_TEXT) {
+        size_t o = 0;
+        for (size_t i = 0; i != n; ++i) {
+            if (buf[i] == '\r' && i + 1 != n && buf[i + 1] == '\n') continue;
+            buf[o++] = buf[i] == '\n'? '\r' : buf[i];
+        }
+        input.len = o;
+    } else if (input.kind == KIND_BASIC && memchr(buf, 0, n) == NULL) {
+        // Program text, not (as it would have NULs) already tokenized.
+        input.data = asoft_tokenize((const char *)buf, n, &input.len);
+        free(buf);
+    }
+    cur_file = NULL;
+}
+
+static void write_output(FileData *fd)
+{
+    uint8_t *data = fd->data;
+    size_t len = fd->len;
+    if (opt.raw) {
+        // as is
+    } else if (fd->kind == KIND_BASIC) {
+        data = (uint8_t *)asoft_detokenize(fd->data, fd->len, &len);
+    } else if (fd->kind == KIND_TEXT) {
+        for (size_t i = 0; i != len; ++i) {
+            data[i] &= 0x7F;
+            if (data[i] == '\r') data[i] = '\n';
+        }
+    }
+
+    FILE *f = opt.out? fopen(opt.out, "wb") : stdout;
+    if (f == NULL) fail("%s: %s", opt.out, strerror(errno));
+    if (fwrite(data, 1, len, f) != len || fflush(f) != 0) {
+        fail("couldn't write: %s", strerror(errno));
+    }
+    if (f != stdout) fclose(f);
+}
+
+static void do_image(const char *path)
+{
+    cur_file = path;
+    Image im;
+    image_load(&im, path);
+
+    const FsOps *fs = NULL;
+    for (size_t i = 0; fs == NULL && i != sizeof filesystems
+                                             / sizeof filesystems[0]; ++i) {
+        if (filesystems[i]->probe(&im)) fs = filesystems[i];
+    }
+    if (fs == NULL) fail("no DOS 3.3 or ProDOS filesystem found.");
+
+    switch (cmd) {
+    case CMD_CATALOG:
+        fs->catalog(&im);
+        break;
+    case CMD_EXTRACT: {
+        FileData fd;
+        fs->extract(&im, args[0], &fd);
+        write_output(&fd);
+        break;
+    }
+    case CMD_INSERT:
+        fs->insert(&im, args[1], &input);
+        break;
+    case CMD_DELETE:
+        fs->delete(&im, args[0]);
+        break;
+    case CMD_RENAME:
+        fs->rename(&im, args[0], args[1]);
+        break;
+    }
+    image_save(&im);
+    free(im.file);
+    cur_file = NULL;
+}
+
+// Each image gets a process. Their output is held in temporary files
+// and passed on in the order the images were given.
+static int run_parallel(char **images, int n)
+{
+    FILE **outs = xalloc(n * sizeof *outs);
+    pid_t *pids = xalloc(n * sizeof *pids);
+    int *status = xalloc(n * sizeof *status);
+    int next = 0, running = 0, shown = 0, result = 0;
+
+    while (shown != n) {
+        while (running != opt.jobs && next != n) {
+            outs[next] = tmpfile();
+            if (outs[next] == NULL) {
+                fail("couldn't create temporary file: %s", strerror(errno));
+            }
+            fflush(stdout);
+            fflush(stderr);
+            pid_t pid = fork();
+            if (pid < 0) fail("couldn't fork: %s", strerror(errno));
+            if (pid == 0) {
+                if (dup2(fileno(outs[next]), STDOUT_FILENO) < 0) {
+                    fail("couldn't redirect output: %s", strerror(errno));
+                }
+                do_image(images[next]);
+                exit(0);
+            }
+            pids[next++] = pid;
+            ++running;
+        }
+
+        int st;
+        pid_t pid = wait(&st);
+        if (pid < 0) fail("wait: %s", strerror(errno));
+        for (int i = shown; i != next; ++i) {
+            if (pids[i] == pid) {
+                pids[i] = 0;
+                status[i] = st;
+            }
+        }
+        --running;
+
+        for (; shown != next && pids[shown] == 0; ++shown) {
+            if (cmd == CMD_CATALOG) {
+                printf("%s%s:\n", shown? "\n" : "", images[shown]);
+            }
+            rewind(outs[shown]);
+            char buf[4096];
+            size_t got;
+            while ((got = fread(buf, 1, sizeof buf, outs[shown])) != 0) {
+                fwrite(buf, 1, got, stdout);
+            }
+            fclose(outs[shown]);
+            if (!WIFEXITED(status[shown]) || WEXITSTATUS(status[shown])) {
+                result = 1;
+            }
+        }
+    }
+    fflush(stdout);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    progname = strrchr(argv[0], '/');
+    progname = progname? progname + 1 : argv[0];
+
+    int c;
+    while ((c = getopt(argc, argv, "j:o:t:a:rh")) != -1) {
+        char *end;
+        switch (c) {
+        case 'j':
+            opt.jobs = strtol(optarg, &end, 10);
+            if (*end != '\0' || opt.jobs < 1) {
+                fail("-j needs a positive number.");
+            }
+            break;
+        case 'o':
+            opt.out = optarg;
+            break;
+        case 't':
+            opt.type = optarg;
+            break;
+        case 'a':
+            opt.addr = strtoul(optarg + (optarg[0] == '$'), &end, 16);
+            if (*end != '\0' || opt.addr > 0xFFFF) {
+                fail("-a needs a hex address.");
+            }
+            break;
+        case 'r':
+            opt.raw = true;
+            break;
+        case 'h':
+            exit_with_usage(0);
+            break;
+        default:
+            exit_with_usage(2);
+            break;
+        }
+    }
+    if (optind == argc) exit_with_usage(2);
+
+    const char *name = argv[optind++];
+    size_t i;
+    for (i = 0; i != sizeof commands / sizeof commands[0]; ++i) {
+        if (!strcmp(name, commands[i].name)
+            || !strcmp(name, commands[i].alias)) {
+            break;
+        }
+    }
+    if (i == sizeof commands / sizeof commands[0]) {
+        fprintf(stderr, "%s: unknown command \"%s\".\n", progname, name);
+        exit_with_usage(2);
+    }
+    cmd = commands[i].cmd;
+    args = argv + optind;
+    char **images = args + commands[i].nargs;
+    int nimages = argc - optind - commands[i].nargs;
+    if (nimages < 1) exit_with_usage(2);
+    if (opt.out && nimages != 1) fail("-o works with only one image.");
+
+    if (cmd == CMD_INSERT) read_input(args[0]);
+
+    if (nimages == 1) {
+        do_image(images[0]);
+        return 0;
+    }
+    if (opt.jobs == 0) {
+        opt.jobs = sysconf(_SC_NPROCESSORS_ONLN);
+        if (opt.jobs < 1) opt.jobs = 1;
+    }
+    return run_parallel(images, nimages);
+}
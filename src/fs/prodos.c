@@ -0,0 +1,645 @@
+//  fs/prodos.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "fs.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+// ProDOS volumes, on floppies or block images of any size.
+//
+// The volume directory starts at block 2. Every directory is a
+// chain of blocks of file entries, the first of which is the
+// directory's own header. A file's key block is its data (seedling,
+// up to 512 bytes), an index of data blocks (sapling, up to 128k),
+// or an index of index blocks (tree).
+//
+// Subdirectories can be read and written by path (DIR/FILE), but
+// aren't created or grown; files are written as seedlings or
+// saplings only.
+
+#define VOL_DIR_BLOCK   2
+#define NAME_LEN        15
+#define ENTRY_LEN       0x27
+#define ENTRIES_PER_BLK 0x0D
+#define MAX_PATH_DEPTH  64
+
+enum {
+    ST_DELETED      = 0x0,
+    ST_SEEDLING     = 0x1,
+    ST_SAPLING      = 0x2,
+    ST_TREE         = 0x3,
+    ST_SUBDIR       = 0xD,
+    ST_SUBDIR_HDR   = 0xE,
+    ST_VOLUME_HDR   = 0xF,
+};
+
+// Entry fields
+#define E_STORAGE       0x00    // storage type << 4 | name length
+#define E_NAME          0x01
+#define E_TYPE          0x10
+#define E_KEY           0x11
+#define E_BLOCKS        0x13
+#define E_EOF           0x15
+#define E_CREATED       0x18
+#define E_VERSION       0x1C
+#define E_MIN_VERSION   0x1D
+#define E_ACCESS        0x1E
+#define E_AUX           0x1F
+#define E_MODIFIED      0x21
+#define E_HEADER        0x25
+
+// Header fields
+#define H_ENTRY_LEN     0x1F
+#define H_PER_BLOCK     0x20
+#define H_FILE_COUNT    0x21
+#define H_BITMAP        0x23    // volume header only
+#define H_TOTAL_BLOCKS  0x25    // volume header only
+
+#define ACCESS_DESTROY  0x80
+#define ACCESS_DEFAULT  0xE3    // destroy, rename, backup, write, read
+
+enum {
+    TYPE_TXT = 0x04,
+    TYPE_BIN = 0x06,
+    TYPE_BAS = 0xFC,
+};
+
+static const struct {
+    uint8_t     type;
+    const char  *name;
+} type_names[] = {
+    { 0x01, "BAD" }, { 0x04, "TXT" }, { 0x06, "BIN" }, { 0x0F, "DIR" },
+    { 0x19, "ADB" }, { 0x1A, "AWP" }, { 0x1B, "ASP" }, { 0xEF, "PAS" },
+    { 0xF0, "CMD" }, { 0xFA, "INT" }, { 0xFB, "IVR" }, { 0xFC, "BAS" },
+    { 0xFD, "VAR" }, { 0xFE, "REL" }, { 0xFF, "SYS" },
+};
+
+typedef struct Vol Vol;
+struct Vol {
+    Image       *im;
+    char        name[NAME_LEN + 1];
+    unsigned    total;
+    unsigned    bitmap_blk;
+    uint8_t     *bitmap;
+    bool        bitmap_dirty;
+};
+
+typedef struct Dir Dir;
+struct Dir {
+    unsigned    nblocks;
+    unsigned    *blocks;
+    uint8_t     (*data)[FS_BLOCK_SIZE];
+    unsigned    elen, epb;
+};
+
+static inline unsigned get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline void put16(uint8_t *p, unsigned v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+static inline unsigned long get24(const uint8_t *p)
+{
+    return get16(p) | ((unsigned long)p[2] << 16);
+}
+
+static inline void put24(uint8_t *p, unsigned long v)
+{
+    put16(p, v & 0xFFFF);
+    p[2] = (v >> 16) & 0xFF;
+}
+
+static bool probe(Image *im)
+{
+    if (image_blocks(im) <= VOL_DIR_BLOCK) return false;
+    uint8_t b[FS_BLOCK_SIZE];
+    image_read_block(im, VOL_DIR_BLOCK, b);
+    const uint8_t *h = b + 4;
+    return get16(b) == 0 && (h[E_STORAGE] >> 4) == ST_VOLUME_HDR
+        && (h[E_STORAGE] & 0xF) != 0
+        && h[H_ENTRY_LEN] == ENTRY_LEN && h[H_PER_BLOCK] == ENTRIES_PER_BLK;
+}
+
+static void load_dir(Image *im, unsigned key, Dir *d)
+{
+    d->nblocks = 0;
+    d->blocks = NULL;
+    d->data = NULL;
+    unsigned blk = key;
+    while (blk != 0) {
+        if (d->nblocks == image_blocks(im)) fail("directory chain loops.");
+        d->blocks = xrealloc(d->blocks, (d->nblocks + 1) * sizeof *d->blocks);
+        d->data = xrealloc(d->data, (d->nblocks + 1) * sizeof *d->data);
+        d->blocks[d->nblocks] = blk;
+        image_read_block(im, blk, d->data[d->nblocks]);
+        blk = get16(d->data[d->nblocks] + 2);
+        ++d->nblocks;
+    }
+    const uint8_t *h = d->data[0] + 4;
+    d->elen = h[H_ENTRY_LEN];
+    d->epb = h[H_PER_BLOCK];
+    if (d->elen < ENTRY_LEN || d->epb == 0 || 4 + d->elen * d->epb > 512) {
+        fail("bad directory header in block %u.", key);
+    }
+}
+
+static void free_dir(Dir *d)
+{
+    free(d->blocks);
+    free(d->data);
+}
+
+static unsigned dir_entries(const Dir *d)
+{
+    return d->nblocks * d->epb;
+}
+
+// Entry 0 is the directory's header.
+static uint8_t *dir_entry(Dir *d, unsigned n)
+{
+    return d->data[n / d->epb] + 4 + (n % d->epb) * d->elen;
+}
+
+static void dir_store(Image *im, Dir *d, unsigned n)
+{
+    image_write_block(im, d->blocks[n / d->epb], d->data[n / d->epb]);
+}
+
+static void vol_open(Image *im, Vol *v)
+{
+    uint8_t b[FS_BLOCK_SIZE];
+    image_read_block(im, VOL_DIR_BLOCK, b);
+    const uint8_t *h = b + 4;
+    v->im = im;
+    memcpy(v->name, h + E_NAME, h[E_STORAGE] & 0xF);
+    v->name[h[E_STORAGE] & 0xF] = '\0';
+    v->total = get16(h + H_TOTAL_BLOCKS);
+    v->bitmap_blk = get16(h + H_BITMAP);
+    if (v->total > image_blocks(im)) {
+        fail("volume is %u blocks, but the image has only %u.",
+             v->total, image_blocks(im));
+    }
+
+    unsigned nbm = (v->total + 4095) / 4096;
+    v->bitmap = xalloc(nbm * FS_BLOCK_SIZE);
+    for (unsigned i = 0; i != nbm; ++i) {
+        image_read_block(im, v->bitmap_blk + i, v->bitmap + i * FS_BLOCK_SIZE);
+    }
+    v->bitmap_dirty = false;
+}
+
+static void vol_close(Vol *v)
+{
+    if (v->bitmap_dirty) {
+        unsigned nbm = (v->total + 4095) / 4096;
+        for (unsigned i = 0; i != nbm; ++i) {
+            image_write_block(v->im, v->bitmap_blk + i,
+                              v->bitmap + i * FS_BLOCK_SIZE);
+        }
+    }
+    free(v->bitmap);
+}
+
+// A set bit means the block is free.
+static bool block_free(const Vol *v, unsigned blk)
+{
+    return (v->bitmap[blk / 8] >> (7 - blk % 8)) & 1;
+}
+
+static void set_free(Vol *v, unsigned blk, bool fr)
+{
+    if (blk >= v->total) fail("bad block number %u.", blk);
+    uint8_t bit = 1 << (7 - blk % 8);
+    if (fr) v->bitmap[blk / 8] |= bit; else v->bitmap[blk / 8] &= ~bit;
+    v->bitmap_dirty = true;
+}
+
+static unsigned count_free(const Vol *v)
+{
+    unsigned n = 0;
+    for (unsigned b = 0; b != v->total; ++b) n += block_free(v, b);
+    return n;
+}
+
+static unsigned alloc_block(Vol *v)
+{
+    for (unsigned b = 0; b != v->total; ++b) {
+        if (block_free(v, b)) {
+            set_free(v, b, false);
+            return b;
+        }
+    }
+    fail("disk full.");
+    return 0;
+}
+
+static void check_name(const char *name, size_t len)
+{
+    bool ok = len != 0 && len <= NAME_LEN && isalpha((unsigned char)name[0]);
+    for (size_t i = 1; ok && i != len; ++i) {
+        ok = isalnum((unsigned char)name[i]) || name[i] == '.';
+    }
+    if (!ok) {
+        fail("\"%.*s\": ProDOS names are 1 to %d letters, digits and "
+             "periods, starting with a letter.", (int)len, name, NAME_LEN);
+    }
+}
+
+static bool name_is(const uint8_t *e, const char *name, size_t len)
+{
+    return (e[E_STORAGE] & 0xF) == len
+        && strncasecmp((const char *)e + E_NAME, name, len) == 0;
+}
+
+static int find_in(Dir *d, const char *name, size_t len)
+{
+    for (unsigned n = 1; n != dir_entries(d); ++n) {
+        uint8_t *e = dir_entry(d, n);
+        if ((e[E_STORAGE] >> 4) != ST_DELETED && name_is(e, name, len)) {
+            return n;
+        }
+    }
+    return -1;
+}
+
+// Loads the directory that path's last component would be in, and
+// returns that component (pointing into path). A leading slash is
+// ignored: paths start at the volume directory.
+static const char *resolve(Image *im, const char *path, Dir *d)
+{
+    while (*path == '/') ++path;
+    load_dir(im, VOL_DIR_BLOCK, d);
+
+    int depth = 0;
+    const char *slash;
+    while ((slash = strchr(path, '/')) != NULL) {
+        if (++depth == MAX_PATH_DEPTH) fail("%s: path too deep.", path);
+        int n = find_in(d, path, slash - path);
+        if (n < 0) fail("%.*s: not found.", (int)(slash - path), path);
+        const uint8_t *e = dir_entry(d, n);
+        if ((e[E_STORAGE] >> 4) != ST_SUBDIR) {
+            fail("%.*s: not a directory.", (int)(slash - path), path);
+        }
+        unsigned key = get16(e + E_KEY);
+        free_dir(d);
+        load_dir(im, key, d);
+        path = slash + 1;
+    }
+    check_name(path, strlen(path));
+    return path;
+}
+
+static const char *type_name(unsigned type, char *buf)
+{
+    for (size_t i = 0; i != sizeof type_names / sizeof type_names[0]; ++i) {
+        if (type_names[i].type == type) return type_names[i].name;
+    }
+    sprintf(buf, "$%02X", type);
+    return buf;
+}
+
+static void list_dir(Image *im, unsigned key, const char *path)
+{
+    Dir d;
+    load_dir(im, key, &d);
+
+    printf("%s\n\n NAME            TYPE  BLOCKS  ENDFILE SUBTYPE\n\n", path);
+    for (unsigned n = 1; n != dir_entries(&d); ++n) {
+        const uint8_t *e = dir_entry(&d, n);
+        if ((e[E_STORAGE] >> 4) == ST_DELETED) continue;
+        char tbuf[4];
+        printf("%c%-15.*s %-4s %7u %8lu   $%04X\n",
+               e[E_ACCESS] & ACCESS_DESTROY? ' ' : '*',
+               e[E_STORAGE] & 0xF, (const char *)e + E_NAME,
+               type_name(e[E_TYPE], tbuf), get16(e + E_BLOCKS),
+               get24(e + E_EOF), get16(e + E_AUX));
+    }
+
+    for (unsigned n = 1; n != dir_entries(&d); ++n) {
+        const uint8_t *e = dir_entry(&d, n);
+        if ((e[E_STORAGE] >> 4) != ST_SUBDIR) continue;
+        char *sub = xalloc(strlen(path) + NAME_LEN + 2);
+        sprintf(sub, "%s/%.*s", path, e[E_STORAGE] & 0xF,
+                (const char *)e + E_NAME);
+        printf("\n");
+        list_dir(im, get16(e + E_KEY), sub);
+        free(sub);
+    }
+    free_dir(&d);
+}
+
+static void catalog(Image *im)
+{
+    Vol v;
+    vol_open(im, &v);
+    char path[NAME_LEN + 2];
+    sprintf(path, "/%s", v.name);
+    list_dir(im, VOL_DIR_BLOCK, path);
+
+    unsigned fr = count_free(&v);
+    printf("\nBLOCKS FREE: %u  BLOCKS USED: %u  TOTAL BLOCKS: %u\n",
+           fr, v.total - fr, v.total);
+    vol_close(&v);
+}
+
+// Copies data block blk (0 for a sparse hole) to out + off, stopping
+// at eof.
+static void copy_block(Image *im, unsigned blk, uint8_t *out,
+                       unsigned long off, unsigned long eof)
+{
+    if (off >= eof) return;
+    unsigned long n = eof - off < FS_BLOCK_SIZE? eof - off : FS_BLOCK_SIZE;
+    if (blk == 0) {
+        memset(out + off, 0, n);
+    } else {
+        uint8_t b[FS_BLOCK_SIZE];
+        image_read_block(im, blk, b);
+        memcpy(out + off, b, n);
+    }
+}
+
+static void copy_index(Image *im, unsigned blk, uint8_t *out,
+                       unsigned long off, unsigned long eof)
+{
+    uint8_t idx[FS_BLOCK_SIZE];
+    if (blk == 0) {
+        memset(idx, 0, sizeof idx);
+    } else {
+        image_read_block(im, blk, idx);
+    }
+    for (int i = 0; i != 256; ++i) {
+        copy_block(im, idx[i] | (idx[256 + i] << 8), out,
+                   off + i * (unsigned long)FS_BLOCK_SIZE, eof);
+    }
+}
+
+static void extract(Image *im, const char *path, FileData *fd)
+{
+    Dir d;
+    const char *name = resolve(im, path, &d);
+    int n = find_in(&d, name, strlen(name));
+    if (n < 0) fail("%s: file not found.", path);
+    const uint8_t *e = dir_entry(&d, n);
+
+    unsigned long eof = get24(e + E_EOF);
+    unsigned key = get16(e + E_KEY);
+    fd->data = xalloc(eof + 1);
+    fd->len = eof;
+    fd->aux = get16(e + E_AUX);
+    switch (e[E_STORAGE] >> 4) {
+    case ST_SEEDLING:
+        copy_block(im, key, fd->data, 0, eof);
+        break;
+    case ST_SAPLING:
+        copy_index(im, key, fd->data, 0, eof);
+        break;
+    case ST_TREE: {
+        uint8_t master[FS_BLOCK_SIZE];
+        image_read_block(im, key, master);
+        for (int i = 0; i != 128; ++i) {
+            copy_index(im, master[i] | (master[256 + i] << 8), fd->data,
+                       i * 256ul * FS_BLOCK_SIZE, eof);
+        }
+        break;
+    }
+    case ST_SUBDIR:
+        fail("%s: is a directory.", path);
+        break;
+    default:
+        fail("%s: unsupported storage type $%X.", path, e[E_STORAGE] >> 4);
+        break;
+    }
+
+    switch (e[E_TYPE]) {
+    case TYPE_TXT:  fd->kind = KIND_TEXT;   break;
+    case TYPE_BIN:  fd->kind = KIND_BINARY; break;
+    case TYPE_BAS:  fd->kind = KIND_BASIC;  break;
+    default:        fd->kind = KIND_OTHER;  break;
+    }
+    free_dir(&d);
+}
+
+static void free_index(Vol *v, unsigned blk)
+{
+    if (blk == 0) return;
+    uint8_t idx[FS_BLOCK_SIZE];
+    image_read_block(v->im, blk, idx);
+    for (int i = 0; i != 256; ++i) {
+        unsigned b = idx[i] | (idx[256 + i] << 8);
+        if (b != 0) set_free(v, b, true);
+    }
+    set_free(v, blk, true);
+}
+
+// Frees the file's blocks, and its entry.
+static void remove_entry(Vol *v, Dir *d, unsigned n)
+{
+    uint8_t *e = dir_entry(d, n);
+    unsigned key = get16(e + E_KEY);
+    switch (e[E_STORAGE] >> 4) {
+    case ST_SEEDLING:
+        set_free(v, key, true);
+        break;
+    case ST_SAPLING:
+        free_index(v, key);
+        break;
+    case ST_TREE: {
+        uint8_t master[FS_BLOCK_SIZE];
+        image_read_block(v->im, key, master);
+        for (int i = 0; i != 128; ++i) {
+            free_index(v, master[i] | (master[256 + i] << 8));
+        }
+        set_free(v, key, true);
+        break;
+    }
+    default:
+        fail("can't remove this kind of file (storage type $%X).",
+             e[E_STORAGE] >> 4);
+        break;
+    }
+    e[E_STORAGE] = ST_DELETED << 4;
+    dir_store(v->im, d, n);
+
+    uint8_t *h = dir_entry(d, 0);
+    put16(h + H_FILE_COUNT, get16(h + H_FILE_COUNT) - 1);
+    dir_store(v->im, d, 0);
+}
+
+static void delete(Image *im, const char *path)
+{
+    Vol v;
+    vol_open(im, &v);
+    Dir d;
+    const char *name = resolve(im, path, &d);
+    int n = find_in(&d, name, strlen(name));
+    if (n < 0) fail("%s: file not found.", path);
+    if (!(dir_entry(&d, n)[E_ACCESS] & ACCESS_DESTROY)) {
+        fail("%s: file is locked.", path);
+    }
+    remove_entry(&v, &d, n);
+    free_dir(&d);
+    vol_close(&v);
+}
+
+static void native_type(const FileData *fd, unsigned *type, unsigned *aux)
+{
+    *aux = fd->aux;
+    switch (fd->kind) {
+    case KIND_TEXT:     *type = TYPE_TXT; *aux = 0;            return;
+    case KIND_BINARY:   *type = TYPE_BIN;                      return;
+    case KIND_BASIC:    *type = TYPE_BAS; *aux = ASOFT_BASE;   return;
+    default:
+        break;
+    }
+    for (size_t i = 0; i != sizeof type_names / sizeof type_names[0]; ++i) {
+        if (strcasecmp(fd->type, type_names[i].name) == 0) {
+            *type = type_names[i].type;
+            return;
+        }
+    }
+    char *end;
+    unsigned long t = strtoul(fd->type + (fd->type[0] == '$'), &end, 16);
+    if (fd->type[0] != '$' || end == fd->type + 1 || *end != '\0'
+        || t > 0xFF || t == 0x0F) {
+        fail("unknown ProDOS file type \"%s\".", fd->type);
+    }
+    *type = t;
+}
+
+static void now_stamp(uint8_t *p)
+{
+    time_t t = time(NULL);
+    const struct tm *tm = localtime(&t);
+    put16(p, (tm->tm_year % 100) << 9 | (tm->tm_mon + 1) << 5 | tm->tm_mday);
+    p[2] = tm->tm_min;
+    p[3] = tm->tm_hour;
+}
+
+static void insert(Image *im, const char *path, const FileData *fd)
+{
+    unsigned type, aux;
+    native_type(fd, &type, &aux);
+
+    unsigned nblk = fd->len? (fd->len + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE : 1;
+    if (nblk > 256) {
+        fail("%s: bobbin-fs only writes ProDOS files up to 128k.", path);
+    }
+
+    Vol v;
+    vol_open(im, &v);
+    Dir d;
+    const char *name = resolve(im, path, &d);
+    int n = find_in(&d, name, strlen(name));
+    if (n >= 0) {
+        if (!(dir_entry(&d, n)[E_ACCESS] & ACCESS_DESTROY)) {
+            fail("%s: file is locked.", path);
+        }
+        remove_entry(&v, &d, n);
+    } else {
+        for (n = 1; n != dir_entries(&d); ++n) {
+            if ((dir_entry(&d, n)[E_STORAGE] >> 4) == ST_DELETED) break;
+        }
+        if (n == dir_entries(&d)) fail("directory is full.");
+    }
+
+    unsigned storage = nblk == 1? ST_SEEDLING : ST_SAPLING;
+    unsigned used = nblk + (storage == ST_SAPLING);
+    if (count_free(&v) < used) fail("disk full.");
+
+    unsigned key = alloc_block(&v);
+    uint8_t idx[FS_BLOCK_SIZE] = {0};
+    for (unsigned i = 0; i != nblk; ++i) {
+        unsigned blk = storage == ST_SEEDLING? key : alloc_block(&v);
+        idx[i] = blk & 0xFF;
+        idx[256 + i] = blk >> 8;
+
+        uint8_t b[FS_BLOCK_SIZE] = {0};
+        size_t off = i * (size_t)FS_BLOCK_SIZE;
+        size_t chunk = fd->len - off < FS_BLOCK_SIZE? fd->len - off
+                                                    : FS_BLOCK_SIZE;
+        if (off < fd->len) memcpy(b, fd->data + off, chunk);
+        image_write_block(im, blk, b);
+    }
+    if (storage == ST_SAPLING) image_write_block(im, key, idx);
+
+    uint8_t *e = dir_entry(&d, n);
+    size_t len = strlen(name);
+    memset(e, 0, d.elen);
+    e[E_STORAGE] = storage << 4 | len;
+    for (size_t i = 0; i != len; ++i) {
+        e[E_NAME + i] = toupper((unsigned char)name[i]);
+    }
+    e[E_TYPE] = type;
+    put16(e + E_KEY, key);
+    put16(e + E_BLOCKS, used);
+    put24(e + E_EOF, fd->len);
+    now_stamp(e + E_CREATED);
+    e[E_ACCESS] = ACCESS_DEFAULT;
+    put16(e + E_AUX, aux);
+    now_stamp(e + E_MODIFIED);
+    put16(e + E_HEADER, d.blocks[0]);
+    dir_store(im, &d, n);
+
+    uint8_t *h = dir_entry(&d, 0);
+    put16(h + H_FILE_COUNT, get16(h + H_FILE_COUNT) + 1);
+    dir_store(im, &d, 0);
+
+    free_dir(&d);
+    vol_close(&v);
+}
+
+static void rename_file(Image *im, const char *from, const char *to)
+{
+    Dir d;
+    const char *name = resolve(im, from, &d);
+    int n = find_in(&d, name, strlen(name));
+    if (n < 0) fail("%s: file not found.", from);
+
+    // Files are renamed within their directory, not moved.
+    const char *fslash = strrchr(from, '/'), *tslash = strrchr(to, '/');
+    size_t fdir = fslash? fslash - from : 0, tdir = tslash? tslash - to : 0;
+    if (fdir != tdir || strncasecmp(from, to, fdir) != 0) {
+        fail("%s: can't move files between directories.", to);
+    }
+    if (tslash) to = tslash + 1;
+    size_t len = strlen(to);
+    check_name(to, len);
+    int other = find_in(&d, to, len);
+    if (other >= 0 && other != n) fail("%s: file exists.", to);
+
+    uint8_t *e = dir_entry(&d, n);
+    e[E_STORAGE] = (e[E_STORAGE] & 0xF0) | len;
+    memset(e + E_NAME, 0, NAME_LEN);
+    for (size_t i = 0; i != len; ++i) {
+        e[E_NAME + i] = toupper((unsigned char)to[i]);
+    }
+    // GS/OS keeps a lowercase mask here; it no longer applies.
+    if (e[E_MIN_VERSION] & 0x80) {
+        e[E_VERSION] = e[E_MIN_VERSION] = 0;
+    }
+    dir_store(im, &d, n);
+    free_dir(&d);
+}
+
+const FsOps prodos_ops = {
+    .name = "ProDOS",
+    .probe = probe,
+    .catalog = catalog,
+    .extract = extract,
+    .insert = insert,
+    .delete = delete,
+    .rename = rename_file,
+};
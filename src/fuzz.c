@@ -0,0 +1,323 @@
+//  fuzz.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// --fuzz-at: coverage-guided fuzzing of Apple ][ code, standalone or
+// under AFL++.
+//
+// The first time the PC reaches the --fuzz-at address, we snapshot
+// the machine: CPU registers, soft switches, card state (as for
+// --rewind), and all of RAM. Each run then reads the --fuzz-input
+// file, feeds it to the program (as keypresses, or straight into RAM
+// at --fuzz-mem), and lets it go until one of:
+//
+//   - the PC is back at --fuzz-at, with all the input delivered
+//   - the PC reaches --trap-success
+//   - the --fuzz-cycles budget runs out
+//   - the PC reaches --trap-failure, or a BRK/illegal opcode is
+//     executed (a "crash")
+//
+// Every instruction-to-instruction transition is counted in an
+// AFL-style edge bitmap. Afterwards, just the RAM pages written
+// during the run are copied back from the snapshot, and the next run
+// starts from the same state.
+//
+// Run by afl-fuzz (which gives us its bitmap in __AFL_SHM_ID, and the
+// fork-server pipes on fds 198 and 199), we're a persistent-mode fork
+// server: the fork is made at the snapshot, and each child does
+// PERSIST_RUNS runs, stopping itself with SIGSTOP between them.
+// Crashes end the child with SIGABRT, as afl-fuzz expects.
+// Otherwise, we do a single run and report how it went.
+
+#define FORKSRV_FD      198
+#define MAP_SIZE        (1 << 16)
+#define PERSIST_RUNS    10000
+#define MAX_INPUT       (64 * 1024)
+#define NPAGES          (128 * 1024 / 256)
+
+// Tells afl-fuzz to use persistent mode with us.
+const char fuzz_persistent_sig[] = "##SIG_AFL_PERSISTENT##";
+
+typedef enum {
+    OUT_PASS,
+    OUT_SUCCESS,
+    OUT_BUDGET,
+    OUT_FAILURE,
+    OUT_BRK,
+} Outcome;
+
+static const char * const outcome_names[] = {
+    [OUT_PASS]      = "input consumed",
+    [OUT_SUCCESS]   = "success trap",
+    [OUT_BUDGET]    = "cycle budget exhausted",
+    [OUT_FAILURE]   = "failure trap",
+    [OUT_BRK]       = "BRK or illegal opcode",
+};
+
+static bool afl;
+static bool snapped;
+static bool brk_hit;
+
+static byte *map;
+static word prev_loc;
+static unsigned long run_cycles;
+static unsigned long runs;
+
+static Registers snap_regs;
+static SoftSwitches snap_ss;
+static byte *snap_periph;
+static byte snap_ram[NPAGES * 256];
+static bool page_dirty[NPAGES];
+static size_t dirty[NPAGES];
+static size_t ndirty;
+
+static byte input[MAX_INPUT];
+static size_t input_len;
+static size_t input_pos;
+
+static void fuzz_event(Event *e)
+{
+    if (!snapped || cfg.fuzz_mem_set) return;
+    word a = e->loc & 0xFFF0;
+
+    if (e->type == EV_PEEK && a == SS_KBD) {
+        if (input_pos < input_len) {
+            e->val = util_fromascii(input[input_pos]);
+        } else {
+            e->val = 0; // no key
+        }
+    } else if (((e->type == EV_PEEK && !machine_is_iie())
+                || e->type == EV_POKE) && a == SS_KBDSTROBE) {
+        if (input_pos < input_len) ++input_pos;
+    }
+}
+
+void fuzz_init(void)
+{
+    if (!cfg.fuzz_at_set) {
+        if (cfg.fuzz_input || cfg.fuzz_mem_set) {
+            DIE(2, "--fuzz-input and --fuzz-mem need --fuzz-at.\n");
+        }
+        return;
+    }
+    if (cfg.fuzz_input == NULL) {
+        DIE(2, "--fuzz-at needs a --fuzz-input file.\n");
+    }
+    if (cfg.rewind || cfg.record_file || cfg.replay_file) {
+        DIE(2, "--fuzz-at can't be used with --rewind, --record"
+            " or --replay.\n");
+    }
+    if (cfg.interface == NULL) {
+        cfg.interface = "simple";
+    } else if (!STREQ(cfg.interface, "simple")) {
+        DIE(2, "--fuzz-at only works with the \"simple\" interface.\n");
+    }
+
+    const char *shm = getenv("__AFL_SHM_ID");
+    if (shm != NULL) {
+        map = shmat(atoi(shm), NULL, 0);
+        if (map == (void *) -1) {
+            DIE(1, "Couldn't attach AFL bitmap: %s\n", strerror(errno));
+        }
+    } else {
+        map = xalloc(MAP_SIZE);
+        memset(map, 0, MAP_SIZE);
+    }
+    event_reghandler(fuzz_event);
+}
+
+static void read_input(void)
+{
+    int fd = open(cfg.fuzz_input, O_RDONLY);
+    if (fd < 0) {
+        DIE(1, "Couldn't open --fuzz-input file \"%s\": %s\n",
+            cfg.fuzz_input, strerror(errno));
+    }
+    input_len = 0;
+    ssize_t n;
+    while (input_len != sizeof input
+           && (n = read(fd, input + input_len,
+                        sizeof input - input_len)) > 0) {
+        input_len += n;
+    }
+    close(fd);
+    input_pos = 0;
+
+    if (cfg.fuzz_mem_set) {
+        // Like GETLN: at most 255 bytes, length in X.
+        if (input_len > 255) input_len = 255;
+        for (size_t i = 0; i != input_len; ++i) {
+            poke_sneaky(cfg.fuzz_mem + i, input[i]);
+        }
+        XREG = input_len;
+        input_pos = input_len;
+    }
+}
+
+static void begin_run(void)
+{
+    read_input();
+    prev_loc = 0;
+    run_cycles = 0;
+    brk_hit = false;
+}
+
+static void take_snapshot(void)
+{
+    snap_regs = theCpu.regs;
+    memcpy(snap_ss, ss, sizeof ss);
+    size_t psz = periph_state_size();
+    snap_periph = psz? xalloc(psz) : NULL;
+    periph_save_state(snap_periph);
+    memcpy(snap_ram, getram(), sizeof snap_ram);
+    ndirty = 0;
+    snapped = true;
+}
+
+static void restore_snapshot(void)
+{
+    for (size_t i = 0; i != ndirty; ++i) {
+        size_t page = dirty[i];
+        mem_put(page << 8, &snap_ram[page << 8], 256);
+        page_dirty[page] = false;
+    }
+    ndirty = 0;
+    theCpu.regs = snap_regs;
+    memcpy(ss, snap_ss, sizeof ss);
+    periph_restore_state(snap_periph);
+}
+
+void fuzz_note_write(size_t bufloc)
+{
+    size_t page = bufloc >> 8;
+    if (snapped && !page_dirty[page]) {
+        page_dirty[page] = true;
+        dirty[ndirty++] = page;
+    }
+}
+
+static void fork_server(void)
+{
+    uint32_t msg = 0;
+    if (write(FORKSRV_FD + 1, &msg, 4) != 4) {
+        return; // not run by afl-fuzz
+    }
+    afl = true;
+
+    pid_t child = -1;
+    bool stopped = false;
+    for (;;) {
+        int status;
+        if (read(FORKSRV_FD, &msg, 4) != 4) exit(0);
+        if (stopped && msg != 0) {
+            // afl-fuzz killed the stopped child (timeout).
+            stopped = false;
+            (void) waitpid(child, &status, 0);
+        }
+        if (stopped) {
+            kill(child, SIGCONT);
+            stopped = false;
+        } else {
+            child = fork();
+            if (child < 0) {
+                DIE(1, "fuzz: fork failed: %s\n", strerror(errno));
+            } else if (child == 0) {
+                close(FORKSRV_FD);
+                close(FORKSRV_FD + 1);
+                return;
+            }
+        }
+        int32_t pid = child;
+        if (write(FORKSRV_FD + 1, &pid, 4) != 4) exit(1);
+        if (waitpid(child, &status, WUNTRACED) < 0) exit(1);
+        stopped = WIFSTOPPED(status);
+        if (write(FORKSRV_FD + 1, &status, 4) != 4) exit(1);
+    }
+}
+
+static unsigned int count_edges(void)
+{
+    unsigned int n = 0;
+    for (size_t i = 0; i != MAP_SIZE; ++i) {
+        if (map[i]) ++n;
+    }
+    return n;
+}
+
+static void end_run(Outcome o)
+{
+    bool crash = o == OUT_FAILURE || o == OUT_BRK;
+    if (afl) {
+        if (crash) {
+            signal(SIGABRT, SIG_DFL);
+            abort();
+        }
+        if (++runs == PERSIST_RUNS) exit(0);
+        raise(SIGSTOP);
+    } else {
+        fprintf(stderr, "fuzz: %s after %lu cycles, %u edges.\n",
+                outcome_names[o], run_cycles, count_edges());
+        exit(crash? 3 : 0);
+    }
+    restore_snapshot();
+    begin_run();
+}
+
+void fuzz_check(void)
+{
+    if (!snapped) {
+        if (PC != cfg.fuzz_at) return;
+        take_snapshot();
+        INFO("Fuzzing from $%04X.\n", (unsigned int)PC);
+        fork_server();
+        begin_run();
+        return;
+    }
+
+    if (brk_hit) {
+        end_run(OUT_BRK);
+    } else if (cfg.trap_failure_on && PC == cfg.trap_failure) {
+        end_run(OUT_FAILURE);
+    } else if (cfg.trap_success_on && PC == cfg.trap_success) {
+        end_run(OUT_SUCCESS);
+    } else if (run_cycles >= cfg.fuzz_cycles) {
+        end_run(OUT_BUDGET);
+    } else if (PC == cfg.fuzz_at && run_cycles != 0
+               && input_pos == input_len) {
+        end_run(OUT_PASS);
+    }
+}
+
+void fuzz_cpu_step(void)
+{
+    uintmax_t before = cycle_count;
+    cpu_step();
+    if (!snapped) return;
+    run_cycles += cycle_count - before;
+
+    // A cheap scramble of the PC, so that nearby instructions
+    // spread out over the bitmap.
+    word cur = PC * 40503u;
+    ++map[cur ^ prev_loc];
+    prev_loc = cur >> 1;
+}
+
+void fuzz_brk(void)
+{
+    brk_hit = true;
+}
@@ -0,0 +1,246 @@
+// This file was auto-generated from the README.md,
+// as part of the build process. Any changes here may
+// be overwritten!
+
+// this file is read by config.c.
+
+// One string per option (and heading), since C99 compilers
+// needn't handle a string longer than 4095 characters.
+static const char * const help_text[] = {
+    "bobbin --help\n"
+    "bobbin -m MACHINE [ OPTIONS ]\n"
+    "\n"
+    "See /usr/local/share/doc/bobbin/README.md for much, much more detail.\n"
+    ,
+    "\n"
+    "BASIC OPTIONS\n"
+    ,
+    "  -V, --version\n"
+    "     Display version info and exit.\n"
+    ,
+    "  -h, --help\n"
+    "     Display basic information on how to use bobbin, and exit.\n"
+    ,
+    "  -v, --verbose\n"
+    "     Increase bobbin's informational output. Use again for even more.\n"
+    ,
+    "  -q, --quiet\n"
+    "     Don't produce warnings, only errors.\n"
+    ,
+    "  -i, --input ARG\n"
+    "     Input filename. `-` means standard input (and is usually redundant).\n"
+    ,
+    "  -o, --output ARG\n"
+    "     Output filename. `-` means standard output (and is usually redundant).\n"
+    ,
+    "\n"
+    "ESSENTIAL OPTIONS\n"
+    ,
+    "  -m, --machine, --mach ARG\n"
+    "     The machine bobbin should emulate.\n"
+    ,
+    "  --if, --interface, --iface ARG\n"
+    "     Select the user interface.\n"
+    ,
+    "  --simple\n"
+    "     Alias for `--interface=simple`.\n"
+    ,
+    "  --disk, --disk1 ARG\n"
+    "     Load the given disk file to drive 1.\n"
+    ,
+    "  --disk2 ARG\n"
+    "     Load the given disk file to drive 2.\n"
+    ,
+    "  --share-nibbles\n"
+    "     Share the nibblized form of `.dsk`/`.do`/`.po` disk images with other bobbin processes.\n"
+    ,
+    "  --hdd, --hdd1 ARG\n"
+    "     Attach the given ProDOS hard disk image, as drive 1 of a block-device card in slot 7.\n"
+    ,
+    "  --hdd2 ARG\n"
+    "     Attach the given ProDOS hard disk image as drive 2 of the slot 7 card.\n"
+    ,
+    "  --ramdisk ARG\n"
+    "     Add a RAM-disk card of the given size (such as `512K` or `4M`) to slot 4.\n"
+    ,
+    "  --ramdisk-file ARG\n"
+    "     Keep the RAM disk's contents in the given file, so they persist from one run to the next.\n"
+    ,
+    "  --hostio-dir ARG\n"
+    "     Add a host-file bridge card to slot 1, for moving files between the emulated machine and the given host directory.\n"
+    ,
+    "  --serial ARG\n"
+    "     Add a serial card to slot 2, connected to a new pseudo-terminal (`pty`), or to a Unix-domain socket (`unix:PATH`).\n"
+    ,
+    "  --card ARG\n"
+    "     Load a peripheral card from a shared object, as *slot*`=`*path* (for example, `--card 5=./timer-card.so`).\n"
+    ,
+    "\n"
+    "SPECIAL OPTIONS\n"
+    ,
+    "  --watch [=MODE]\n"
+    "     Watch the `--load` file for changes, and reboot with the new version if it does (or with `--watch=patch`, patch it into RAM); also reload changed `--disk` images in place.\n"
+    ,
+    "  --tokenize\n"
+    "     Reads in a AppleSoft BASIC listing, outputs AppleSoft tokenized binary.\n"
+    ,
+    "  --detokenize\n"
+    "     Reads in a tokenized BASIC binary, and outputs the program listing.\n"
+    ,
+    "  --disassemble ARG\n"
+    "     Disassemble a binary file, given as `FILE@ADDR`, and exit without running the emulator.\n"
+    ,
+    "\n"
+    "MACHINE CONFIGURATION OPTIONS\n"
+    ,
+    "  --no-bell\n"
+    "     Suppress your terminal bell from playing when the Apple issues a beep.\n"
+    ,
+    "  --turbo, --no-turbo\n"
+    "     Run as fast as possible - don't throttle speed to 1.023 MHz.\n"
+    ,
+    "  --no-lang-card\n"
+    "     Disable the language card.\n"
+    ,
+    "  --rom-file ARG\n"
+    "     Use the specified file as the firmware ROM.\n"
+    ,
+    "  --no-rom\n"
+    "     Refrain from loading a ROM file into the upper address space.\n"
+    ,
+    "  --load ARG\n"
+    "     Load the specified binary file into RAM.\n"
+    ,
+    "  --load-at, --load-loc  ARG\n"
+    "     RAM location to load file from `--load`.\n"
+    ,
+    "  --load-basic-bin ARG\n"
+    "     Load tokenized (binary) AppleSoft BASIC file at boot.\n"
+    ,
+    "  --start-at, --start-loc\n"
+    "     Specify an initial start position in place of what's in the reset vector.\n"
+    ,
+    "  --delay-until-pc, --delay-until ARG\n"
+    "     Delays the effects of `--load` (RAM) and `--start-at`, until PC is *arg*.\n"
+    ,
+    "  --ram ARG\n"
+    "     Select how much RAM is installed on the machine, in kilobytes.\n"
+    ,
+    "\n"
+    "TTY INTERFACE OPTIONS\n"
+    ,
+    "  --tty-gfx ARG\n"
+    "     How the `tty` interface shows graphics modes: `auto`, `half`, `braille`, or `off`.\n"
+    ,
+    "  --tty-colors ARG\n"
+    "     Colors to use for `--tty-gfx`: `auto`, `256`, or `truecolor`.\n"
+    ,
+    "\n"
+    "SIMPLE INTERFACE OPTIONS\n"
+    ,
+    "  --remain\n"
+    "     Go interactive after input is exhausted.\n"
+    ,
+    "  --remain-tty\n"
+    "     Go interactive after input is exhausted, *and* switch to `tty` interface.\n"
+    ,
+    "  --simple-input ARG\n"
+    "     `apple` (default), or `fgets`.\n"
+    ,
+    "\n"
+    "VIDEO OUTPUT OPTIONS\n"
+    ,
+    "  --screenshot ARG\n"
+    "     Write a screenshot of the graphics display to *arg* at exit.\n"
+    ,
+    "  --video-color ARG\n"
+    "     How to render hi-res graphics: `color` (default), `mono`, or `ntsc`.\n"
+    ,
+    "  --record-video ARG\n"
+    "     Record the graphics display to the video stream file *arg*.\n"
+    ,
+    "  --record-video-every ARG\n"
+    "     Record only every *arg*th emulated frame (decimal; default 1).\n"
+    ,
+    "\n"
+    "DIAGNOSTICS, DEBUGGING, AND TESTING OPTIONS\n"
+    ,
+    "  --die-on-brk\n"
+    "     Exit emulation with an error, if a BRK or illegal opcode is encountered.\n"
+    ,
+    "  --breakpoint, --bp ARG\n"
+    "     Set a debugger breakpoint (`simple` interface only).\n"
+    ,
+    "  --rewind\n"
+    "     Keep execution history, so the debugger can step backwards.\n"
+    ,
+    "  --record ARG\n"
+    "     Record everything from outside the emulated machine to file *arg*, for `--replay`.\n"
+    ,
+    "  --replay ARG\n"
+    "     Run with the inputs recorded by `--record` in file *arg*.\n"
+    ,
+    "  --trace-to M[:N]\n"
+    "     Trace N instructions before/including M (default N = 256).\n"
+    ,
+    "  --trace-file ARG\n"
+    "     Trace log file to use instead of `trace.log`.\n"
+    ,
+    "  --trace-format ARG\n"
+    "     Write the trace as `text` (the default) or `binary`.\n"
+    ,
+    "  --trap-failure ARG\n"
+    "     Exit emulator with an error if execution reaches this location.\n"
+    ,
+    "  --trap-success ARG\n"
+    "     Exit emulator, reporting success, if execution reaches this location.\n"
+    ,
+    "  --trap-print ARG\n"
+    "     Print the ASCII char in ACC and return, if execution reaches this location.\n"
+    ,
+    "  --fuzz-at ARG\n"
+    "     Fuzz the code that runs from this location, with the input in `--fuzz-input`.\n"
+    ,
+    "  --fuzz-input ARG\n"
+    "     File holding the input for each `--fuzz-at` run.\n"
+    ,
+    "  --fuzz-mem ARG\n"
+    "     Put `--fuzz-at` input into memory at this location, instead of typing it.\n"
+    ,
+    "  --fuzz-cycles ARG\n"
+    "     Limit each `--fuzz-at` run to *arg* CPU cycles (default 1000000).\n"
+    ,
+    "  --shm ARG\n"
+    "     Share the emulated RAM with other programs, as POSIX shared memory object *arg*.\n"
+    ,
+    "  --detect-loops\n"
+    "     Stop a run that has got stuck in a loop it can never leave.\n"
+    ,
+    "  --cycle-limit ARG\n"
+    "     Stop the run, with exit status 4, once the CPU has run for *arg* cycles.\n"
+    ,
+    "  --time-limit ARG\n"
+    "     Stop the run, with exit status 4, after *arg* seconds of real time.\n"
+    ,
+    "  --stall-dump ARG\n"
+    "     When `--detect-loops`, `--cycle-limit` or `--time-limit` stops the run, write all of RAM (128k, main then aux) to the file *arg*, for a closer look.\n"
+    ,
+    "  --checkpoint ARG\n"
+    "     Every so often, save the state of the machine to file *arg*, so that a long run can be picked up again with `--resume`.\n"
+    ,
+    "  --checkpoint-every ARG\n"
+    "     Take a `--checkpoint` every *arg* seconds of real time (default 60).\n"
+    ,
+    "  --resume ARG\n"
+    "     Start from the last complete checkpoint in the `--checkpoint` file *arg*, instead of booting.\n"
+    ,
+    "  --cosim [=ENGINE]\n"
+    "     Check a second CPU engine against the normal one, instruction by instruction.\n"
+    ,
+    "  --bus-log ARG\n"
+    "     Log soft-switch, I/O and bank-switched memory accesses to file *arg*.\n"
+    ,
+    "  --bus-log-only ARG\n"
+    "     Which classes of accesses `--bus-log` records (default `switch,lc,lcram`).\n"
+    , NULL
+};
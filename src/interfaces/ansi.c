@@ -0,0 +1,807 @@
+//  interfaces/ansi.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+// The "ansi" interface: the same full-screen display as "tty", but
+// written as ANSI escape sequences straight to the terminal, with no
+// curses in between.
+//
+// Curses has to cope with any screen; ours is a fixed 24-line grid of
+// 40 or 80 columns that, more often than not, has just scrolled. So
+// every frame we read the text page into a grid, and compare it with
+// a shadow copy of what the terminal is showing. Where a block of
+// lines matches the shadow shifted up a line or few, we have the
+// terminal scroll them (inside a scroll region, since the Apple may
+// have been only partway through its own scroll), and then send
+// just the changed cells, moving the cursor the cheapest way we can.
+// The whole frame goes out in one write(). Graphics modes are drawn
+// by termgfx, which keeps its own shadow.
+
+#define ROWS                24
+#define MAX_COLS            80
+#define MAX_SCROLL          4
+#define MAX_MSGS            ROWS
+#define MSG_WIDTH           160
+#define DRIVE_INDICATOR_Y   24
+#define DRIVE_INDICATOR_X   3
+
+// A cell is the display character, plus REV for inverse video.
+#define REV                 0x100
+#define BLANK               ' '
+#define UNKNOWN             0xFFFF
+
+static const unsigned long overlay_wait = 120; // 2 seconds
+static const unsigned long overlay_long_wait = 600; // 10 seconds
+
+static uint16_t shadow[ROWS][MAX_COLS];  // what the terminal shows
+static uint16_t want[ROWS][MAX_COLS];    // what it should
+
+static char *obuf;
+static size_t olen, osize;
+static int cur_x = -1, cur_y = -1;      // -1: don't know
+static bool cur_rev;
+static uintmax_t bytes_sent;
+static uintmax_t frames_sent;
+
+static bool started;
+static bool hooked;
+static bool need_clear = true;
+static bool too_small;
+static int term_cols = 80, term_rows = 24;
+
+static int cols = 40;
+static byte text_page = 0x4;
+static bool gfx_avail = false;
+static bool gfx_on = false;
+static int gfx_rows = 24;
+
+static bool interactive;
+static struct termios orig_ios;
+static byte typed_char = '\0';
+
+static char msgs[MAX_MSGS][MSG_WIDTH + 1];
+static int nmsgs;
+static bool msg_open;       // last line hasn't had its newline yet
+static bool msgs_dirty;
+static int msgs_shown;      // terminal rows they're taking up
+static unsigned long msg_timer;
+
+static int disk_active;
+static bool disk_dirty;
+
+/********** output **********/
+
+static void out(const char *s, size_t n)
+{
+    if (olen + n > osize) {
+        osize = (olen + n) * 2;
+        obuf = realloc(obuf, osize);
+        if (obuf == NULL) DIE(1, "ansi: out of memory.\n");
+    }
+    memcpy(obuf + olen, s, n);
+    olen += n;
+}
+
+static void outs(const char *s)
+{
+    out(s, strlen(s));
+}
+
+static int outf(const char *fmt, ...)
+{
+    char buf[64];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof buf, fmt, args);
+    va_end(args);
+    out(buf, n);
+    return n;
+}
+
+static void flush_out(void)
+{
+    const char *p = obuf;
+    size_t left = olen;
+    bytes_sent += olen;
+    if (olen != 0) ++frames_sent;
+    while (left > 0) {
+        ssize_t n = write(STDOUT_FILENO, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break; // nothing sensible to do; drop the frame.
+        }
+        p += n;
+        left -= n;
+    }
+    olen = 0;
+}
+
+static void set_rev(bool rev)
+{
+    if (rev == cur_rev) return;
+    outs(rev? "\033[7m" : "\033[m");
+    cur_rev = rev;
+}
+
+static int digits(int n)
+{
+    return n >= 100? 3 : n >= 10? 2 : 1;
+}
+
+// Moves the cursor to (y, x), by whichever sequence is shortest.
+static void move_to(int y, int x)
+{
+    if (y == cur_y && x == cur_x) return;
+
+    // Absolute: ESC [ row ; col H, with the defaults left off.
+    int best = 3 + (y? digits(y + 1) : 0) + (x? 1 + digits(x + 1) : 0);
+    enum { ABS, CR, CRLF, FWD, BACK } how = ABS;
+    if (cur_x >= 0 && cur_y >= 0) {
+        int n = x - cur_x;
+        if (y == cur_y && x == 0 && 1 < best) {
+            how = CR; best = 1;
+        } else if (y == cur_y + 1 && x == 0 && 2 < best) {
+            how = CRLF; best = 2;
+        } else if (y == cur_y && n > 0 && 3 + (n > 1? digits(n) : 0) < best) {
+            how = FWD; best = 3 + (n > 1? digits(n) : 0);
+        } else if (y == cur_y && n < 0
+                   && 3 + (-n > 1? digits(-n) : 0) < best) {
+            how = BACK; best = 3 + (-n > 1? digits(-n) : 0);
+        }
+    }
+
+    switch (how) {
+        case CR:
+            out("\r", 1);
+            break;
+        case CRLF:
+            out("\r\n", 2);
+            break;
+        case FWD:
+            if (x - cur_x == 1) outs("\033[C");
+            else outf("\033[%dC", x - cur_x);
+            break;
+        case BACK:
+            if (cur_x - x == 1) outs("\033[D");
+            else outf("\033[%dD", cur_x - x);
+            break;
+        default:
+            if (x != 0) outf("\033[%d;%dH", y + 1, x + 1);
+            else if (y != 0) outf("\033[%dH", y + 1);
+            else outs("\033[H");
+    }
+    cur_y = y;
+    cur_x = x;
+}
+
+static void put_cell(uint16_t c)
+{
+    set_rev((c & REV) != 0);
+    char ch = c & 0xFF;
+    out(&ch, 1);
+    // Writing the last column leaves the cursor in limbo.
+    cur_x = (cur_x >= 0 && cur_x + 1 < term_cols)? cur_x + 1 : -1;
+}
+
+/********** what should be on screen **********/
+
+static word get_line_base(byte page, byte y)
+{
+    byte hi = ((y >> 1) & 0x03) | page;
+    byte lo = ((y & 0x18) + (((y % 2) == 1)? 0x80 : 0));
+    lo |= (lo << 2); // *= 3
+    return WORD(lo, hi);
+}
+
+static int gfx_cols(void)
+{
+    return term_cols >= 80? 80 : 40;
+}
+
+static int first_text_row(void)
+{
+    return gfx_on? gfx_rows : 0;
+}
+
+// Last row of the emulated screen that the messages leave visible.
+static int last_text_row(void)
+{
+    int top = term_rows - msgs_shown;
+    return top < ROWS? top - 1 : ROWS - 1;
+}
+
+static void fill_want(int top, int bot)
+{
+    const byte *membuf = getram();
+    bool have_aux = cfg.amt_ram > LOC_AUX_START;
+    bool flash = swget(ss, ss_altcharset)? false : text_flash;
+    for (int y = top; y <= bot; ++y) {
+        if (cols == 80) {
+            word base = get_line_base(0x4, y);
+            for (int x = 0; x != 80; ++x) {
+                bool even = have_aux && (x % 2 == 0);
+                byte c = membuf[(base | (even? LOC_AUX_START : 0)) + x/2];
+                want[y][x] = util_todisplay(c)
+                    | (util_isreversed(c, false)? REV : 0);
+            }
+        } else {
+            word base = get_line_base(text_page, y);
+            for (int x = 0; x != 40; ++x) {
+                byte c = peek_sneaky(base + x);
+                want[y][x] = util_todisplay(c)
+                    | (util_isreversed(c, flash)? REV : 0);
+            }
+        }
+    }
+}
+
+/********** getting it there **********/
+
+static int row_cost(const uint16_t *a, const uint16_t *b)
+{
+    int n = 0;
+    for (int x = 0; x != cols; ++x) {
+        if (a[x] != b[x]) ++n;
+    }
+    return n;
+}
+
+static bool row_same(const uint16_t *a, const uint16_t *b)
+{
+    return memcmp(a, b, cols * sizeof *a) == 0;
+}
+
+static int blank_cost(const uint16_t *a)
+{
+    int n = 0;
+    for (int x = 0; x != cols; ++x) {
+        if (a[x] != BLANK) ++n;
+    }
+    return n;
+}
+
+// Scrolls rows top..bot of the terminal up by n lines.
+static void scroll_up(int top, int bot, int n)
+{
+    set_rev(false); // new lines are blank, not inverse
+    outf("\033[%d;%dr", top + 1, bot + 1);
+    cur_x = cur_y = 0; // setting the region homes the cursor
+    move_to(bot, 0);
+    for (int i = 0; i != n; ++i) outs("\033D");
+    outs("\033[r");
+    cur_x = cur_y = 0;
+
+    for (int y = top; y <= bot - n; ++y) {
+        memcpy(shadow[y], shadow[y + n], sizeof shadow[y]);
+    }
+    for (int y = bot - n + 1; y <= bot; ++y) {
+        for (int x = 0; x != MAX_COLS; ++x) shadow[y][x] = BLANK;
+    }
+}
+
+// Finds the scroll that saves the most, if any does, and does it.
+static bool scroll_once(int top, int bot)
+{
+    int best_gain = 0, best_top = 0, best_bot = 0, best_n = 0;
+    for (int n = 1; n <= MAX_SCROLL && n <= bot - top; ++n) {
+        for (int a = top; a <= bot - n; ) {
+            if (!row_same(want[a], shadow[a + n])) {
+                ++a;
+                continue;
+            }
+            // A run of lines that are their lower neighbours, moved up.
+            int b = a;
+            while (b + 1 <= bot - n && row_same(want[b + 1], shadow[b + 1 + n]))
+                ++b;
+            int rbot = b + n;
+            int without = 0, with = 24; // (about what the escapes take)
+            for (int y = a; y <= rbot; ++y) {
+                without += row_cost(want[y], shadow[y]);
+            }
+            for (int y = b + 1; y <= rbot; ++y) {
+                with += blank_cost(want[y]);
+            }
+            if (without - with > best_gain) {
+                best_gain = without - with;
+                best_top = a; best_bot = rbot; best_n = n;
+            }
+            a = b + 1;
+        }
+    }
+    if (best_gain == 0) return false;
+    scroll_up(best_top, best_bot, best_n);
+    return true;
+}
+
+static void update_rows(int top, int bot)
+{
+    for (int pass = 0; pass != 4 && scroll_once(top, bot); ++pass)
+        ;
+
+    for (int y = top; y <= bot; ++y) {
+        uint16_t *w = want[y], *s = shadow[y];
+        int x = 0;
+        while (x != cols) {
+            if (w[x] == s[x]) {
+                ++x;
+                continue;
+            }
+            // Send a run of changes, carrying on through short
+            // stretches of unchanged cells rather than moving past.
+            int end = x + 1;
+            for (int j = end; j != cols && j - end <= 4; ++j) {
+                if (w[j] != s[j]) end = j + 1;
+            }
+            move_to(y, x);
+            for (; x != end; ++x) {
+                put_cell(w[x]);
+                s[x] = w[x];
+            }
+        }
+    }
+}
+
+static void forget_rows(int top, int bot)
+{
+    for (int y = top; y <= bot; ++y) {
+        for (int x = 0; x != MAX_COLS; ++x) shadow[y][x] = UNKNOWN;
+    }
+}
+
+static void clear_screen(void)
+{
+    outs("\033[m\033[H\033[2J");
+    cur_rev = false;
+    cur_x = cur_y = 0;
+    for (int y = 0; y != ROWS; ++y) {
+        for (int x = 0; x != MAX_COLS; ++x) shadow[y][x] = BLANK;
+    }
+    termgfx_invalidate();
+    msgs_dirty = true;
+    disk_dirty = true;
+    need_clear = false;
+}
+
+static void draw_msgs(void)
+{
+    int old_top = term_rows - msgs_shown;
+    msgs_shown = nmsgs < term_rows? nmsgs : term_rows;
+    int top = term_rows - msgs_shown;
+    int width = term_cols > MSG_WIDTH? MSG_WIDTH : term_cols - 1;
+
+    set_rev(false);
+    // Lines the messages no longer cover: give the screen back.
+    for (int y = old_top; y < top; ++y) {
+        if (y < ROWS) {
+            forget_rows(y, y);
+        } else {
+            move_to(y, 0);
+            outs("\033[K");
+        }
+    }
+    if (top < ROWS) forget_rows(top, ROWS - 1);
+    for (int i = 0; i != msgs_shown; ++i) {
+        const char *m = msgs[nmsgs - msgs_shown + i];
+        int len = strlen(m);
+        if (len > width) len = width;
+        move_to(top + i, 0);
+        outs("\033[36m");
+        out(m, len);
+        outs("\033[m\033[K");
+        cur_x = len;
+    }
+    msgs_dirty = false;
+    disk_dirty = true;
+}
+
+static void draw_disk(void)
+{
+    disk_dirty = false;
+    if (term_rows <= DRIVE_INDICATOR_Y
+        || term_rows - msgs_shown <= DRIVE_INDICATOR_Y) {
+        return;
+    }
+    move_to(DRIVE_INDICATOR_Y, DRIVE_INDICATOR_X);
+    if (disk_active == 0) {
+        set_rev(false);
+        outs("     ");
+    } else {
+        outs("\033[1;37;41m");
+        outs(disk_active == 1? " ONE " : " TWO ");
+        outs("\033[m");
+        cur_rev = false;
+    }
+    cur_x += 5;
+}
+
+static void get_size(void)
+{
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col != 0) {
+        term_cols = ws.ws_col;
+        term_rows = ws.ws_row;
+    }
+}
+
+/********** messages **********/
+
+static void add_msg_text(const char *text)
+{
+    for (const char *p = text; *p != '\0'; ) {
+        if (!msg_open) {
+            if (nmsgs == MAX_MSGS) {
+                memmove(msgs[0], msgs[1], (MAX_MSGS - 1) * sizeof msgs[0]);
+                --nmsgs;
+            }
+            msgs[nmsgs++][0] = '\0';
+            msg_open = true;
+        }
+        char *m = msgs[nmsgs - 1];
+        size_t len = strlen(m);
+        const char *nl = strchr(p, '\n');
+        size_t n = nl? (size_t)(nl - p) : strlen(p);
+        for (size_t i = 0; i != n && len != MSG_WIDTH; ++i) {
+            // Keep control characters from reaching the terminal.
+            m[len++] = (p[i] >= 0x20 && p[i] < 0x7F)? p[i] : '?';
+        }
+        m[len] = '\0';
+        p += n;
+        if (nl) {
+            msg_open = false;
+            ++p;
+        }
+    }
+    msgs_dirty = true;
+}
+
+static void add_msg(const char *fmt, va_list args)
+{
+    char buf[1024];
+    vsnprintf(buf, sizeof buf, fmt, args);
+    add_msg_text(buf);
+}
+
+static int ansi_print(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    add_msg(fmt, args);
+    va_end(args);
+    return 0;
+}
+
+static void clear_msgs(void)
+{
+    nmsgs = 0;
+    msg_open = false;
+    msgs_dirty = true;
+}
+
+/********** the terminal **********/
+
+static void set_raw(void)
+{
+    if (!interactive) return;
+    struct termios ios = orig_ios;
+    ios.c_lflag &= ~(tcflag_t)(ICANON | ECHO);   // (but keep ISIG)
+    ios.c_iflag &= ~(tcflag_t)(IXON | ICRNL);
+    ios.c_oflag &= ~(tcflag_t)ONLCR;            // "\n" is just a move down
+    ios.c_cc[VMIN] = 0;
+    ios.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &ios) < 0) {
+        WARN("tcsetattr: %s\n", strerror(errno));
+    }
+}
+
+static void set_blocking(bool b)
+{
+    int flags = fcntl(STDIN_FILENO, F_GETFL);
+    if (flags < 0) return;
+    flags = b? flags & ~O_NONBLOCK : flags | O_NONBLOCK;
+    (void) fcntl(STDIN_FILENO, F_SETFL, flags);
+}
+
+static void enter_screen(void)
+{
+    set_raw();
+    set_blocking(false);
+    outs("\033[?1049h\033[?25l"); // alternate screen; hide cursor
+    need_clear = true;
+    hooked = true;
+}
+
+static void leave_screen(void)
+{
+    if (!hooked) return;
+    hooked = false;
+    outs("\033[m\033[?25h\033[?1049l");
+    flush_out();
+    set_blocking(true);
+    if (interactive) (void) tcsetattr(STDIN_FILENO, TCSANOW, &orig_ios);
+}
+
+static void ansi_atexit(void)
+{
+    leave_screen();
+    INFO("ansi: sent %ju bytes over %ju frames with changes.\n",
+         bytes_sent, frames_sent);
+}
+
+static void if_ansi_start(void)
+{
+    if (!cfg.turbo_was_set) {
+        cfg.turbo = false; // default
+    }
+    // Keys can come from a pipe, too (no terminal settings then).
+    interactive = isatty(STDIN_FILENO);
+    if (interactive && tcgetattr(STDIN_FILENO, &orig_ios) < 0) {
+        DIE(1, "tcgetattr: %s\n", strerror(errno));
+    }
+    atexit(ansi_atexit);
+    get_size();
+    gfx_avail = termgfx_init();
+    enter_screen();
+    started = true;
+}
+
+/********** keyboard **********/
+
+static int read_input_char(void)
+{
+    if ((typed_char & 0x80) != 0)
+        return typed_char;
+
+    if (sigint_received == 1) {
+        sigint_received = 0;
+        typed_char = 0x83; // Ctrl-C
+        return typed_char;
+    }
+
+    unsigned char c;
+    if (read(STDIN_FILENO, &c, 1) != 1) return typed_char;
+    if (c == 0x1B) {
+        // Arrow keys arrive all together, as ESC [ A (etc.).
+        unsigned char seq[2];
+        if (read(STDIN_FILENO, &seq[0], 1) == 1 && seq[0] == '['
+            && read(STDIN_FILENO, &seq[1], 1) == 1) {
+            switch (seq[1]) {
+                case 'A': typed_char = 0x8B; break; // Ctrl-K
+                case 'B': typed_char = 0x8A; break; // Ctrl-J
+                case 'C': typed_char = 0x95; break; // Ctrl-U
+                case 'D': typed_char = 0x88; break; // Ctrl-H
+                default: ;
+            }
+        } else {
+            typed_char = 0x9B;
+        }
+    } else if (c < 0x80) {
+        typed_char = util_fromascii(c);
+    }
+    return typed_char;
+}
+
+static byte read_char(void)
+{
+    return record_key(read_input_char);
+}
+
+static void breakout(void)
+{
+    char buf[1024];
+
+    sigint_received = 0;
+    typed_char = 'A'; // something besides Ctrl-C, NOT ready for consumption.
+
+    int y = term_rows < 2? 0 : term_rows - 2;
+    move_to(y, 0);
+    set_rev(true);
+    outs("CMD ENTRY. q = quit. h = help.\033[K");
+    set_rev(false);
+    outs("\r\n\033[K:\033[?25h");
+    flush_out();
+
+    if (interactive) (void) tcsetattr(STDIN_FILENO, TCSANOW, &orig_ios);
+    set_blocking(true);
+    if (fgets(buf, sizeof buf, stdin) == NULL) {
+        buf[0] = '\0';
+        clearerr(stdin);
+    }
+    char *nl = strchr(buf, '\n');
+    if (nl) *nl = '\0';
+
+    set_raw();
+    set_blocking(false);
+    outs("\033[?25l");
+    clear_msgs();
+    bool handled = command_do(buf, ansi_print);
+    if (!handled && buf[0] != '\0') {
+        ansi_print("Unrecognized command: %s\n", buf);
+    }
+    need_clear = true;
+    msg_timer = overlay_long_wait;
+}
+
+/********** events **********/
+
+static void if_ansi_switch(void)
+{
+    int old_cols = cols;
+    bool old_gfx_on = gfx_on;
+    int old_gfx_rows = gfx_rows;
+
+    if (swget(ss, ss_eightycol)) {
+        cols = 80;
+        text_page = 0x4;
+    } else {
+        cols = 40;
+        text_page = swget(ss, ss_page2) ? 0x8 : 0x4;
+    }
+    gfx_on = gfx_avail && !swget(ss, ss_text);
+    gfx_rows = swget(ss, ss_mixed)? 20 : 24;
+
+    // Text and graphics don't share a shadow, so start afresh when
+    // the boundary between them moves. (A page flip is just a big
+    // change of contents.)
+    if (cols != old_cols || gfx_on != old_gfx_on
+        || (gfx_on && gfx_rows != old_gfx_rows)) {
+        need_clear = true;
+    }
+}
+
+static void if_ansi_peek(Event *e)
+{
+    word a = e->loc & 0xFFF0;
+
+    if (a == SS_KBD) {
+        e->val = read_char();
+    } else if (a == SS_KBDSTROBE) {
+        if (!machine_is_iie()) { // Must be a write, for ]]e and up
+            typed_char &= 0x7F; // Clear high-bit (key avail)
+            if (sigint_received == 1) sigint_received = 0;
+        }
+    }
+}
+
+static void if_ansi_poke(Event *e)
+{
+    if ((e->loc & 0xFFF0) == SS_KBDSTROBE) {
+        typed_char &= 0x7F;
+        if (sigint_received == 1) sigint_received = 0;
+    }
+}
+
+static void if_ansi_frame(void)
+{
+    if (!hooked) return;
+    if (sigwinch_received) {
+        sigwinch_received = false;
+        get_size();
+        need_clear = true;
+    }
+    if (msg_timer && --msg_timer == 0) clear_msgs();
+    if (need_clear) clear_screen();
+
+    bool small = term_cols < cols || term_rows < ROWS;
+    if (small) {
+        if (!too_small) {
+            outs("\033[1;35mTerminal too small. Please resize.\033[m");
+            cur_x = cur_y = -1;
+            too_small = true;
+        }
+        flush_out();
+        return;
+    } else if (too_small) {
+        too_small = false;
+        clear_screen();
+    }
+
+    if (msgs_dirty) draw_msgs();
+    int top = first_text_row();
+    int bot = last_text_row();
+    if (top > 0) forget_rows(0, top - 1);
+    if (top <= bot) {
+        fill_want(top, bot);
+        update_rows(top, bot);
+    }
+    if (disk_dirty) draw_disk();
+    flush_out();
+
+    if (gfx_on) {
+        int rows = gfx_rows <= bot + 1? gfx_rows : bot + 1;
+        if (rows > 0) termgfx_draw(STDOUT_FILENO, gfx_cols(), rows, rows * 8);
+    }
+}
+
+static void if_ansi_step(void)
+{
+    if (current_pc() == 0xFBD9 && cfg.bell) {
+        out("\a", 1);
+    }
+}
+
+static bool if_ansi_squawk(int level, bool cont, const char *fmt,
+                           va_list args)
+{
+    if (!started || !hooked) return false;
+    add_msg(fmt, args);
+    msg_timer = overlay_wait;
+    return true; // suppress normal (stderr) squawking
+}
+
+static void if_ansi_event(Event *e)
+{
+    if (started && (sigint_received >= 2
+        || (sigint_received == 1 && (typed_char & 0x7F) == 0x03))) {
+
+        breakout();
+        sigint_received = 0;
+    }
+
+    switch (e->type) {
+        case EV_START:
+            if_ansi_start();
+            break;
+        case EV_STEP:
+            if_ansi_step();
+            break;
+        case EV_POKE:
+            if_ansi_poke(e);
+            break;
+        case EV_PEEK:
+            if_ansi_peek(e);
+            break;
+        case EV_REBOOT:
+        case EV_RESET:
+        case EV_SWITCH:
+            if_ansi_switch();
+            break;
+        case EV_FRAME:
+            if_ansi_frame();
+            break;
+        case EV_UNHOOK:
+            leave_screen();
+            break;
+        case EV_REHOOK:
+            if (started) enter_screen();
+            break;
+        case EV_DISPLAY_TOUCH:
+            need_clear = true;
+            break;
+        case EV_DISK_ACTIVE:
+            disk_active = e->val;
+            disk_dirty = true;
+
+            // As for "tty": unless --turbo or --no-turbo was given,
+            //  run at full speed during disk stuff.
+            if (cfg.turbo_was_set) {
+                // nevermind
+            } else if (e->val == 0) {
+                cfg.turbo = false;
+            } else {
+                cfg.turbo = true;
+            }
+            break;
+        default:
+            ; // Nothing
+    }
+}
+
+IfaceDesc ansiInterface = {
+    .event = if_ansi_event,
+    .squawk= if_ansi_squawk,
+};
@@ -10,6 +10,7 @@
 #include <unistd.h>
 
 extern IfaceDesc simpleInterface;
+extern IfaceDesc ansiInterface;
 #ifdef HAVE_LIBCURSES
 extern IfaceDesc ttyInterface;
 #endif
@@ -24,6 +25,7 @@ static struct if_t {
     {"tty", &ttyInterface},
 #endif
     {"simple", &simpleInterface},
+    {"ansi", &ansiInterface},
 };
 
 void iface_fire(Event *e)
@@ -70,10 +72,9 @@ void interfaces_init(void)
 
 #ifndef HAVE_LIBCURSES
     if (STREQ(cfg.interface, "tty")) {
-        DIE(0,"default interface is \"tty\" when stdin is a tty; but that\n");
-        DIE(0,"interface has not been included with this build of bobbin\n");
-        DIE(0,"(may have been missing a libncurses-dev or similar package?)\n");
-        DIE(2,"Try invoking with --simple, instead.\n");
+        // No curses; "ansi" does the same job without it.
+        INFO("\"tty\" interface not built; using \"ansi\" instead.\n");
+        cfg.interface = "ansi";
     }
 #endif
     load_interface();
@@ -207,7 +207,7 @@ static void tokenize_err(void)
     // Remainder of DIE will be printed by the emulated machine.
 }
 
-int read_char(void)
+static int read_input_char(void)
 {
     int c = -1;
 
@@ -313,6 +313,11 @@ recheck:
     return c;
 }
 
+int read_char(void)
+{
+    return record_key(read_input_char);
+}
+
 void consume_char(void)
 {
     if (!eof_found) {
@@ -402,6 +407,9 @@ static void iface_simple_start(void)
     } else if (cfg.detokenize) {
         output_suppressed = SUPPRESS_ALWAYS;
         suppress_input = true;
+    } else if (cfg.fuzz_at_set) {
+        // Keypresses come from the --fuzz-input file.
+        suppress_input = true;
     } else if (isatty(0)) {
         set_interactive();
     }
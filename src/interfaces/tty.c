@@ -37,6 +37,12 @@ static int badterm_attr;
 static int cols = 40;
 static byte typed_char = '\0';
 
+// Graphics modes, via termgfx
+static bool gfx_avail = false;
+static bool gfx_on = false;
+static int gfx_rows = 24;     // rows of graphics (20 in mixed mode)
+static int overlay_top = 0;   // first row covered by the message overlay
+
 static void draw_border(void);
 static void do_overlay(int offset);
 static void repaint_flash(bool flash);
@@ -80,20 +86,31 @@ static byte get_line_for_addr(word loc)
     return y;
 }
 
+static int gfx_cols(void)
+{
+    return COLS > 80? 80 : 40;
+}
+
+static int first_text_row(void)
+{
+    return gfx_on? gfx_rows : 0;
+}
+
 static void draw_border(void)
 {
     int y, x;
+    int bcols = gfx_on? gfx_cols() : cols;
     getmaxyx(stdscr, y, x);
-    if (x > cols) {
-        move(0,cols);
+    if (x > bcols) {
+        move(0,bcols);
         vline('|', y >= 25? 25: y);
     }
     if (y > 24) {
         move(24,0);
-        hline('-', x >= (cols)? (cols): x);
+        hline('-', x >= bcols? bcols: x);
     }
-    if (x > cols && y > 24) {
-        move(24, cols);
+    if (x > bcols && y > 24) {
+        move(24, bcols);
         addch('+');
     }
     // Draw disk activity
@@ -110,10 +127,14 @@ static void do_overlay(int offset)
     int y, x;
     getyx(msgwin, y, x);
     draw_border();
-    if (x == 0 && y == 0) return;
     int maxy, maxx;
     getmaxyx(stdscr, maxy, maxx);
-    int err = copywin(msgwin, stdscr, 0, 0, maxy - 1 - y + (x? 0: 1) - offset, 0, maxy-1, maxx-1, false);
+    if (x == 0 && y == 0) {
+        overlay_top = maxy;
+        return;
+    }
+    overlay_top = maxy - 1 - y + (x? 0: 1) - offset;
+    int err = copywin(msgwin, stdscr, 0, 0, overlay_top, 0, maxy-1, maxx-1, false);
 }
 
 static void repaint_flash(bool flash)
@@ -121,7 +142,7 @@ static void repaint_flash(bool flash)
     saved_flash = flash;
     attrset(A_NORMAL);
     if (flash) attron(A_REVERSE);
-    for (int y=0; y != 24; ++y) {
+    for (int y=first_text_row(); y < 24; ++y) {
         word base = get_line_base(text_page, y);
         for (int x=0; x != 40; ++x) {
             byte c = peek_sneaky(base + x);
@@ -139,7 +160,7 @@ static void refresh_video80(void)
     attrset(A_NORMAL);
     const byte *membuf = getram();
     bool have_aux = cfg.amt_ram > LOC_AUX_START;
-    for (int y=0; y != 24; ++y) {
+    for (int y=first_text_row(); y < 24; ++y) {
         word base = get_line_base(0x4, y);
         move(y, 0);
         for (byte x=0; x != 80; ++x) {
@@ -170,7 +191,7 @@ static void refresh_video(bool flash)
     }
     saved_flash = flash;
     attrset(A_NORMAL);
-    for (int y=0; y != 24; ++y) {
+    for (int y=first_text_row(); y < 24; ++y) {
         word base = get_line_base(text_page, y);
         move(y, 0);
         for (int x=0; x != 40; ++x) {
@@ -196,6 +217,7 @@ static void clear_overlay(void)
     refresh_video(saved_flash);
     draw_border();
     refresh();
+    termgfx_invalidate(); // erase() will have wiped out graphics
 }
 
 static void do_overlay_timer(void)
@@ -204,7 +226,7 @@ static void do_overlay_timer(void)
     if (--overlay_timer == 0) clear_overlay();
 }
 
-static byte read_char(void) {
+static int read_input_char(void) {
     if ((typed_char & 0x80) != 0)
         return typed_char;
 
@@ -236,6 +258,11 @@ static byte read_char(void) {
     return typed_char;
 }
 
+static byte read_char(void)
+{
+    return record_key(read_input_char);
+}
+
 static void if_tty_start(void)
 {
     if (!cfg.turbo_was_set) {
@@ -288,6 +315,8 @@ static void if_tty_start(void)
     wattron(msgwin, msg_attr);
     scrollok(msgwin, true);
 
+    gfx_avail = termgfx_init();
+
     // Draw current video memory (garbage)
     refresh_video(false);
     refresh();
@@ -316,8 +345,14 @@ static void if_tty_switch(void)
         altcharset = swget(ss, ss_altcharset);
     }
 
+    bool old_gfx_on = gfx_on;
+    int old_gfx_rows = gfx_rows;
+    gfx_on = gfx_avail && !swget(ss, ss_text);
+    gfx_rows = swget(ss, ss_mixed)? 20 : 24;
+
     refresh_all = refresh_all || (prev_page != text_page || prevcols != cols
-        || oldcharset != altcharset);
+        || oldcharset != altcharset || old_gfx_on != gfx_on
+        || (gfx_on && old_gfx_rows != gfx_rows));
 }
 
 static void if_tty_peek(Event *e)
@@ -344,6 +379,7 @@ static void if_tty_poke(Event *e)
        && !(COLS < cols || LINES < 24)) {
         x %= 40;
         byte y = get_line_for_addr(loc);
+        if (y < first_text_row()) return; // graphics, not text
 
 #if 0
         int d = util_toascii(val);
@@ -395,6 +431,14 @@ static void redraw(bool force, int overlay_offset)
     refresh_video(saved_flash);
     do_overlay(overlay_offset);
     refresh();
+    termgfx_invalidate();
+}
+
+static void draw_gfx(void)
+{
+    if (!gfx_on || COLS < gfx_cols() || LINES < 24) return;
+    int rows = gfx_rows < overlay_top? gfx_rows : overlay_top;
+    termgfx_draw(STDOUT_FILENO, gfx_cols(), rows, rows * 8);
 }
 
 int squawk_print(const char *fmt, ...)
@@ -474,6 +518,7 @@ static void if_tty_frame(void)
         do_overlay(0);
         refresh();
     }
+    draw_gfx();
 }
 
 static void if_tty_step(void)
@@ -490,7 +535,9 @@ static void if_tty_display_touched(void)
     if (stdscr) {
         refresh();
         touchwin(stdscr);
+        termgfx_invalidate();
     }
+    refresh_all = true; // re-read screen memory at the next frame
 }
 
 static void if_tty_disk_active(int val)
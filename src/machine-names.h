@@ -0,0 +1,15 @@
+// This file was auto-generated from the README.md,
+// as part of the build process. Any changes here may
+// be overwritten!
+
+// this file is read by config.c.
+
+static const char * const TWOEY_TAG = "twoey";
+static const char * const ORIGINAL_TAG = "original";
+static const char * const PLUS_TAG = "plus";
+static const char * const ENHANCED_TAG = "enhanced";
+
+static const StrArray TWOEY_ALIASES = {TWOEY_TAG, "][e", "IIe", NULL};
+static const StrArray ORIGINAL_ALIASES = {ORIGINAL_TAG, "][", "II", "two", "woz", "int", "integer", NULL};
+static const StrArray PLUS_ALIASES = {PLUS_TAG, "+", "][+", "II+", "twoplus", "autostart", "applesoft", "asoft", NULL};
+static const StrArray ENHANCED_ALIASES = {ENHANCED_TAG, "//e", NULL};
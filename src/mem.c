@@ -21,7 +21,8 @@
 // Enough of a RAM buffer to provide 128k
 //  Note: memory at 0xC000 thru 0xCFFF, and 0x1C000 thru 0x1CFFF,
 //  are read at alternate banks of RAM for locations $D000 - $DFFF
-static byte membuf[128 * 1024];
+static byte ramstore[MEM_SIZE];
+static byte *membuf = ramstore; // or a --shm mapping
 
 SoftSwitches ss;
 
@@ -29,6 +30,9 @@ SoftSwitches ss;
 static unsigned char *rombuf;
 static unsigned char *ramloadbuf;
 static size_t        ramloadsz;
+// A copy of what load_ram_finish() last put into RAM, for --watch=patch.
+static byte          *loadedbuf;
+static size_t        loadedsz;
 
 static const char * const switch_names[] = {
     "LC_PREWRITE",
@@ -70,6 +74,12 @@ const byte *getram(void)
     return membuf;
 }
 
+void mem_use_buffer(byte *buf)
+{
+    memcpy(buf, membuf, MEM_SIZE);
+    membuf = buf;
+}
+
 void swset(SoftSwitches ss, SoftSwitchFlagPos pos, bool val)
 {
     int bynum = pos / 8;
@@ -401,6 +411,40 @@ no_adjust:
          adjusted? "one" : "zero");
 }
 
+static void asoft_fixup(void)
+{
+    // This was an AppleSoft BASIC file. Fixup some
+    // zero-page values.
+    poke_sneaky(ZP_TXTTAB, LO(cfg.ram_load_loc)   /* s/b $01 */);
+    poke_sneaky(ZP_TXTTAB+1, HI(cfg.ram_load_loc) /* s/b $08 */);
+    byte lo = LO(cfg.ram_load_loc + ramloadsz);
+    byte hi = HI(cfg.ram_load_loc + ramloadsz);
+    poke_sneaky(ZP_VARTAB, lo);
+    poke_sneaky(ZP_VARTAB+1, hi);
+    poke_sneaky(ZP_PRGEND, lo);
+    poke_sneaky(ZP_PRGEND+1, hi);
+    poke_sneaky(ZP_ARYTAB, lo);
+    poke_sneaky(ZP_ARYTAB+1, hi);
+    poke_sneaky(ZP_STREND, lo);
+    poke_sneaky(ZP_STREND+1, hi);
+    INFO("--load-basic-bin: AppleSoft settings adjusted.\n");
+    VERBOSE("BASIC program start = $%X, end = $%X.\n",
+            (unsigned int)(cfg.ram_load_loc),
+            (unsigned int)WORD(lo, hi));
+}
+
+static void remember_loaded(const byte *buf, size_t sz)
+{
+    if (!(cfg.watch && cfg.watch_mode && STREQ(cfg.watch_mode, "patch"))) {
+        return; // only --watch=patch needs it
+    }
+
+    free(loadedbuf);
+    loadedbuf = xalloc(sz);
+    memcpy(loadedbuf, buf, sz);
+    loadedsz = sz;
+}
+
 void load_ram_finish(void)
 {
     unsigned char *buf = ramloadbuf;
@@ -412,7 +456,9 @@ void load_ram_finish(void)
         adjust_asoft_start(&buf, &sz);
     }
 
-    memcpy(&membuf[cfg.ram_load_loc], buf, sz);
+    rewind_barrier();
+    mem_put(cfg.ram_load_loc, buf, sz);
+    remember_loaded(buf, sz);
 
     INFO("%zu bytes loaded into RAM from file \"%s\",\n",
          ramloadsz, cfg.ram_load_file);
@@ -422,25 +468,62 @@ void load_ram_finish(void)
     //  aux mem locations
 
     if (cfg.basic_fixup) {
-        // This was an AppleSoft BASIC file. Fixup some
-        // zero-page values.
-        poke_sneaky(ZP_TXTTAB, LO(cfg.ram_load_loc)   /* s/b $01 */);
-        poke_sneaky(ZP_TXTTAB+1, HI(cfg.ram_load_loc) /* s/b $08 */);
-        byte lo = LO(cfg.ram_load_loc + ramloadsz);
-        byte hi = HI(cfg.ram_load_loc + ramloadsz);
-        poke_sneaky(ZP_VARTAB, lo);
-        poke_sneaky(ZP_VARTAB+1, hi);
-        poke_sneaky(ZP_PRGEND, lo);
-        poke_sneaky(ZP_PRGEND+1, hi);
-        poke_sneaky(ZP_ARYTAB, lo);
-        poke_sneaky(ZP_ARYTAB+1, hi);
-        poke_sneaky(ZP_STREND, lo);
-        poke_sneaky(ZP_STREND+1, hi);
-        INFO("--load-basic-bin: AppleSoft settings adjusted.\n");
-        VERBOSE("BASIC program start = $%X, end = $%X.\n",
-                (unsigned int)(cfg.ram_load_loc),
-                (unsigned int)WORD(lo, hi));
+        asoft_fixup();
+    }
+}
+
+int load_ram_patch(void)
+{
+    byte *newbuf;
+    size_t newsz;
+    int err = mmapfile(cfg.ram_load_file, &newbuf, &newsz, O_RDONLY);
+    if (newbuf == NULL) {
+        WARN("Couldn't mmap --load file \"%s\": %s\n",
+             cfg.ram_load_file, strerror(err));
+        return -1;
+    }
+    if ((newsz + cfg.ram_load_loc) > (MEM_SIZE)) {
+        WARN("--load file \"%s\" would exceed the end of emulated memory!\n",
+             cfg.ram_load_file);
+        munmap(newbuf, newsz);
+        return -1;
+    }
+    if (ramloadbuf != NULL) {
+        munmap(ramloadbuf, ramloadsz);
+    }
+    ramloadbuf = newbuf;
+    ramloadsz = newsz;
+
+    if (loadedbuf == NULL) {
+        // Still waiting on --delay-until; it'll load the new version.
+        return 0;
+    }
+
+    byte *buf = newbuf;
+    size_t sz = newsz;
+    if (cfg.basic_fixup) {
+        adjust_asoft_start(&buf, &sz);
     }
+
+    // Only bytes that differ from what we loaded last time are
+    // written, so anything else the program has changed in RAM
+    // since then is left alone.
+    rewind_barrier();
+    size_t npatched = 0;
+    for (size_t i = 0; i != sz; ++i) {
+        if (i >= loadedsz || buf[i] != loadedbuf[i]) {
+            mem_put(cfg.ram_load_loc + i, &buf[i], 1);
+            ++npatched;
+        }
+    }
+    remember_loaded(buf, sz);
+    INFO("Patched %zu changed bytes into RAM from \"%s\".\n",
+         npatched, cfg.ram_load_file);
+
+    if (cfg.basic_fixup) {
+        asoft_fixup();
+    }
+    return 1;
 }
 
 static void load_ram(void)
@@ -453,7 +536,7 @@ static void load_ram(void)
             cfg.ram_load_file, strerror(err));
     }
 
-    if ((ramloadsz + cfg.ram_load_loc) > (sizeof membuf)) {
+    if ((ramloadsz + cfg.ram_load_loc) > (MEM_SIZE)) {
         DIE(1, "--load file \"%s\" would exceed the end of emulated memory!\n",
             cfg.ram_load_file);
     }
@@ -469,7 +552,7 @@ static void load_ram(void)
 static void fillmem(void)
 {
     /* Immitate the on-boot memory pattern. */
-    for (size_t z=0; z != sizeof membuf; ++z) {
+    for (size_t z=0; z != MEM_SIZE; ++z) {
         if (!(z & 0x2))
             membuf[z] = 0xFF;
     }
@@ -477,11 +560,11 @@ static void fillmem(void)
     /* Seed random generator */
     struct timespec tm;
     clock_gettime(CLOCK_REALTIME, &tm);
-    srandom(tm.tv_nsec);
+    srandom(record_seed(tm.tv_nsec));
 
     /* For now at least, do what AppleWin does, and
      * set specific bytes to garbage. */
-    for (size_t z=0; z < sizeof membuf; z += 0x200) {
+    for (size_t z=0; z < MEM_SIZE; z += 0x200) {
         membuf[z + 0x28] = random();
         membuf[z + 0x29] = random();
         membuf[z + 0x68] = random();
@@ -496,7 +579,7 @@ static inline void mem_init_langcard(void)
 
 void mem_init(void)
 {
-    if (cfg.ram_load_loc >= sizeof membuf) {
+    if (cfg.ram_load_loc >= MEM_SIZE) {
         DIE(2, "--load-at value must be less than $20000 (128k).\n");
     }
 
@@ -525,7 +608,10 @@ void mem_reset(void)
 
 void mem_reboot(void)
 {
+    rewind_barrier();
     fillmem();
+    free(loadedbuf);
+    loadedbuf = NULL;
 
     if (cfg.ram_load_file != NULL) {
         if (ramloadbuf != NULL) {
@@ -634,6 +720,9 @@ int slot_access_switches(word loc, int val)
     bool fval;
 
     //RestartSw oldsw = rstsw;
+    if (loc >= LOC_SLOTS_START && loc < LOC_SLOTS_END) {
+        periph_expansion_access(loc);
+    }
     if (loc >= 0xC300 && loc < 0xC400 && !swget(ss, ss_slotc3rom)
             && machine_is_iie()) {
         f = ss_intc8rom;
@@ -792,16 +881,38 @@ static int switch_reads(word loc)
     return (!!b) << 7;
 }
 
+// While --rewind is re-executing history, I/O reads get the values
+// they got the first time. Soft switches still flip as they did, and
+// cards that keep rewindable state see the access, but interfaces
+// aren't consulted.
+static byte replay_io_peek(word loc)
+{
+    if (loc < 0xC090) {
+        maybe_language_card(loc, false);
+        (void) slot_access_switches(loc, -1);
+    } else {
+        periph_sw_replay(loc, -1);
+    }
+    return rewind_replay_io(loc);
+}
+
 byte peek(word loc)
 {
+    if (rewind_replaying && (loc & 0xFF00) == SS_START) {
+        return replay_io_peek(loc);
+    }
+
     int t = event_fire_peek(loc);
     if (t < 0) maybe_language_card(loc, false);
     if (t < 0) t = slot_access_switches(loc, -1);
-    if (t >= 0) {
-        return (byte) t;
-    }
+    if (t < 0) t = peek_sneaky(loc);
 
-    return peek_sneaky(loc);
+    if (cfg.rewind && (loc & 0xFF00) == SS_START) {
+        rewind_log_io(loc, t);
+    }
+    if (cosim_logging) cosim_note_read(loc, t);
+    if (buslog_on) buslog_note(loc, t, false);
+    return (byte) t;
 }
 
 byte peek_sneaky(word loc)
@@ -822,6 +933,11 @@ byte peek_sneaky(word loc)
     if (loc >= LOC_SLOTS_START && loc < LOC_SLOT_EXPANDED_AREA) {
         return periph_rom_peek(loc);
     }
+    const byte *c8;
+    if (loc >= LOC_SLOT_EXPANDED_AREA && loc < LOC_SLOTS_END
+        && (c8 = periph_expansion_rom(loc)) != NULL) {
+        return *c8;
+    }
     if (loc >= cfg.amt_ram && loc < SS_START) {
         return 0; // s/b floating bus? not sure, in sneaky
     }
@@ -839,19 +955,34 @@ byte peek_sneaky(word loc)
     }
 }
 
-void poke(word loc, byte val)
+static void poke_bus(word loc, byte val)
 {
-    if (event_fire_poke(loc, val))
+    if (rewind_replaying) {
+        rewind_replay_poke(loc);
+    } else if (event_fire_poke(loc, val)) {
         return;
+    }
     if (maybe_language_card(loc, true) >= 0)
         return;
     if (loc >= 0xC000 && loc < 0xC100) {
-        (void) slot_access_switches(loc, val);
+        if (!rewind_replaying || loc < 0xC090) {
+            (void) slot_access_switches(loc, val);
+        } else {
+            periph_sw_replay(loc, val);
+        }
         return;
     }
     poke_sneaky(loc, val);
 }
 
+void poke(word loc, byte val)
+{
+    if (cosim_logging) cosim_note_write(loc, val);
+    poke_bus(loc, val);
+    // Logged afterward, to show the memory configuration it leaves.
+    if (buslog_on) buslog_note(loc, val, true);
+}
+
 void poke_sneaky(word loc, byte val)
 {
     // XXX should handle slot-area writes
@@ -864,10 +995,54 @@ void poke_sneaky(word loc, byte val)
     if (acc != MA_ROM && acc != MA_SLOTS
         && (!aux || cfg.amt_ram > LOC_AUX_START)) {
 
+        if (cfg.rewind) rewind_note_write(bufloc, val);
+        if (cfg.fuzz_at_set) fuzz_note_write(bufloc);
+        if (cfg.detect_loops) stall_note_write(bufloc);
+        if (cfg.checkpoint_file) checkpoint_note_write(bufloc);
         membuf[bufloc] = val;
     }
 }
 
+void mem_put(size_t bufloc, const byte *src, size_t n)
+{
+    if (n != 0 && (cfg.detect_loops || cfg.checkpoint_file)) {
+        for (size_t i = 0; i < n + 255; i += 256) {
+            size_t loc = i < n? bufloc + i : bufloc + n - 1;
+            if (cfg.detect_loops) stall_note_write(loc);
+            if (cfg.checkpoint_file) checkpoint_note_write(loc);
+        }
+    }
+    memcpy(&membuf[bufloc], src, n);
+}
+
+static inline bool in_display_mem(word loc)
+{
+    return (loc >= 0x400 && loc < 0xC00) || (loc >= 0x2000 && loc < 0x6000);
+}
+
+void mem_dma_write(word loc, const byte *src, size_t n)
+{
+    bool touched = false;
+    if (cfg.rewind) rewind_dma(true);
+    for (; n != 0; --n, ++loc) {
+        poke_sneaky(loc, *src++);
+        touched = touched || in_display_mem(loc);
+    }
+    if (cfg.rewind) rewind_dma(false);
+    if (touched) {
+        // No POKE events were sent, so anyone following the screen
+        // needs telling.
+        event_fire(EV_DISPLAY_TOUCH);
+    }
+}
+
+void mem_dma_read(word loc, byte *dst, size_t n)
+{
+    for (; n != 0; --n, ++loc) {
+        *dst++ = peek_sneaky(loc);
+    }
+}
+
 bool mem_match(word loc, unsigned int nargs, ...)
 {
     bool status = true;
@@ -0,0 +1,75 @@
+// This file was auto-generated from the README.md,
+// as part of the build process. Any changes here may
+// be overwritten!
+
+// this file is read by config.c.
+
+static AryOfStr VERSION_OPT_NAMES[] = {"V", "version", NULL};
+static AryOfStr HELP_OPT_NAMES[] = {"h", "help", NULL};
+static AryOfStr VERBOSE_OPT_NAMES[] = {"v", "verbose", NULL};
+static AryOfStr QUIET_OPT_NAMES[] = {"q", "quiet", NULL};
+static AryOfStr INPUT_OPT_NAMES[] = {"i", "input", NULL};
+static AryOfStr OUTPUT_OPT_NAMES[] = {"o", "output", NULL};
+static AryOfStr MACHINE_OPT_NAMES[] = {"m", "machine", "mach", NULL};
+static AryOfStr IF_OPT_NAMES[] = {"if", "interface", "iface", NULL};
+static AryOfStr SIMPLE_OPT_NAMES[] = {"simple", NULL};
+static AryOfStr DISK_OPT_NAMES[] = {"disk", "disk1", NULL};
+static AryOfStr DISK2_OPT_NAMES[] = {"disk2", NULL};
+static AryOfStr SHARE_NIBBLES_OPT_NAMES[] = {"share-nibbles", NULL};
+static AryOfStr HDD_OPT_NAMES[] = {"hdd", "hdd1", NULL};
+static AryOfStr HDD2_OPT_NAMES[] = {"hdd2", NULL};
+static AryOfStr RAMDISK_OPT_NAMES[] = {"ramdisk", NULL};
+static AryOfStr RAMDISK_FILE_OPT_NAMES[] = {"ramdisk-file", NULL};
+static AryOfStr HOSTIO_DIR_OPT_NAMES[] = {"hostio-dir", NULL};
+static AryOfStr SERIAL_OPT_NAMES[] = {"serial", NULL};
+static AryOfStr CARD_OPT_NAMES[] = {"card", NULL};
+static AryOfStr WATCH_OPT_NAMES[] = {"watch", NULL};
+static AryOfStr TOKENIZE_OPT_NAMES[] = {"tokenize", NULL};
+static AryOfStr DETOKENIZE_OPT_NAMES[] = {"detokenize", NULL};
+static AryOfStr DISASSEMBLE_OPT_NAMES[] = {"disassemble", NULL};
+static AryOfStr BELL_OPT_NAMES[] = {"bell", NULL};
+static AryOfStr TURBO_OPT_NAMES[] = {"turbo", NULL};
+static AryOfStr LANG_CARD_OPT_NAMES[] = {"lang-card", NULL};
+static AryOfStr ROM_FILE_OPT_NAMES[] = {"rom-file", NULL};
+static AryOfStr ROM_OPT_NAMES[] = {"rom", NULL};
+static AryOfStr LOAD_OPT_NAMES[] = {"load", NULL};
+static AryOfStr LOAD_AT_OPT_NAMES[] = {"load-at", "load-loc ", NULL};
+static AryOfStr LOAD_BASIC_BIN_OPT_NAMES[] = {"load-basic-bin", NULL};
+static AryOfStr START_AT_OPT_NAMES[] = {"start-at", "start-loc", NULL};
+static AryOfStr DELAY_UNTIL_PC_OPT_NAMES[] = {"delay-until-pc", "delay-until", NULL};
+static AryOfStr RAM_OPT_NAMES[] = {"ram", NULL};
+static AryOfStr TTY_GFX_OPT_NAMES[] = {"tty-gfx", NULL};
+static AryOfStr TTY_COLORS_OPT_NAMES[] = {"tty-colors", NULL};
+static AryOfStr REMAIN_OPT_NAMES[] = {"remain", NULL};
+static AryOfStr REMAIN_TTY_OPT_NAMES[] = {"remain-tty", NULL};
+static AryOfStr SIMPLE_INPUT_OPT_NAMES[] = {"simple-input", NULL};
+static AryOfStr SCREENSHOT_OPT_NAMES[] = {"screenshot", NULL};
+static AryOfStr VIDEO_COLOR_OPT_NAMES[] = {"video-color", NULL};
+static AryOfStr RECORD_VIDEO_OPT_NAMES[] = {"record-video", NULL};
+static AryOfStr RECORD_VIDEO_EVERY_OPT_NAMES[] = {"record-video-every", NULL};
+static AryOfStr DIE_ON_BRK_OPT_NAMES[] = {"die-on-brk", NULL};
+static AryOfStr BREAKPOINT_OPT_NAMES[] = {"breakpoint", "bp", NULL};
+static AryOfStr REWIND_OPT_NAMES[] = {"rewind", NULL};
+static AryOfStr RECORD_OPT_NAMES[] = {"record", NULL};
+static AryOfStr REPLAY_OPT_NAMES[] = {"replay", NULL};
+static AryOfStr TRACE_TO_OPT_NAMES[] = {"trace-to", NULL};
+static AryOfStr TRACE_FILE_OPT_NAMES[] = {"trace-file", NULL};
+static AryOfStr TRACE_FORMAT_OPT_NAMES[] = {"trace-format", NULL};
+static AryOfStr TRAP_FAILURE_OPT_NAMES[] = {"trap-failure", NULL};
+static AryOfStr TRAP_SUCCESS_OPT_NAMES[] = {"trap-success", NULL};
+static AryOfStr TRAP_PRINT_OPT_NAMES[] = {"trap-print", NULL};
+static AryOfStr FUZZ_AT_OPT_NAMES[] = {"fuzz-at", NULL};
+static AryOfStr FUZZ_INPUT_OPT_NAMES[] = {"fuzz-input", NULL};
+static AryOfStr FUZZ_MEM_OPT_NAMES[] = {"fuzz-mem", NULL};
+static AryOfStr FUZZ_CYCLES_OPT_NAMES[] = {"fuzz-cycles", NULL};
+static AryOfStr SHM_OPT_NAMES[] = {"shm", NULL};
+static AryOfStr DETECT_LOOPS_OPT_NAMES[] = {"detect-loops", NULL};
+static AryOfStr CYCLE_LIMIT_OPT_NAMES[] = {"cycle-limit", NULL};
+static AryOfStr TIME_LIMIT_OPT_NAMES[] = {"time-limit", NULL};
+static AryOfStr STALL_DUMP_OPT_NAMES[] = {"stall-dump", NULL};
+static AryOfStr CHECKPOINT_OPT_NAMES[] = {"checkpoint", NULL};
+static AryOfStr CHECKPOINT_EVERY_OPT_NAMES[] = {"checkpoint-every", NULL};
+static AryOfStr RESUME_OPT_NAMES[] = {"resume", NULL};
+static AryOfStr COSIM_OPT_NAMES[] = {"cosim", NULL};
+static AryOfStr BUS_LOG_OPT_NAMES[] = {"bus-log", NULL};
+static AryOfStr BUS_LOG_ONLY_OPT_NAMES[] = {"bus-log-only", NULL};
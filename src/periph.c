@@ -9,8 +9,13 @@
 #include <assert.h>
 
 static PeriphDesc *slot[8];
+static PeriphDesc *c8owner; // whose ROM is at $C800
 
 extern PeriphDesc disk2card;
+extern PeriphDesc hddcard;
+extern PeriphDesc ramdiskcard;
+extern PeriphDesc hostiocard;
+extern PeriphDesc ssccard;
 
 PeriphDesc *get_sw_slot(word loc)
 {
@@ -57,12 +62,68 @@ void periph_rom_poke(word loc, byte val)
     // XXX
 }
 
+void periph_expansion_access(word loc)
+{
+    if (loc == 0xCFFF) {
+        c8owner = NULL;
+    } else if (loc < LOC_SLOT_EXPANDED_AREA) {
+        PeriphDesc *p = get_rom_slot(loc);
+        if (p && p->c8rom) c8owner = p;
+    }
+}
+
+const byte *periph_expansion_rom(word loc)
+{
+    if (c8owner == NULL || loc == 0xCFFF) return NULL;
+    return &c8owner->c8rom[loc - LOC_SLOT_EXPANDED_AREA];
+}
+
+void periph_sw_replay(word loc, int val)
+{
+    PeriphDesc *p = get_sw_slot(loc);
+    if (p && p->save_state) {
+        (void) p->handler(loc, val, -1, loc & 0x000F);
+    }
+}
+
+size_t periph_state_size(void)
+{
+    size_t sz = 0;
+    for (int i = 0; i != (sizeof slot)/(sizeof slot[0]); ++i) {
+        if (slot[i] != NULL && slot[i]->save_state) {
+            sz += slot[i]->state_size;
+        }
+    }
+    return sz;
+}
+
+void periph_save_state(byte *buf)
+{
+    for (int i = 0; i != (sizeof slot)/(sizeof slot[0]); ++i) {
+        if (slot[i] != NULL && slot[i]->save_state) {
+            slot[i]->save_state(buf);
+            buf += slot[i]->state_size;
+        }
+    }
+}
+
+void periph_restore_state(const byte *buf)
+{
+    for (int i = 0; i != (sizeof slot)/(sizeof slot[0]); ++i) {
+        if (slot[i] != NULL && slot[i]->restore_state) {
+            slot[i]->restore_state(buf);
+            buf += slot[i]->state_size;
+        }
+    }
+}
+
 int periph_slot_reg(unsigned int slotnum, PeriphDesc *card)
 {
     if (slotnum > (sizeof slot)/(sizeof slot[0]))
         return -1;
     if (slot[slotnum] != NULL)
         return -1;
+    rewind_barrier(); // the checkpoints don't have this card's state
     slot[slotnum] = card;
     card->init();
     return 0;
@@ -73,7 +134,28 @@ void periph_init(void)
     if (cfg.disk || cfg.disk2) {
         slot[6] = &disk2card;
     }
-    
+    if (cfg.hdd || cfg.hdd2) {
+        slot[7] = &hddcard;
+    }
+    if (cfg.ramdisk || cfg.ramdisk_file) {
+        slot[4] = &ramdiskcard;
+    }
+    if (cfg.hostio_dir) {
+        slot[1] = &hostiocard;
+    }
+    if (cfg.serial) {
+        slot[2] = &ssccard;
+    }
+    for (unsigned int i = 1; i != (sizeof slot)/(sizeof slot[0]); ++i) {
+        PeriphDesc *card = plugin_card(i);
+        if (card == NULL) continue;
+        if (slot[i] != NULL) {
+            DIE(2, "--card: slot %u is already taken by a built-in card.\n",
+                i);
+        }
+        slot[i] = card;
+    }
+
     const int slots_end = (sizeof slot)/(sizeof slot[0]);
     for (int i=0; i != slots_end; ++i) {
         if (slot[i] != NULL && slot[i]->init != NULL) {
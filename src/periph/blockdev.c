@@ -0,0 +1,192 @@
+//  periph/blockdev.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+#include <ctype.h>
+#include <string.h>
+
+// Pieces shared by our paravirtual ProDOS block-device cards (the
+// hard disk and RAM disk cards). Rather than emulating the firmware
+// of any particular real card, their slot ROM is a tiny ProDOS
+// driver that hands each call off to the emulator through a soft
+// switch; we then copy whole 512-byte blocks between the volume's
+// storage and emulated memory.
+//
+// Soft switches, relative to the card's chosen base ($C0n0 + base):
+//   +0  (write) perform the ProDOS call whose parameters are at $42-$47
+//   +1  (read)  error code from the last call (0 = success)
+//   +2  (read)  low byte of the unit's size in blocks
+//   +3  (read)  high byte of the unit's size in blocks
+
+enum {
+    PD_STATUS = 0,
+    PD_READ,
+    PD_WRITE,
+    PD_FORMAT,
+};
+
+enum {
+    PDERR_NONE      = 0x00,
+    PDERR_IO        = 0x27,
+    PDERR_NODEV     = 0x28,
+    PDERR_WRITEPROT = 0x2B,
+};
+
+#define DRIVER_ENTRY    0x29
+
+void blockdev_build_rom(byte *rombuf, unsigned int slot, unsigned int swbase,
+                        bool bootable, int nvolumes)
+{
+    const byte sn = 0xC0 | slot;                    // $Cn
+    const byte sw = 0x80 | (slot << 4) | swbase;    // $C0nX, low byte
+    const byte rom[] = {
+        // Signature: ProDOS looks for $20/$00/$03 at $Cn01/03/05;
+        // the autostart ROM boots from a slot that also has $3C at
+        // $Cn07.
+        0xA2, 0x20,             // $00  LDX #$20
+        0xA0, 0x00,             // $02  LDY #$00
+        0xA2, 0x03,             // $04  LDX #$03
+        0x86, 0x3C,             // $06  STX $3C
+        // Boot: read block 0 of drive 1 to $800, and run it.
+        0xA9, PD_READ,          // $08  LDA #READ
+        0x85, 0x42,             // $0A  STA $42
+        0xA9, slot << 4,        // $0C  LDA #$n0
+        0x85, 0x43,             // $0E  STA $43
+        0xA9, 0x08,             // $10  LDA #$08
+        0x85, 0x45,             // $12  STA $45
+        0xA9, 0x00,             // $14  LDA #$00
+        0x85, 0x44,             // $16  STA $44
+        0x85, 0x46,             // $18  STA $46
+        0x85, 0x47,             // $1A  STA $47
+        0x20, DRIVER_ENTRY, sn, // $1C  JSR driver
+        0xB0, 0x05,             // $1F  BCS fail
+        0xA2, slot << 4,        // $21  LDX #$n0
+        0x4C, 0x01, 0x08,       // $23  JMP $0801
+        0x4C, 0x00, 0xE0,       // $26  fail: JMP $E000 (BASIC)
+        // ProDOS driver entry.
+        0x8D, sw, 0xC0,         // $29  STA $C0nX
+        0xAE, sw + 2, 0xC0,     // $2C  LDX $C0nX+2
+        0xAC, sw + 3, 0xC0,     // $2F  LDY $C0nX+3
+        0xAD, sw + 1, 0xC0,     // $32  LDA $C0nX+1
+        0xC9, 0x01,             // $35  CMP #$01 (carry set on error)
+        0x60,                   // $37  RTS
+    };
+    memset(rombuf, 0, 256);
+    memcpy(rombuf, rom, sizeof rom);
+    if (!bootable) {
+        // Not $3C at $Cn07, so the autostart ROM passes us by; and
+        // just return, if someone does a PR# or IN# to us.
+        rombuf[0x06] = 0xA2;    // $06  LDX #$01
+        rombuf[0x07] = 0x01;
+        rombuf[0x08] = 0x60;    // $08  RTS
+        memset(&rombuf[0x09], 0, DRIVER_ENTRY - 0x09);
+    }
+    // $CnFC-$CnFD: size in blocks (0 = ask via STATUS)
+    // $CnFE: status byte: number of volumes; supports format, write,
+    //        read, and status calls.
+    rombuf[0xFE] = (nvolumes > 1? 0x10 : 0x00) | 0x0F;
+    rombuf[0xFF] = DRIVER_ENTRY;
+}
+
+static byte do_call(BlockCard *card)
+{
+    byte cmd    = peek_sneaky(0x42);
+    byte unit   = peek_sneaky(0x43);
+    word buffer = WORD(peek_sneaky(0x44), peek_sneaky(0x45));
+    unsigned long block = WORD(peek_sneaky(0x46), peek_sneaky(0x47));
+
+    // Only the drive bit matters: ProDOS may present our second
+    // volume under some other slot number.
+    BlockDev *d = card->unit[(unit & 0x80) != 0];
+    card->blocks_lo = card->blocks_hi = 0;
+    if (d == NULL || d->data == NULL) return PDERR_NODEV;
+    card->blocks_lo = d->nblocks & 0xFF;
+    card->blocks_hi = (d->nblocks >> 8) & 0xFF;
+
+    switch (cmd) {
+        case PD_STATUS:
+            return d->writeprot? PDERR_WRITEPROT : PDERR_NONE;
+        case PD_READ:
+            if (block >= d->nblocks) return PDERR_IO;
+            mem_dma_write(buffer, d->data + block * BLOCK_SIZE, BLOCK_SIZE);
+            return PDERR_NONE;
+        case PD_WRITE:
+            if (block >= d->nblocks) return PDERR_IO;
+            if (d->writeprot) return PDERR_WRITEPROT;
+            mem_dma_read(buffer, d->data + block * BLOCK_SIZE, BLOCK_SIZE);
+            if (d->wrote) d->wrote(d, block);
+            return PDERR_NONE;
+        case PD_FORMAT:
+            // Nothing to lay down; the volume's "media" is always good.
+            return d->writeprot? PDERR_WRITEPROT : PDERR_NONE;
+        default:
+            return PDERR_IO;
+    }
+}
+
+byte blockdev_sw(BlockCard *card, unsigned int reg, int val)
+{
+    switch (reg) {
+        case 0x0:
+            if (val != -1) {
+                card->err = do_call(card);
+            }
+            break;
+        case 0x1:
+            return card->err;
+        case 0x2:
+            return card->blocks_lo;
+        case 0x3:
+            return card->blocks_hi;
+        default:
+            ;
+    }
+    return 0;
+}
+
+static inline void put_word(byte *p, unsigned int w)
+{
+    p[0] = w & 0xFF;
+    p[1] = (w >> 8) & 0xFF;
+}
+
+void blockdev_format(BlockDev *d, const char *volname)
+{
+    const unsigned long nblocks = d->nblocks;
+    const unsigned int dir_first = 2, dir_blocks = 4;
+    const unsigned int bitmap_first = dir_first + dir_blocks;
+    const unsigned int bitmap_blocks = (nblocks + 4095) / 4096;
+    byte *data = d->data;
+
+    memset(data, 0, nblocks * BLOCK_SIZE);
+
+    // Volume directory: a chain of blocks, each with prev/next links;
+    // the first holds the volume directory header.
+    for (unsigned int i = 0; i != dir_blocks; ++i) {
+        byte *blk = data + (dir_first + i) * BLOCK_SIZE;
+        put_word(blk + 0, i == 0? 0 : dir_first + i - 1);
+        put_word(blk + 2, i == dir_blocks - 1? 0 : dir_first + i + 1);
+    }
+    byte *hdr = data + dir_first * BLOCK_SIZE + 4;
+    size_t len = strlen(volname);
+    if (len > 15) len = 15;
+    hdr[0x00] = 0xF0 | len;             // storage type $F, name length
+    for (size_t i = 0; i != len; ++i) {
+        hdr[0x01 + i] = toupper((unsigned char)volname[i]);
+    }
+    hdr[0x1E] = 0xC3;                   // access: destroy/rename/r/w
+    hdr[0x1F] = 0x27;                   // entry length
+    hdr[0x20] = 0x0D;                   // entries per block
+    put_word(hdr + 0x23, bitmap_first); // bit map pointer
+    put_word(hdr + 0x25, nblocks);      // total blocks
+
+    // Free-block bitmap: a set bit means free.
+    byte *bitmap = data + bitmap_first * BLOCK_SIZE;
+    for (unsigned long b = bitmap_first + bitmap_blocks; b < nblocks; ++b) {
+        bitmap[b >> 3] |= 0x80 >> (b & 7);
+    }
+}
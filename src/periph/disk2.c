@@ -39,6 +39,7 @@ static int pr_count;
 static bool steppers[4];
 static int cog1 = 0;
 static int cog2 = 0;
+static bool refresh_pending[2];
 
 static inline DiskFormatDesc *active_disk_obj(void)
 {
@@ -80,6 +81,7 @@ int eject_disk(int drive)
     }
 
     init(); // to make sure
+    rewind_barrier();
 
     if (drive == 1) {
         disk1.eject(&disk1);
@@ -88,6 +90,9 @@ int eject_disk(int drive)
         disk2.eject(&disk2);
         disk2 = disk_format_load(NULL);
     }
+    if (drive == 1 || drive == 2) {
+        refresh_pending[drive-1] = false;
+    }
 
     return 0;
 }
@@ -114,6 +119,23 @@ int insert_disk(int drive, const char *path)
     return 0;
 }
 
+static void refresh_if_idle(int drive)
+{
+    if (!refresh_pending[drive-1]) return;
+    if (motor_on && active_disk() == drive) return;
+
+    DiskFormatDesc *disk = drive == 1? &disk1 : &disk2;
+    refresh_pending[drive-1] = false;
+    if (disk->refresh) disk->refresh(disk);
+}
+
+void disk_image_changed(int drive)
+{
+    if (!initialized) return;
+    refresh_pending[drive-1] = true;
+    refresh_if_idle(drive);
+}
+
 // NOTE: cog "left" and "right" refers only to the number line,
 //       and not the physical cog or track head movement.
 static inline bool cogleft(int *cog)
@@ -174,6 +196,7 @@ static void turn_off_motor(void)
     DiskFormatDesc *disk = active_disk_obj();
     disk->spin(disk, false);
     event_fire_disk_active(0);
+    refresh_if_idle(active_disk());
 }
 
 static int lastsw = -1;
@@ -232,6 +255,7 @@ static byte handler(word loc, int val, int ploc, int psw)
             if (motor_on) {
                 event_fire_disk_active(1);
             }
+            refresh_if_idle(2);
             break;
         case 0x0B:
             if (motor_on && !drive_two) {
@@ -242,6 +266,7 @@ static byte handler(word loc, int val, int ploc, int psw)
             if (motor_on) {
                 event_fire_disk_active(2);
             }
+            refresh_if_idle(1);
             break;
         case 0x0C:
         {
@@ -286,7 +311,72 @@ static byte handler(word loc, int val, int ploc, int psw)
     return ret;
 }
 
+// For --rewind. Only the controller and the drive mechanics: the
+// disks' contents are whatever they are now.
+struct disk2_state {
+    bool motor_on;
+    bool drive_two;
+    bool write_mode;
+    byte data_register;
+    bool steppers[4];
+    int cog1, cog2;
+    unsigned int halftrack[2];
+    int bytenum[2];
+};
+
+static void save_state(void *buf)
+{
+    struct disk2_state *st = buf;
+    st->motor_on = motor_on;
+    st->drive_two = drive_two;
+    st->write_mode = write_mode;
+    st->data_register = data_register;
+    memcpy(st->steppers, steppers, sizeof steppers);
+    st->cog1 = cog1;
+    st->cog2 = cog2;
+    st->halftrack[0] = disk1.halftrack;
+    st->halftrack[1] = disk2.halftrack;
+    st->bytenum[0] = disk1.bytenum;
+    st->bytenum[1] = disk2.bytenum;
+}
+
+static void restore_state(const void *buf)
+{
+    const struct disk2_state *st = buf;
+    bool was_on = motor_on;
+    DiskFormatDesc *was = active_disk_obj();
+
+    motor_on = st->motor_on;
+    drive_two = st->drive_two;
+    write_mode = st->write_mode;
+    data_register = st->data_register;
+    memcpy(steppers, st->steppers, sizeof steppers);
+    cog1 = st->cog1;
+    cog2 = st->cog2;
+    disk1.halftrack = st->halftrack[0];
+    disk2.halftrack = st->halftrack[1];
+    disk1.bytenum = st->bytenum[0];
+    disk2.bytenum = st->bytenum[1];
+
+    DiskFormatDesc *now = active_disk_obj();
+    if (was_on && (!motor_on || now != was)) {
+        was->spin(was, false);
+    }
+    if (motor_on && (!was_on || now != was)) {
+        now->spin(now, true);
+    }
+    if (!motor_on) {
+        frame_timer_cancel(turn_off_motor);
+    }
+    if (motor_on != was_on || now != was) {
+        event_fire_disk_active(motor_on? active_disk() : 0);
+    }
+}
+
 PeriphDesc disk2card = {
     init,
     handler,
+    sizeof (struct disk2_state),
+    save_state,
+    restore_state,
 };
@@ -0,0 +1,181 @@
+//  periph/hdd.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// A ProDOS block-device card ("hard drive"), for up to two volumes
+// of up to 32MB apiece. The slot ROM and soft switches (at $C0n0-$C0n3)
+// are the paravirtual ones from blockdev.c; this file supplies the
+// (mmapped) disk images, and syncs written blocks back to them.
+
+#define HDD_SLOT        7
+#define MAX_BLOCKS      0xFFFF
+
+#define TWOMG_HDR_SIZE  64
+
+// How long after the last write, in frames, before dirty blocks
+// are synced back to the image file.
+#define SYNC_FRAMES     60
+
+struct hdd_unit {
+    BlockDev dev;       // (must be first)
+    const char *path;
+    byte *dirty;        // one bit per block
+    bool any_dirty;
+};
+
+static struct hdd_unit units[2];
+static BlockCard card;
+static byte rombuf[256];
+static bool initialized;
+
+static void mark_dirty(BlockDev *d, unsigned long block);
+
+static unsigned long le32(const byte *p)
+{
+    return p[0] | (p[1] << 8) | ((unsigned long)p[2] << 16)
+        | ((unsigned long)p[3] << 24);
+}
+
+static void load_image(struct hdd_unit *u, const char *path)
+{
+    byte *buf;
+    size_t sz;
+    bool writeprot = false;
+    int err = mmapfile(path, &buf, &sz, O_RDWR);
+    if (buf == NULL && (err == EACCES || err == EROFS || err == EPERM)) {
+        writeprot = true;
+        err = mmapfile(path, &buf, &sz, O_RDONLY);
+    }
+    if (buf == NULL) {
+        DIE(1, "Couldn't load/mmap hard disk image %s: %s\n",
+            path, strerror(err));
+    }
+
+    const char *ext = get_file_ext(path);
+    size_t off = 0;
+    size_t len = sz;
+    if (STREQCASE(ext, "2mg") || STREQCASE(ext, "2img")) {
+        if (sz < TWOMG_HDR_SIZE || memcmp(buf, "2IMG", 4) != 0) {
+            DIE(2, "%s: not a 2IMG file.\n", path);
+        }
+        unsigned long format = le32(buf + 0x0C);
+        unsigned long flags  = le32(buf + 0x10);
+        off = le32(buf + 0x18);
+        len = le32(buf + 0x1C);
+        if (format != 1) {
+            DIE(2, "%s: only ProDOS-ordered 2IMG files are supported.\n",
+                path);
+        }
+        if (off > sz || len > sz - off) {
+            DIE(2, "%s: 2IMG data lies outside the file.\n", path);
+        }
+        if (flags & 0x80000000ul) writeprot = true; // locked
+    } else if (!STREQCASE(ext, "po") && !STREQCASE(ext, "hdv")) {
+        DIE(2, "Unrecognized hard disk image format for %s"
+            " (expected .po, .hdv, or .2mg).\n", path);
+    }
+    if (len == 0 || len % BLOCK_SIZE != 0) {
+        DIE(2, "%s: image size is not a whole number of blocks.\n", path);
+    }
+    if (len / BLOCK_SIZE > MAX_BLOCKS) {
+        DIE(2, "%s: image is larger than ProDOS's 32MB limit.\n", path);
+    }
+
+    u->path = path;
+    u->dev.data = buf + off;
+    u->dev.nblocks = len / BLOCK_SIZE;
+    u->dev.writeprot = writeprot;
+    u->dev.wrote = mark_dirty;
+    u->dirty = xalloc((u->dev.nblocks + 7) / 8);
+    memset(u->dirty, 0, (u->dev.nblocks + 7) / 8);
+    u->any_dirty = false;
+    card.unit[u - units] = &u->dev;
+}
+
+static void sync_range(struct hdd_unit *u, unsigned long first,
+                       unsigned long end)
+{
+    static uintptr_t pgmask;
+    if (pgmask == 0) pgmask = ~((uintptr_t)sysconf(_SC_PAGESIZE) - 1);
+
+    uintptr_t start = (uintptr_t)(u->dev.data + first * BLOCK_SIZE);
+    uintptr_t stop  = (uintptr_t)(u->dev.data + end * BLOCK_SIZE);
+    start &= pgmask;
+    errno = 0;
+    if (msync((void *)start, stop - start, MS_SYNC) < 0) {
+        DIE(1, "Couldn't sync to hard disk image %s: %s\n",
+            u->path, strerror(errno));
+    }
+}
+
+// Writes back only the runs of blocks that were actually written.
+static void sync_unit(struct hdd_unit *u)
+{
+    if (!u->any_dirty) return;
+    unsigned long b = 0;
+    while (b < u->dev.nblocks) {
+        if (!(u->dirty[b >> 3] & (1 << (b & 7)))) {
+            ++b;
+            continue;
+        }
+        unsigned long first = b;
+        while (b < u->dev.nblocks && (u->dirty[b >> 3] & (1 << (b & 7)))) {
+            u->dirty[b >> 3] &= ~(1 << (b & 7));
+            ++b;
+        }
+        sync_range(u, first, b);
+    }
+    u->any_dirty = false;
+}
+
+static void sync_all(void)
+{
+    sync_unit(&units[0]);
+    sync_unit(&units[1]);
+}
+
+static void mark_dirty(BlockDev *d, unsigned long block)
+{
+    struct hdd_unit *u = (struct hdd_unit *)d;
+    u->dirty[block >> 3] |= 1 << (block & 7);
+    u->any_dirty = true;
+    frame_timer(SYNC_FRAMES, sync_all);
+}
+
+static void init(void)
+{
+    if (initialized) return;
+    initialized = true;
+
+    blockdev_build_rom(rombuf, HDD_SLOT, 0, true, 2);
+    if (cfg.hdd) load_image(&units[0], cfg.hdd);
+    if (cfg.hdd2) load_image(&units[1], cfg.hdd2);
+    atexit(sync_all);
+}
+
+static byte handler(word loc, int val, int ploc, int psw)
+{
+    if (ploc != -1) {
+        return rombuf[ploc];
+    }
+
+    return blockdev_sw(&card, psw, val);
+}
+
+PeriphDesc hddcard = {
+    init,
+    handler,
+};
@@ -0,0 +1,227 @@
+//  periph/hostio.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+
+// A paravirtual "host I/O" card, that moves whole files (or pieces
+// of them) between the host file system and emulated memory, in a
+// single access. Files are confined to the --hostio-dir directory.
+//
+// Soft switches ($C080 + slot * $10):
+//   +0,+1  (r/w) address of the file name (lo, hi)
+//   +2,+3  (r/w) buffer address
+//   +4,+5  (r/w) length (for READ, 0 means "up to end of file", at
+//          most $FFFF bytes)
+//   +6..+8 (r/w) file offset, for READ (24 bits)
+//   +9     (write) perform an operation (HIO_OP_*);
+//          (read)  status of the last operation (HIO_ST_*)
+//   +A,+B  (read)  number of bytes transferred by the last operation;
+//                  after SIZE, the file's size (capped at $FFFF)
+//
+// The file name is read from memory up to a NUL or carriage return
+// (at most 64 characters), with the high bit of each character
+// ignored, so that BASIC strings and ASCII from an assembler both
+// work. See examples/hostio.s for 6502 helper routines.
+
+#define MAX_NAME        64
+
+enum {
+    HIO_OP_READ = 1,    // file @ offset  -> memory
+    HIO_OP_WRITE,       // memory -> file (created or truncated)
+    HIO_OP_APPEND,      // memory -> end of file (created if needed)
+    HIO_OP_SIZE,        // file size -> count registers
+    HIO_OP_DELETE,
+};
+
+enum {
+    HIO_ST_OK = 0,
+    HIO_ST_NOTFOUND,
+    HIO_ST_BADNAME,
+    HIO_ST_IOERR,
+    HIO_ST_BADOP,
+};
+
+static byte regs[9];
+static byte status;
+static word count;
+static bool initialized;
+
+static inline word reg_word(int i)
+{
+    return WORD(regs[i], regs[i+1]);
+}
+
+// Builds the host path for the name at `loc`. Returns NULL (and
+// sets status) if the name isn't allowed: it must be relative, and
+// may not climb out of the host directory with "..".
+static char *get_path(word loc)
+{
+    char name[MAX_NAME + 1];
+    int n;
+    for (n = 0; n != MAX_NAME; ++n) {
+        byte c = peek_sneaky(loc + n) & 0x7F;
+        if (c == '\0' || c == '\r') break;
+        if (c < 0x20) {
+            status = HIO_ST_BADNAME;
+            return NULL;
+        }
+        name[n] = c;
+    }
+    name[n] = '\0';
+
+    if (n == 0 || n == MAX_NAME || name[0] == '/') {
+        status = HIO_ST_BADNAME;
+        return NULL;
+    }
+    for (const char *p = name; p != NULL; ) {
+        if (p[0] == '.' && p[1] == '.' && (p[2] == '/' || p[2] == '\0')) {
+            status = HIO_ST_BADNAME;
+            return NULL;
+        }
+        p = strchr(p, '/');
+        if (p) ++p;
+    }
+
+    size_t sz = strlen(cfg.hostio_dir) + 1 + n + 1;
+    char *path = xalloc(sz);
+    snprintf(path, sz, "%s/%s", cfg.hostio_dir, name);
+    return path;
+}
+
+static byte errno_status(void)
+{
+    return errno == ENOENT? HIO_ST_NOTFOUND : HIO_ST_IOERR;
+}
+
+static byte do_read(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return errno_status();
+
+    word buf = reg_word(2);
+    size_t len = reg_word(4);
+    long off = regs[6] | (regs[7] << 8) | ((long)regs[8] << 16);
+    if (len == 0) {
+        // Up to the top of memory, but no more than the count
+        // registers can report.
+        len = 0x10000 - buf;
+        if (len > 0xFFFF) len = 0xFFFF;
+    }
+
+    byte *data = xalloc(len);
+    byte st = HIO_ST_OK;
+    size_t got = 0;
+    if (fseek(f, off, SEEK_SET) != 0) {
+        st = HIO_ST_IOERR;
+    } else {
+        got = fread(data, 1, len, f);
+        if (ferror(f)) st = HIO_ST_IOERR;
+    }
+    fclose(f);
+    mem_dma_write(buf, data, got);
+    free(data);
+    count = got;
+    return st;
+}
+
+static byte do_write(const char *path, const char *mode)
+{
+    FILE *f = fopen(path, mode);
+    if (f == NULL) return errno_status();
+
+    size_t len = reg_word(4);
+    byte *data = xalloc(len? len : 1);
+    mem_dma_read(reg_word(2), data, len);
+    size_t put = fwrite(data, 1, len, f);
+    free(data);
+    byte st = put == len? HIO_ST_OK : HIO_ST_IOERR;
+    if (fclose(f) != 0) st = HIO_ST_IOERR;
+    count = put;
+    return st;
+}
+
+static byte do_op(byte op)
+{
+    count = 0;
+    status = HIO_ST_OK;
+    char *path = get_path(reg_word(0));
+    if (path == NULL) return status;
+
+    struct stat st;
+    switch (op) {
+        case HIO_OP_READ:
+            status = do_read(path);
+            break;
+        case HIO_OP_WRITE:
+            status = do_write(path, "wb");
+            break;
+        case HIO_OP_APPEND:
+            status = do_write(path, "ab");
+            break;
+        case HIO_OP_SIZE:
+            if (stat(path, &st) != 0) {
+                status = errno_status();
+            } else {
+                count = st.st_size > 0xFFFF? 0xFFFF : st.st_size;
+            }
+            break;
+        case HIO_OP_DELETE:
+            if (remove(path) != 0) status = errno_status();
+            break;
+        default:
+            status = HIO_ST_BADOP;
+    }
+    free(path);
+    return status;
+}
+
+static void init(void)
+{
+    if (initialized) return;
+    initialized = true;
+
+    struct stat st;
+    if (stat(cfg.hostio_dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        DIE(2, "--hostio-dir %s: not a directory.\n", cfg.hostio_dir);
+    }
+}
+
+static byte handler(word loc, int val, int ploc, int psw)
+{
+    if (ploc != -1) {
+        return 0; // no firmware
+    }
+
+    if (psw < 9) {
+        if (val != -1) regs[psw] = val;
+        return regs[psw];
+    }
+    switch (psw) {
+        case 0x9:
+            if (val != -1) {
+                (void) do_op(val);
+            }
+            return status;
+        case 0xA:
+            return count & 0xFF;
+        case 0xB:
+            return count >> 8;
+        default:
+            return 0;
+    }
+}
+
+PeriphDesc hostiocard = {
+    init,
+    handler,
+};
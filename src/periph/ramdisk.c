@@ -0,0 +1,165 @@
+//  periph/ramdisk.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A RAM-disk card, after the "Slinky" memory-expansion cards (Apple's
+// Memory Expansion Card, the RamFactor): up to 16MB of memory that
+// the Apple reaches a byte at a time through an auto-incrementing
+// address register. Its slot ROM, though, is the paravirtual ProDOS
+// block driver from blockdev.c, so ProDOS sees it as an ordinary
+// (and very fast) volume, which we format ourselves when it's new.
+//
+// Soft switches ($C0n0 + slot * $10):
+//   +0..2  24-bit address register, low byte first
+//   +3     data at the address; the address increments on each access
+//   +4..7  ProDOS block-device switches (see blockdev.c)
+//
+// The memory can be backed by a file, which is mapped in (so its
+// contents persist from one run to the next).
+
+#define RAMDISK_SLOT    4
+#define BLOCK_SWBASE    4
+#define DEFAULT_SIZE    (1024ul * 1024)
+#define MIN_SIZE        (64ul * 1024)
+#define MAX_SIZE        (16ul * 1024 * 1024)
+
+static BlockDev dev;
+static BlockCard card = { .unit = { &dev, NULL } };
+static byte rombuf[256];
+static size_t size;
+static unsigned long addr;
+static bool initialized;
+
+static size_t parse_size(const char *str)
+{
+    char *end;
+    errno = 0;
+    unsigned long n = strtoul(str, &end, 10);
+    unsigned long mult = 1024;
+    if (*end == 'k' || *end == 'K') {
+        ++end;
+    } else if (*end == 'm' || *end == 'M') {
+        mult = 1024 * 1024;
+        ++end;
+    }
+    if (errno != 0 || end == str || *end != '\0'
+        || n > MAX_SIZE / mult || n * mult < MIN_SIZE) {
+        DIE(2, "--ramdisk: bad size \"%s\" (expected 64K to 16M).\n", str);
+    }
+    return n * mult;
+}
+
+static void sync_file(void)
+{
+    if (msync(dev.data, size, MS_SYNC) < 0) {
+        DIE(1, "Couldn't sync RAM disk to %s: %s\n",
+            cfg.ramdisk_file, strerror(errno));
+    }
+}
+
+// Maps in the backing file, creating or sizing it if it's empty.
+// Returns true if the volume needs formatting.
+static bool map_file(const char *path)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        DIE(1, "Couldn't open RAM disk file %s: %s\n", path, strerror(errno));
+    }
+
+    bool fresh = (st.st_size == 0);
+    if (!fresh && cfg.ramdisk == NULL) {
+        size = st.st_size;
+        if (size < MIN_SIZE || size > MAX_SIZE || size % BLOCK_SIZE != 0) {
+            DIE(2, "RAM disk file %s has a bad size (%zu bytes).\n",
+                path, size);
+        }
+    } else if (!fresh && (size_t)st.st_size != size) {
+        DIE(2, "RAM disk file %s is %zu bytes, not the %zu asked for.\n",
+            path, (size_t)st.st_size, size);
+    }
+    if (fresh && ftruncate(fd, size) < 0) {
+        DIE(1, "Couldn't size RAM disk file %s: %s\n", path, strerror(errno));
+    }
+
+    dev.data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (dev.data == MAP_FAILED) {
+        DIE(1, "Couldn't mmap RAM disk file %s: %s\n", path, strerror(errno));
+    }
+    close(fd);
+    atexit(sync_file);
+    return fresh;
+}
+
+static void init(void)
+{
+    if (initialized) return;
+    initialized = true;
+
+    size = cfg.ramdisk? parse_size(cfg.ramdisk) : DEFAULT_SIZE;
+    bool fresh = true;
+    if (cfg.ramdisk_file) {
+        fresh = map_file(cfg.ramdisk_file);
+    } else {
+        dev.data = xalloc(size);
+    }
+    dev.nblocks = size / BLOCK_SIZE;
+    if (fresh) {
+        char volname[] = "RAMn";
+        volname[3] = '0' + RAMDISK_SLOT;
+        blockdev_format(&dev, volname);
+    }
+    blockdev_build_rom(rombuf, RAMDISK_SLOT, BLOCK_SWBASE, false, 1);
+}
+
+static byte handler(word loc, int val, int ploc, int psw)
+{
+    if (ploc != -1) {
+        return rombuf[ploc];
+    }
+
+    switch (psw) {
+        case 0x0:
+        case 0x1:
+        case 0x2: {
+            const int shift = 8 * psw;
+            if (val != -1) {
+                addr &= ~(0xFFul << shift);
+                addr |= (unsigned long)val << shift;
+            }
+            return (addr >> shift) & 0xFF;
+        }
+        case 0x3: {
+            byte c = 0xFF;
+            if (addr < size) {
+                if (val != -1) dev.data[addr] = val;
+                c = dev.data[addr];
+            }
+            addr = (addr + 1) & 0xFFFFFF;
+            return c;
+        }
+        default:
+            if (psw >= BLOCK_SWBASE && psw < BLOCK_SWBASE + 4) {
+                return blockdev_sw(&card, psw - BLOCK_SWBASE, val);
+            }
+    }
+    return 0;
+}
+
+PeriphDesc ramdiskcard = {
+    init,
+    handler,
+};
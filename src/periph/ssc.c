@@ -0,0 +1,310 @@
+//  periph/ssc.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// A serial card, after the Super Serial Card: a 6551 ACIA at
+// $C0n8-$C0nB, connected to a host pseudo-terminal or Unix-domain
+// socket. Bytes in each direction pass through large ring buffers,
+// which are exchanged with the host only once per frame (via poll()),
+// so an emulated program can send or receive at far more than the
+// "real" baud rate without a system call per byte. The ACIA's
+// "receive full" and "transmit empty" flags just reflect the state of
+// those buffers, which gives us flow control for free.
+//
+// The slot ROM is not the SSC's; it's a minimal PR#n/IN#n driver.
+// Output is sent to the serial port and also echoed to the screen;
+// input is taken from whichever of the serial port or the keyboard
+// has a character first. $C0n0 is a plain scratch latch, which the
+// ROM uses to hold a character while it restores the screen.
+
+#define SSC_SLOT    2
+#define RING_SIZE   (256 * 1024)
+
+// ACIA status register bits
+#define ST_RDRF     0x08    // receive data register full
+#define ST_TDRE     0x10    // transmit data register empty
+#define ST_DCD      0x20    // 1 = no carrier
+#define ST_DSR      0x40    // 1 = data set not ready
+
+struct ring {
+    byte buf[RING_SIZE];
+    size_t head;    // next byte to take
+    size_t len;
+};
+
+static struct ring rx;  // host -> Apple
+static struct ring tx;  // Apple -> host
+
+static bool initialized;
+static int listen_fd = -1;
+static int fd = -1;         // connected peer (pty master or socket)
+static bool is_pty;
+static byte command, control;
+static byte latch;
+static byte rombuf[256];
+
+static inline size_t ring_space(const struct ring *r)
+{
+    return RING_SIZE - r->len;
+}
+
+static void ring_put(struct ring *r, byte c)
+{
+    r->buf[(r->head + r->len) % RING_SIZE] = c;
+    ++r->len;
+}
+
+static byte ring_get(struct ring *r)
+{
+    byte c = r->buf[r->head];
+    r->head = (r->head + 1) % RING_SIZE;
+    --r->len;
+    return c;
+}
+
+static void disconnect(void)
+{
+    if (fd >= 0 && !is_pty) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+// Moves as much as the buffers and the peer allow, in both
+// directions. With a nonzero timeout, waits (up to that long) for
+// the peer to be ready, if it isn't already.
+static void pump(int timeout)
+{
+    if (fd < 0 && listen_fd >= 0) {
+        fd = accept(listen_fd, NULL, NULL);
+        if (fd >= 0) {
+            (void) fcntl(fd, F_SETFL, O_NONBLOCK);
+        }
+    }
+    if (fd < 0) return;
+
+    struct pollfd pfd = { .fd = fd };
+    if (ring_space(&rx) != 0) pfd.events |= POLLIN;
+    if (tx.len != 0) pfd.events |= POLLOUT;
+    if (pfd.events == 0) return;
+    if (poll(&pfd, 1, timeout) <= 0) return;
+
+    if (pfd.revents & POLLIN) {
+        // Read into the contiguous free stretch (and maybe the next).
+        for (int i = 0; i != 2 && ring_space(&rx) != 0; ++i) {
+            size_t tail = (rx.head + rx.len) % RING_SIZE;
+            size_t n = ring_space(&rx);
+            if (tail + n > RING_SIZE) n = RING_SIZE - tail;
+            ssize_t got = read(fd, &rx.buf[tail], n);
+            if (got == 0 && !is_pty) {
+                disconnect();
+                return;
+            }
+            if (got <= 0) break;
+            rx.len += got;
+            if ((size_t)got < n) break;
+        }
+    }
+    if (pfd.revents & POLLOUT) {
+        for (int i = 0; i != 2 && tx.len != 0; ++i) {
+            size_t n = tx.len;
+            if (tx.head + n > RING_SIZE) n = RING_SIZE - tx.head;
+            ssize_t put = write(fd, &tx.buf[tx.head], n);
+            if (put <= 0) break;
+            tx.head = (tx.head + put) % RING_SIZE;
+            tx.len -= put;
+            if ((size_t)put < n) break;
+        }
+    }
+    if ((pfd.revents & (POLLHUP | POLLERR)) && !(pfd.revents & POLLIN)) {
+        disconnect();
+    }
+}
+
+static void ssc_event(Event *e)
+{
+    if (e->type == EV_FRAME) pump(0);
+}
+
+static void flush_at_exit(void)
+{
+    // Give the peer a moment to take whatever's left.
+    for (int i = 0; i != 10 && tx.len != 0 && fd >= 0; ++i) {
+        pump(100);
+    }
+    if (listen_fd >= 0) {
+        disconnect();
+        close(listen_fd);
+        unlink(cfg.serial + 5);
+    }
+}
+
+static void open_pty(void)
+{
+    fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0) {
+        DIE(1, "Couldn't create a pty for the serial card: %s\n",
+            strerror(errno));
+    }
+    (void) fcntl(fd, F_SETFL, O_NONBLOCK);
+    is_pty = true;
+    WARN("serial card (slot %d) is at %s\n", SSC_SLOT, ptsname(fd));
+}
+
+static void open_socket(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof addr.sun_path) {
+        DIE(2, "--serial: socket path %s is too long.\n", path);
+    }
+    strcpy(addr.sun_path, path);
+    (void) unlink(path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0
+        || bind(listen_fd, (struct sockaddr *)&addr, sizeof addr) < 0
+        || listen(listen_fd, 1) < 0) {
+        DIE(1, "Couldn't listen on socket %s: %s\n", path, strerror(errno));
+    }
+    (void) fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+}
+
+static void build_rom(unsigned int slot)
+{
+    const byte sn = 0xC0 | slot;                // $Cn
+    const byte sw = 0x80 | (slot << 4);         // $C0n0, low byte
+    const byte out = 0x1B, in = 0x2E;
+    const byte rom[] = {
+        // Entry from PR#n or IN#n. If the output hook points here,
+        // that's how we got here: aim it at the output routine.
+        // Otherwise it was the input hook.
+        0x48,                   // $00  PHA
+        0xA5, 0x36,             // $01  LDA CSWL
+        0xD0, 0x0E,             // $03  BNE notout
+        0xA5, 0x37,             // $05  LDA CSWH
+        0xC9, sn,               // $07  CMP #$Cn
+        0xD0, 0x08,             // $09  BNE notout
+        0xA9, out,              // $0B  LDA #<output
+        0x85, 0x36,             // $0D  STA CSWL
+        0x68,                   // $0F  PLA
+        0x4C, out, sn,          // $10  JMP output
+        0xA9, in,               // $13  notout: LDA #<input
+        0x85, 0x38,             // $15  STA KSWL
+        0x68,                   // $17  PLA
+        0x4C, in, sn,           // $18  JMP input
+        // Output: wait for room, send (as 7-bit ASCII), and echo
+        // to the screen.
+        0x48,                   // $1B  output: PHA
+        0xAD, sw + 9, 0xC0,     // $1C  LDA $C0n9 (status)
+        0x29, ST_TDRE,          // $1F  AND #TDRE
+        0xF0, 0xF9,             // $21  BEQ $1C
+        0x68,                   // $23  PLA
+        0x48,                   // $24  PHA
+        0x29, 0x7F,             // $25  AND #$7F
+        0x8D, sw + 8, 0xC0,     // $27  STA $C0n8
+        0x68,                   // $2A  PLA
+        0x4C, 0xF0, 0xFD,       // $2B  JMP COUT1
+        // Input: A holds the screen character that RDKEY replaced
+        // with the cursor; it's put back once we have a key.
+        0x48,                   // $2E  input: PHA
+        0xAD, sw + 9, 0xC0,     // $2F  LDA $C0n9 (status)
+        0x29, ST_RDRF,          // $32  AND #RDRF
+        0xF0, 0x08,             // $34  BEQ kbd
+        0xAD, sw + 8, 0xC0,     // $36  LDA $C0n8
+        0x09, 0x80,             // $39  ORA #$80
+        0x4C, 0x46, sn,         // $3B  JMP got
+        0xAD, 0x00, 0xC0,       // $3E  kbd: LDA KBD
+        0x10, 0xEC,             // $41  BPL $2F
+        0x2C, 0x10, 0xC0,       // $43  BIT KBDSTRB
+        0x8D, sw, 0xC0,         // $46  got: STA $C0n0 (scratch latch)
+        0x68,                   // $49  PLA
+        0x91, 0x28,             // $4A  STA (BASL),Y
+        0xAD, sw, 0xC0,         // $4C  LDA $C0n0
+        0x60,                   // $4F  RTS
+    };
+    memset(rombuf, 0, sizeof rombuf);
+    memcpy(rombuf, rom, sizeof rom);
+}
+
+static void init(void)
+{
+    if (initialized) return;
+    initialized = true;
+
+    if (STREQ(cfg.serial, "pty")) {
+        open_pty();
+    } else if (strncmp(cfg.serial, "unix:", 5) == 0) {
+        open_socket(cfg.serial + 5);
+    } else {
+        DIE(2, "--serial: expected \"pty\" or \"unix:PATH\", got \"%s\".\n",
+            cfg.serial);
+    }
+    build_rom(SSC_SLOT);
+    event_reghandler_flags(ssc_event, EVH_FRAME);
+    atexit(flush_at_exit);
+}
+
+static byte status(void)
+{
+    byte st = 0;
+    if (rx.len != 0) st |= ST_RDRF;
+    if (ring_space(&tx) != 0) st |= ST_TDRE;
+    if (fd < 0) st |= ST_DCD | ST_DSR;
+    return st;
+}
+
+static byte handler(word loc, int val, int ploc, int psw)
+{
+    if (ploc != -1) {
+        return rombuf[ploc];
+    }
+
+    switch (psw) {
+        case 0x0:
+            if (val != -1) latch = val;
+            return latch;
+        case 0x8:
+            if (val != -1) {
+                if (ring_space(&tx) != 0) ring_put(&tx, val);
+                if (ring_space(&tx) == 0) pump(0);
+            } else if (rx.len != 0) {
+                return ring_get(&rx);
+            }
+            break;
+        case 0x9:
+            if (val != -1) {
+                command &= 0xE0; // programmed reset
+            } else {
+                return status();
+            }
+            break;
+        case 0xA:
+            if (val != -1) command = val;
+            return command;
+        case 0xB:
+            if (val != -1) control = val;
+            return control;
+        default:
+            ;
+    }
+    return 0;
+}
+
+PeriphDesc ssccard = {
+    init,
+    handler,
+};
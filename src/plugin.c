@@ -0,0 +1,206 @@
+//  plugin.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+#include "bobbin-plugin.h"
+
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Peripheral cards loaded from shared objects (--card SLOT=PATH).
+// See bobbin-plugin.h for the plugin's side of things.
+//
+// Each loaded card sits in its slot behind an ordinary PeriphDesc,
+// whose handler only ever sees the addresses the card asked for.
+
+#define NSLOTS      8
+#define MAX_TIMERS  64
+
+typedef struct Plugin Plugin;
+struct Plugin {
+    const char  *path;
+    void        *dl;
+    BobbinHost  host;
+    BobbinCard  card;
+    PeriphDesc  desc;
+};
+
+typedef struct Timer Timer;
+struct Timer {
+    uintmax_t   due;
+    void        (*fn)(void *ctx);
+    void        *ctx;
+};
+
+uintmax_t plugin_next_due = UINTMAX_MAX;
+
+static Plugin plugins[NSLOTS];
+static bool any_loaded;
+
+// Kept in order of due time, soonest first.
+static Timer timers[MAX_TIMERS];
+static int ntimers;
+
+void do_card(const char *arg)
+{
+    char *end;
+    unsigned long n = strtoul(arg, &end, 10);
+    if (end == arg || *end != '=' || end[1] == '\0') {
+        DIE(2, "--card argument must be SLOT=PATH.\n");
+    }
+    if (n < 1 || n >= NSLOTS) {
+        DIE(2, "--card slot must be from 1 to %d.\n", NSLOTS - 1);
+    }
+    if (plugins[n].path != NULL) {
+        DIE(2, "--card given twice for slot %lu.\n", n);
+    }
+    plugins[n].path = end + 1;
+}
+
+static uint8_t host_peek(uint16_t loc)
+{
+    return peek_sneaky(loc);
+}
+
+static void host_poke(uint16_t loc, uint8_t val)
+{
+    mem_dma_write(loc, &val, 1);
+}
+
+static uint64_t host_cycles(void)
+{
+    return cycles_elapsed();
+}
+
+static int host_schedule(uint64_t delay, void (*fn)(void *ctx), void *ctx)
+{
+    if (ntimers == MAX_TIMERS) return -1;
+
+    Timer t = { cycles_elapsed() + delay, fn, ctx };
+    int i = ntimers++;
+    for (; i != 0 && timers[i-1].due > t.due; --i) {
+        timers[i] = timers[i-1];
+    }
+    timers[i] = t;
+    plugin_next_due = timers[0].due;
+    return 0;
+}
+
+static void host_message(const BobbinHost *host, const char *msg)
+{
+    const Plugin *p = &plugins[host->slot];
+    WARN("%s (slot %u): %s\n", p->card.name? p->card.name : p->path,
+         host->slot, msg);
+}
+
+void plugin_run_timers(void)
+{
+    uintmax_t t = cycles_elapsed();
+    while (ntimers != 0 && timers[0].due <= t) {
+        Timer due = timers[0];
+        --ntimers;
+        memmove(&timers[0], &timers[1], ntimers * sizeof timers[0]);
+        plugin_next_due = ntimers? timers[0].due : UINTMAX_MAX;
+        due.fn(due.ctx); // may schedule more
+    }
+}
+
+static byte handler(word loc, int val, int ploc, int psw)
+{
+    if (psw >= 0) {
+        const BobbinCard *c = &plugins[(loc >> 4) & 7].card;
+        if (!(c->io_mask & (1u << psw))) {
+            return 0; // s/b floating bus
+        } else if (val < 0) {
+            return c->io_read(c->ctx, psw);
+        } else {
+            c->io_write(c->ctx, psw, val);
+            return 0;
+        }
+    } else {
+        const BobbinCard *c = &plugins[(loc >> 8) & 7].card;
+        return c->slot_rom? c->slot_rom[ploc] : 0;
+    }
+}
+
+static void plugin_event(Event *e)
+{
+    if (e->type == EV_REBOOT) {
+        // The cycle count starts again from zero.
+        ntimers = 0;
+        plugin_next_due = UINTMAX_MAX;
+    } else if (e->type == EV_RESET) {
+        for (int i = 1; i != NSLOTS; ++i) {
+            Plugin *p = &plugins[i];
+            if (p->dl && p->card.reset) p->card.reset(p->card.ctx);
+        }
+    }
+}
+
+static void load(unsigned int slot)
+{
+    Plugin *p = &plugins[slot];
+
+    // A bare name would send dlopen() searching the library path.
+    char *path = xalloc(strlen(p->path) + 3);
+    sprintf(path, "%s%s", strchr(p->path, '/')? "" : "./", p->path);
+    p->dl = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    free(path);
+    if (p->dl == NULL) {
+        DIE(1, "--card: couldn't load \"%s\": %s\n", p->path, dlerror());
+    }
+
+    BobbinCardInit init;
+    // (Converting void * to a function pointer is how dlsym() works.)
+    *(void **)&init = dlsym(p->dl, BOBBIN_CARD_INIT_SYM);
+    if (init == NULL) {
+        DIE(1, "--card: \"%s\" has no %s function.\n", p->path,
+            BOBBIN_CARD_INIT_SYM);
+    }
+
+    p->host = (BobbinHost){
+        .abi_version = BOBBIN_PLUGIN_ABI,
+        .slot = slot,
+        .peek = host_peek,
+        .poke = host_poke,
+        .cycles = host_cycles,
+        .schedule = host_schedule,
+        .message = host_message,
+    };
+    p->card = (BobbinCard){
+        .abi_version = BOBBIN_PLUGIN_ABI,
+        .size = sizeof (BobbinCard),
+    };
+    if (init(&p->host, &p->card) != 0) {
+        DIE(1, "--card: \"%s\" failed to start in slot %u.\n",
+            p->path, slot);
+    }
+    if (p->card.io_mask && (!p->card.io_read || !p->card.io_write)) {
+        DIE(1, "--card: \"%s\" claims I/O addresses without handlers.\n",
+            p->path);
+    }
+
+    p->desc = (PeriphDesc){ .handler = handler };
+    p->desc.c8rom = p->card.exp_rom;
+    INFO("Loaded card \"%s\" into slot %u.\n",
+         p->card.name? p->card.name : p->path, slot);
+}
+
+PeriphDesc *plugin_card(unsigned int slot)
+{
+    Plugin *p = &plugins[slot];
+    if (p->path == NULL) return NULL;
+
+    load(slot);
+    if (!any_loaded) {
+        event_reghandler(plugin_event);
+        any_loaded = true;
+    }
+    return &p->desc;
+}
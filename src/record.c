@@ -0,0 +1,242 @@
+//  record.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// --record and --replay.
+//
+// Given the same options, the emulated machine runs the same way
+// every time, except for what comes in from outside: the random
+// seed for the power-on RAM pattern, what the keyboard gives the
+// CPU, and commands typed at the debugger or tty breakout prompt
+// (resets, disk insert/eject). --record logs those to a text file,
+// each stamped with the instruction count at which it happened, and
+// --replay feeds them back in at the same instructions (running at
+// full speed), then hands over to the live keyboard.
+//
+// File format, one entry per line:
+//   seed N         random seed for the next RAM fill
+//   key AT VAL     keyboard value seen by the CPU, from instruction AT
+//                  (-1 = none)
+//   cmd AT LINE    breakout command, run before instruction AT
+//   end AT         the recorded run ended here
+// Lines starting with '#' are ignored.
+
+typedef enum {
+    REC_KEY,
+    REC_CMD,
+    REC_END,
+} RecType;
+
+typedef struct RecEntry RecEntry;
+struct RecEntry {
+    RecType     type;
+    uintmax_t   at;
+    int         val;
+    char        *line;
+};
+
+uintmax_t replay_next_at = UINTMAX_MAX;
+
+static FILE *recfile;
+static int last_key = INT_MIN;
+
+static RecEntry *entries;
+static size_t nentries, cur;
+static unsigned long *seeds;
+static size_t nseeds, cur_seed;
+static int cur_key = -1;
+static bool replaying;
+
+static void write_end(void)
+{
+    fprintf(recfile, "end %ju\n", instr_count);
+    fclose(recfile);
+}
+
+static void add_entry(const RecEntry *e)
+{
+    static size_t cap;
+    if (nentries == cap) {
+        cap = cap? cap * 2 : 256;
+        entries = realloc(entries, cap * sizeof *entries);
+        if (entries == NULL) {
+            DIE(1, "Out of memory reading --replay file.\n");
+        }
+    }
+    entries[nentries++] = *e;
+}
+
+static void add_seed(unsigned long seed)
+{
+    static size_t cap;
+    if (nseeds == cap) {
+        cap = cap? cap * 2 : 4;
+        seeds = realloc(seeds, cap * sizeof *seeds);
+        if (seeds == NULL) {
+            DIE(1, "Out of memory reading --replay file.\n");
+        }
+    }
+    seeds[nseeds++] = seed;
+}
+
+static void load_replay(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        DIE(1, "Couldn't open --replay file \"%s\": %s\n",
+            path, strerror(errno));
+    }
+
+    char buf[512];
+    unsigned long lineno = 0;
+    uintmax_t prev_at = 0;
+    while (fgets(buf, sizeof buf, f) != NULL) {
+        ++lineno;
+        char *nl = strchr(buf, '\n');
+        if (nl) *nl = '\0';
+        if (buf[0] == '#' || buf[0] == '\0') continue;
+
+        RecEntry e = { 0 };
+        unsigned long seed;
+        int n = 0;
+        if (sscanf(buf, "seed %lu%n", &seed, &n) == 1 && buf[n] == '\0') {
+            add_seed(seed);
+            continue;
+        } else if (sscanf(buf, "key %ju %d%n", &e.at, &e.val, &n) == 2
+                   && buf[n] == '\0') {
+            e.type = REC_KEY;
+        } else if (sscanf(buf, "cmd %ju %n", &e.at, &n) == 1 && n != 0) {
+            e.type = REC_CMD;
+            e.line = strdup(&buf[n]);
+        } else if (sscanf(buf, "end %ju%n", &e.at, &n) == 1
+                   && buf[n] == '\0') {
+            e.type = REC_END;
+        } else {
+            DIE(2, "--replay file \"%s\", line %lu: bad entry.\n",
+                path, lineno);
+        }
+        if (e.at < prev_at) {
+            DIE(2, "--replay file \"%s\", line %lu: out of order.\n",
+                path, lineno);
+        }
+        prev_at = e.at;
+        add_entry(&e);
+    }
+    if (ferror(f)) {
+        DIE(1, "Error reading --replay file \"%s\": %s\n",
+            path, strerror(errno));
+    }
+    fclose(f);
+
+    replaying = true;
+    replay_next_at = nentries? entries[0].at : 0;
+    INFO("Replaying %zu recorded inputs from \"%s\".\n", nentries, path);
+}
+
+void record_init(void)
+{
+    if (cfg.record_file && cfg.replay_file) {
+        DIE(2, "--record and --replay can't be used together.\n");
+    }
+    if ((cfg.record_file || cfg.replay_file) && cfg.rewind) {
+        DIE(2, "--rewind can't be used with --record or --replay.\n");
+    }
+
+    if (cfg.record_file) {
+        recfile = fopen(cfg.record_file, "w");
+        if (recfile == NULL) {
+            DIE(1, "Couldn't open --record file \"%s\": %s\n",
+                cfg.record_file, strerror(errno));
+        }
+        fputs("# bobbin session record\n", recfile);
+        atexit(write_end);
+    } else if (cfg.replay_file) {
+        load_replay(cfg.replay_file);
+    }
+}
+
+bool record_replaying(void)
+{
+    return replaying;
+}
+
+static void replay_finish(void)
+{
+    replaying = false;
+    replay_next_at = UINTMAX_MAX;
+    INFO("Replay finished at instruction %ju; input is live now.\n",
+         instr_count);
+}
+
+static int quiet(const char *fmt, ...)
+{
+    return 0;
+}
+
+void replay_catch_up(void)
+{
+    for (; cur != nentries && entries[cur].at <= instr_count; ++cur) {
+        RecEntry *e = &entries[cur];
+        switch (e->type) {
+            case REC_KEY:
+                cur_key = e->val;
+                break;
+            case REC_CMD:
+                VERBOSE("Replaying command \"%s\".\n", e->line);
+                (void) command_do(e->line, quiet);
+                break;
+            case REC_END:
+                break;
+        }
+    }
+    if (cur == nentries) {
+        replay_finish();
+    } else {
+        replay_next_at = entries[cur].at;
+    }
+}
+
+unsigned long record_seed(unsigned long live)
+{
+    if (replaying) {
+        if (cur_seed != nseeds) return seeds[cur_seed++];
+        WARN("--replay file has no seed for this RAM fill.\n");
+    }
+    if (recfile) {
+        fprintf(recfile, "seed %lu\n", live);
+    }
+    return live;
+}
+
+int record_key(int (*live)(void))
+{
+    if (replaying) {
+        if (replay_due()) replay_catch_up();
+        if (replaying) return cur_key;
+    }
+
+    int c = live();
+    if (recfile && c != last_key) {
+        fprintf(recfile, "key %ju %d\n", instr_count, c);
+        last_key = c;
+    }
+    return c;
+}
+
+void record_cmd(const char *line)
+{
+    if (recfile && !replaying) {
+        fprintf(recfile, "cmd %ju %s\n", instr_count, line);
+    }
+}
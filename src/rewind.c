@@ -0,0 +1,483 @@
+//  rewind.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Execution history for the debugger's reverse-stepping commands
+// (--rewind).
+//
+// Every CHECKPOINT_INTERVAL instructions we note the CPU registers,
+// soft switches, and the state of cards that can give it to us (the
+// Disk II controller and drive mechanics). RAM isn't copied; instead, the first write to
+// each 256-byte page after a checkpoint saves that page's old
+// contents to the checkpoint's undo store, so undoing the stores
+// newest-first takes RAM back to what it was at any checkpoint.
+//
+// From a checkpoint, the emulation is deterministic except for what
+// comes from outside the CPU: I/O reads ($C000-$C0FF), peripheral
+// DMA into RAM, and changes that hooks, interfaces and the debugger
+// make to registers and memory between instructions. Those are logged
+// as they happen, and fed back in (in place of the real peripherals)
+// when re-executing from a checkpoint to reach any earlier
+// instruction.
+//
+// Other cards' state isn't part of a checkpoint, and neither are
+// disk contents: after moving back, those carry on from where they
+// really are. Loading a file into RAM, changing disks or rebooting
+// discards the history.
+
+#define CHECKPOINT_INTERVAL     100000
+#define MAX_CHECKPOINTS         64
+#define NPAGES                  (128 * 1024 / 256)
+
+typedef struct SavedPage SavedPage;
+struct SavedPage {
+    size_t  page;
+    byte    data[256];
+};
+
+typedef struct IoEntry IoEntry;
+struct IoEntry {
+    word        loc;
+    byte        val;
+    uint32_t    count;  // consecutive identical reads
+};
+
+typedef struct IoPos IoPos;
+struct IoPos {
+    size_t      idx;
+    uint32_t    off;
+};
+
+typedef enum {
+    DELTA_STATE,
+    DELTA_MEM,
+} DeltaType;
+
+typedef struct Delta Delta;
+struct Delta {
+    uintmax_t   insn;   // applies before this instruction
+    DeltaType   type;
+    union {
+        struct {
+            Registers       regs;
+            SoftSwitches    ss;
+        } state;
+        struct {
+            size_t  bufloc;
+            byte    val;
+        } mem;
+    } u;
+};
+
+typedef struct Checkpoint Checkpoint;
+struct Checkpoint {
+    uintmax_t       insn;
+    Registers       regs;
+    SoftSwitches    ss;
+    byte            *periph;    // card state (see PeriphDesc)
+    IoPos           io_pos;
+    size_t          delta_pos;
+    SavedPage       *pages;
+    size_t          npages;
+    size_t          pages_cap;
+};
+
+bool rewind_replaying = false;
+
+static Checkpoint cps[MAX_CHECKPOINTS];
+static int ncps;
+static bool page_saved[NPAGES];
+
+static IoEntry *io_log;
+static size_t io_len, io_cap;
+static bool io_sealed;
+static IoPos io_cur;
+
+static Delta *deltas;
+static size_t delta_len, delta_cap;
+static size_t delta_cur;
+
+static bool in_step;
+static bool in_dma;
+static bool desynced;
+static Registers post_regs;
+static SoftSwitches post_ss;
+
+static long write_watch = -1;
+static bool write_hit;
+
+static void *grow(void *buf, size_t *cap, size_t need, size_t elsz)
+{
+    if (need <= *cap) return buf;
+    size_t ncap = *cap? *cap * 2 : 256;
+    while (ncap < need) ncap *= 2;
+    buf = realloc(buf, ncap * elsz);
+    if (buf == NULL) {
+        DIE(1, "Out of memory for --rewind history.\n");
+    }
+    *cap = ncap;
+    return buf;
+}
+
+static inline bool regs_equal(const Registers *a, const Registers *b)
+{
+    return a->pc == b->pc && a->sp == b->sp && a->p == b->p
+        && a->a == b->a && a->x == b->x && a->y == b->y;
+}
+
+static inline bool recording(void)
+{
+    return ncps != 0 && !rewind_replaying;
+}
+
+static void save_post_state(void)
+{
+    post_regs = theCpu.regs;
+    memcpy(post_ss, ss, sizeof ss);
+}
+
+static void save_page(size_t page)
+{
+    Checkpoint *cp = &cps[ncps-1];
+    cp->pages = grow(cp->pages, &cp->pages_cap, cp->npages + 1,
+                     sizeof *cp->pages);
+    cp->pages[cp->npages].page = page;
+    memcpy(cp->pages[cp->npages].data, &getram()[page << 8], 256);
+    ++cp->npages;
+    page_saved[page] = true;
+}
+
+static void free_pages(Checkpoint *cp)
+{
+    free(cp->pages);
+    cp->pages = NULL;
+    cp->npages = cp->pages_cap = 0;
+}
+
+static void free_checkpoint(Checkpoint *cp)
+{
+    free_pages(cp);
+    free(cp->periph);
+    cp->periph = NULL;
+}
+
+// Drops the oldest checkpoint, and the log entries only it needed.
+static void drop_oldest(void)
+{
+    free_checkpoint(&cps[0]);
+    memmove(&cps[0], &cps[1], (ncps - 1) * sizeof cps[0]);
+    --ncps;
+    memset(&cps[ncps], 0, sizeof cps[ncps]);
+
+    size_t io_drop = cps[0].io_pos.idx;
+    size_t delta_drop = cps[0].delta_pos;
+    memmove(io_log, io_log + io_drop, (io_len - io_drop) * sizeof *io_log);
+    io_len -= io_drop;
+    memmove(deltas, deltas + delta_drop,
+            (delta_len - delta_drop) * sizeof *deltas);
+    delta_len -= delta_drop;
+    for (int i = 0; i != ncps; ++i) {
+        cps[i].io_pos.idx -= io_drop;
+        cps[i].delta_pos -= delta_drop;
+    }
+    if (rewind_replaying) {
+        io_cur.idx -= io_drop;
+        delta_cur -= delta_drop;
+    }
+}
+
+static void checkpoint(void)
+{
+    if (ncps == MAX_CHECKPOINTS) drop_oldest();
+
+    Checkpoint *cp = &cps[ncps++];
+    cp->insn = instr_count;
+    cp->regs = theCpu.regs;
+    memcpy(cp->ss, ss, sizeof ss);
+    size_t psz = periph_state_size();
+    cp->periph = psz? xalloc(psz) : NULL;
+    periph_save_state(cp->periph);
+    if (rewind_replaying) {
+        cp->io_pos = io_cur;
+        cp->delta_pos = delta_cur;
+    } else {
+        cp->io_pos = (IoPos){ io_len, 0 };
+        cp->delta_pos = delta_len;
+        io_sealed = true;
+    }
+    memset(page_saved, 0, sizeof page_saved);
+}
+
+static inline bool checkpoint_due(void)
+{
+    return ncps == 0
+        || instr_count - cps[ncps-1].insn >= CHECKPOINT_INTERVAL;
+}
+
+void rewind_barrier(void)
+{
+    for (int i = 0; i != ncps; ++i) {
+        free_checkpoint(&cps[i]);
+    }
+    ncps = 0;
+    io_len = 0;
+    delta_len = 0;
+}
+
+static void log_delta(const Delta *d)
+{
+    deltas = grow(deltas, &delta_cap, delta_len + 1, sizeof *deltas);
+    deltas[delta_len++] = *d;
+}
+
+void rewind_dma(bool on)
+{
+    in_dma = on;
+}
+
+void rewind_note_write(size_t bufloc, byte val)
+{
+    if (ncps == 0) return;
+    if (!page_saved[bufloc >> 8]) save_page(bufloc >> 8);
+    if ((in_dma || !in_step) && recording()) {
+        // DMA that an instruction set off lands after it.
+        Delta d = { .insn = instr_count + in_step, .type = DELTA_MEM };
+        d.u.mem.bufloc = bufloc;
+        d.u.mem.val = val;
+        log_delta(&d);
+    }
+}
+
+void rewind_log_io(word loc, byte val)
+{
+    if (!in_step || !recording()) return;
+    if (!io_sealed && io_len != 0 && io_log[io_len-1].loc == loc
+        && io_log[io_len-1].val == val) {
+        ++io_log[io_len-1].count;
+        return;
+    }
+    io_log = grow(io_log, &io_cap, io_len + 1, sizeof *io_log);
+    io_log[io_len++] = (IoEntry){ loc, val, 1 };
+    io_sealed = false;
+}
+
+byte rewind_replay_io(word loc)
+{
+    if (io_cur.idx >= io_len || io_log[io_cur.idx].loc != loc) {
+        desynced = true;
+        return 0;
+    }
+    byte val = io_log[io_cur.idx].val;
+    if (++io_cur.off == io_log[io_cur.idx].count) {
+        ++io_cur.idx;
+        io_cur.off = 0;
+    }
+    return val;
+}
+
+void rewind_replay_poke(word loc)
+{
+    if (loc == write_watch) write_hit = true;
+}
+
+static void step(void)
+{
+    in_step = true;
+    cpu_step();
+    in_step = false;
+}
+
+void rewind_cpu_step(void)
+{
+    if (ncps != 0
+        && (!regs_equal(&theCpu.regs, &post_regs)
+            || memcmp(ss, post_ss, sizeof ss) != 0)) {
+        // Something besides the CPU changed things since the last
+        // instruction.
+        Delta d = { .insn = instr_count, .type = DELTA_STATE };
+        d.u.state.regs = theCpu.regs;
+        memcpy(d.u.state.ss, ss, sizeof ss);
+        log_delta(&d);
+    }
+    if (checkpoint_due()) checkpoint();
+    step();
+    save_post_state();
+}
+
+static void restore(int j)
+{
+    for (int i = ncps - 1; i >= j; --i) {
+        for (size_t k = cps[i].npages; k-- != 0; ) {
+            mem_put(cps[i].pages[k].page << 8, cps[i].pages[k].data, 256);
+        }
+        if (i == j) {
+            free_pages(&cps[i]);
+        } else {
+            free_checkpoint(&cps[i]);
+        }
+    }
+    ncps = j + 1;
+    memset(page_saved, 0, sizeof page_saved);
+
+    Checkpoint *cp = &cps[j];
+    theCpu.regs = cp->regs;
+    memcpy(ss, cp->ss, sizeof ss);
+    periph_restore_state(cp->periph);
+    instr_count = cp->insn;
+    io_cur = cp->io_pos;
+    delta_cur = cp->delta_pos;
+    rewind_replaying = true;
+}
+
+static void apply_deltas(void)
+{
+    for (; delta_cur != delta_len && deltas[delta_cur].insn <= instr_count;
+         ++delta_cur) {
+        const Delta *d = &deltas[delta_cur];
+        if (d->type == DELTA_STATE) {
+            theCpu.regs = d->u.state.regs;
+            memcpy(ss, d->u.state.ss, sizeof ss);
+        } else {
+            if (!page_saved[d->u.mem.bufloc >> 8]) {
+                save_page(d->u.mem.bufloc >> 8);
+            }
+            mem_put(d->u.mem.bufloc, &d->u.mem.val, 1);
+        }
+    }
+}
+
+// Re-executes one instruction from the logs; the replay counterpart
+// of rewind_cpu_step().
+static void replay_step(void)
+{
+    apply_deltas();
+    if (checkpoint_due()) checkpoint();
+    write_hit = false;
+    step();
+}
+
+static void replay_to(uintmax_t target)
+{
+    while (instr_count < target && !desynced) {
+        replay_step();
+    }
+}
+
+// Back to live execution: whatever the logs held beyond this point
+// is a future that won't happen now.
+static void finish(void)
+{
+    if (io_cur.off != 0) {
+        io_log[io_cur.idx].count = io_cur.off;
+        io_len = io_cur.idx + 1;
+    } else {
+        io_len = io_cur.idx;
+    }
+    io_sealed = true;
+    delta_len = delta_cur;
+    rewind_replaying = false;
+    save_post_state();
+    if (desynced) {
+        WARN("Rewind history went out of step with execution;"
+             " discarding it.\n");
+        desynced = false;
+        rewind_barrier();
+    }
+    event_fire(EV_DISPLAY_TOUCH);
+}
+
+// Latest checkpoint at or before instruction n, or -1.
+static int checkpoint_before(uintmax_t n)
+{
+    int j;
+    for (j = ncps - 1; j >= 0 && cps[j].insn > n; --j) {}
+    return j;
+}
+
+uintmax_t rewind_available(void)
+{
+    return ncps == 0? 0 : instr_count - cps[0].insn;
+}
+
+bool rewind_back(uintmax_t n)
+{
+    if (n == 0 || n > rewind_available()) return false;
+
+    uintmax_t cycles = cycle_count;
+    uintmax_t target = instr_count - n;
+    restore(checkpoint_before(target));
+    replay_to(target);
+    finish();
+    cycle_count = cycles;
+    return true;
+}
+
+// Searches backward from the current instruction for the most recent
+// boundary at which match() is true or (if wloc isn't -1) that's
+// followed by an instruction writing wloc, and moves there.
+static bool search(void (*begin)(void), bool (*match)(void), long wloc)
+{
+    if (ncps == 0) return false;
+
+    uintmax_t cycles = cycle_count;
+    uintmax_t cur = instr_count;
+    uintmax_t starts[MAX_CHECKPOINTS];
+    int nstarts = ncps;
+    for (int i = 0; i != ncps; ++i) {
+        starts[i] = cps[i].insn;
+    }
+
+    bool found = false;
+    uintmax_t found_at = 0;
+    int j;
+    write_watch = wloc;
+    for (j = nstarts - 1; j >= 0 && !found && !desynced; --j) {
+        uintmax_t hi = (j == nstarts - 1)? cur : starts[j+1];
+        restore(j);
+        if (begin) begin();
+        for (;;) {
+            if (instr_count < cur && match && match()) {
+                found = true;
+                found_at = instr_count;
+            }
+            if (instr_count >= hi || desynced) break;
+            uintmax_t here = instr_count;
+            replay_step();
+            if (write_hit) {
+                found = true;
+                found_at = here;
+            }
+        }
+        if (found) break;
+    }
+    write_watch = -1;
+
+    if (found) {
+        restore(j);
+        replay_to(found_at);
+    } else {
+        // Nothing; go back to where we started.
+        replay_to(cur);
+    }
+    finish();
+    cycle_count = cycles;
+    return found;
+}
+
+bool rewind_search(void (*begin)(void), bool (*match)(void))
+{
+    return search(begin, match, -1);
+}
+
+bool rewind_last_write(word loc)
+{
+    return search(NULL, NULL, loc);
+}
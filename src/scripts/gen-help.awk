@@ -18,7 +18,9 @@ BEGIN {
     print
     print "// this file is read by config.c."
     print
-    print "static const char help_text[] = "
+    print "// One string per option (and heading), since C99 compilers"
+    print "// needn't handle a string longer than 4095 characters."
+    print "static const char * const help_text[] = {"
 }
 
 1 {
@@ -68,6 +70,10 @@ NEED_DESC && !/^$/ {
     OUTPUT = "     " $0;
 }
 
+STARTED && /^####/ {
+    print "    ,"
+}
+
 STARTED && /^#### / {
     sub(/^#### /,"")
     gsub("\"","")
@@ -101,7 +107,8 @@ OUTPUT {
 }
 
 /^<!--END-OPTIONS-->/ {
-    print ";"
+    print "    , NULL"
+    print "};"
     exit(0);
 }
 
@@ -0,0 +1,24 @@
+//  secmap.h
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#ifndef BOBBIN_SECMAP_H
+#define BOBBIN_SECMAP_H
+
+// Sector orderings of 140k disk images, shared by the emulator's
+// .dsk/.do/.po support and bobbin-fs. This header has no dependencies
+// on the rest of bobbin's source.
+//
+// Both tables are indexed by physical sector; the value is the sector
+// number as DOS 3.3 (DO) or ProDOS (PO) sees it, which is also the
+// sector's position within its track in an image of that order.
+// ProDOS block N is ProDOS sectors 2*(N%8) and 2*(N%8)+1 of track N/8.
+
+#include <stdint.h>
+
+extern const uint8_t DO[16];
+extern const uint8_t PO[16];
+
+#endif // BOBBIN_SECMAP_H
@@ -0,0 +1,127 @@
+//  shm.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+#include "bobbin-shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// --shm: emulated RAM, and a header of machine state, in a named
+// POSIX shared-memory object (see bobbin-shm.h for the layout).
+//
+// RAM isn't copied out: the emulator's memory *is* the shared object,
+// so viewers see every write as it happens, at no cost to us. The
+// header is rewritten each frame.
+
+#define HEADER_SIZE     4096    // keeps RAM page-aligned
+
+static char *shm_name;
+static BobbinShmHeader *hdr;
+
+static void shm_remove(void)
+{
+    shm_unlink(shm_name);
+}
+
+// The pid of the bobbin still running with the object we found at
+// shm_name, or 0 if it's left over from one that's gone.
+static pid_t shm_owner(void)
+{
+    int fd = shm_open(shm_name, O_RDONLY, 0);
+    if (fd < 0) return 0;
+    BobbinShmHeader h;
+    ssize_t n = read(fd, &h, sizeof h);
+    close(fd);
+    if (n != sizeof h || memcmp(h.magic, BOBBIN_SHM_MAGIC, sizeof h.magic)
+        || h.pid == 0) {
+        return 0;
+    }
+    if (kill(h.pid, 0) < 0 && errno == ESRCH) return 0;
+    return h.pid;
+}
+
+static void shm_frame(Event *e)
+{
+    if (e->type != EV_FRAME) return;
+
+    __atomic_store_n(&hdr->seq, hdr->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    hdr->frames = frame_count;
+    hdr->cycles = frame_count * CYCLES_PER_FRAME
+        + cycle_count % CYCLES_PER_FRAME;
+    hdr->instructions = instr_count;
+    hdr->pc = PC;
+    hdr->a = ACC;
+    hdr->x = XREG;
+    hdr->y = YREG;
+    hdr->sp = SP;
+    hdr->p = PFLAGS;
+    memcpy(hdr->switches, ss, sizeof hdr->switches);
+
+    __atomic_store_n(&hdr->seq, hdr->seq + 1, __ATOMIC_RELEASE);
+}
+
+void shm_init(void)
+{
+    if (cfg.shm == NULL) return;
+    if (cfg.fuzz_at_set) {
+        // Forked runs would all write the one copy of RAM.
+        DIE(2, "--shm can't be used with --fuzz-at.\n");
+    }
+
+    // shm_open() names must start with a slash.
+    shm_name = xalloc(strlen(cfg.shm) + 2);
+    shm_name[0] = '/';
+    strcpy(shm_name + (cfg.shm[0] != '/'), cfg.shm);
+
+    // Never reuse another bobbin's object: truncating it would wipe
+    // that one's RAM out from under it.
+    int fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        pid_t owner = shm_owner();
+        if (owner != 0) {
+            DIE(1, "--shm: \"%s\" is in use by bobbin process %ld.\n",
+                shm_name, (long)owner);
+        }
+        shm_unlink(shm_name);
+        fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0) {
+        DIE(1, "--shm: couldn't create \"%s\": %s\n", shm_name,
+            strerror(errno));
+    }
+    atexit(shm_remove);
+
+    size_t sz = HEADER_SIZE + MEM_SIZE;
+    if (ftruncate(fd, sz) < 0) {
+        DIE(1, "--shm: couldn't size \"%s\": %s\n", shm_name,
+            strerror(errno));
+    }
+    byte *buf = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (buf == MAP_FAILED) {
+        DIE(1, "--shm: couldn't map \"%s\": %s\n", shm_name,
+            strerror(errno));
+    }
+    close(fd);
+
+    hdr = (BobbinShmHeader *)buf;
+    memcpy(hdr->magic, BOBBIN_SHM_MAGIC, sizeof hdr->magic);
+    hdr->version = BOBBIN_SHM_VERSION;
+    hdr->header_size = HEADER_SIZE;
+    hdr->ram_size = MEM_SIZE;
+    hdr->pid = getpid();
+
+    mem_use_buffer(buf + HEADER_SIZE);
+    event_reghandler_flags(shm_frame, EVH_FRAME);
+    INFO("Sharing emulated RAM as \"%s\".\n", shm_name);
+}
@@ -0,0 +1,266 @@
+//  stall.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Catching batch runs that will never finish: --detect-loops,
+// --cycle-limit and --time-limit.
+//
+// Limits are checked once per frame. Loop detection samples the
+// machine state (CPU registers, soft switches and all of RAM) at
+// most once per frame too - but always at the same PC (the "anchor",
+// wherever the CPU happened to be at a frame's end), so that a loop
+// whose length has nothing to do with the frame's is seen at the
+// same point in it each time.
+//
+// Each sample is hashed, keeping a hash per RAM page that only needs
+// redoing for pages written since the last sample. When a hash turns
+// up that's in the recent history, we copy the whole state; if we
+// later come back to exactly that state, the program can't ever get
+// out again, and we stop it.
+//
+// Anything the program learns from outside - a key taken from the
+// keyboard, the game I/O switches, or any slot's I/O - might break
+// the loop, so it forgets all the history. Just printing doesn't.
+
+#define NPAGES      (MEM_SIZE / 256)
+#define HISTORY     64
+
+bool stall_sampling;
+word stall_anchor;
+
+static bool detecting;
+static bool have_anchor;
+static uintmax_t frames;
+static struct timespec started;
+
+static uint32_t page_hash[NPAGES];
+static bool page_dirty[NPAGES];
+static size_t dirty[NPAGES];
+static size_t ndirty;
+
+static uint32_t history[HISTORY];
+static size_t nhist;
+static size_t hist_next;
+static unsigned int misses;
+
+static bool have_cand;
+static uint32_t cand_hash;
+static uintmax_t cand_instr;
+static Registers cand_regs;
+static SoftSwitches cand_ss;
+static byte cand_ram[MEM_SIZE];
+
+static const char *dump_reason;
+
+// FNV-1a
+static uint32_t hash_bytes(uint32_t h, const void *p, size_t n)
+{
+    const byte *b = p;
+    for (; n != 0; --n) {
+        h ^= *b++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t hash_state(void)
+{
+    const byte *ram = getram();
+    for (size_t i = 0; i != ndirty; ++i) {
+        size_t page = dirty[i];
+        page_hash[page] = hash_bytes(2166136261u, &ram[page << 8], 256);
+        page_dirty[page] = false;
+    }
+    ndirty = 0;
+
+    const Registers *r = &theCpu.regs;
+    byte regs[] = { LO(r->pc), HI(r->pc), r->sp, r->p, r->a, r->x, r->y };
+    uint32_t h = hash_bytes(2166136261u, regs, sizeof regs);
+    h = hash_bytes(h, ss, sizeof ss);
+    return hash_bytes(h, page_hash, sizeof page_hash);
+}
+
+static bool same_as_cand(void)
+{
+    const Registers *r = &theCpu.regs;
+    return r->pc == cand_regs.pc && r->sp == cand_regs.sp
+        && r->p == cand_regs.p && r->a == cand_regs.a
+        && r->x == cand_regs.x && r->y == cand_regs.y
+        && memcmp(ss, cand_ss, sizeof ss) == 0
+        && memcmp(getram(), cand_ram, sizeof cand_ram) == 0;
+}
+
+static void forget(void)
+{
+    nhist = 0;
+    hist_next = 0;
+    misses = 0;
+    have_cand = false;
+    have_anchor = false; // pick a new one at the next frame
+    stall_sampling = false;
+}
+
+static void write_dump(void)
+{
+    FILE *f = fopen(cfg.stall_dump, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Couldn't open --stall-dump file \"%s\": %s\n",
+                cfg.stall_dump, strerror(errno));
+        return;
+    }
+    size_t n = fwrite(getram(), 1, MEM_SIZE, f);
+    if (fclose(f) != 0 || n != MEM_SIZE) {
+        fprintf(stderr, "Couldn't write --stall-dump file \"%s\".\n",
+                cfg.stall_dump);
+    } else {
+        fprintf(stderr, "RAM written to \"%s\".\n", cfg.stall_dump);
+    }
+}
+
+static void stop(void)
+{
+    fprintf(stderr, "*** STALLED: %s ***\n", dump_reason);
+    fprintf(stderr, "Instr #: %ju\n", instr_count);
+    fprintf(stderr, "Frames: %ju\n", frames);
+    util_print_state(stderr, PC, &theCpu.regs);
+    if (cfg.stall_dump) write_dump();
+    exit(4);
+}
+
+void stall_sample(void)
+{
+    stall_sampling = false;
+    misses = 0;
+    uint32_t h = hash_state();
+
+    if (have_cand) {
+        if (h == cand_hash && same_as_cand()) {
+            static char buf[80];
+            snprintf(buf, sizeof buf,
+                     "looping at $%04X (%ju instructions per pass)",
+                     (unsigned int)PC, instr_count - cand_instr);
+            dump_reason = buf;
+            stop();
+        }
+    } else {
+        for (size_t i = 0; i != nhist; ++i) {
+            if (history[i] != h) continue;
+            have_cand = true;
+            cand_hash = h;
+            cand_instr = instr_count;
+            cand_regs = theCpu.regs;
+            memcpy(cand_ss, ss, sizeof ss);
+            memcpy(cand_ram, getram(), sizeof cand_ram);
+            break;
+        }
+    }
+
+    history[hist_next] = h;
+    hist_next = (hist_next + 1) % HISTORY;
+    if (nhist != HISTORY) ++nhist;
+}
+
+void stall_note_write(size_t bufloc)
+{
+    size_t page = bufloc >> 8;
+    if (!page_dirty[page]) {
+        page_dirty[page] = true;
+        dirty[ndirty++] = page;
+    }
+}
+
+static double seconds_running(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - started.tv_sec)
+        + (now.tv_nsec - started.tv_nsec) / 1e9;
+}
+
+static void stall_event(Event *e)
+{
+    switch (e->type) {
+        case EV_PEEK:
+        case EV_POKE:
+        {
+            if (!detecting) break;
+            // (On the //e, only $C010 itself clears the strobe;
+            // the rest of $C01x are status flags.)
+            bool strobe = machine_is_iie()? e->loc == SS_KBDSTROBE
+                : (e->loc & 0xFFF0) == SS_KBDSTROBE;
+            if (strobe
+                || (e->loc >= 0xC060 && e->loc < 0xC080)
+                || (e->loc >= 0xC090 && e->loc < 0xC100)) {
+                forget();
+            }
+        }
+            break;
+        case EV_REBOOT:
+        case EV_RESET:
+            if (detecting) forget();
+            break;
+        case EV_FRAME:
+            ++frames;
+            if (cfg.cycle_limit
+                && frames * CYCLES_PER_FRAME >= cfg.cycle_limit) {
+                dump_reason = "--cycle-limit reached";
+                stop();
+            }
+            if (cfg.time_limit != 0 && seconds_running() >= cfg.time_limit) {
+                dump_reason = "--time-limit reached";
+                stop();
+            }
+            if (!detecting) break;
+            if (!have_anchor) {
+                stall_anchor = PC;
+                have_anchor = true;
+                stall_sampling = true;
+            } else if (!stall_sampling) {
+                stall_sampling = true;
+            } else if (++misses == HISTORY) {
+                // Haven't been back to the anchor in a long while:
+                // try somewhere else.
+                forget();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void stall_init(void)
+{
+    if (cfg.stall_dump && !cfg.detect_loops
+        && !cfg.cycle_limit && cfg.time_limit == 0) {
+        DIE(2, "--stall-dump needs --detect-loops, --cycle-limit"
+            " or --time-limit.\n");
+    }
+    if (cfg.detect_loops) {
+        if (isatty(STDIN_FILENO)) {
+            // Someone's there to press a key.
+            WARN("--detect-loops ignored: input is a terminal.\n");
+        } else {
+            detecting = true;
+            // Every page needs hashing the first time around.
+            for (size_t page = 0; page != NPAGES; ++page) {
+                stall_note_write(page << 8);
+            }
+        }
+    }
+    if (!detecting && !cfg.cycle_limit && cfg.time_limit == 0) return;
+
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    event_reghandler_flags(stall_event, EVH_FRAME);
+}
@@ -0,0 +1,352 @@
+//  termgfx.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+#include <errno.h>
+#include <langinfo.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Draws the video renderer's framebuffer into a terminal, using
+// Unicode half-block or braille characters with 256-color or
+// truecolor escapes. Writes go straight to a file descriptor,
+// independently of curses (callers that use curses must invalidate
+// us whenever curses might have painted over our area).
+//
+// A shadow copy of every cell we've sent is kept, and a frame only
+// emits the cells that differ from it, so a small moving sprite
+// costs a handful of bytes per frame rather than a full repaint.
+
+#define MAX_COLS    160
+#define MAX_ROWS    48
+
+#define NO_COLOR    0xFFFFFFFFu
+
+typedef enum {
+    TG_OFF,
+    TG_AUTO,
+    TG_HALF,
+    TG_BRAILLE,
+} TermGfxMode;
+
+struct cell {
+    uint32_t glyph; // Unicode code point; 0 if unknown
+    uint32_t fg;    // 0xRRGGBB, or NO_COLOR
+    uint32_t bg;
+};
+
+static TermGfxMode mode = TG_OFF;
+static bool truecolor = false;
+
+static struct cell shadow[MAX_ROWS][MAX_COLS];
+static uint32_t seen[VIDEO_HEIGHT];
+static bool need_all = true;
+static TermGfxMode last_mode = TG_OFF;
+static int last_cols, last_rows, last_lines;
+
+static char *obuf;
+static size_t olen, osize;
+
+static void out(const char *s, size_t n)
+{
+    if (olen + n > osize) {
+        osize = (olen + n) * 2;
+        obuf = realloc(obuf, osize);
+        if (obuf == NULL) DIE(1, "termgfx: out of memory.\n");
+    }
+    memcpy(obuf + olen, s, n);
+    olen += n;
+}
+
+static void outf(const char *fmt, ...)
+{
+    char buf[64];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof buf, fmt, args);
+    va_end(args);
+    out(buf, n);
+}
+
+static void out_utf8(uint32_t cp)
+{
+    char buf[3];
+    if (cp < 0x80) {
+        buf[0] = cp;
+        out(buf, 1);
+    } else {
+        // Everything we draw is in the BMP, above U+07FF.
+        buf[0] = 0xE0 | (cp >> 12);
+        buf[1] = 0x80 | ((cp >> 6) & 0x3F);
+        buf[2] = 0x80 | (cp & 0x3F);
+        out(buf, 3);
+    }
+}
+
+static int to_256(uint32_t rgb)
+{
+    static const int levels[] = {0, 95, 135, 175, 215, 255};
+    int idx[3];
+    for (int i = 0; i != 3; ++i) {
+        int v = (rgb >> (16 - 8 * i)) & 0xFF;
+        int best = 0;
+        for (int l = 1; l != 6; ++l) {
+            if (abs(levels[l] - v) < abs(levels[best] - v)) best = l;
+        }
+        idx[i] = best;
+    }
+    return 16 + 36 * idx[0] + 6 * idx[1] + idx[2];
+}
+
+static void out_color(bool bg, uint32_t rgb)
+{
+    int sel = bg? 48 : 38;
+    if (truecolor) {
+        outf("\033[%d;2;%u;%u;%um", sel,
+             (unsigned)(rgb >> 16), (unsigned)((rgb >> 8) & 0xFF),
+             (unsigned)(rgb & 0xFF));
+    } else {
+        outf("\033[%d;5;%dm", sel, to_256(rgb));
+    }
+}
+
+static inline uint32_t pixel_at(const byte *fb, int x, int y)
+{
+    const byte *p = &fb[(y * VIDEO_WIDTH + x) * 3];
+    return ((uint32_t)p[0] << 16) | (p[1] << 8) | p[2];
+}
+
+// Finds the most common color in a rectangle of the framebuffer.
+// If skip_black, black only wins when nothing else is present.
+static uint32_t area_color(const byte *fb, int x0, int x1, int y0, int y1,
+                           bool skip_black)
+{
+    uint32_t colors[16];
+    int counts[16];
+    int n = 0;
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+            uint32_t c = pixel_at(fb, x, y);
+            if (skip_black && c == 0) continue;
+            int i;
+            for (i = 0; i != n && colors[i] != c; ++i)
+                ;
+            if (i == n) {
+                if (n == 16) continue;
+                colors[n] = c;
+                counts[n++] = 0;
+            }
+            ++counts[i];
+        }
+    }
+    int best = -1;
+    for (int i = 0; i != n; ++i) {
+        if (best < 0 || counts[i] > counts[best]) best = i;
+    }
+    return best < 0? 0 : colors[best];
+}
+
+static bool area_lit(const byte *fb, int x0, int x1, int y0, int y1)
+{
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+            if (pixel_at(fb, x, y) != 0) return true;
+        }
+    }
+    return false;
+}
+
+static void compute_cell(struct cell *c, const byte *fb, TermGfxMode m,
+                         int cx, int cy, int cols, int rows, int lines)
+{
+    // Cell boundaries in framebuffer pixels
+    int x0 = cx * VIDEO_WIDTH / cols, x1 = (cx + 1) * VIDEO_WIDTH / cols;
+    int y0 = cy * lines / rows, y1 = (cy + 1) * lines / rows;
+
+    if (m == TG_HALF) {
+        int ym = (2 * cy + 1) * lines / (2 * rows);
+        uint32_t top = area_color(fb, x0, x1, y0, ym, false);
+        uint32_t bot = area_color(fb, x0, x1, ym, y1, false);
+        if (top == bot) {
+            c->glyph = ' ';
+            c->fg = NO_COLOR;
+        } else {
+            c->glyph = 0x2580; // upper half block
+            c->fg = top;
+        }
+        c->bg = bot;
+        return;
+    }
+
+    // Braille: 2x4 dots per cell
+    static const byte dotbit[4][2] = {
+        {0x01, 0x08}, {0x02, 0x10}, {0x04, 0x20}, {0x40, 0x80},
+    };
+    byte bits = 0;
+    for (int dy = 0; dy != 4; ++dy) {
+        int sy0 = (4 * cy + dy) * lines / (4 * rows);
+        int sy1 = (4 * cy + dy + 1) * lines / (4 * rows);
+        for (int dx = 0; dx != 2; ++dx) {
+            int sx0 = (2 * cx + dx) * VIDEO_WIDTH / (2 * cols);
+            int sx1 = (2 * cx + dx + 1) * VIDEO_WIDTH / (2 * cols);
+            if (sy1 == sy0) sy1 = sy0 + 1;
+            if (sx1 == sx0) sx1 = sx0 + 1;
+            if (area_lit(fb, sx0, sx1, sy0, sy1)) bits |= dotbit[dy][dx];
+        }
+    }
+    c->bg = 0;
+    if (bits == 0) {
+        c->glyph = ' ';
+        c->fg = NO_COLOR;
+    } else {
+        c->glyph = 0x2800 | bits;
+        c->fg = area_color(fb, x0, x1, y0, y1, true);
+    }
+}
+
+static void write_all(int fd)
+{
+    const char *p = obuf;
+    size_t left = olen;
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break; // nothing sensible to do; drop the frame.
+        }
+        p += n;
+        left -= n;
+    }
+    olen = 0;
+}
+
+void termgfx_invalidate(void)
+{
+    need_all = true;
+}
+
+bool termgfx_active(void)
+{
+    return mode != TG_OFF;
+}
+
+void termgfx_draw(int fd, int cols, int rows, int lines)
+{
+    if (mode == TG_OFF) return;
+    if (cols > MAX_COLS) cols = MAX_COLS;
+    if (rows > MAX_ROWS) rows = MAX_ROWS;
+    if (cols <= 0 || rows <= 0) return;
+
+    TermGfxMode m = mode;
+    if (m == TG_AUTO) {
+        m = swget(ss, ss_hires)? TG_BRAILLE : TG_HALF;
+    }
+    if (m != last_mode || cols != last_cols || rows != last_rows
+        || lines != last_lines) {
+        last_mode = m; last_cols = cols; last_rows = rows;
+        last_lines = lines;
+        need_all = true;
+    }
+
+    byte changed[VIDEO_HEIGHT / 8];
+    memset(changed, 0, sizeof changed);
+    const byte *fb = video_render_changed(seen, changed);
+
+    if (need_all) {
+        for (int y = 0; y != MAX_ROWS; ++y) {
+            for (int x = 0; x != MAX_COLS; ++x) {
+                shadow[y][x].glyph = 0;
+            }
+        }
+    }
+
+    uint32_t cur_fg = NO_COLOR, cur_bg = NO_COLOR;
+    int cur_x = -1, cur_y = -1;
+    bool started = false;
+    for (int cy = 0; cy != rows; ++cy) {
+        int y0 = cy * lines / rows, y1 = (cy + 1) * lines / rows;
+        bool row_changed = need_all;
+        for (int y = y0; !row_changed && y < y1; ++y) {
+            if (changed[y >> 3] & (1 << (y & 7))) row_changed = true;
+        }
+        if (!row_changed) continue;
+
+        for (int cx = 0; cx != cols; ++cx) {
+            struct cell c;
+            compute_cell(&c, fb, m, cx, cy, cols, rows, lines);
+            struct cell *s = &shadow[cy][cx];
+            if (s->glyph == c.glyph && s->fg == c.fg && s->bg == c.bg)
+                continue;
+            *s = c;
+
+            if (!started) {
+                started = true;
+                out("\0337", 2); // save cursor & attributes
+            }
+            if (cur_x != cx || cur_y != cy) {
+                outf("\033[%d;%dH", cy + 1, cx + 1);
+            }
+            if (c.bg != cur_bg) {
+                out_color(true, c.bg);
+                cur_bg = c.bg;
+            }
+            if (c.fg != NO_COLOR && c.fg != cur_fg) {
+                out_color(false, c.fg);
+                cur_fg = c.fg;
+            }
+            out_utf8(c.glyph);
+            cur_x = cx + 1;
+            cur_y = cy;
+        }
+    }
+    need_all = false;
+
+    if (started) {
+        out("\033[0m\0338", 6); // restore cursor & attributes
+        write_all(fd);
+    }
+}
+
+bool termgfx_init(void)
+{
+    const char *m = cfg.tty_gfx;
+    if (STREQCASE(m, "off")) {
+        mode = TG_OFF;
+    } else if (STREQCASE(m, "auto")) {
+        mode = TG_AUTO;
+    } else if (STREQCASE(m, "half")) {
+        mode = TG_HALF;
+    } else if (STREQCASE(m, "braille")) {
+        mode = TG_BRAILLE;
+    } else {
+        DIE(2, "Unknown --tty-gfx mode \"%s\".\n", m);
+    }
+
+    const char *c = cfg.tty_colors;
+    if (STREQCASE(c, "auto")) {
+        const char *ct = getenv("COLORTERM");
+        truecolor = ct != NULL
+            && (STREQCASE(ct, "truecolor") || STREQCASE(ct, "24bit"));
+    } else if (STREQCASE(c, "truecolor")) {
+        truecolor = true;
+    } else if (STREQ(c, "256")) {
+        truecolor = false;
+    } else {
+        DIE(2, "Unknown --tty-colors value \"%s\".\n", c);
+    }
+
+    if (mode != TG_OFF && !STREQ(nl_langinfo(CODESET), "UTF-8")) {
+        if (mode != TG_AUTO) {
+            WARN("--tty-gfx needs a UTF-8 locale; graphics disabled.\n");
+        }
+        mode = TG_OFF;
+    }
+
+    if (mode != TG_OFF) video_enable();
+    return mode != TG_OFF;
+}
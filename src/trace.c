@@ -5,11 +5,13 @@
 //  See the accompanying LICENSE file for details.
 
 #include "bobbin-internal.h"
+#include "tracefmt.h"
 
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 bool handler_registered = false;
 
@@ -24,32 +26,62 @@ void trace_on(char *format, ...)
     va_list args;
 
     if (trfile == NULL) {
-        trfile = fopen(cfg.trace_file, "w");
+        trfile = fopen(cfg.trace_file, cfg.trace_binary? "wb" : "w");
         if (trfile == NULL) {
             perror("Couldn't open trace file");
             exit(2);
         }
-        setvbuf(trfile, NULL, _IOLBF, 0);
+        if (cfg.trace_binary) {
+            byte hdr[TRACE_HDR_LEN] = {0};
+            memcpy(hdr, TRACE_MAGIC, TRACE_MAGIC_LEN);
+            fwrite(hdr, 1, sizeof hdr, trfile);
+        } else {
+            setvbuf(trfile, NULL, _IOLBF, 0);
+        }
     }
 
-    fprintf(trfile, "\n\n~~~ TRACING STARTED: ");
-    va_start(args, format);
-    vfprintf(trfile, format, args);
-    va_end(args);
-    fprintf(trfile, " ~~~\n");
     traceon = 1;
     if (!handler_registered) {
         handler_registered = true;
         event_reghandler(trace_step);
     }
+    if (cfg.trace_binary) return;
+
+    fprintf(trfile, "\n\n~~~ TRACING STARTED: ");
+    va_start(args, format);
+    vfprintf(trfile, format, args);
+    va_end(args);
+    fprintf(trfile, " ~~~\n");
 }
 
 void trace_off(void)
 {
-    fprintf(trfile, "~~~ TRACING FINISHED ~~~\n");
+    if (!cfg.trace_binary)
+        fprintf(trfile, "~~~ TRACING FINISHED ~~~\n");
     traceon = 0;
 }
 
+// One fixed-width record (see tracefmt.h), for bobbin-tracediff.
+static void trace_binary_record(void)
+{
+    byte rec[TRACE_REC_LEN];
+    uintmax_t n = instr_count;
+    for (int i = 0; i != 8; ++i) {
+        rec[TR_INSTR + i] = n & 0xFF;
+        n >>= 8;
+    }
+    word pc = current_pc();
+    rec[TR_PC]      = LO(pc);
+    rec[TR_PC + 1]  = HI(pc);
+    rec[TR_ACC]     = ACC;
+    rec[TR_X]       = XREG;
+    rec[TR_Y]       = YREG;
+    rec[TR_SP]      = SP;
+    rec[TR_P]       = PFLAGS;
+    rec[TR_OP]      = peek_sneaky(pc);
+    fwrite(rec, 1, sizeof rec, trfile);
+}
+
 void trace_step(Event *e)
 {
     if (e->type != EV_STEP) return;
@@ -61,7 +93,9 @@ void trace_step(Event *e)
         trace_off();
     }
 
-    if (traceon) {
+    if (traceon && cfg.trace_binary) {
+        trace_binary_record();
+    } else if (traceon) {
         fprintf(trfile, "%79ju\n", instr_count);
         util_print_state(trfile, current_pc(), &theCpu.regs);
     }
@@ -0,0 +1,520 @@
+//  tracediff.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "ac-config.h"
+#include "tracefmt.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Compares two bobbin traces (written by --trace-to, as text or
+// binary), and reports the first place where they differ.
+//
+// Both files are mapped into memory whole. A binary trace is already
+// an array of fixed-width records, and is compared where it lies; a
+// text trace is parsed, a chunk at a time, into records of the same
+// layout. Records are compared a block at a time, by XORing them
+// together 8 bytes at a time and ORing the results, with no early
+// exit, which the compiler can turn into vector instructions. Only a
+// block that comes out nonzero is searched for the record that differs.
+
+#define CHUNK       65536       // records parsed at a time, for text
+#define BLOCK       64          // records compared at a time
+#define MAX_CONTEXT 1000
+
+typedef unsigned char byte;
+
+typedef struct {
+    const char *name;
+    const byte *map;
+    size_t      size;
+    bool        text;
+
+    // The records ready to compare are numbers [base, base + n).
+    const byte *recs;
+    size_t      base;
+    size_t      n;
+
+    // Text traces only:
+    byte       *buf;            // parsed records
+    uintmax_t  *lines;          // line number of each parsed record
+    size_t      cap;            // room in buf, in records
+    size_t      pos;            // next byte to parse
+    uintmax_t   line;           // line number at pos
+} Trace;
+
+static const char *progname;
+static size_t context = 3;
+static bool by_pc;              // align by PC, and ignore instr counts
+
+static void exit_with_usage(int status)
+{
+    FILE *fp = status == 0? stdout : stderr;
+
+    fprintf(fp, "USAGE: %s [-p] [-C NUM] TRACE1 TRACE2\n"
+          "\n"
+          "Compares two bobbin traces (from --trace-to; text or binary),\n"
+          "and shows where they first differ, with NUM records of context\n"
+          "(default 3). Records are matched up by instruction count, or,\n"
+          "with -p, from the first point where both traces have the same\n"
+          "PC and registers (instruction counts are then ignored).\n"
+          "\n"
+          "Exits 0 if the traces match, 1 if they differ.\n", progname);
+    exit(status);
+}
+
+static void die(const Trace *t, const char *msg)
+{
+    if (t) {
+        fprintf(stderr, "%s: %s: %s\n", progname, t->name, msg);
+    } else {
+        fprintf(stderr, "%s: %s\n", progname, msg);
+    }
+    exit(2);
+}
+
+static void open_trace(Trace *t, const char *name)
+{
+    t->name = name;
+    int fd = open(name, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "%s: couldn't open %s: %s\n", progname, name,
+                strerror(errno));
+        exit(2);
+    }
+    t->size = st.st_size;
+    if (t->size != 0) {
+        void *m = mmap(NULL, t->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED) {
+            fprintf(stderr, "%s: couldn't mmap %s: %s\n", progname, name,
+                    strerror(errno));
+            exit(2);
+        }
+        (void) posix_madvise(m, t->size, POSIX_MADV_SEQUENTIAL);
+        t->map = m;
+    }
+    close(fd);
+
+    t->text = t->size < TRACE_MAGIC_LEN
+        || memcmp(t->map, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0;
+    if (t->text) {
+        t->cap = CHUNK + 2 * context;
+        t->buf = malloc(t->cap * TRACE_REC_LEN);
+        t->lines = malloc(t->cap * sizeof t->lines[0]);
+        if (t->buf == NULL || t->lines == NULL) die(NULL, "out of memory");
+        t->recs = t->buf;
+        t->line = 1;
+    } else {
+        if (t->size < TRACE_HDR_LEN) die(t, "truncated header");
+        size_t body = t->size - TRACE_HDR_LEN;
+        if (body % TRACE_REC_LEN != 0) {
+            fprintf(stderr, "%s: %s: warning: trace was truncated\n",
+                    progname, name);
+        }
+        t->recs = t->map + TRACE_HDR_LEN;
+        t->n = body / TRACE_REC_LEN;
+    }
+}
+
+/********** Text traces **********/
+
+static int hexval(int c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// A two-digit hex byte at p, or -1.
+static int hexbyte(const byte *p)
+{
+    int hi = hexval(p[0]), lo = hexval(p[1]);
+    return (hi < 0 || lo < 0)? -1 : (hi << 4) | lo;
+}
+
+// The instruction count that starts each record is on a line of its
+// own: spaces, then digits.
+static bool count_line(const byte *s, const byte *e, uintmax_t *count)
+{
+    while (s != e && *s == ' ') ++s;
+    if (s == e) return false;
+    uintmax_t v = 0;
+    for (; s != e; ++s) {
+        if (*s < '0' || *s > '9') return false;
+        v = v * 10 + (*s - '0');
+    }
+    *count = v;
+    return true;
+}
+
+// "ACC: 33  X: 38  Y: 87  SP: F5           N    V   [U]   B ..."
+static bool regs_line(const byte *s, const byte *e, byte *rec)
+{
+    static const char fnams[] = "CZIDBUVN";
+    if (e - s < 29 || memcmp(s, "ACC: ", 5) != 0) return false;
+    int a = hexbyte(s + 5), x = hexbyte(s + 12);
+    int y = hexbyte(s + 19), sp = hexbyte(s + 27);
+    if (a < 0 || x < 0 || y < 0 || sp < 0) return false;
+    rec[TR_ACC] = a;
+    rec[TR_X] = x;
+    rec[TR_Y] = y;
+    rec[TR_SP] = sp;
+
+    byte p = 0;
+    for (s += 29; s < e - 1; ++s) {
+        if (*s != '[') continue;
+        const char *f = memchr(fnams, s[1], 8);
+        if (f != NULL) p |= 1 << (f - fnams);
+    }
+    rec[TR_P] = p;
+    return true;
+}
+
+// "FCAC:   D0 FC       BNE $FCAA"
+static bool disasm_line(const byte *s, const byte *e, byte *rec)
+{
+    if (e - s < 10 || s[4] != ':') return false;
+    int hi = hexbyte(s), lo = hexbyte(s + 2), op = hexbyte(s + 8);
+    if (hi < 0 || lo < 0 || op < 0) return false;
+    rec[TR_PC] = lo;
+    rec[TR_PC + 1] = hi;
+    rec[TR_OP] = op;
+    return true;
+}
+
+// Parses the next record from a text trace into rec. Returns false at
+// the end of the file.
+static bool parse_record(Trace *t, byte *rec, uintmax_t *line)
+{
+    const byte *p = t->map + t->pos, *end = t->map + t->size;
+    uintmax_t count;
+    bool found = false;
+
+    // Skip to the start of a record (past "~~~ TRACING STARTED ~~~", etc).
+    while (p != end) {
+        const byte *nl = memchr(p, '\n', end - p);
+        const byte *e = nl? nl : end;
+        found = count_line(p, e, &count);
+        p = nl? nl + 1 : end;
+        ++t->line;
+        if (found) break;
+    }
+    if (!found) {
+        t->pos = t->size;
+        return false;
+    }
+    *line = t->line - 1;
+
+    memset(rec, 0, TRACE_REC_LEN);
+    for (int i = 0; i != 8; ++i) {
+        rec[TR_INSTR + i] = count & 0xFF;
+        count >>= 8;
+    }
+
+    bool regs = false, disasm = false;
+    while (p != end && !(regs && disasm)) {
+        const byte *nl = memchr(p, '\n', end - p);
+        const byte *e = nl? nl : end;
+        uintmax_t dummy;
+        if (count_line(p, e, &dummy) || *p == '~') break;
+        if (!regs) regs = regs_line(p, e, rec);
+        if (!disasm) disasm = disasm_line(p, e, rec);
+        p = nl? nl + 1 : end;
+        ++t->line;
+    }
+    if ((!regs || !disasm) && p == end) {
+        // Cut off (say, by the emulator being killed); ignore it.
+        fprintf(stderr, "%s: %s: warning: trace was truncated\n",
+                progname, t->name);
+        t->pos = t->size;
+        return false;
+    } else if (!regs || !disasm) {
+        fprintf(stderr, "%s: %s:%ju: incomplete trace record\n",
+                progname, t->name, *line);
+        exit(2);
+    }
+    t->pos = p - t->map;
+    return true;
+}
+
+// Parses more of a text trace, keeping the records from number keep on.
+static void refill(Trace *t, size_t keep)
+{
+    if (keep < t->base) keep = t->base;
+    if (keep > t->base + t->n) keep = t->base + t->n;
+    size_t kept = t->base + t->n - keep;
+    memmove(t->buf, t->buf + (keep - t->base) * TRACE_REC_LEN,
+            kept * TRACE_REC_LEN);
+    memmove(t->lines, t->lines + (keep - t->base),
+            kept * sizeof t->lines[0]);
+    t->base = keep;
+    t->n = kept;
+    while (t->n != t->cap
+           && parse_record(t, t->buf + t->n * TRACE_REC_LEN,
+                           &t->lines[t->n])) {
+        ++t->n;
+    }
+}
+
+/********** Comparing **********/
+
+// How many records, from number i, are ready to compare. A text trace
+// is parsed further if there are only a few (or i is past the ones we
+// have, as after rewind_trace()); the context records before i are
+// kept, for reporting.
+static size_t avail(Trace *t, size_t i)
+{
+    while (t->text && t->base + t->n <= i + context && t->pos != t->size) {
+        refill(t, i < context? 0 : i - context);
+    }
+    return i < t->base + t->n? t->base + t->n - i : 0;
+}
+
+static const byte *rec(const Trace *t, size_t i)
+{
+    return t->recs + (i - t->base) * TRACE_REC_LEN;
+}
+
+static uint64_t load64(const byte *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static uintmax_t instr_of(const byte *r)
+{
+    uintmax_t v = 0;
+    for (int i = 7; i != -1; --i) v = (v << 8) | r[TR_INSTR + i];
+    return v;
+}
+
+// Whether two records match (with -p, instruction counts aside).
+static bool same(const byte *a, const byte *b)
+{
+    if (!by_pc && load64(a) != load64(b)) return false;
+    return load64(a + 8) == load64(b + 8);
+}
+
+// The index of the first of n records that differ, or n.
+static size_t first_diff(const byte *a, const byte *b, size_t n)
+{
+    const uint64_t mask = by_pc? 0 : ~(uint64_t)0;
+    for (size_t i = 0; i < n; i += BLOCK) {
+        size_t end = n - i < BLOCK? n : i + BLOCK;
+        uint64_t diff = 0;
+        for (size_t j = i; j != end; ++j) {
+            const byte *ra = a + j * TRACE_REC_LEN;
+            const byte *rb = b + j * TRACE_REC_LEN;
+            diff |= ((load64(ra) ^ load64(rb)) & mask)
+                | (load64(ra + 8) ^ load64(rb + 8));
+        }
+        if (diff == 0) continue;
+        for (size_t j = i; j != end; ++j) {
+            if (!same(a + j * TRACE_REC_LEN, b + j * TRACE_REC_LEN))
+                return j;
+        }
+    }
+    return n;
+}
+
+// The number of the first record of t that matches key (ignoring
+// instruction counts), or SIZE_MAX.
+static size_t find(Trace *t, const byte *key)
+{
+    uint64_t k = load64(key + 8);
+    for (size_t i = 0; avail(t, i) != 0; ++i) {
+        if (load64(rec(t, i) + 8) == k) return i;
+    }
+    return SIZE_MAX;
+}
+
+static void rewind_trace(Trace *t)
+{
+    if (!t->text) return;
+    t->base = t->n = t->pos = 0;
+    t->line = 1;
+}
+
+// Finds where to start comparing, in each trace.
+static void align(Trace *a, Trace *b, size_t *ia, size_t *ib)
+{
+    *ia = *ib = 0;
+    if (avail(a, 0) == 0 || avail(b, 0) == 0) return;
+
+    if (!by_pc) {
+        // Skip whichever starts earlier, to the other's first instr.
+        uintmax_t na, nb;
+        while (avail(a, *ia) != 0 && avail(b, *ib) != 0
+               && (na = instr_of(rec(a, *ia)))
+                   != (nb = instr_of(rec(b, *ib)))) {
+            if (na < nb) ++*ia; else ++*ib;
+        }
+        return;
+    }
+
+    byte key[TRACE_REC_LEN];
+    memcpy(key, rec(a, 0), sizeof key);
+    size_t i = find(b, key);
+    if (i != SIZE_MAX) {
+        rewind_trace(b);
+        *ib = i;
+        return;
+    }
+    rewind_trace(b);
+    (void) avail(b, 0);     // re-read the start of a text trace
+    memcpy(key, rec(b, 0), sizeof key);
+    i = find(a, key);
+    if (i == SIZE_MAX) {
+        die(NULL, "the traces never reach the same PC and registers");
+    }
+    rewind_trace(a);
+    *ia = i;
+}
+
+/********** Reporting **********/
+
+static int loc_width;
+static size_t skipped_a, skipped_b;    // records before the aligned start
+
+static void print_rec(char mark, const Trace *t, size_t i)
+{
+    char loc[64];
+    if (t->text) {
+        snprintf(loc, sizeof loc, "%s:%ju", t->name,
+                 t->lines[i - t->base]);
+    } else {
+        snprintf(loc, sizeof loc, "%s[%zu]", t->name, i);
+    }
+    const byte *r = rec(t, i);
+    printf("%c %-*s %10ju  PC: %02X%02X  op: %02X  ACC: %02X  X: %02X"
+           "  Y: %02X  SP: %02X  P: %02X\n", mark, loc_width, loc,
+           instr_of(r), r[TR_PC + 1], r[TR_PC], r[TR_OP], r[TR_ACC],
+           r[TR_X], r[TR_Y], r[TR_SP], r[TR_P]);
+}
+
+static void print_fields(const byte *a, const byte *b)
+{
+    static const struct {
+        const char *name;
+        int         off, len;
+    } fields[] = {
+        {"instr", TR_INSTR, 8}, {"PC", TR_PC, 2}, {"op", TR_OP, 1},
+        {"ACC", TR_ACC, 1}, {"X", TR_X, 1}, {"Y", TR_Y, 1},
+        {"SP", TR_SP, 1}, {"P", TR_P, 1},
+    };
+    fputs("Differs in:", stdout);
+    for (size_t f = by_pc? 1 : 0; f != sizeof fields / sizeof fields[0];
+         ++f) {
+        if (memcmp(a + fields[f].off, b + fields[f].off, fields[f].len))
+            printf(" %s", fields[f].name);
+    }
+    putchar('\n');
+}
+
+// Shows the records around the first difference, at ia in a and ib in
+// b (either of which may be past the end of its trace).
+static void report(Trace *a, Trace *b, size_t ia, size_t ib)
+{
+    size_t na = avail(a, ia), nb = avail(b, ib);
+    size_t before = ia - a->base < ib - b->base? ia - a->base : ib - b->base;
+    if (before > context) before = context;
+
+    if (na == 0 || nb == 0) {
+        printf("%s ends first, after %zu matching records.\n",
+               (na == 0? a : b)->name, ia - skipped_a);
+    } else {
+        printf("First difference: %s instruction %ju, %s instruction %ju.\n",
+               a->name, instr_of(rec(a, ia)), b->name, instr_of(rec(b, ib)));
+        print_fields(rec(a, ia), rec(b, ib));
+    }
+
+    for (size_t k = before; k != 0; --k) print_rec(' ', a, ia - k);
+    for (size_t k = 0; k <= context && (k < na || k < nb); ++k) {
+        if (k < na && k < nb && same(rec(a, ia + k), rec(b, ib + k))) {
+            print_rec(' ', a, ia + k);
+            continue;
+        }
+        if (k < na) print_rec('-', a, ia + k);
+        if (k < nb) print_rec('+', b, ib + k);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    progname = argv[0];
+    const char *names[2];
+    int nnames = 0;
+
+    for (int i = 1; i != argc; ++i) {
+        const char *arg = argv[i];
+        if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+            exit_with_usage(0);
+        } else if (!strcmp(arg, "-p")) {
+            by_pc = true;
+        } else if (!strncmp(arg, "-C", 2)) {
+            const char *num = arg[2]? arg + 2 : argv[++i];
+            if (num == NULL) exit_with_usage(2);
+            char *end;
+            unsigned long v = strtoul(num, &end, 10);
+            if (*num == '\0' || *end != '\0' || v > MAX_CONTEXT) {
+                die(NULL, "bad context count");
+            }
+            context = v;
+        } else if (arg[0] == '-' && arg[1] != '\0') {
+            exit_with_usage(2);
+        } else if (nnames == 2) {
+            exit_with_usage(2);
+        } else {
+            names[nnames++] = arg;
+        }
+    }
+    if (nnames != 2) exit_with_usage(2);
+
+    Trace a = {0}, b = {0};
+    open_trace(&a, names[0]);
+    open_trace(&b, names[1]);
+    loc_width = (int)(strlen(a.name) > strlen(b.name)?
+                      strlen(a.name) : strlen(b.name)) + 8;
+
+    size_t ia, ib;
+    align(&a, &b, &ia, &ib);
+    skipped_a = ia;
+    skipped_b = ib;
+
+    for (;;) {
+        size_t na = avail(&a, ia), nb = avail(&b, ib);
+        size_t n = na < nb? na : nb;
+        if (n == 0) {
+            if (na == nb) break;
+            report(&a, &b, ia, ib);
+            return 1;
+        }
+        size_t d = first_diff(rec(&a, ia), rec(&b, ib), n);
+        if (d != n) {
+            report(&a, &b, ia + d, ib + d);
+            return 1;
+        }
+        ia += n;
+        ib += n;
+    }
+
+    printf("Traces match (%zu records", ia - skipped_a);
+    if (skipped_a) printf("; skipped the first %zu of %s", skipped_a, a.name);
+    if (skipped_b) printf("; skipped the first %zu of %s", skipped_b, b.name);
+    puts(").");
+    return 0;
+}
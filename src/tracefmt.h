@@ -0,0 +1,35 @@
+//  tracefmt.h
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#ifndef BOBBIN_TRACEFMT_H
+#define BOBBIN_TRACEFMT_H
+
+// Layout of a binary (--trace-format binary) trace file. All
+// multi-byte values are little-endian.
+//
+// Header (16 bytes):
+//   TRACE_MAGIC (8 bytes), reserved (8).
+//
+// Then one fixed-width record per traced instruction, holding the
+// state just before it runs: the instruction count (8 bytes), PC (2),
+// ACC, X, Y, SP, P, and the opcode at PC (1 byte each).
+
+#define TRACE_MAGIC         "BOBTRC\0\1"
+#define TRACE_MAGIC_LEN     8
+#define TRACE_HDR_LEN       16
+#define TRACE_REC_LEN       16
+
+// Offsets of the fields within a record.
+#define TR_INSTR    0
+#define TR_PC       8
+#define TR_ACC      10
+#define TR_X        11
+#define TR_Y        12
+#define TR_SP       13
+#define TR_P        14
+#define TR_OP       15
+
+#endif /* BOBBIN_TRACEFMT_H */
@@ -51,6 +51,7 @@ int mmapfile(const char *fname, byte **buf, size_t *sz, int flags)
     errno = 0;
     err = fstat(fd, &st);
     if (err < 0) {
+        err = errno;
         goto bail;
     }
 
@@ -62,7 +63,8 @@ int mmapfile(const char *fname, byte **buf, size_t *sz, int flags)
         mflags = MAP_SHARED;
     }
     *buf = mmap(NULL, st.st_size, protect, mflags, fd, 0);
-    if (*buf == NULL) {
+    if (*buf == MAP_FAILED) {
+        *buf = NULL;
         err = errno;
         goto bail;
     }
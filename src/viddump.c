@@ -0,0 +1,167 @@
+//  viddump.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "vidstream.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Converts a bobbin --record-video stream into PPM images: either
+// one file per frame, or a single concatenated stream of PPMs on
+// standard output (suitable for e.g. ffmpeg -f image2pipe).
+
+static const char *progname;
+static const char *inname;
+static FILE *in;
+
+static void exit_with_usage(int status)
+{
+    FILE *fp = status == 0? stdout : stderr;
+
+    fprintf(fp, "USAGE: %s STREAM [PREFIX]\n"
+          "\n"
+          "Converts a bobbin --record-video STREAM into PPM images.\n"
+          "Frames are written to PREFIXnnnnnn.ppm if PREFIX is given,\n"
+          "or as one concatenated PPM stream to standard output\n"
+          "otherwise.\n", progname);
+    exit(status);
+}
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "%s: %s: %s\n", progname, inname, msg);
+    exit(1);
+}
+
+static int get_byte(void)
+{
+    int c = getc(in);
+    if (c == EOF) die("unexpected end of stream");
+    return c;
+}
+
+static unsigned long get_le(int nbytes)
+{
+    unsigned long v = 0;
+    for (int i = 0; i != nbytes; ++i) {
+        v |= (unsigned long)get_byte() << (8 * i);
+    }
+    return v;
+}
+
+static void decode_line(uint8_t *line, size_t len)
+{
+    size_t i = 0;
+    while (i < len) {
+        int c = get_byte();
+        size_t n = (c & 0x7F) + 1;
+        if (i + n > len) die("scanline delta overruns the line");
+        if (c & 0x80) {
+            i += n; // unchanged bytes
+        } else {
+            for (size_t j = 0; j != n; ++j) {
+                line[i++] ^= get_byte();
+            }
+        }
+    }
+}
+
+static void write_frame(const char *prefix, unsigned long num,
+                        const uint8_t *frame, unsigned w, unsigned h)
+{
+    FILE *f = stdout;
+    char *fname = NULL;
+    if (prefix) {
+        size_t sz = strlen(prefix) + 16;
+        fname = malloc(sz);
+        if (fname == NULL) die("out of memory");
+        snprintf(fname, sz, "%s%06lu.ppm", prefix, num);
+        f = fopen(fname, "w");
+        if (f == NULL) {
+            fprintf(stderr, "%s: couldn't open %s: %s\n", progname, fname,
+                    strerror(errno));
+            exit(1);
+        }
+    }
+    fprintf(f, "P6\n%u %u\n255\n", w, h);
+    fwrite(frame, 1, (size_t)w * h * 3, f);
+    if (prefix) {
+        if (fclose(f) != 0) {
+            fprintf(stderr, "%s: error writing %s: %s\n", progname, fname,
+                    strerror(errno));
+            exit(1);
+        }
+        free(fname);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    progname = argv[0];
+    if (argc < 2 || argc > 3) exit_with_usage(2);
+    if (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help"))
+        exit_with_usage(0);
+    inname = argv[1];
+    const char *prefix = argc == 3? argv[2] : NULL;
+
+    in = fopen(inname, "r");
+    if (in == NULL) {
+        fprintf(stderr, "%s: couldn't open %s: %s\n", progname, inname,
+                strerror(errno));
+        exit(1);
+    }
+
+    char magic[VIDSTREAM_MAGIC_LEN];
+    if (fread(magic, 1, sizeof magic, in) != sizeof magic
+        || memcmp(magic, VIDSTREAM_MAGIC, sizeof magic) != 0) {
+        die("not a bobbin video stream");
+    }
+    unsigned w = get_le(2);
+    unsigned h = get_le(2);
+    (void) get_le(2); // frame interval
+    (void) get_le(2); // reserved
+    if (w == 0 || h == 0 || h % 8 != 0) die("bad frame dimensions");
+
+    size_t linesz = (size_t)w * 3;
+    uint8_t *frame = calloc(h, linesz);
+    uint8_t *changed = malloc(h / 8);
+    if (frame == NULL || changed == NULL) die("out of memory");
+
+    unsigned long nframes = 0;
+    for (;;) {
+        int type = getc(in);
+        if (type == VS_END) {
+            break;
+        } else if (type == VS_REPEAT) {
+            unsigned long count = get_le(4);
+            while (count-- != 0) {
+                write_frame(prefix, nframes++, frame, w, h);
+            }
+        } else if (type == VS_FRAME) {
+            for (unsigned i = 0; i != h / 8; ++i) {
+                changed[i] = get_byte();
+            }
+            for (unsigned y = 0; y != h; ++y) {
+                if (changed[y >> 3] & (1 << (y & 7))) {
+                    decode_line(&frame[y * linesz], linesz);
+                }
+            }
+            write_frame(prefix, nframes++, frame, w, h);
+        } else if (type == EOF) {
+            fprintf(stderr, "%s: %s: warning: stream was truncated\n",
+                    progname, inname);
+            break;
+        } else {
+            die("unknown record type");
+        }
+    }
+
+    fprintf(stderr, "%s: %lu frames\n", progname, nframes);
+    return 0;
+}
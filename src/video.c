@@ -0,0 +1,405 @@
+//  video.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A headless renderer for the Apple ]['s graphics modes. It renders
+// the currently-displayed page into a 280x192 RGB framebuffer, which
+// can be written out as a screenshot, or handed to other consumers.
+//
+// Rendering is done a scanline at a time, and only for scanlines
+// that have been marked dirty (by a POKE to display memory, a
+// display soft-switch change, a reset, or a DISPLAY_TOUCH). Each
+// scanline is expanded from per-byte lookup tables: a single
+// memcpy of a precomputed 7-pixel run for each byte of screen
+// memory, which compilers turn into a couple of wide vector moves.
+//
+// Text (and the text portion of mixed mode) is rendered black: we
+// don't have a character-generator ROM to draw glyphs from.
+
+typedef enum {
+    VC_MONO,
+    VC_COLOR,
+    VC_NTSC,
+} VideoColor;
+
+#define PIX_BYTES       3
+#define RUN_PIXELS      7
+#define RUN_BYTES       (RUN_PIXELS * PIX_BYTES)
+#define LINE_BYTES      (VIDEO_WIDTH * PIX_BYTES)
+
+static const byte palette[16][PIX_BYTES] = {
+    {0x00, 0x00, 0x00}, // black
+    {0xE3, 0x1E, 0x60}, // magenta
+    {0x60, 0x4E, 0xBD}, // dark blue
+    {0xFF, 0x44, 0xFD}, // purple
+    {0x00, 0xA3, 0x60}, // dark green
+    {0x9C, 0x9C, 0x9C}, // grey 1
+    {0x14, 0xCF, 0xFD}, // medium blue
+    {0xD0, 0xC3, 0xFF}, // light blue
+    {0x60, 0x72, 0x03}, // brown
+    {0xFF, 0x6A, 0x3C}, // orange
+    {0x9C, 0x9C, 0x9C}, // grey 2
+    {0xFF, 0xA0, 0xD0}, // pink
+    {0x14, 0xF5, 0x3C}, // green
+    {0xD0, 0xDD, 0x8D}, // yellow
+    {0x72, 0xFF, 0xD0}, // aqua
+    {0xFF, 0xFF, 0xFF}, // white
+};
+
+// Hi-res colors, as lo-res palette indices
+#define HC_BLACK    0
+#define HC_VIOLET   3
+#define HC_BLUE     6
+#define HC_ORANGE   9
+#define HC_GREEN    12
+#define HC_WHITE    15
+
+static VideoColor color_mode = VC_COLOR;
+static bool enabled = false;
+static bool tables_built = false;
+
+static byte fb[VIDEO_HEIGHT][LINE_BYTES];
+static byte dirty[VIDEO_HEIGHT / 8]; // one bit per scanline
+// Bumped whenever a scanline is re-rendered, so that each consumer
+// of video_render_changed() can track what it has already seen.
+static uint32_t line_gen[VIDEO_HEIGHT];
+
+// hires_lut: index is (byte << 3) | (prev-bit << 2) | (next-bit << 1)
+//  | column parity. prev-bit is the last dot of the byte to our left;
+//  next-bit is the first dot of the byte to our right.
+static byte hires_lut[256 * 8][RUN_BYTES];
+static byte mono_lut[128][RUN_BYTES];
+static byte lores_lut[16][RUN_BYTES];
+// ntsc_lut: index is [phase][4-dot window], yielding an RGB triple.
+static byte ntsc_lut[4][16][PIX_BYTES];
+// dots for a byte, in 560-dot space (hi bit: delayed by one dot).
+static uint16_t dots_lut[256];
+
+static void set_pixel(byte *run, int i, int color)
+{
+    memcpy(&run[i * PIX_BYTES], palette[color], PIX_BYTES);
+}
+
+static void build_tables(void)
+{
+    if (tables_built) return;
+    tables_built = true;
+
+    for (int idx = 0; idx < 256 * 8; ++idx) {
+        int b = idx >> 3;
+        bool hb = (b & 0x80) != 0;
+        int bits[RUN_PIXELS + 2];
+        bits[0] = (idx >> 2) & 1;
+        for (int i = 0; i != RUN_PIXELS; ++i) {
+            bits[i+1] = (b >> i) & 1;
+        }
+        bits[RUN_PIXELS + 1] = (idx >> 1) & 1;
+        int parity = idx & 1;
+
+        for (int i = 0; i != RUN_PIXELS; ++i) {
+            int left = bits[i], me = bits[i+1], right = bits[i+2];
+            bool even = ((parity + i) & 1) == 0;
+            int color;
+            if (me && (left || right)) {
+                color = HC_WHITE;
+            } else if (me) {
+                color = even? (hb? HC_BLUE : HC_VIOLET)
+                            : (hb? HC_ORANGE : HC_GREEN);
+            } else if (left && right) {
+                // Gap between two like-colored dots: fill it in
+                // with the neighbors' color, as a monitor would.
+                color = !even? (hb? HC_BLUE : HC_VIOLET)
+                             : (hb? HC_ORANGE : HC_GREEN);
+            } else {
+                color = HC_BLACK;
+            }
+            set_pixel(hires_lut[idx], i, color);
+        }
+    }
+
+    for (int b = 0; b != 128; ++b) {
+        for (int i = 0; i != RUN_PIXELS; ++i) {
+            set_pixel(mono_lut[b], i, (b >> i) & 1? HC_WHITE : HC_BLACK);
+        }
+    }
+
+    for (int c = 0; c != 16; ++c) {
+        for (int i = 0; i != RUN_PIXELS; ++i) {
+            set_pixel(lores_lut[c], i, c);
+        }
+    }
+
+    // A lo-res color n, in 560-dot space, puts bit (d % 4) of n
+    // at dot d. So a window of four dots starting at a dot with
+    // phase p recovers n by rotating the window left by p.
+    for (int p = 0; p != 4; ++p) {
+        for (int w = 0; w != 16; ++w) {
+            int n = ((w << p) | (w >> (4 - p))) & 0xF;
+            memcpy(ntsc_lut[p][w], palette[n], PIX_BYTES);
+        }
+    }
+
+    for (int b = 0; b != 256; ++b) {
+        uint16_t d = 0;
+        for (int i = 0; i != RUN_PIXELS; ++i) {
+            if (b & (1 << i)) d |= 3 << (2 * i);
+        }
+        if (b & 0x80) d <<= 1; // the 15th dot falls off the end
+        dots_lut[b] = d;
+    }
+}
+
+static inline void mark_line(int y)
+{
+    dirty[y >> 3] |= 1 << (y & 7);
+}
+
+static inline void mark_row(int row)
+{
+    dirty[row] = 0xFF;
+}
+
+static void mark_all(void)
+{
+    memset(dirty, 0xFF, sizeof dirty);
+}
+
+static word text_base(int row, bool page2)
+{
+    return (page2? 0x800 : 0x400)
+        + (row & 7) * 0x80 + (row >> 3) * 0x28;
+}
+
+static word hires_base(int y, bool page2)
+{
+    return (page2? 0x4000 : 0x2000)
+        + (y & 7) * 0x400 + ((y >> 3) & 7) * 0x80 + (y >> 6) * 0x28;
+}
+
+static void render_hires_color(byte *dst, const byte *src)
+{
+    int prev = 0;
+    for (int col = 0; col != 40; ++col) {
+        int next = col == 39? 0 : src[col+1] & 1;
+        int idx = (src[col] << 3) | (prev << 2) | (next << 1) | (col & 1);
+        memcpy(dst, hires_lut[idx], RUN_BYTES);
+        dst += RUN_BYTES;
+        prev = (src[col] >> 6) & 1;
+    }
+}
+
+static void render_hires_mono(byte *dst, const byte *src)
+{
+    for (int col = 0; col != 40; ++col) {
+        memcpy(dst, mono_lut[src[col] & 0x7F], RUN_BYTES);
+        dst += RUN_BYTES;
+    }
+}
+
+static void render_hires_ntsc(byte *dst, const byte *src)
+{
+    // Build the 560-dot bitstream (plus a little padding on either
+    // side), then read colors off of a sliding four-dot window.
+    byte dots[560 + 4];
+    memset(dots, 0, sizeof dots);
+    int last = 0;
+    for (int col = 0; col != 40; ++col) {
+        uint16_t d = dots_lut[src[col]];
+        if (src[col] & 0x80) d |= last; // delayed byte repeats last dot
+        for (int i = 0; i != 14; ++i) {
+            dots[2 + col * 14 + i] = (d >> i) & 1;
+        }
+        last = (d >> 13) & 1;
+    }
+    for (int x = 0; x != VIDEO_WIDTH; ++x) {
+        // The window covers dots 2x-2 thru 2x+1 (the padding in
+        // dots[] makes that dots[2x] thru dots[2x+3]).
+        int d = 2 * x;
+        int w = dots[d] | (dots[d+1] << 1) | (dots[d+2] << 2)
+            | (dots[d+3] << 3);
+        memcpy(&dst[x * PIX_BYTES], ntsc_lut[(d - 2) & 3][w], PIX_BYTES);
+    }
+}
+
+static void render_lores(byte *dst, const byte *src, bool bottom)
+{
+    for (int col = 0; col != 40; ++col) {
+        int c = bottom? (src[col] >> 4) : (src[col] & 0xF);
+        memcpy(dst, lores_lut[c], RUN_BYTES);
+        dst += RUN_BYTES;
+    }
+}
+
+static void render_line(int y)
+{
+    const byte *ram = getram();
+    byte *dst = fb[y];
+    bool page2 = swget(ss, ss_page2) && !swget(ss, ss_eightystore);
+
+    if (swget(ss, ss_text) || (swget(ss, ss_mixed) && y >= 160)) {
+        memset(dst, 0, LINE_BYTES);
+    } else if (swget(ss, ss_hires)) {
+        const byte *src = &ram[hires_base(y, page2)];
+        switch (color_mode) {
+            case VC_MONO:
+                render_hires_mono(dst, src);
+                break;
+            case VC_NTSC:
+                render_hires_ntsc(dst, src);
+                break;
+            default:
+                render_hires_color(dst, src);
+        }
+    } else {
+        const byte *src = &ram[text_base(y >> 3, page2)];
+        render_lores(dst, src, (y & 7) >= 4);
+    }
+}
+
+const byte *video_render_changed(uint32_t *seen, byte *changed)
+{
+    build_tables();
+    for (int i = 0; i != sizeof dirty; ++i) {
+        if (dirty[i] == 0) continue;
+        for (int j = 0; j != 8; ++j) {
+            if (dirty[i] & (1 << j)) {
+                render_line(i * 8 + j);
+                ++line_gen[i * 8 + j];
+            }
+        }
+        dirty[i] = 0;
+    }
+    if (seen != NULL) {
+        for (int y = 0; y != VIDEO_HEIGHT; ++y) {
+            if (seen[y] != line_gen[y]) {
+                seen[y] = line_gen[y];
+                changed[y >> 3] |= 1 << (y & 7);
+            }
+        }
+    }
+    return &fb[0][0];
+}
+
+const byte *video_render(void)
+{
+    return video_render_changed(NULL, NULL);
+}
+
+static void video_poke(word loc)
+{
+    if (loc >= 0x400 && loc < 0xC00) {
+        unsigned off = (loc - 0x400) & 0x3FF;
+        unsigned lo7 = off & 0x7F;
+        if (lo7 >= 0x78) return; // screen hole
+        mark_row((lo7 / 0x28) * 8 + ((off >> 7) & 7));
+    } else if (loc >= 0x2000 && loc < 0x6000) {
+        unsigned off = (loc - 0x2000) & 0x1FFF;
+        unsigned lo7 = off & 0x7F;
+        if (lo7 >= 0x78) return;
+        mark_line((lo7 / 0x28) * 64 + ((off >> 7) & 7) * 8
+                  + ((off >> 10) & 7));
+    }
+}
+
+static void video_event(Event *e)
+{
+    switch (e->type) {
+        case EV_POKE:
+            if (!e->aux) video_poke(e->loc);
+            break;
+        case EV_SWITCH:
+            switch (e->val) {
+                case ss_text:
+                case ss_mixed:
+                case ss_page2:
+                case ss_hires:
+                case ss_eightystore:
+                    mark_all();
+                    break;
+                default:
+                    ;
+            }
+            break;
+        case EV_RESET:
+        case EV_DISPLAY_TOUCH:
+            mark_all();
+            break;
+        default:
+            ;
+    }
+}
+
+void video_enable(void)
+{
+    if (enabled) return;
+    enabled = true;
+    for (int y = 0; y != VIDEO_HEIGHT; ++y) {
+        line_gen[y] = 1; // differs from any consumer's initial zero
+    }
+    mark_all();
+    event_reghandler(video_event);
+}
+
+int video_write_frame(const char *path)
+{
+    FILE *f;
+    errno = 0;
+    f = fopen(path, "w");
+    if (f == NULL) return errno;
+
+    video_enable();
+    const byte *buf = video_render();
+    const char *ext = get_file_ext(path);
+    if (ext != NULL && STREQCASE(ext, "ppm")) {
+        fprintf(f, "P6\n%d %d\n255\n", VIDEO_WIDTH, VIDEO_HEIGHT);
+    }
+    size_t sz = (size_t)VIDEO_WIDTH * VIDEO_HEIGHT * PIX_BYTES;
+    errno = 0;
+    if (fwrite(buf, 1, sz, f) != sz) {
+        int err = errno;
+        fclose(f);
+        return err? err : EIO;
+    }
+    errno = 0;
+    if (fclose(f) != 0) return errno;
+    return 0;
+}
+
+static void screenshot_at_exit(void)
+{
+    int err = video_write_frame(cfg.screenshot_file);
+    if (err) {
+        WARN("Couldn't write screenshot to \"%s\": %s\n",
+             cfg.screenshot_file, strerror(err));
+    }
+}
+
+void video_init(void)
+{
+    if (STREQCASE(cfg.video_color, "mono")) {
+        color_mode = VC_MONO;
+    } else if (STREQCASE(cfg.video_color, "color")) {
+        color_mode = VC_COLOR;
+    } else if (STREQCASE(cfg.video_color, "ntsc")) {
+        color_mode = VC_NTSC;
+    } else {
+        DIE(2, "Unknown --video-color mode \"%s\".\n", cfg.video_color);
+    }
+
+    if (cfg.screenshot_file) {
+        video_enable();
+        atexit(screenshot_at_exit);
+    }
+    if (cfg.record_video) {
+        vidrec_init();
+    }
+}
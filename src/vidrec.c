@@ -0,0 +1,155 @@
+//  vidrec.c
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+#include "vidstream.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+// Records every Nth emulated frame from the video renderer into a
+// compact stream (see vidstream.h), for bobbin-viddump to turn back
+// into images. Only scanlines the renderer actually redrew are
+// compared against the previous frame, so a frame where nothing on
+// screen moved costs a memcmp or two and a counter increment.
+
+#define LINE_BYTES  (VIDEO_WIDTH * 3)
+
+static FILE *out;
+static byte prev[VIDEO_HEIGHT][LINE_BYTES];
+static uint32_t seen[VIDEO_HEIGHT];
+static unsigned long frames_seen;
+static unsigned long repeats;
+static byte encbuf[LINE_BYTES + LINE_BYTES / VS_RUN_MAX + 1];
+
+static void put_le(unsigned long v, int nbytes)
+{
+    for (int i = 0; i != nbytes; ++i) {
+        putc(v & 0xFF, out);
+        v >>= 8;
+    }
+}
+
+static void flush_repeats(void)
+{
+    if (repeats == 0) return;
+    putc(VS_REPEAT, out);
+    put_le(repeats, 4);
+    repeats = 0;
+}
+
+static size_t encode_line(const byte *cur, const byte *old)
+{
+    byte *enc = encbuf;
+    size_t i = 0;
+    while (i < LINE_BYTES) {
+        size_t n = 0;
+        if ((cur[i] ^ old[i]) == 0) {
+            while (i + n < LINE_BYTES && n < VS_RUN_MAX
+                   && (cur[i+n] ^ old[i+n]) == 0) {
+                ++n;
+            }
+            *enc++ = 0x80 | (n - 1);
+        } else {
+            // Literal run: stop at a pair of unchanged bytes, where
+            // a zero run starts paying for itself.
+            while (i + n < LINE_BYTES && n < VS_RUN_MAX
+                   && !(i + n + 1 < LINE_BYTES
+                        && (cur[i+n] ^ old[i+n]) == 0
+                        && (cur[i+n+1] ^ old[i+n+1]) == 0)) {
+                ++n;
+            }
+            *enc++ = n - 1;
+            for (size_t j = 0; j != n; ++j) {
+                *enc++ = cur[i+j] ^ old[i+j];
+            }
+        }
+        i += n;
+    }
+    return enc - encbuf;
+}
+
+static void record_frame(bool final)
+{
+    byte changed[VIDEO_HEIGHT / 8];
+    memset(changed, 0, sizeof changed);
+    const byte *buf = video_render_changed(seen, changed);
+
+    // The renderer reports lines it redrew; weed out the ones
+    // that came out the same anyway.
+    bool any = false;
+    for (int y = 0; y != VIDEO_HEIGHT; ++y) {
+        byte bit = 1 << (y & 7);
+        if (!(changed[y >> 3] & bit)) continue;
+        if (memcmp(prev[y], &buf[y * LINE_BYTES], LINE_BYTES) == 0) {
+            changed[y >> 3] &= ~bit;
+        } else {
+            any = true;
+        }
+    }
+
+    if (!any) {
+        if (!final) ++repeats;
+        return;
+    }
+
+    flush_repeats();
+    putc(VS_FRAME, out);
+    fwrite(changed, 1, sizeof changed, out);
+    for (int y = 0; y != VIDEO_HEIGHT; ++y) {
+        if (!(changed[y >> 3] & (1 << (y & 7)))) continue;
+        const byte *line = &buf[y * LINE_BYTES];
+        fwrite(encbuf, 1, encode_line(line, prev[y]), out);
+        memcpy(prev[y], line, LINE_BYTES);
+    }
+}
+
+static void vidrec_event(Event *e)
+{
+    if (e->type != EV_FRAME) return;
+    if (frames_seen++ % cfg.record_video_every != 0) return;
+    record_frame(false);
+}
+
+static void vidrec_finish(void)
+{
+    // Catch whatever was drawn since the last recorded frame.
+    record_frame(true);
+    flush_repeats();
+    putc(VS_END, out);
+    if (fclose(out) != 0) {
+        WARN("Error writing video stream \"%s\": %s\n",
+             cfg.record_video, strerror(errno));
+    }
+}
+
+void vidrec_init(void)
+{
+    if (cfg.record_video_every == 0 || cfg.record_video_every > 0xFFFF) {
+        DIE(2, "--record-video-every must be between 1 and FFFF.\n");
+    }
+
+    errno = 0;
+    out = fopen(cfg.record_video, "w");
+    if (out == NULL) {
+        DIE(1, "Couldn't open video stream \"%s\": %s\n",
+            cfg.record_video, strerror(errno));
+    }
+    // A large buffer keeps write() calls rare enough not to
+    // interfere with real-time emulation.
+    setvbuf(out, NULL, _IOFBF, 1024 * 1024);
+
+    fwrite(VIDSTREAM_MAGIC, 1, VIDSTREAM_MAGIC_LEN, out);
+    put_le(VIDEO_WIDTH, 2);
+    put_le(VIDEO_HEIGHT, 2);
+    put_le(cfg.record_video_every, 2);
+    put_le(0, 2);
+
+    video_enable();
+    event_reghandler_flags(vidrec_event, EVH_FRAME);
+    atexit(vidrec_finish);
+}
@@ -0,0 +1,40 @@
+//  vidstream.h
+//
+//  Copyright (c) 2023 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#ifndef BOBBIN_VIDSTREAM_H
+#define BOBBIN_VIDSTREAM_H
+
+// Layout of a --record-video stream. All multi-byte values are
+// little-endian.
+//
+// Header (16 bytes):
+//   VIDSTREAM_MAGIC (8 bytes), width (2), height (2),
+//   emulated frames per recorded frame (2), reserved (2).
+//
+// Then a sequence of records, each starting with a type byte:
+//   VS_FRAME   A bitmap of changed scanlines (height/8 bytes, lsb
+//              first), followed by one encoded delta per set bit.
+//              The delta is the new scanline XOR the previous frame's
+//              scanline (width * 3 bytes of RGB, once decoded).
+//   VS_REPEAT  A 4-byte count: the current frame is shown that many
+//              more times.
+//   VS_END     End of stream.
+//
+// The current frame starts out all black. Deltas are run-length
+// encoded: a control byte c with the high bit set stands for
+// (c & 0x7F) + 1 zero bytes; otherwise c + 1 literal bytes follow.
+
+#define VIDSTREAM_MAGIC     "BOBVID\0\1"
+#define VIDSTREAM_MAGIC_LEN 8
+#define VIDSTREAM_HDR_LEN   16
+
+#define VS_FRAME    'F'
+#define VS_REPEAT   'R'
+#define VS_END      'E'
+
+#define VS_RUN_MAX  128
+
+#endif /* BOBBIN_VIDSTREAM_H */
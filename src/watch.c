@@ -10,6 +10,8 @@
 
 #ifdef HAVE_SYS_INOTIFY_H
 #include <errno.h>
+#include <libgen.h>
+#include <limits.h>
 #include <stdlib.h>
 
 #include <fcntl.h>
@@ -19,25 +21,74 @@
 
 static int inotify_fd = -1;
 
+#ifdef HAVE_SYS_INOTIFY_H
+static int load_wd = -1;
+static bool patch_mode;
+
+// Disk images are watched through their directories, so that we
+// also hear about an image that's replaced by a rename (as many
+// tools do), and not just one that's rewritten in place.
+struct disk_watch {
+    int wd;
+    char *name;
+};
+static struct disk_watch disk_watches[2] = { { -1 }, { -1 } };
+
+static void watch_disk(int drive, const char *path)
+{
+    char *dircp = strdup(path);
+    char *basecp = strdup(path);
+    if (dircp == NULL || basecp == NULL) {
+        DIE(1, "strdup: %s\n", strerror(errno));
+    }
+    const char *dir = dirname(dircp);
+
+    errno = 0;
+    int wd = inotify_add_watch(inotify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) {
+        DIE(1,"Failed to set up watch for \"%s\": %s\n",
+            path, strerror(errno));
+    }
+    disk_watches[drive-1].wd = wd;
+    disk_watches[drive-1].name = strdup(basename(basecp));
+    free(dircp);
+    free(basecp);
+    INFO("Watching disk \"%s\" for rewrites.\n", path);
+}
+#endif
+
 void setup_watches(void)
 {
 #ifdef HAVE_SYS_INOTIFY_H
-    if (cfg.watch && cfg.ram_load_file) {
-        errno = 0;
-        inotify_fd = inotify_init1(O_NONBLOCK);
-        if (inotify_fd < 0) {
-            DIE(1,"Failed to set up watches: %s\n", strerror(errno));
-        }
+    if (!cfg.watch) return;
 
+    if (cfg.watch_mode == NULL || STREQ(cfg.watch_mode, "reboot")) {
+        patch_mode = false;
+    } else if (STREQ(cfg.watch_mode, "patch")) {
+        patch_mode = true;
+    } else {
+        DIE(2, "--watch: unknown mode \"%s\" (expected reboot or patch).\n",
+            cfg.watch_mode);
+    }
+
+    errno = 0;
+    inotify_fd = inotify_init1(O_NONBLOCK);
+    if (inotify_fd < 0) {
+        DIE(1,"Failed to set up watches: %s\n", strerror(errno));
+    }
+
+    if (cfg.ram_load_file) {
         errno = 0;
-        int err = inotify_add_watch(inotify_fd, cfg.ram_load_file,
+        load_wd = inotify_add_watch(inotify_fd, cfg.ram_load_file,
                                     IN_CLOSE_WRITE);
-        if (err < 0) {
+        if (load_wd < 0) {
             DIE(1,"Failed to set up watch for \"%s\": %s\n",
                 cfg.ram_load_file, strerror(errno));
         }
         INFO("Watching \"%s\" for rewrites.\n", cfg.ram_load_file);
     }
+    if (cfg.disk) watch_disk(1, cfg.disk);
+    if (cfg.disk2) watch_disk(2, cfg.disk2);
 #else  // HAVE_SYS_INOTIFY_H
     if (cfg.watch) {
         DIE(0,"--watch requested, but this build of bobbin is"
@@ -50,9 +101,49 @@ void setup_watches(void)
 bool check_watches(void)
 {
 #ifdef HAVE_SYS_INOTIFY_H
-    struct inotify_event evt;
-    int rb = read(inotify_fd, &evt, sizeof evt);
-    if (rb == sizeof evt) {
+    if (inotify_fd < 0) return false;
+
+    char buf[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    bool reboot = false;
+    bool changed[2] = { false, false };
+    ssize_t rb;
+    while ((rb = read(inotify_fd, buf, sizeof buf)) > 0) {
+        char *p = buf;
+        while (p < buf + rb) {
+            const struct inotify_event *evt = (void *)p;
+            if (evt->wd == load_wd) {
+                reboot = true;
+            }
+            for (int i = 0; i != 2; ++i) {
+                if (evt->wd == disk_watches[i].wd && evt->len != 0
+                    && STREQ(evt->name, disk_watches[i].name)) {
+                    changed[i] = true;
+                }
+            }
+            p += sizeof *evt + evt->len;
+        }
+    }
+
+    // A disk that's changed doesn't need a reboot: the drive just
+    // picks up the new contents (once it isn't spinning).
+    for (int i = 0; i != 2; ++i) {
+        if (changed[i]) disk_image_changed(i+1);
+    }
+    if (reboot && patch_mode) {
+        int r = load_ram_patch();
+        if (r > 0 && cfg.start_loc_set) {
+            INFO("Jumping PC to $%04X after patch.\n",
+                 (unsigned int)cfg.start_loc);
+            PC = cfg.start_loc;
+        }
+        if (r > 0) {
+            event_fire(EV_DISPLAY_TOUCH);
+        }
+        if (r >= 0) return false;
+        WARN("Couldn't patch; rebooting instead.\n");
+    }
+    if (reboot) {
         INFO("Rewrite event for watched file. Rebooting...\n");
         event_fire(EV_REBOOT);
         return true;
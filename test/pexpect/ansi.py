@@ -0,0 +1,19 @@
+#!/usr/bin/python
+
+from common import *
+
+@bobbin('-m plus --iface ansi')
+def ansi_basic(p):
+    p.expect("\\]")
+    p.send("PRINT 6*7\r")
+    p.expect("42")
+    p.sendintr()
+    p.expect(TIMEOUT)
+    p.sendintr()
+    p.expect("CMD ENTRY")
+    p.sendline("q")
+    p.expect(EOF)
+    # Left the alternate screen on the way out.
+    if "\033[?1049l" not in p.before:
+        fail("didn't restore the terminal")
+    return True
@@ -0,0 +1,42 @@
+#!/usr/bin/python
+
+from common import *
+
+import os
+
+BIN = 'rewind-test.bin'
+
+# $300: LDX #0; INX; STX $06; CPX #$10; BNE $302; RTS
+with open(BIN, 'wb') as f:
+    f.write(bytes([0xA2, 0x00, 0xE8, 0x86, 0x06, 0xE0, 0x10, 0xD0, 0xF9,
+                   0x60]))
+
+def dbg(p, cmd, want):
+    p.sendline(cmd)
+    p.expect("\r\n>")
+    if want not in p.before:
+        fail("%r: wanted %r in:\n%s" % (cmd, want, p.before))
+    return True
+
+@bobbin('-m plus --simple -q --load %s --load-at 300 --start-at 300'
+        ' --bp 309 --rewind' % BIN)
+def rewind_dbg(p):
+    try:
+        p.expect("Breakpoint 1 at \\$0309\\.")
+        p.expect("\r\n>")
+        dbg(p, 'bs', '0307:')
+        dbg(p, 'bs', '0305:')
+        dbg(p, 'bs 2', 'X: 0F')
+        dbg(p, 'lw 6', '$0006 was last written 3 instructions ago, at $0303.')
+        dbg(p, 'w 6', 'cur val is $0E')
+        dbg(p, 'rc', 'Value changed at $0006 ($0D -> $0E).')
+        dbg(p, 'b 302', 'Breakpoint set')
+        dbg(p, 'rc', 'Breakpoint 3 at $0302.')
+        dbg(p, 'bs 1000', 'ERR: history only goes back')
+        # Forward again, from the past.
+        dbg(p, 'c 309', 'Value changed at $0006 ($0D -> $0E).')
+    finally:
+        os.remove(BIN)
+    p.sendline('q')
+    p.expect(EOF)
+    return True
@@ -1,6 +1,12 @@
 from debug import *
 from basics import *
 from asoft import *
+from sercard import *
+from watchdisk import *
+from watchpatch import *
+from rewind import *
+from shm import *
+from ansi import *
 import pexpect
 import os
 import re
@@ -0,0 +1,49 @@
+#!/usr/bin/python
+
+from common import *
+
+import os
+import socket
+import time
+
+SOCK = 'serial-test.sock'
+
+def serial_connect():
+    for _ in range(50):
+        try:
+            s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            s.connect(SOCK)
+            s.settimeout(2)
+            return s
+        except OSError:
+            s.close()
+            time.sleep(0.1)
+    fail("couldn't connect to %s" % SOCK)
+
+def serial_expect(s, want):
+    got = b''
+    while want not in got:
+        chunk = s.recv(4096)
+        if not chunk:
+            fail("serial got %r, wanted %r" % (got, want))
+        got += chunk
+    return True
+
+@bobbin('-m plus --simple -q --serial unix:' + SOCK)
+def serial_pr_and_in(p):
+    repl = REPLWrapper(p, "\r\n]", None)
+    s = serial_connect()
+    try:
+        commandck(repl, 'pr#2', 'PR#2\r\n')
+        commandck(repl, 'print "over the wire"', 'PRINT "OVER THE WIRE"\r\nOVER THE WIRE\r\n')
+        serial_expect(s, b'OVER THE WIRE\r')
+        commandck(repl, 'pr#0', 'PR#0\r\n')
+        p.sendline('in#2')
+        p.expect_exact('IN#2')
+        s.sendall(b'PRINT 6*7\r')
+        p.expect_exact('42')
+    finally:
+        s.close()
+    p.send("\x04") # EOF char
+    p.expect(EOF)
+    return not os.path.exists(SOCK)
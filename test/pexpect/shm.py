@@ -0,0 +1,43 @@
+#!/usr/bin/python
+
+from common import *
+
+import os
+import struct
+import time
+from multiprocessing import shared_memory, resource_tracker
+
+SHM = 'bobbin-test-%d' % os.getpid()
+
+def header(shm):
+    # See src/bobbin-shm.h
+    (magic, version, header_size, ram_size, pid, seq, _, frames, cycles,
+        instrs, pc) = struct.unpack_from('=8sIIIIIIQQQH', shm.buf)
+    return (magic, header_size, frames)
+
+@bobbin('-m plus --simple -q --shm %s' % SHM)
+def shm_ram(p):
+    repl = REPLWrapper(p, "\r\n]", None)
+    commandck(repl, 'poke 768, 171', 'POKE 768, 171\r\n')
+
+    shm = shared_memory.SharedMemory(SHM)
+    # We're only looking; bobbin removes it.
+    resource_tracker.unregister(shm._name, 'shared_memory')
+    try:
+        (magic, header_size, frames) = header(shm)
+        want_got(b'BOBBIN\0\0', magic)
+        want_got(171, shm.buf[header_size + 768])
+
+        commandck(repl, 'poke 769, 205', 'POKE 769, 205\r\n')
+        want_got(205, shm.buf[header_size + 769])
+
+        time.sleep(0.1)
+        if header(shm)[2] <= frames:
+            fail("frame count didn't advance")
+    finally:
+        shm.close()
+    p.send("\x04") # EOF char
+    p.expect(EOF)
+    if os.path.exists('/dev/shm/' + SHM):
+        fail("shm object left behind")
+    return True
@@ -0,0 +1,60 @@
+#!/usr/bin/python
+
+from common import *
+
+import os
+import shutil
+import time
+
+DISK = 'watch-test.dsk'
+SRCDISK = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                       '..', 'noninteract', 'disk_do_rw.t', 'indisk.dsk')
+# First catalog entry's file name (track $11, sector $F, DOS order)
+NAME_OFF = (17 * 16 + 15) * 256 + 0x0B + 3
+
+shutil.copyfile(SRCDISK, DISK)
+
+def rename_first_file(name, replace):
+    with open(DISK, 'rb') as f:
+        data = bytearray(f.read())
+    data[NAME_OFF:NAME_OFF+30] = bytes(ord(c) | 0x80 for c in name.ljust(30))
+    if replace:
+        # Write a new file, and rename it over the old one.
+        with open(DISK + '.new', 'wb') as f:
+            f.write(data)
+        os.replace(DISK + '.new', DISK)
+    else:
+        with open(DISK, 'r+b') as f:
+            f.write(data)
+
+def catalog_shows(repl, name):
+    got = repl.run_command('catalog', timeout=5)
+    if (' %s ' % name) not in got:
+        fail("CATALOG didn't show %s:\n%s" % (name, got))
+    return True
+
+@bobbin('-m plus --simple -q --watch --disk ' + DISK)
+def watch_disk_reload(p):
+    p.expect_exact('TEMPLATE DISK', timeout=10)
+    repl = REPLWrapper(p, "\r\n]", None)
+    try:
+        commandck(repl, 'a = 42', 'A = 42\r\n')
+        catalog_shows(repl, 'HELLO')
+        time.sleep(1.5) # let the drive motor stop
+
+        rename_first_file('EDITED', False)
+        time.sleep(0.2)
+        catalog_shows(repl, 'EDITED')
+        time.sleep(1.5)
+
+        rename_first_file('REPLACED', True)
+        time.sleep(0.2)
+        catalog_shows(repl, 'REPLACED')
+
+        # ...and it never rebooted.
+        commandck(repl, 'print a', 'PRINT A\r\n42\r\n')
+    finally:
+        os.remove(DISK)
+    p.send("\x04") # EOF char
+    p.expect(EOF)
+    return True
@@ -0,0 +1,34 @@
+#!/usr/bin/python
+
+from common import *
+
+import os
+import time
+
+BIN = 'watch-patch.bin'
+
+def write_bin(ch):
+    # $300: LDA #ch; JSR COUT; RTS; NOP
+    with open(BIN, 'wb') as f:
+        f.write(bytes([0xA9, ord(ch) | 0x80, 0x20, 0xED, 0xFD, 0x60, 0xEA]))
+
+write_bin('A')
+
+@bobbin('-m plus --simple -q --load %s --load-at 300 --watch=patch' % BIN)
+def watch_patch_ram(p):
+    repl = REPLWrapper(p, "\r\n]", None)
+    try:
+        commandck(repl, 'x = 5', 'X = 5\r\n')
+        commandck(repl, 'call 768', 'CALL 768\r\nA')
+        # Change a byte the new version won't, to see it left alone.
+        commandck(repl, 'poke 774, 0', 'POKE 774, 0\r\n')
+
+        write_bin('B')
+        time.sleep(0.3)
+        commandck(repl, 'call 768', 'CALL 768\r\nB')
+        commandck(repl, 'print peek(774); x', 'PRINT PEEK(774); X\r\n05\r\n')
+    finally:
+        os.remove(BIN)
+    p.send("\x04") # EOF char
+    p.expect(EOF)
+    return True